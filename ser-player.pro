@@ -107,6 +107,16 @@ contains(DEFINES, DISABLE_NEW_VERSION_CHECK) {
     DEFINES += USE_SYSTEM_LIBPNG
 }
 
+linux {
+    # Enable the io_uring SER read mode if liburing is installed
+    CONFIG += link_pkgconfig
+    packagesExist(liburing) {
+        message("Using liburing for io_uring SER reads")
+        PKGCONFIG += liburing
+        DEFINES += PIPP_SER_IO_URING
+    }
+}
+
 QT += core gui
 QT += concurrent
 QT += widgets
@@ -157,6 +167,14 @@ SOURCES += src/main.cpp\
     src/markers_dialog.cpp \
     src/image.cpp \
     src/histogram_thread.cpp \
+    src/frame_prefetcher.cpp \
+    src/save_frames_pipeline.cpp \
+    src/ser_metadata_cache.cpp \
+    src/ser_io_backend.cpp \
+    src/ser_unpack.cpp \
+    src/frame_cache.cpp \
+    src/render_worker.cpp \
+    src/async_file_writer.cpp \
     src/histogram_dialog.cpp \
     src/pipp_ser_write.cpp \
     src/header_details_dialog.cpp \
@@ -205,6 +223,14 @@ HEADERS  += src/ser_player.h \
     src/markers_dialog.h \
     src/image.h \
     src/histogram_thread.h \
+    src/frame_prefetcher.h \
+    src/save_frames_pipeline.h \
+    src/ser_metadata_cache.h \
+    src/ser_io_backend.h \
+    src/ser_unpack.h \
+    src/frame_cache.h \
+    src/render_worker.h \
+    src/async_file_writer.h \
     src/histogram_dialog.h \
     src/pipp_ser_write.h \
     src/header_details_dialog.h \
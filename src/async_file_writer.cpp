@@ -0,0 +1,280 @@
+// ---------------------------------------------------------------------
+// Copyright (C) 2015 Chris Garry
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>
+// ---------------------------------------------------------------------
+
+#include "async_file_writer.h"
+#include "pipp_utf8.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <sys/stat.h>
+    #include <sys/types.h>
+    #include <unistd.h>
+    #define ASYNC_FILE_WRITER_TRUNCATE
+#endif
+
+#if defined(__linux__)
+    #include <fcntl.h>
+    #define ASYNC_FILE_WRITER_FALLOCATE
+#endif
+
+
+namespace {
+    // Size of each buffer, the write thread writes whole buffers at a time
+    const size_t C_BLOCK_SIZE = 4 * 1024 * 1024;
+
+    // Most buffers that can be queued before write() waits for the disk
+    const size_t C_MAX_BLOCKS = 8;
+}
+
+
+c_async_file_writer::c_async_file_writer()
+    : mp_file(nullptr),
+      m_position(0),
+      m_file_position(0),
+      m_preallocated(false),
+      mp_fill_block(nullptr),
+      m_writing(false),
+      m_stop(false),
+      m_write_error(false)
+{
+}
+
+
+c_async_file_writer::~c_async_file_writer()
+{
+    close();
+}
+
+
+bool c_async_file_writer::open(const std::string &filename_utf8)
+{
+    close();
+
+    mp_file = fopen_utf8(filename_utf8, "wb+");
+    if (mp_file == nullptr) {
+        return false;
+    }
+
+    m_position = 0;
+    m_file_position = 0;
+    m_preallocated = false;
+    m_write_error = false;
+    m_stop = false;
+    m_write_thread = std::thread(&c_async_file_writer::write_blocks, this);
+    return true;
+}
+
+
+void c_async_file_writer::preallocate(uint64_t size)
+{
+#ifdef ASYNC_FILE_WRITER_FALLOCATE
+    // The file size is left alone so a file that is not finished still reads correctly
+    if (mp_file != nullptr && fallocate(fileno(mp_file), FALLOC_FL_KEEP_SIZE, 0, (off_t)size) == 0) {
+        m_preallocated = true;
+    }
+#else
+    (void)size;  // Remove unused parameter warning
+#endif
+}
+
+
+bool c_async_file_writer::write(const void *p_data, size_t size)
+{
+    if (mp_file == nullptr) {
+        return false;
+    }
+
+    const uint8_t *p_read = (const uint8_t *)p_data;
+    while (size > 0) {
+        if (mp_fill_block == nullptr) {
+            mp_fill_block = get_free_block();
+            mp_fill_block->m_offset = m_position;
+            mp_fill_block->m_size = 0;
+        }
+
+        size_t chunk_size = std::min(size, C_BLOCK_SIZE - mp_fill_block->m_size);
+        memcpy(mp_fill_block->mp_data.get() + mp_fill_block->m_size, p_read, chunk_size);
+        mp_fill_block->m_size += chunk_size;
+        m_position += chunk_size;
+        p_read += chunk_size;
+        size -= chunk_size;
+
+        if (mp_fill_block->m_size == C_BLOCK_SIZE) {
+            queue_fill_block();
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return !m_write_error;
+}
+
+
+bool c_async_file_writer::seek(int64_t offset)
+{
+    if (mp_file == nullptr) {
+        return false;
+    }
+
+    // Data after the seek goes in a new block
+    queue_fill_block();
+    m_position = offset;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return !m_write_error;
+}
+
+
+bool c_async_file_writer::flush()
+{
+    if (mp_file == nullptr) {
+        return false;
+    }
+
+    queue_fill_block();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_blocks_changed.wait(lock, [this]() {
+        return m_queued_blocks.empty() && !m_writing;
+    });
+
+    if (fflush(mp_file) != 0) {
+        m_write_error = true;
+    }
+
+    // The file may be written to directly before the next block
+    m_file_position = -1;
+    return !m_write_error;
+}
+
+
+bool c_async_file_writer::close()
+{
+    if (mp_file == nullptr) {
+        return true;
+    }
+
+    flush();
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+
+    m_blocks_changed.notify_all();
+    m_write_thread.join();
+
+#ifdef ASYNC_FILE_WRITER_TRUNCATE
+    if (m_preallocated) {
+        // Give back any reserved space past the end of the file
+        struct stat stat_buf;
+        if (fstat(fileno(mp_file), &stat_buf) == 0) {
+            if (ftruncate(fileno(mp_file), stat_buf.st_size) != 0) {
+                m_write_error = true;
+            }
+        }
+    }
+#endif
+
+    if (fclose(mp_file) != 0) {
+        m_write_error = true;
+    }
+
+    mp_file = nullptr;
+    return !m_write_error;
+}
+
+
+c_async_file_writer::s_block *c_async_file_writer::get_free_block()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_free_blocks.empty() && m_blocks.size() < C_MAX_BLOCKS) {
+        // Buffers are only allocated as they are needed
+        m_blocks.emplace_back(new s_block);
+        m_blocks.back()->mp_data.reset(new uint8_t[C_BLOCK_SIZE]);
+        return m_blocks.back().get();
+    }
+
+    // Wait for the write thread to finish with a block
+    m_blocks_changed.wait(lock, [this]() {
+        return !m_free_blocks.empty();
+    });
+
+    s_block *p_block = m_free_blocks.back();
+    m_free_blocks.pop_back();
+    return p_block;
+}
+
+
+void c_async_file_writer::queue_fill_block()
+{
+    if (mp_fill_block == nullptr) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (mp_fill_block->m_size > 0) {
+            m_queued_blocks.push_back(mp_fill_block);
+        } else {
+            m_free_blocks.push_back(mp_fill_block);
+        }
+    }
+
+    mp_fill_block = nullptr;
+    m_blocks_changed.notify_all();
+}
+
+
+void c_async_file_writer::write_blocks()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_blocks_changed.wait(lock, [this]() {
+            return m_stop || !m_queued_blocks.empty();
+        });
+
+        if (m_queued_blocks.empty()) {
+            // Stopping and everything has been written
+            return;
+        }
+
+        s_block *p_block = m_queued_blocks.front();
+        m_queued_blocks.pop_front();
+        m_writing = true;
+        bool write_error = m_write_error;
+        lock.unlock();
+
+        // Do not continue writing after an error has occured
+        if (!write_error) {
+            if (p_block->m_offset != m_file_position && fseek64(mp_file, p_block->m_offset, SEEK_SET) != 0) {
+                write_error = true;
+            } else if (fwrite(p_block->mp_data.get(), 1, p_block->m_size, mp_file) != p_block->m_size) {
+                write_error = true;
+            }
+
+            m_file_position = (write_error) ? -1 : p_block->m_offset + (int64_t)p_block->m_size;
+        }
+
+        lock.lock();
+        m_write_error = m_write_error || write_error;
+        m_writing = false;
+        m_free_blocks.push_back(p_block);
+        m_blocks_changed.notify_all();
+    }
+}
@@ -0,0 +1,115 @@
+// ---------------------------------------------------------------------
+// Copyright (C) 2015 Chris Garry
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>
+// ---------------------------------------------------------------------
+
+#ifndef ASYNC_FILE_WRITER_H
+#define ASYNC_FILE_WRITER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+// ------------------------------------------
+// Write-behind file output for the SER and AVI writers.
+// Data passed to write() is copied into a small pool of large buffers that a single
+// thread writes out in order, so the export loop only waits for the disk when every
+// buffer is full.  Each buffer remembers where it goes in the file, so the writers can
+// still seek back to rewrite headers.  A failed write is reported by the next call
+// to write(), seek(), flush() or close().
+// ------------------------------------------
+class c_async_file_writer
+{
+public:
+    // Constructor
+    c_async_file_writer();
+
+    // Destructor - writes out anything still queued and closes the file
+    ~c_async_file_writer();
+
+    // Create a file, or truncate an existing one, returns false if it cannot be opened
+    bool open(const std::string &filename_utf8);
+
+    bool is_open() const
+    {
+        return mp_file != nullptr;
+    }
+
+    // Reserve disk space for a file that is expected to grow to size bytes.
+    // This is only a hint, unused space is given back by close()
+    void preallocate(uint64_t size);
+
+    // Queue data to be written at the current position
+    bool write(const void *p_data, size_t size);
+
+    // Current position, including data that is still queued
+    int64_t tell() const
+    {
+        return m_position;
+    }
+
+    // Move the write position, data that is already queued is still written where it was queued
+    bool seek(int64_t offset);
+
+    // Wait for everything queued to be written
+    bool flush();
+
+    // Handle for writing to the file directly between flush() and the next write() or seek()
+    FILE *get_file()
+    {
+        return mp_file;
+    }
+
+    // Write out anything still queued and close the file
+    bool close();
+
+
+private:
+    struct s_block {
+        std::unique_ptr<uint8_t[]> mp_data;
+        int64_t m_offset;  // File position of the first byte
+        size_t m_size;  // Bytes used
+    };
+
+    s_block *get_free_block();
+    void queue_fill_block();
+    void write_blocks();
+
+    FILE *mp_file;
+    int64_t m_position;
+    int64_t m_file_position;  // Only used by the write thread, -1 if unknown
+    bool m_preallocated;
+    s_block *mp_fill_block;  // Block being filled by write()
+
+    std::vector<std::unique_ptr<s_block> > m_blocks;
+    std::vector<s_block *> m_free_blocks;
+    std::deque<s_block *> m_queued_blocks;
+    bool m_writing;  // Write thread is writing a block
+    bool m_stop;
+    bool m_write_error;
+    std::mutex m_mutex;
+    std::condition_variable m_blocks_changed;
+    std::thread m_write_thread;
+};
+
+#endif  // ASYNC_FILE_WRITER_H
@@ -0,0 +1,126 @@
+// ---------------------------------------------------------------------
+// Copyright (C) 2015 Chris Garry
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>
+// ---------------------------------------------------------------------
+
+#include <QMutexLocker>
+#include <cstring>
+#include <iterator>
+
+#include "frame_cache.h"
+
+
+c_frame_cache::c_frame_cache()
+    : m_frame_size(0),
+      m_budget(0)
+{
+}
+
+
+void c_frame_cache::set_budget(int64_t budget_bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_budget = (budget_bytes > 0) ? budget_bytes : 0;
+    trim(max_frames());
+}
+
+
+void c_frame_cache::reset(size_t frame_size)
+{
+    QMutexLocker locker(&m_mutex);
+    trim(0);
+    m_frame_size = frame_size;
+}
+
+
+void c_frame_cache::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    trim(0);
+}
+
+
+bool c_frame_cache::contains(int frame_number)
+{
+    QMutexLocker locker(&m_mutex);
+    return m_index.count(frame_number) != 0;
+}
+
+
+bool c_frame_cache::get_frame(int frame_number, uint8_t *p_buffer, uint64_t &timestamp)
+{
+    QMutexLocker locker(&m_mutex);
+    auto index_it = m_index.find(frame_number);
+    if (index_it == m_index.end()) {
+        return false;
+    }
+
+    // Move to the front of the list as the most recently used frame
+    t_entry_list::iterator entry_it = index_it->second;
+    m_entries.splice(m_entries.begin(), m_entries, entry_it);
+
+    memcpy(p_buffer, entry_it->mp_buffer.get(), m_frame_size);
+    timestamp = entry_it->m_timestamp;
+    return true;
+}
+
+
+void c_frame_cache::add_frame(int frame_number, const uint8_t *p_buffer, uint64_t timestamp)
+{
+    QMutexLocker locker(&m_mutex);
+    const int64_t frame_limit = max_frames();
+    if (frame_limit == 0) {
+        // Cache is disabled or a frame is larger than the whole budget
+        return;
+    }
+
+    auto index_it = m_index.find(frame_number);
+    if (index_it != m_index.end()) {
+        // Already cached, refresh it
+        m_entries.splice(m_entries.begin(), m_entries, index_it->second);
+    } else if ((int64_t)m_entries.size() >= frame_limit) {
+        // Reuse the buffer of the least recently used frame
+        m_index.erase(m_entries.back().m_frame_number);
+        m_entries.splice(m_entries.begin(), m_entries, std::prev(m_entries.end()));
+        m_entries.front().m_frame_number = frame_number;
+        m_index[frame_number] = m_entries.begin();
+    } else {
+        s_cache_entry entry;
+        entry.m_frame_number = frame_number;
+        entry.mp_buffer.reset(new uint8_t[m_frame_size]);
+        m_entries.push_front(std::move(entry));
+        m_index[frame_number] = m_entries.begin();
+    }
+
+    s_cache_entry &entry = m_entries.front();
+    memcpy(entry.mp_buffer.get(), p_buffer, m_frame_size);
+    entry.m_timestamp = timestamp;
+}
+
+
+int64_t c_frame_cache::max_frames() const
+{
+    return (m_frame_size == 0) ? 0 : m_budget / (int64_t)m_frame_size;
+}
+
+
+void c_frame_cache::trim(int64_t frame_count)
+{
+    // Drop least recently used frames until there are no more than frame_count
+    while ((int64_t)m_entries.size() > frame_count) {
+        m_index.erase(m_entries.back().m_frame_number);
+        m_entries.pop_back();
+    }
+}
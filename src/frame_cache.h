@@ -0,0 +1,80 @@
+// ---------------------------------------------------------------------
+// Copyright (C) 2015 Chris Garry
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>
+// ---------------------------------------------------------------------
+
+
+#ifndef FRAME_CACHE_H
+#define FRAME_CACHE_H
+
+#include <QMutex>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+
+// ------------------------------------------
+// Keeps copies of recently read frames, as returned by c_pipp_ser::get_frame(),
+// so going back to a frame or redrawing it with new processing settings does not
+// read it from the SER file again.  The least recently used frames are dropped
+// to keep within the memory budget.
+// ------------------------------------------
+class c_frame_cache
+{
+public:
+    // Constructor
+    c_frame_cache();
+
+    // Set the most memory the cached frames may use, 0 disables the cache
+    void set_budget(int64_t budget_bytes);
+
+    // Drop all frames and set the size of the frames that will be cached
+    void reset(size_t frame_size);
+
+    // Drop all frames
+    void clear();
+
+    // Check if a frame is cached without counting it as used
+    bool contains(int frame_number);
+
+    // Copy a cached frame into p_buffer, returns false if the frame is not cached
+    bool get_frame(int frame_number, uint8_t *p_buffer, uint64_t &timestamp);
+
+    // Add a copy of a frame, dropping the least recently used frames to make room
+    void add_frame(int frame_number, const uint8_t *p_buffer, uint64_t timestamp);
+
+
+private:
+    struct s_cache_entry {
+        int m_frame_number;
+        uint64_t m_timestamp;
+        std::unique_ptr<uint8_t[]> mp_buffer;
+    };
+
+    typedef std::list<s_cache_entry> t_entry_list;
+
+    int64_t max_frames() const;
+    void trim(int64_t frame_count);
+
+    t_entry_list m_entries;  // Most recently used first
+    std::unordered_map<int, t_entry_list::iterator> m_index;
+    size_t m_frame_size;
+    int64_t m_budget;
+    QMutex m_mutex;
+};
+
+#endif // FRAME_CACHE_H
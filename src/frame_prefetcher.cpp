@@ -0,0 +1,226 @@
+// ---------------------------------------------------------------------
+// Copyright (C) 2015 Chris Garry
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>
+// ---------------------------------------------------------------------
+
+#include <QtConcurrent>
+#include <QMutexLocker>
+#include <cstring>
+
+#include "frame_prefetcher.h"
+#include "image.h"
+#include "pipp_ser.h"
+
+
+c_frame_prefetcher::c_frame_prefetcher()
+    : mp_ser_file(new c_pipp_ser),
+      m_frame_size(0),
+      m_is_running(false)
+{
+    mp_ser_file->set_memory_mapped_mode(true);
+    for (int x = 0; x < C_RING_SIZE; x++) {
+        m_ring[x].mp_image.reset(new c_image);
+        m_ring[x].m_frame_number = 0;
+        m_ring[x].m_ready = false;
+        m_ring[x].m_timestamp = 0;
+    }
+}
+
+
+c_frame_prefetcher::~c_frame_prefetcher()
+{
+    clear();
+}
+
+
+bool c_frame_prefetcher::open(const std::string &filename_utf8, const c_pipp_ser::s_metadata &metadata)
+{
+    close();
+
+    mp_ser_file->set_cached_metadata(metadata);
+    if (mp_ser_file->open(filename_utf8, 0, 0) <= 0) {
+        // File did not open, no prefetching will be done
+        mp_ser_file->close();
+        m_frame_size = 0;
+        return false;
+    }
+
+    bool is_colour = (mp_ser_file->get_colour_id() == COLOURID_RGB || mp_ser_file->get_colour_id() == COLOURID_BGR);
+    for (int x = 0; x < C_RING_SIZE; x++) {
+        m_ring[x].mp_image->set_image_details(
+                    mp_ser_file->get_width(),  // width
+                    mp_ser_file->get_height(),  // height
+                    mp_ser_file->get_byte_depth(),  // byte_depth
+                    mp_ser_file->get_colour_id(),  // colour_id
+                    is_colour);  // colour
+    }
+
+    m_frame_size = mp_ser_file->get_buffer_size();
+    return true;
+}
+
+
+void c_frame_prefetcher::close()
+{
+    clear();
+    mp_ser_file->close();
+    m_frame_size = 0;
+}
+
+
+void c_frame_prefetcher::set_follow_mode(bool enable)
+{
+    mp_ser_file->set_follow_mode(enable);
+}
+
+
+bool c_frame_prefetcher::update_frame_count(int frame_count)
+{
+    QMutexLocker locker(&m_mutex);
+
+    // Early return if no file is open
+    if (m_frame_size == 0) {
+        return true;
+    }
+
+    if (m_is_running) {
+        // The worker is reading from the file, try again later
+        return false;
+    }
+
+    return mp_ser_file->update_frame_count() >= frame_count;
+}
+
+
+void c_frame_prefetcher::request_frames(const QVector<int> &frame_numbers)
+{
+    QMutexLocker locker(&m_mutex);
+
+    // Early return if no file is open
+    if (m_frame_size == 0) {
+        return;
+    }
+
+    m_wanted_frames = frame_numbers;
+    if (!m_is_running && !m_wanted_frames.isEmpty()) {
+        m_is_running = true;
+        m_prefetch_thread = QtConcurrent::run(this, &c_frame_prefetcher::prefetch_frames);
+    }
+}
+
+
+void c_frame_prefetcher::clear()
+{
+    m_mutex.lock();
+    m_wanted_frames.clear();
+    m_mutex.unlock();
+
+    // The worker stops once there is nothing left to fetch
+    m_prefetch_thread.waitForFinished();
+
+    QMutexLocker locker(&m_mutex);
+    for (int x = 0; x < C_RING_SIZE; x++) {
+        m_ring[x].m_frame_number = 0;
+        m_ring[x].m_ready = false;
+    }
+}
+
+
+bool c_frame_prefetcher::take_frame(int frame_number, uint8_t *p_buffer, uint64_t &timestamp)
+{
+    QMutexLocker locker(&m_mutex);
+    for (int x = 0; x < C_RING_SIZE; x++) {
+        s_ring_entry &entry = m_ring[x];
+        if (entry.m_ready && entry.m_frame_number == frame_number) {
+            memcpy(p_buffer, entry.mp_image->get_p_buffer(), m_frame_size);
+            timestamp = entry.m_timestamp;
+
+            // Slot can be reused
+            entry.m_frame_number = 0;
+            entry.m_ready = false;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+bool c_frame_prefetcher::is_wanted(int frame_number)
+{
+    return m_wanted_frames.contains(frame_number);
+}
+
+
+void c_frame_prefetcher::prefetch_frames()
+{
+    while (true) {
+        int frame_number = 0;
+        s_ring_entry *p_entry = nullptr;
+
+        m_mutex.lock();
+
+        // Find the first wanted frame that is not already in the ring
+        for (int wanted_frame : m_wanted_frames) {
+            bool in_ring = false;
+            for (int x = 0; x < C_RING_SIZE; x++) {
+                if (m_ring[x].m_frame_number == wanted_frame) {
+                    in_ring = true;
+                    break;
+                }
+            }
+
+            if (!in_ring) {
+                frame_number = wanted_frame;
+                break;
+            }
+        }
+
+        // Find a free slot or one holding a frame that is no longer wanted
+        if (frame_number > 0) {
+            for (int x = 0; x < C_RING_SIZE; x++) {
+                if (m_ring[x].m_frame_number == 0 || !is_wanted(m_ring[x].m_frame_number)) {
+                    p_entry = &m_ring[x];
+                    break;
+                }
+            }
+        }
+
+        if (p_entry == nullptr) {
+            // Nothing left to do
+            m_is_running = false;
+            m_mutex.unlock();
+            return;
+        }
+
+        p_entry->m_frame_number = frame_number;
+        p_entry->m_ready = false;
+        m_mutex.unlock();
+
+        // Read the frame without holding the lock
+        int32_t ret = mp_ser_file->get_frame(frame_number, p_entry->mp_image->get_p_buffer());
+        uint64_t timestamp = mp_ser_file->get_timestamp();
+
+        QMutexLocker locker(&m_mutex);
+        if (ret < 0) {
+            // Frame could not be read, do not offer it or try again
+            p_entry->m_frame_number = 0;
+            m_wanted_frames.removeAll(frame_number);
+        } else {
+            p_entry->m_ready = true;
+            p_entry->m_timestamp = timestamp;
+        }
+    }
+}
@@ -0,0 +1,90 @@
+// ---------------------------------------------------------------------
+// Copyright (C) 2015 Chris Garry
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>
+// ---------------------------------------------------------------------
+
+
+#ifndef FRAME_PREFETCHER_H
+#define FRAME_PREFETCHER_H
+
+#include <QFuture>
+#include <QMutex>
+#include <QVector>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "pipp_ser.h"
+
+
+class c_image;
+
+
+class c_frame_prefetcher
+{
+public:
+    // Number of frames held in the read-ahead ring
+    static const int C_RING_SIZE = 8;
+
+    // Constructor
+    c_frame_prefetcher();
+
+    // Destructor
+    ~c_frame_prefetcher();
+
+    // Open SER file to prefetch frames from - the prefetcher uses its own file handle
+    // Passing the metadata from the main file handle saves it being worked out again
+    bool open(const std::string &filename_utf8, const c_pipp_ser::s_metadata &metadata);
+
+    // Stop prefetching and close the SER file
+    void close();
+
+    // Follow SER files that are still being recorded, takes effect when the next file is opened
+    void set_follow_mode(bool enable);
+
+    // Pick up frames written to a followed file since it was opened
+    // Returns false if the prefetcher cannot supply frames up to frame_count yet
+    bool update_frame_count(int frame_count);
+
+    // Set the frames that will be wanted next, in the order they will be wanted
+    void request_frames(const QVector<int> &frame_numbers);
+
+    // Throw away all prefetched frames and wait for the worker to stop
+    void clear();
+
+    // Copy a prefetched frame into p_buffer, returns false if the frame is not ready
+    bool take_frame(int frame_number, uint8_t *p_buffer, uint64_t &timestamp);
+
+
+private:
+    struct s_ring_entry {
+        std::unique_ptr<c_image> mp_image;
+        int m_frame_number;
+        bool m_ready;
+        uint64_t m_timestamp;
+    };
+
+    void prefetch_frames();
+    bool is_wanted(int frame_number);
+
+    std::unique_ptr<c_pipp_ser> mp_ser_file;
+    s_ring_entry m_ring[C_RING_SIZE];
+    QVector<int> m_wanted_frames;
+    int64_t m_frame_size;
+    QMutex m_mutex;
+    bool m_is_running;
+    QFuture<void> m_prefetch_thread;
+};
+
+#endif // FRAME_PREFETCHER_H
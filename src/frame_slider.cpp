@@ -196,6 +196,58 @@ bool c_frame_slider::goto_next_frame()
 }
 
 
+QVector<int> c_frame_slider::get_next_frames(int count)
+{
+    // Work out which frames goto_next_frame() will move to without actually moving
+    assert(m_direction >= 0 && m_direction <= 2);  // Unsupported direction
+
+    QVector<int> next_frames;
+    int current_value = value();
+    int current_direction = m_current_direction;
+    int start_frame = get_start_frame();
+    int end_frame = get_end_frame();
+
+    while (next_frames.size() < count) {
+        int direction = (m_direction == 2) ? current_direction : m_direction;
+        if (direction == 0) {
+            // Forward play
+            if (current_value < start_frame) {
+                current_value = start_frame;
+            } else if (current_value < end_frame) {
+                current_value++;
+            } else if (m_direction == 2) {
+                // At end of forward playback - play backwards, the frame is shown again
+                current_direction = 1;
+            } else if (m_repeat) {
+                current_value = start_frame;
+            } else {
+                break;  // Playback will stop
+            }
+        } else {
+            // Reverse play
+            if (current_value > end_frame) {
+                current_value = end_frame;
+            } else if (current_value > start_frame) {
+                current_value--;
+            } else if (m_repeat) {
+                if (m_direction == 2) {
+                    // Start playing forward again, the frame is shown again
+                    current_direction = 0;
+                } else {
+                    current_value = end_frame;
+                }
+            } else {
+                break;  // Playback will stop
+            }
+        }
+
+        next_frames.append(current_value);
+    }
+
+    return next_frames;
+}
+
+
 int c_frame_slider::get_start_frame()
 {
     int ret;
@@ -235,6 +287,24 @@ void c_frame_slider::set_maximum_frame(int max_frame)
 }
 
 
+// Change the maximum of a file that is growing while it is recorded.
+// Like tail -f, the current frame and end marker stay on the last frame if they are already there.
+void c_frame_slider::follow_maximum_frame(int max_frame)
+{
+    bool end_marker_at_end = (m_end_marker >= maximum());
+    bool at_last_frame = (value() >= maximum());
+    set_maximum_frame(max_frame);
+
+    if (end_marker_at_end || m_end_marker > max_frame) {
+        set_end_marker_slot(max_frame);
+    }
+
+    if (at_last_frame) {
+        setValue(max_frame);
+    }
+}
+
+
 void c_frame_slider::set_start_marker_to_current()
 {
     set_start_marker_slot(value());
@@ -20,6 +20,7 @@
 #define FRAME_SLIDER_H
 
 #include <QSlider>
+#include <QVector>
 
 
 class c_markers_dialog;
@@ -36,6 +37,7 @@ public:
     void set_direction(int dir);
     void goto_first_frame();
     bool goto_next_frame();
+    QVector<int> get_next_frames(int count);
     int get_start_frame();
     int get_end_frame();
 
@@ -49,6 +51,7 @@ public slots:
     void set_markers_show(bool show);
     void set_markers_enable(bool active);
     void set_maximum_frame(int max_frame);
+    void follow_maximum_frame(int max_frame);
     void set_start_marker_to_current();
     void set_start_marker_slot(int frame);
     void set_end_marker_to_current();
@@ -29,16 +29,20 @@ extern "C" {
     #include <QDebug>
 #endif
 
+#include <algorithm>
 #include <cmath>
 #include <cassert>
+#include <cstring>
 #include <functional>
 #include <memory>
+#include <thread>
 
 
 c_gif_write::c_gif_write() :
     m_file_write_error(false),
     mp_gif_file(nullptr),
-    m_open(false)
+    m_open(false),
+    m_max_pending_frames(std::max(1U, std::thread::hardware_concurrency()))
 {
     // Header structure fixed fields
     m_gif_header.m_signature[0] = 'G';
@@ -336,9 +340,13 @@ bool c_gif_write::write_frame(
         return true;
     }
 
+    // Everything that depends on the previous frame is done here, in frame order.  Colour quantisation
+    // and LZW compression only depend on this frame and are done in the background by encode_frame()
+    std::unique_ptr<s_pending_frame> p_frame(new s_pending_frame);
+    p_frame->m_display_time = display_time;
+
     //  Create buffer for indexed pixels image
-    std::unique_ptr<uint8_t[]> p_index_image(new uint8_t[m_width * m_height]);
-    std::unique_ptr<uint8_t[]> p_colour_table;
+    p_frame->mp_index_image.reset(new uint8_t[m_width * m_height]);
 
     // Scan top/bottom lines and left/right columns to check for lines/columns identical to previous frame
     // These areas do not need to be encoded.
@@ -371,7 +379,7 @@ bool c_gif_write::write_frame(
         // Create an indexed version of the image including transparent pixels if required
         //
         // Create a buffer for the indexed image
-        uint8_t *p_write_data = p_index_image.get();
+        uint8_t *p_write_data = p_frame->mp_index_image.get();
         for (int y = y_start; y <= y_end; y++) {
             int x = x_start;
             uint8_t *p_current_data = p_data + (y * m_width + x);
@@ -429,36 +437,11 @@ bool c_gif_write::write_frame(
             num_colours--;
         }
 
-        if (m_lossy_compression_level > 0) {
-            mp_index_to_index_colour_difference_lut.reset(new uint8_t[256 * 256]);
-        }
+        p_frame->m_number_of_colours = num_colours;
 
-        // Colour data - convert values to indexed values
-        p_colour_table.reset(new uint8_t[3 * (1 << m_bit_depth)]);
-        std::unique_ptr<uint8_t[]> p_rev_colour_table(new uint8_t[1 << (3 * 6)]);
-
-        if (m_colour_quant_type == COLOUR_QUANT_TYPE_NEUQUANT) {
-            quantise_colours_neuquant(
-                p_data,  // uint8_t *p_data
-//                x_start,  // uint16_t x_start,
-//                x_end,  // uint16_t x_end,
-//                y_start,  // uint16_t y_start,
-//                y_end,  // uint16_t y_end,
-                num_colours,  // int number_of_colours
-                p_colour_table.get(),
-                mp_index_to_index_colour_difference_lut.get()); // uint8_t *p_index_to_index_colour_difference
-        } else {
-            quantise_colours_median_cut(
-                p_data,  // uint8_t *p_data
-                x_start,  // uint16_t x_start,
-                x_end,  // uint16_t x_end,
-                y_start,  // uint16_t y_start,
-                y_end,  // uint16_t y_end,
-                num_colours,  // int number_of_colours
-                p_colour_table.get(),
-                p_rev_colour_table.get(),
-                mp_index_to_index_colour_difference_lut.get()); // uint8_t *p_index_to_index_colour_difference
-        }
+        // Keep a copy of the frame for colour quantisation as the caller is free to reuse p_data
+        p_frame->mp_frame_data.reset(new uint8_t[m_width * m_height * 3]);
+        memcpy(p_frame->mp_frame_data.get(), p_data, m_width * m_height * 3);
 
         // Buffer to keep image data for processing the next frame
         if (mp_last_image.get() == nullptr) {
@@ -467,17 +450,13 @@ bool c_gif_write::write_frame(
         }
 
         //
-        // Create an indexed version of the image including transparent pixels if required
+        // Mark transparent pixels and update the last image ready for the next frame
         //
-        // Create a buffer for the index image
-        uint8_t *p_write_data = p_index_image.get();
-        uint8_t(c_gif_write::*p_get_best_index)(uint8_t b, uint8_t g, uint8_t r, uint8_t *p_rev_colour_table);
-        if (m_colour_quant_type == COLOUR_QUANT_TYPE_NEUQUANT) {
-            p_get_best_index = &c_gif_write::get_best_index_neuquant;
-        } else {
-            p_get_best_index = &c_gif_write::get_best_index_median_cut;
+        if (m_use_transparent_pixels && !first_frame) {
+            p_frame->mp_transparent_mask.reset(new uint8_t[(x_end - x_start + 1) * (y_end - y_start + 1)]);
         }
 
+        uint8_t *p_mask = p_frame->mp_transparent_mask.get();
         for (int y = y_start; y <= y_end; y++) {
             int x = x_start;
             uint8_t *p_current_data = p_data + (y * m_width + x) * 3;
@@ -495,7 +474,7 @@ bool c_gif_write::write_frame(
                     not_transparent |= r_diff > m_transparent_tolerence;
                     if (not_transparent) {
                         // This pixel is not transparent
-                        *p_write_data++ = (this->*p_get_best_index)(b, g, r, p_rev_colour_table.get());
+                        *p_mask++ = 0;
 
                         // Update last image pixel for comparison with the next frame
                         *(p_last_data - 3) = b;
@@ -503,89 +482,217 @@ bool c_gif_write::write_frame(
                         *(p_last_data - 1) = r;
                     } else {
                         // This pixel is close enough to the previous pixel to be transparent
-                        *p_write_data++ = m_transparent_index;
+                        *p_mask++ = 1;
                         // Note that the last image pixel value is left unchanged
                     }
                 } else {  // Not using transparent pixels or first frame
-                    uint8_t b = *p_current_data++;
-                    uint8_t g = *p_current_data++;
-                    uint8_t r = *p_current_data++;
+                    // Write these pixels to last image buffer
+                    *p_last_data++ = *p_current_data++;
+                    *p_last_data++ = *p_current_data++;
+                    *p_last_data++ = *p_current_data++;
+                }
+            }
+        }
+    }
+
+//    printf("Active area: (%d, %d) - (%d, %d)\n", x_start, x_end, y_start, y_end);
+
+    p_frame->m_x_start = x_start;
+    p_frame->m_x_end = x_end;
+    p_frame->m_y_start = y_start;
+    p_frame->m_y_end = y_end;
+    p_frame->m_first_frame_and_not_transparent = first_frame_and_not_transparent;
+    p_frame->m_transparent_index = m_transparent_index;
+
+    // Start encoding this frame in the background
+    s_pending_frame *p_pending_frame = p_frame.get();
+    p_frame->m_future = std::async(std::launch::async, [this, p_pending_frame]() {
+        encode_frame(p_pending_frame);
+    });
+    m_pending_frames.push_back(std::move(p_frame));
+
+    // Write out the oldest frames once too many are in flight
+    while (m_pending_frames.size() > m_max_pending_frames) {
+        write_oldest_pending_frame();
+    }
+
+    // Tidy up after write failures
+    if (m_file_write_error) {
+        discard_pending_frames();
+        fclose(mp_gif_file);
+        mp_gif_file = nullptr;
+        m_open = false;
+    }
+
+    bool ret = m_file_write_error;
+    m_file_write_error = false;
+    return ret;
+}
+
+
+// ------------------------------------------
+// Quantise and compress a frame into memory
+// ------------------------------------------
+void c_gif_write::encode_frame(
+    s_pending_frame *p_frame)
+{
+    const uint16_t x_start = p_frame->m_x_start;
+    const uint16_t x_end = p_frame->m_x_end;
+    const uint16_t y_start = p_frame->m_y_start;
+    const uint16_t y_end = p_frame->m_y_end;
+    std::unique_ptr<uint8_t[]> p_colour_table;
+
+    // Colour frames use their own colour difference table, monochrome frames share the one built by create()
+    std::unique_ptr<uint8_t[]> p_index_to_index_colour_difference_lut;
+    uint8_t *p_colour_difference_lut = mp_index_to_index_colour_difference_lut.get();
+
+    if (m_colour) {
+        uint8_t *p_data = p_frame->mp_frame_data.get();
+        int num_colours = p_frame->m_number_of_colours;
 
+        if (m_lossy_compression_level > 0) {
+            p_index_to_index_colour_difference_lut.reset(new uint8_t[256 * 256]);
+        }
+
+        p_colour_difference_lut = p_index_to_index_colour_difference_lut.get();
+
+        // Colour data - convert values to indexed values
+        p_colour_table.reset(new uint8_t[3 * (1 << m_bit_depth)]());
+        std::unique_ptr<uint8_t[]> p_rev_colour_table(new uint8_t[1 << (3 * 6)]);
+
+        if (m_colour_quant_type == COLOUR_QUANT_TYPE_NEUQUANT) {
+            quantise_colours_neuquant(
+                p_data,  // uint8_t *p_data
+//                x_start,  // uint16_t x_start,
+//                x_end,  // uint16_t x_end,
+//                y_start,  // uint16_t y_start,
+//                y_end,  // uint16_t y_end,
+                num_colours,  // int number_of_colours
+                p_colour_table.get(),
+                p_colour_difference_lut); // uint8_t *p_index_to_index_colour_difference
+        } else {
+            quantise_colours_median_cut(
+                p_data,  // uint8_t *p_data
+                x_start,  // uint16_t x_start,
+                x_end,  // uint16_t x_end,
+                y_start,  // uint16_t y_start,
+                y_end,  // uint16_t y_end,
+                num_colours,  // int number_of_colours
+                p_colour_table.get(),
+                p_rev_colour_table.get(),
+                p_colour_difference_lut); // uint8_t *p_index_to_index_colour_difference
+        }
+
+        //
+        // Create an indexed version of the image including transparent pixels if required
+        //
+        uint8_t *p_write_data = p_frame->mp_index_image.get();
+        const uint8_t *p_mask = p_frame->mp_transparent_mask.get();
+        uint8_t(c_gif_write::*p_get_best_index)(uint8_t b, uint8_t g, uint8_t r, uint8_t *p_rev_colour_table);
+        if (m_colour_quant_type == COLOUR_QUANT_TYPE_NEUQUANT) {
+            p_get_best_index = &c_gif_write::get_best_index_neuquant;
+        } else {
+            p_get_best_index = &c_gif_write::get_best_index_median_cut;
+        }
+
+        for (int y = y_start; y <= y_end; y++) {
+            const uint8_t *p_current_data = p_data + (y * m_width + x_start) * 3;
+            for (int x = x_start; x <= x_end; x++) {
+                uint8_t b = *p_current_data++;
+                uint8_t g = *p_current_data++;
+                uint8_t r = *p_current_data++;
+                if (p_mask != nullptr && *p_mask++) {
+                    // This pixel is close enough to the previous pixel to be transparent
+                    *p_write_data++ = p_frame->m_transparent_index;
+                } else {
                     // Write indexed data to buffer ready for compression
                     *p_write_data++ = (this->*p_get_best_index)(b, g, r, p_rev_colour_table.get());
-
-                    // Write these pixels to last image buffer
-                    *p_last_data++ = b;
-                    *p_last_data++ = g;
-                    *p_last_data++ = r;
                 }
             }
         }
 
-        p_rev_colour_table.reset(nullptr);
+        // The frame copy is no longer required
+        p_frame->mp_frame_data.reset(nullptr);
+        p_frame->mp_transparent_mask.reset(nullptr);
     }
 
-//    printf("Active area: (%d, %d) - (%d, %d)\n", x_start, x_end, y_start, y_end);
+    std::vector<uint8_t> &encoded_data = p_frame->m_encoded_data;
 
-    // Update graphic control extension structure variables fields
-    m_graphic_control_extension.m_packed_field  = 0 << 2;  // Disposal method: None specified
-    m_graphic_control_extension.m_packed_field |= 0 << 1;  // User Input Flag: No user input expected
+    // Graphic control extension structure variables fields
+    s_graphic_control_extension graphic_control_extension = m_graphic_control_extension;
+    graphic_control_extension.m_packed_field  = 0 << 2;  // Disposal method: None specified
+    graphic_control_extension.m_packed_field |= 0 << 1;  // User Input Flag: No user input expected
 
-    //if (m_use_transparent_pixels && mp_last_image.get() != nullptr) {
-    if (m_use_transparent_pixels && !first_frame_and_not_transparent) {
-        m_graphic_control_extension.m_packed_field |= 1 << 0;  // Transparent colour flag
+    if (m_use_transparent_pixels && !p_frame->m_first_frame_and_not_transparent) {
+        graphic_control_extension.m_packed_field |= 1 << 0;  // Transparent colour flag
     }
 
-    m_graphic_control_extension.m_delay_time[0] = display_time & 0xFF;
-    m_graphic_control_extension.m_delay_time[1] = display_time >> 8;
-    m_graphic_control_extension.m_transparent_colour_index = (uint8_t)m_transparent_index;
+    graphic_control_extension.m_delay_time[0] = p_frame->m_display_time & 0xFF;
+    graphic_control_extension.m_delay_time[1] = p_frame->m_display_time >> 8;
+    graphic_control_extension.m_transparent_colour_index = (uint8_t)p_frame->m_transparent_index;
 
-    // Write graphic control extension to the file
-    fwrite_error_check(&m_graphic_control_extension, 1, sizeof(m_graphic_control_extension), mp_gif_file);
+    const uint8_t *p_bytes = (const uint8_t *)&graphic_control_extension;
+    encoded_data.insert(encoded_data.end(), p_bytes, p_bytes + sizeof(graphic_control_extension));
 
-    // Update image descriptor structure variable fields
-    m_image_descriptor.m_image_left_position[0] = (uint8_t)(x_start & 0xFF);
-    m_image_descriptor.m_image_left_position[1] = (uint8_t)(x_start >> 8);
-    m_image_descriptor.m_image_top_position[0] = (uint8_t)(y_start & 0xFF);
-    m_image_descriptor.m_image_top_position[1] = (uint8_t)(y_start >> 8);
+    // Image descriptor structure variable fields
+    s_image_descriptor image_descriptor = m_image_descriptor;
+    image_descriptor.m_image_left_position[0] = (uint8_t)(x_start & 0xFF);
+    image_descriptor.m_image_left_position[1] = (uint8_t)(x_start >> 8);
+    image_descriptor.m_image_top_position[0] = (uint8_t)(y_start & 0xFF);
+    image_descriptor.m_image_top_position[1] = (uint8_t)(y_start >> 8);
     uint16_t active_width = 1 + x_end - x_start;
-    m_image_descriptor.m_image_width[0] = (uint8_t)(active_width & 0xFF);
-    m_image_descriptor.m_image_width[1] = (uint8_t)(active_width >> 8);
+    image_descriptor.m_image_width[0] = (uint8_t)(active_width & 0xFF);
+    image_descriptor.m_image_width[1] = (uint8_t)(active_width >> 8);
     uint16_t active_height = 1 + y_end - y_start;
-    m_image_descriptor.m_image_height[0] = (uint8_t)(active_height & 0xFF);
-    m_image_descriptor.m_image_height[1] = (uint8_t)(active_height >> 8);
+    image_descriptor.m_image_height[0] = (uint8_t)(active_height & 0xFF);
+    image_descriptor.m_image_height[1] = (uint8_t)(active_height >> 8);
     if (!m_colour) {
         // Monochrome data
         // Image descriptor packed fields byte for monochrome encoding
-        m_image_descriptor.m_packed_fields  = 0 << 7;  // Local Color Table Flag - No local colour table for monochrome
-        m_image_descriptor.m_packed_fields |= 0 << 6;  // Interlace flag - No interlacing
-        m_image_descriptor.m_packed_fields |= 0 << 5;  // Sort flag - Colour table is not sorted
-        m_image_descriptor.m_packed_fields |= 0 << 0;  // Size of local colour table
+        image_descriptor.m_packed_fields  = 0 << 7;  // Local Color Table Flag - No local colour table for monochrome
+        image_descriptor.m_packed_fields |= 0 << 6;  // Interlace flag - No interlacing
+        image_descriptor.m_packed_fields |= 0 << 5;  // Sort flag - Colour table is not sorted
+        image_descriptor.m_packed_fields |= 0 << 0;  // Size of local colour table
     } else {
         // Colour data
         // Image descriptor packed fields byte for colour encoding
-        m_image_descriptor.m_packed_fields  = 1 << 7;  // Local Color Table Flag - Use local colour table for colour
-        m_image_descriptor.m_packed_fields |= 0 << 6;  // Interlace flag - No interlacing
-        m_image_descriptor.m_packed_fields |= 0 << 5;  // Sort flag - Colour table is not sorted
-        m_image_descriptor.m_packed_fields |= (m_bit_depth-1) << 0;  // Size of local colour table
+        image_descriptor.m_packed_fields  = 1 << 7;  // Local Color Table Flag - Use local colour table for colour
+        image_descriptor.m_packed_fields |= 0 << 6;  // Interlace flag - No interlacing
+        image_descriptor.m_packed_fields |= 0 << 5;  // Sort flag - Colour table is not sorted
+        image_descriptor.m_packed_fields |= (m_bit_depth-1) << 0;  // Size of local colour table
     }
 
-    // Write image descriptor to the file
-    fwrite_error_check(&m_image_descriptor, 1, sizeof(m_image_descriptor), mp_gif_file);
+    p_bytes = (const uint8_t *)&image_descriptor;
+    encoded_data.insert(encoded_data.end(), p_bytes, p_bytes + sizeof(image_descriptor));
 
     if (m_colour && p_colour_table != nullptr) {
-        // Write local colour table to file
-        fwrite_error_check(p_colour_table.get(), 1, (1 << m_bit_depth) * 3, mp_gif_file);
+        // Local colour table
+        encoded_data.insert(encoded_data.end(), p_colour_table.get(), p_colour_table.get() + (1 << m_bit_depth) * 3);
 
         // Release colour table as it is no longer required
         p_colour_table.reset(nullptr);
     }
 
-    // Write LZW minimum code size to file
-    fwrite_error_check(&m_bit_depth, 1, 1, mp_gif_file);
+    // LZW minimum code size
+    encoded_data.push_back((uint8_t)m_bit_depth);
+
+    // Take an LZW compressor from the pool so its dictionary is not reallocated for every frame
+    std::unique_ptr<c_lzw_compressor> p_lzw_compressor;
+    {
+        std::lock_guard<std::mutex> lock(m_lzw_compressor_mutex);
+        if (!m_free_lzw_compressors.empty()) {
+            p_lzw_compressor = std::move(m_free_lzw_compressors.back());
+            m_free_lzw_compressors.pop_back();
+        }
+    }
+
+    if (p_lzw_compressor == nullptr) {
+        p_lzw_compressor.reset(new c_lzw_compressor);
+    }
 
-    // Compress image data and write to file
-    c_lzw_compressor lzw_compressor(
+    // Compress image data
+    c_lzw_compressor &lzw_compressor = *p_lzw_compressor;
+    lzw_compressor.set_image(
         x_end - x_start + 1,  // m_width,
         y_end - y_start + 1,  // m_height
         0,  // x_start,
@@ -593,48 +700,75 @@ bool c_gif_write::write_frame(
         0,  // y_start,
         y_end - y_start,  // y_end,
         m_bit_depth,
-        p_index_image.get());
+        p_frame->mp_index_image.get());
 
 
     // Set details of lossy compression
     lzw_compressor.set_lossy_details(
         m_lossy_compression_level,  // int lossy_compression_level
-        mp_index_to_index_colour_difference_lut.get(),  // p_index_to_index_colour_difference_lut
-        m_transparent_index);  // int transparent_index
+        p_colour_difference_lut,  // p_index_to_index_colour_difference_lut
+        p_frame->m_transparent_index);  // int transparent_index
 
     bool all_compressed = false;
     while (!all_compressed) {
         // Compress up to 255 byte block of data (256 with byte count header)
         all_compressed = lzw_compressor.compress_data();
 
-        // Write compressed data block to file
+        // Append compressed data block
         uint8_t *p_compressed_data = lzw_compressor.get_compressed_data_ptr();
-        fwrite_error_check(p_compressed_data, 1, p_compressed_data[0] + 1, mp_gif_file);
+        encoded_data.insert(encoded_data.end(), p_compressed_data, p_compressed_data + p_compressed_data[0] + 1);
     }
 
-    // Data for this frame has been written to the file, free buffer
-    p_index_image.reset(nullptr);
-
-    // Release index to index colour difference table if one was used
-    if (m_colour) {
-        mp_index_to_index_colour_difference_lut.reset(nullptr);
+    // Return the compressor to the pool
+    {
+        std::lock_guard<std::mutex> lock(m_lzw_compressor_mutex);
+        m_free_lzw_compressors.push_back(std::move(p_lzw_compressor));
     }
 
+    // Data for this frame has been compressed, free buffer
+    p_frame->mp_index_image.reset(nullptr);
 
-    // Write block terminator to file
-    char null_term = 0;
-    fwrite_error_check(&null_term, 1, 1, mp_gif_file);
+    // Block terminator
+    encoded_data.push_back(0);
+}
 
-    // Tidy up after write failures
-    if (m_file_write_error) {
-        fclose(mp_gif_file);
-        mp_gif_file = nullptr;
-        m_open = false;
+
+// ------------------------------------------
+// Write the oldest encoded frame to the file
+// ------------------------------------------
+void c_gif_write::write_oldest_pending_frame()
+{
+    std::unique_ptr<s_pending_frame> p_frame = std::move(m_pending_frames.front());
+    m_pending_frames.pop_front();
+
+    // Wait for the frame to finish encoding
+    p_frame->m_future.get();
+
+    fwrite_error_check(p_frame->m_encoded_data.data(), 1, p_frame->m_encoded_data.size(), mp_gif_file);
+}
+
+
+// ------------------------------------------
+// Write all encoded frames to the file
+// ------------------------------------------
+void c_gif_write::write_pending_frames()
+{
+    while (!m_pending_frames.empty()) {
+        write_oldest_pending_frame();
     }
+}
 
-    bool ret = m_file_write_error;
-    m_file_write_error = false;
-    return ret;
+
+// ------------------------------------------
+// Wait for frames being encoded and drop them
+// ------------------------------------------
+void c_gif_write::discard_pending_frames()
+{
+    for (auto &p_frame : m_pending_frames) {
+        p_frame->m_future.wait();
+    }
+
+    m_pending_frames.clear();
 }
 
 
@@ -645,6 +779,13 @@ uint64_t c_gif_write::close()
 {
     uint64_t filesize = 0;
 
+    // Write out frames that are still being encoded
+    if (mp_gif_file != nullptr) {
+        write_pending_frames();
+    } else {
+        discard_pending_frames();
+    }
+
     // Relese memory used for tables
     mp_rev_mono_table.reset(nullptr);
     mp_index_to_index_colour_difference_lut.reset(nullptr);
@@ -679,6 +820,8 @@ uint64_t c_gif_write::get_current_filesize()
 {
     uint64_t filesize = 0L;
     if (mp_gif_file != nullptr) {
+        // Frames still being encoded are part of the file as far as the caller is concerned
+        write_pending_frames();
         filesize = ftell64(mp_gif_file);
     }
 
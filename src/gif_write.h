@@ -25,7 +25,12 @@
 #endif
 
 #include <cstdint>
+#include <deque>
+#include <future>
 #include <memory>
+#include <mutex>
+#include <vector>
+#include "lzw_compressor.h"
 
 #ifndef GIF_COMMENT_STRING
     #define GIF_COMMENT_STRING "Created by PIPP"
@@ -136,6 +141,23 @@ class c_gif_write {
         uint8_t get_best_index_neuquant(uint8_t b, uint8_t g, uint8_t r, uint8_t *p_rev_colour_table);
 
 
+        struct s_pending_frame;
+
+        // ------------------------------------------
+        // Quantise and compress a frame into memory
+        // ------------------------------------------
+        void encode_frame(
+            s_pending_frame *p_frame);
+
+
+        // ------------------------------------------
+        // Write encoded frames to the file in order
+        // ------------------------------------------
+        void write_oldest_pending_frame();
+        void write_pending_frames();
+        void discard_pending_frames();
+
+
         void detect_unchanged_border(
             const uint8_t *p_this_image,
             const uint8_t *mp_last_image,
@@ -233,6 +255,23 @@ class c_gif_write {
 
         static_assert (sizeof(s_g_rev_colour_index) == sizeof(s_b_rev_colour_index) * (1 << 6), "Unexpected size for structure s_g_rev_colour_index");
 
+        // A frame that write_frame() has prepared and that is being encoded in the background
+        struct s_pending_frame {
+            uint16_t m_display_time;
+            uint16_t m_x_start;
+            uint16_t m_x_end;
+            uint16_t m_y_start;
+            uint16_t m_y_end;
+            bool m_first_frame_and_not_transparent;
+            int m_number_of_colours;
+            int m_transparent_index;
+            std::unique_ptr<uint8_t[]> mp_frame_data;  // Colour only - copy of the frame to quantise
+            std::unique_ptr<uint8_t[]> mp_transparent_mask;  // Colour only - non-zero for transparent pixels
+            std::unique_ptr<uint8_t[]> mp_index_image;
+            std::vector<uint8_t> m_encoded_data;  // Frame ready to be written to the file
+            std::future<void> m_future;
+        };
+
 
         //
         // Private member variables
@@ -271,6 +310,15 @@ class c_gif_write {
         bool m_open;
         std::unique_ptr<uint8_t[]> mp_last_image;
 
+        // Pool of LZW compressors so the dictionaries are only allocated once per encoding thread
+        std::mutex m_lzw_compressor_mutex;
+        std::vector<std::unique_ptr<c_lzw_compressor>> m_free_lzw_compressors;
+
+        // Frames being encoded, oldest first.  Declared after the compressor pool so that
+        // outstanding encodes are waited for before the pool is destroyed.
+        std::deque<std::unique_ptr<s_pending_frame>> m_pending_frames;
+        size_t m_max_pending_frames;
+
         // GIF implementation details
         s_gif_header m_gif_header;
         s_netscape_extension m_netscape_extension;
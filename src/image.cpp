@@ -17,13 +17,96 @@
 
 
 #include <QDebug>
+#include <QThreadPool>
+#include <QtConcurrent>
 #include <cstring>  // memset()
 #include <cmath>  // sqrt()
+#include <memory>
+#include <vector>
+
+#if defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+    #include <immintrin.h>
+#endif
+
 
 #include "image.h"
 #include "pipp_ser.h"
 
 
+// ------------------------------------------
+// Row band parallel execution
+// The per-pixel passes split the image into bands of whole rows which are processed
+// across the global thread pool.  Every row is computed in exactly the same way
+// whichever band it lands in, so the output does not depend on the number of bands.
+// ------------------------------------------
+static const int32_t C_MIN_PIXELS_PER_BAND = 64 * 1024;
+
+
+static int32_t get_row_band_count(
+        int32_t rows,
+        int32_t pixels_per_row)
+{
+    int32_t band_count = QThread::idealThreadCount();
+
+    // Do not hand out more bands than there are free threads (the calling thread does one band).
+    // This stops the bands from just queuing up behind each other when these passes are already
+    // being run across the pool, as they are while saving frames
+    QThreadPool *p_pool = QThreadPool::globalInstance();
+    int32_t free_threads = p_pool->maxThreadCount() - p_pool->activeThreadCount();
+    band_count = (free_threads + 1 < band_count) ? free_threads + 1 : band_count;
+
+    // Small images are not worth splitting up
+    int64_t total_pixels = (int64_t)rows * pixels_per_row;
+    int64_t max_bands = total_pixels / C_MIN_PIXELS_PER_BAND;
+    band_count = (max_bands < band_count) ? (int32_t)max_bands : band_count;
+    band_count = (rows < band_count) ? rows : band_count;
+    return (band_count < 1) ? 1 : band_count;
+}
+
+
+template <typename F>
+static void run_row_bands(
+        int32_t rows,
+        int32_t band_count,
+        const F &band_function)  // band_function(start_row, end_row)
+{
+    if (band_count <= 1) {
+        band_function(0, rows);
+        return;
+    }
+
+    QVector<QFuture<void> > band_futures;
+    for (int32_t band = 1; band < band_count; band++) {
+        int32_t start_row = (int32_t)((int64_t)rows * band / band_count);
+        int32_t end_row = (int32_t)((int64_t)rows * (band + 1) / band_count);
+        band_futures.append(QtConcurrent::run([&band_function, start_row, end_row]() {
+            band_function(start_row, end_row);
+        }));
+    }
+
+    // The first band is done on the calling thread
+    band_function(0, (int32_t)((int64_t)rows / band_count));
+
+    for (int i = 0; i < band_futures.size(); i++) {
+        band_futures[i].waitForFinished();
+    }
+}
+
+
+template <typename F>
+static void for_each_row_band(
+        int32_t rows,
+        int32_t pixels_per_row,
+        const F &band_function)  // band_function(start_row, end_row)
+{
+    run_row_bands(rows, get_row_band_count(rows, pixels_per_row), band_function);
+}
+
+
 void c_image::set_image_details(int32_t width,
                                 int32_t height,
                                 int32_t byte_depth,
@@ -41,7 +124,7 @@ void c_image::set_image_details(int32_t width,
 
     m_colour = colour;
     
-    int32_t frame_size = m_width * m_height * m_byte_depth;
+    size_t frame_size = (size_t)m_width * m_height * m_byte_depth;
     if (m_colour) {
         frame_size *= 3;
     }
@@ -50,17 +133,52 @@ void c_image::set_image_details(int32_t width,
 }
 
 
+void c_image::copy_image_data(const c_image &source)
+{
+    set_image_details(source.m_width, source.m_height, source.m_byte_depth, source.m_colour_id, source.m_colour);
+    size_t frame_size = (size_t)m_width * m_height * m_byte_depth;
+    if (m_colour) {
+        frame_size *= 3;
+    }
+
+    memcpy(mp_buffer, source.mp_buffer, frame_size);
+}
+
+
+void c_image::copy_top_down_data(const uint8_t *p_data, bool conv_to_8_bit)
+{
+    // Lines are stored bottom line first
+    const int64_t line_samples = (int64_t)m_width * ((m_colour) ? 3 : 1);
+    if (m_byte_depth == 2 && conv_to_8_bit) {
+        const uint16_t *p_read_data = (const uint16_t *)p_data;
+        for (int32_t y = 0; y < m_height; y++) {
+            uint8_t *p_write_data = mp_buffer + (int64_t)(m_height - 1 - y) * line_samples;
+            for (int64_t x = 0; x < line_samples; x++) {
+                *p_write_data++ = (*p_read_data++) >> 8;
+            }
+        }
+
+        m_byte_depth = 1;
+    } else {
+        const int64_t line_size = line_samples * m_byte_depth;
+        for (int32_t y = 0; y < m_height; y++) {
+            memcpy(mp_buffer + (int64_t)(m_height - 1 - y) * line_size, p_data + (int64_t)y * line_size, (size_t)line_size);
+        }
+    }
+}
+
+
 void c_image::convert_image_to_8bit()
 {
     if (m_byte_depth == 2) { 
         uint16_t *p_read_data = (uint16_t *)mp_buffer;
         uint8_t *p_write_data = mp_buffer;
-        int pixel_count = m_width * m_height;
+        int64_t pixel_count = (int64_t)m_width * m_height;
         if (m_colour) {
             pixel_count *= 3;
         }
 
-        for (int pixel = 0; pixel < pixel_count; pixel++) {
+        for (int64_t pixel = 0; pixel < pixel_count; pixel++) {
             *p_write_data++ = (*p_read_data++) >> 8;
         }
         
@@ -73,12 +191,12 @@ void c_image::convert_data_to_5_bit()
 {
     uint8_t *p_read_data = mp_buffer;
     uint8_t *p_write_data = mp_buffer;
-    int pixel_count = m_width * m_height;
+    int64_t pixel_count = (int64_t)m_width * m_height;
     if (m_colour) {
         pixel_count *= 3;
     }
 
-    for (int pixel = 0; pixel < pixel_count; pixel++) {
+    for (int64_t pixel = 0; pixel < pixel_count; pixel++) {
         uint8_t pixel_data = *p_read_data++;
         pixel_data &= 0xF8;  // Clear bottom 3 bits
         pixel_data |= (pixel_data >> 5);  // Copy top 3 bits to bottom 3 bits
@@ -112,7 +230,7 @@ void c_image::estimate_colour_balance(
     memset(red_table, 0, 256 * sizeof(int32_t));
 
     // Create histograms
-    for (int pixel = 0; pixel < m_width * m_height; pixel++) {
+    for (int64_t pixel = 0; pixel < (int64_t)m_width * m_height; pixel++) {
         blue_table[*blue_data_ptr]++;
         green_table[*green_data_ptr]++;
         red_table[*red_data_ptr]++;
@@ -240,6 +358,29 @@ void c_image::set_colour_align(
 }
 
 
+void c_image::copy_processing_settings(
+    const c_image &source)
+{
+    // Take gain, gamma, colour balance and alignment from another image so it can be processed the same way
+    m_invert = source.m_invert;
+    m_colour_balance_enabled = source.m_colour_balance_enabled;
+    m_red_gain = source.m_red_gain;
+    m_green_gain = source.m_green_gain;
+    m_blue_gain = source.m_blue_gain;
+    m_gain = source.m_gain;
+    m_gamma = source.m_gamma;
+    m_rgb_align_enabled = source.m_rgb_align_enabled;
+    m_red_align_x = source.m_red_align_x;
+    m_red_align_y = source.m_red_align_y;
+    m_blue_align_x = source.m_blue_align_x;
+    m_blue_align_y = source.m_blue_align_y;
+    memcpy(m_mono_lut, source.m_mono_lut, sizeof(m_mono_lut));
+    memcpy(m_red_lut, source.m_red_lut, sizeof(m_red_lut));
+    memcpy(m_green_lut, source.m_green_lut, sizeof(m_green_lut));
+    memcpy(m_blue_lut, source.m_blue_lut, sizeof(m_blue_lut));
+}
+
+
 void c_image::setup_luts()
 {
     for (int x = 0; x < 256; x++) {
@@ -292,138 +433,91 @@ void c_image::setup_luts()
 
 void c_image::monochrome_conversion(int conv_type)
 {
-    if (m_colour) {
+    if (m_colour && conv_type >= 0 && conv_type <= 6) {
+        if (m_byte_depth == 1) {
+            monochrome_conversion_int <uint8_t> (conv_type);
+        } else {
+            monochrome_conversion_int <uint16_t> (conv_type);
+        }
+
+        m_colour_id = COLOURID_MONO;
+        m_colour = false;
+    }
+}
+
+
+template <typename T>
+void c_image::monochrome_conversion_int(int conv_type)
+{
+    // When the conversion is split into bands it is written to a new buffer, otherwise
+    // the writes from one band would overwrite lines that an earlier band has yet to read
+    const int32_t band_count = get_row_band_count(m_height, m_width);
+    uint8_t *p_output_buffer = (band_count > 1) ? new uint8_t[m_buffer_size] : mp_buffer;
+    T *p_input_data = (T *)mp_buffer;
+    T *p_output_data = (T *)p_output_buffer;
+    const int32_t width = m_width;
+
+    run_row_bands(m_height, band_count, [=](int32_t start_row, int32_t end_row) {
+        const int64_t pixel_count = (int64_t)(end_row - start_row) * width;
+        T *write_data_ptr = p_output_data + (int64_t)start_row * width;
+        T *read_data_ptr = p_input_data + (int64_t)start_row * width * 3;
+
         switch (conv_type) {
         case 0:  // conv_type 0 - make mono from all RGB channels
-            if (m_byte_depth == 1) {
-                uint8_t *write_data_ptr = mp_buffer;
-                uint8_t *read_data_ptr = mp_buffer;
-                for (int32_t x = 0; x < m_height * m_width; x++) {
-                    // Convert RGB values to luminace
-                    uint32_t luminance = (114 * *read_data_ptr + 587 * *(read_data_ptr+1) + 299 * *(read_data_ptr+2)) / 1000;
-                    read_data_ptr += 3;
-                    *write_data_ptr++ = (uint8_t)luminance;
-                }
-            } else {
-                uint16_t *write_data_ptr = (uint16_t *)mp_buffer;
-                uint16_t *read_data_ptr = (uint16_t *)mp_buffer;
-                for (int32_t x = 0; x < m_height * m_width; x++) {
-                    // Convert RGB values to luminace
-                    uint32_t luminance = (114 * *read_data_ptr + 587 * *(read_data_ptr+1) + 299 * *(read_data_ptr+2)) / 1000;
-                    read_data_ptr += 3;
-                    *write_data_ptr++ = (uint16_t)luminance;
-                }
+            for (int64_t x = 0; x < pixel_count; x++) {
+                // Convert RGB values to luminace
+                uint32_t luminance = (114 * *read_data_ptr + 587 * *(read_data_ptr+1) + 299 * *(read_data_ptr+2)) / 1000;
+                read_data_ptr += 3;
+                *write_data_ptr++ = (T)luminance;
             }
-
-            m_colour_id = COLOURID_MONO;
-            m_colour = false;
             break;
 
         case 1:  // conv_type 1 - make mono from all R channel only
         case 2:  // conv_type 2 - make mono from all G channel only
         case 3:  // conv_type 3 - make mono from all B channel only
-            if (m_byte_depth == 1) {
-                uint8_t *write_data_ptr = mp_buffer;
-                uint8_t *read_data_ptr = mp_buffer + (3 - conv_type);  // Start on correct coloured pixel
-                for (int32_t x = 0; x < m_height * m_width; x++) {
-                    // Convert RG or B values to luminace
-                    *write_data_ptr++ = *read_data_ptr;
-                    read_data_ptr += 3;
-                }
-            } else {
-                uint16_t *write_data_ptr = (uint16_t *)mp_buffer;
-                uint16_t *read_data_ptr = (uint16_t *)mp_buffer + (3 - conv_type);  // Start on correct coloured pixel
-                for (int32_t x = 0; x < m_height * m_width; x++) {
-                    // Convert RG or B values to luminace
-                    *write_data_ptr++ = *read_data_ptr;
-                    read_data_ptr += 3;
-                }
+            read_data_ptr += (3 - conv_type);  // Start on correct coloured pixel
+            for (int64_t x = 0; x < pixel_count; x++) {
+                // Convert RG or B values to luminace
+                *write_data_ptr++ = *read_data_ptr;
+                read_data_ptr += 3;
             }
-
-            m_colour_id = COLOURID_MONO;
-            m_colour = false;
             break;
 
         case 4:  // R and G
-            if (m_byte_depth == 1) {
-                uint8_t *write_data_ptr = mp_buffer;
-                uint8_t *read_data_ptr = mp_buffer;
-                for (int32_t x = 0; x < m_height * m_width; x++) {
-                    // Convert RG values to luminace
-                    uint32_t luminance = (587 * *(read_data_ptr+1) + 299 * *(read_data_ptr+2)) / 886;
-                    read_data_ptr += 3;
-                    *write_data_ptr++ = (uint8_t)luminance;
-                }
-
-            } else {
-                uint16_t *write_data_ptr = (uint16_t *)mp_buffer;
-                uint16_t *read_data_ptr = (uint16_t *)mp_buffer;
-                for (int32_t x = 0; x < m_height * m_width; x++) {
-                    // Convert RG values to luminace
-                    uint32_t luminance = (587 * *(read_data_ptr+1) + 299 * *(read_data_ptr+2)) / 886;
-                    read_data_ptr += 3;
-                    *write_data_ptr++ = (uint16_t)luminance;
-                }
+            for (int64_t x = 0; x < pixel_count; x++) {
+                // Convert RG values to luminace
+                uint32_t luminance = (587 * *(read_data_ptr+1) + 299 * *(read_data_ptr+2)) / 886;
+                read_data_ptr += 3;
+                *write_data_ptr++ = (T)luminance;
             }
-
-            m_colour_id = COLOURID_MONO;
-            m_colour = false;
             break;
-        case 5:  // R and B
-            if (m_byte_depth == 1) {
-                uint8_t *write_data_ptr = mp_buffer;
-                uint8_t *read_data_ptr = mp_buffer;
-                for (int32_t x = 0; x < m_height * m_width; x++) {
-                    // Convert RB values to luminace
-                    uint32_t luminance = (114 * *(read_data_ptr) + 299 * *(read_data_ptr+2)) / 413;
-                    read_data_ptr += 3;
-                    *write_data_ptr++ = (uint8_t)luminance;
-                }
 
-            } else {
-                uint16_t *write_data_ptr = (uint16_t *)mp_buffer;
-                uint16_t *read_data_ptr = (uint16_t *)mp_buffer;
-                for (int32_t x = 0; x < m_height * m_width; x++) {
-                    // Convert RB values to luminace
-                    uint32_t luminance = (114 * *(read_data_ptr) + 299 * *(read_data_ptr+2)) / 413;
-                    read_data_ptr += 3;
-                    *write_data_ptr++ = (uint16_t)luminance;
-                }
+        case 5:  // R and B
+            for (int64_t x = 0; x < pixel_count; x++) {
+                // Convert RB values to luminace
+                uint32_t luminance = (114 * *(read_data_ptr) + 299 * *(read_data_ptr+2)) / 413;
+                read_data_ptr += 3;
+                *write_data_ptr++ = (T)luminance;
             }
-
-            m_colour_id = COLOURID_MONO;
-            m_colour = false;
             break;
-        case 6:  // G and B
-            if (m_byte_depth == 1) {
-                uint8_t *write_data_ptr = mp_buffer;
-                uint8_t *read_data_ptr = mp_buffer;
-                for (int32_t x = 0; x < m_height * m_width; x++) {
-                    // Convert GB values to luminace
-                    uint32_t luminance = (114 * *(read_data_ptr) + 587 * *(read_data_ptr+1)) / 701;
-                    read_data_ptr += 3;
-                    *write_data_ptr++ = (uint8_t)luminance;
-                }
 
-            } else {
-                uint16_t *write_data_ptr = (uint16_t *)mp_buffer;
-                uint16_t *read_data_ptr = (uint16_t *)mp_buffer;
-                for (int32_t x = 0; x < m_height * m_width; x++) {
-                    // Convert RB values to luminace
-                    uint32_t luminance = (114 * *(read_data_ptr) + 587 * *(read_data_ptr+1)) / 701;
-                    read_data_ptr += 3;
-                    *write_data_ptr++ = (uint16_t)luminance;
-                }
+        case 6:  // G and B
+            for (int64_t x = 0; x < pixel_count; x++) {
+                // Convert GB values to luminace
+                uint32_t luminance = (114 * *(read_data_ptr) + 587 * *(read_data_ptr+1)) / 701;
+                read_data_ptr += 3;
+                *write_data_ptr++ = (T)luminance;
             }
-
-            m_colour_id = COLOURID_MONO;
-            m_colour = false;
             break;
 
         default:
             break;
             // Do nothing
         }
+    });
+
+    if (p_output_buffer != mp_buffer) {
+        set_new_buffer(p_output_buffer, m_buffer_size);
     }
 }
 
@@ -435,84 +529,92 @@ void c_image::do_lut_based_processing()
         if (!m_colour) {
             // Mono images just use 1 LUT
             if (m_gain != 1.0 || m_gamma != 1.0 || m_invert) {
-                uint8_t *p_frame_data = mp_buffer;
-                for (int pixel = 0; pixel < m_width * m_height; pixel++) {
-                    *p_frame_data = m_mono_lut[*p_frame_data];
-                    p_frame_data++;
-                }
+                for_each_row_band(m_height, m_width, [this](int32_t start_row, int32_t end_row) {
+                    uint8_t *p_frame_data = mp_buffer + (int64_t)start_row * m_width;
+                    for (int64_t pixel = 0; pixel < (int64_t)(end_row - start_row) * m_width; pixel++) {
+                        *p_frame_data = m_mono_lut[*p_frame_data];
+                        p_frame_data++;
+                    }
+                });
             }
         } else {
             // Colour images use all 3 LUTs
             if ((m_colour_balance_enabled && m_colour) || m_gain != 1.0 || m_gamma != 1.0 || m_invert) {
-                uint8_t *p_frame_data = mp_buffer;
-                for (int pixel = 0; pixel < m_width * m_height; pixel++) {
-                    *p_frame_data = m_blue_lut[*p_frame_data];
-                    p_frame_data++;
-                    *p_frame_data = m_green_lut[*p_frame_data];
-                    p_frame_data++;
-                    *p_frame_data = m_red_lut[*p_frame_data];
-                    p_frame_data++;
-                }
+                for_each_row_band(m_height, m_width, [this](int32_t start_row, int32_t end_row) {
+                    uint8_t *p_frame_data = mp_buffer + (int64_t)start_row * m_width * 3;
+                    for (int64_t pixel = 0; pixel < (int64_t)(end_row - start_row) * m_width; pixel++) {
+                        *p_frame_data = m_blue_lut[*p_frame_data];
+                        p_frame_data++;
+                        *p_frame_data = m_green_lut[*p_frame_data];
+                        p_frame_data++;
+                        *p_frame_data = m_red_lut[*p_frame_data];
+                        p_frame_data++;
+                    }
+                });
             }
         }
     } else {
         // 16-bit version
         if (!m_colour) {
             // Monochrome processing
-            uint16_t *data_ptr = (uint16_t *)mp_buffer;
-            for (int x = 0; x < m_width * m_height; x++) {
-                double mono_data = *data_ptr;
+            for_each_row_band(m_height, m_width, [this](int32_t start_row, int32_t end_row) {
+                uint16_t *data_ptr = (uint16_t *)mp_buffer + (int64_t)start_row * m_width;
+                for (int64_t x = 0; x < (int64_t)(end_row - start_row) * m_width; x++) {
+                    double mono_data = *data_ptr;
 
-                // Invert pixel
-                if (m_invert) {
-                    mono_data = 65535.0 - mono_data;
-                }
+                    // Invert pixel
+                    if (m_invert) {
+                        mono_data = 65535.0 - mono_data;
+                    }
 
-                // Apply main gain
-                mono_data *= m_gain;
-                mono_data = (mono_data > 65535.0) ? 65535.0 : mono_data;
+                    // Apply main gain
+                    mono_data *= m_gain;
+                    mono_data = (mono_data > 65535.0) ? 65535.0 : mono_data;
 
-                // Apply gamma
-                mono_data = (uint16_t)(pow((double)(mono_data / 65535.0), (double)(1 / m_gamma)) * 65535.0 + 0.5);
-                mono_data = (mono_data > 65535.0) ? 65535.0 : mono_data;
+                    // Apply gamma
+                    mono_data = (uint16_t)(pow((double)(mono_data / 65535.0), (double)(1 / m_gamma)) * 65535.0 + 0.5);
+                    mono_data = (mono_data > 65535.0) ? 65535.0 : mono_data;
 
-                *data_ptr++ = mono_data;
-            }
+                    *data_ptr++ = mono_data;
+                }
+            });
         } else {
             // Colour processing
-            uint16_t *data_ptr = (uint16_t *)mp_buffer;
-            for (int x = 0; x < m_width * m_height; x++) {
-                double b_data = *data_ptr;
-                double g_data = *(data_ptr + 1);
-                double r_data = *(data_ptr + 2);
-
-                // Invert pixel
-                if (m_invert) {
-                    b_data = 65535.0 - b_data;
-                    g_data = 65535.0 - g_data;
-                    r_data = 65535.0 - r_data;
+            for_each_row_band(m_height, m_width, [this](int32_t start_row, int32_t end_row) {
+                uint16_t *data_ptr = (uint16_t *)mp_buffer + (int64_t)start_row * m_width * 3;
+                for (int64_t x = 0; x < (int64_t)(end_row - start_row) * m_width; x++) {
+                    double b_data = *data_ptr;
+                    double g_data = *(data_ptr + 1);
+                    double r_data = *(data_ptr + 2);
+
+                    // Invert pixel
+                    if (m_invert) {
+                        b_data = 65535.0 - b_data;
+                        g_data = 65535.0 - g_data;
+                        r_data = 65535.0 - r_data;
+                    }
+
+                    // Apply colour balance gains and main gain
+                    b_data *=  m_blue_gain * m_gain;
+                    g_data *=  m_green_gain * m_gain;
+                    r_data *=  m_red_gain * m_gain;
+                    b_data = (b_data > 65535.0) ? 65535.0 : b_data;
+                    g_data = (g_data > 65535.0) ? 65535.0 : g_data;
+                    r_data = (r_data > 65535.0) ? 65535.0 : r_data;
+
+                    // Apply gamma
+                    b_data = pow((double)(b_data / 65535.0), (double)(1 / m_gamma)) * 65535.0 + 0.5;
+                    g_data = pow((double)(g_data / 65535.0), (double)(1 / m_gamma)) * 65535.0 + 0.5;
+                    r_data = pow((double)(r_data / 65535.0), (double)(1 / m_gamma)) * 65535.0 + 0.5;
+                    b_data = (b_data > 65535.0) ? 65535.0 : b_data;
+                    g_data = (g_data > 65535.0) ? 65535.0 : g_data;
+                    r_data = (r_data > 65535.0) ? 65535.0 : r_data;
+
+                    *data_ptr++ = (uint16_t)b_data;
+                    *data_ptr++ = (uint16_t)g_data;
+                    *data_ptr++ = (uint16_t)r_data;
                 }
-
-                // Apply colour balance gains and main gain
-                b_data *=  m_blue_gain * m_gain;
-                g_data *=  m_green_gain * m_gain;
-                r_data *=  m_red_gain * m_gain;
-                b_data = (b_data > 65535.0) ? 65535.0 : b_data;
-                g_data = (g_data > 65535.0) ? 65535.0 : g_data;
-                r_data = (r_data > 65535.0) ? 65535.0 : r_data;
-
-                // Apply gamma
-                b_data = pow((double)(b_data / 65535.0), (double)(1 / m_gamma)) * 65535.0 + 0.5;
-                g_data = pow((double)(g_data / 65535.0), (double)(1 / m_gamma)) * 65535.0 + 0.5;
-                r_data = pow((double)(r_data / 65535.0), (double)(1 / m_gamma)) * 65535.0 + 0.5;
-                b_data = (b_data > 65535.0) ? 65535.0 : b_data;
-                g_data = (g_data > 65535.0) ? 65535.0 : g_data;
-                r_data = (r_data > 65535.0) ? 65535.0 : r_data;
-
-                *data_ptr++ = (uint16_t)b_data;
-                *data_ptr++ = (uint16_t)g_data;
-                *data_ptr++ = (uint16_t)r_data;
-            }
+            });
         }
     }
 }
@@ -541,122 +643,129 @@ void c_image::align_colour_channels()
 }
 
 
+// ------------------------------------------
+// Write one line of a shifted colour channel (channel 0 = blue, 2 = red) to the new buffer
+// ------------------------------------------
 template <typename T>
-void c_image::align_colour_channels_int()
+static void align_colour_channel_line(
+        const T *p_rd_buffer,
+        T *p_wr_line,
+        int32_t width,
+        int32_t height,
+        int32_t y,
+        int32_t channel,
+        int32_t align_x,
+        int32_t align_y)
 {
-    T *p_new_buffer = new T[m_width * m_height * 3];  // Create new buffer
-    memcpy(p_new_buffer, mp_buffer, m_width * m_height * 3 * sizeof(T));  // Copy current data into new buffer
+    int active_y_start = (align_y < 0) ? 0 : align_y;
+    int active_y_end = (align_y > 0) ? height - 1 : height - 1 + align_y;
+    int active_x_start = (align_x < 0) ? 0 : align_x;
+    int active_x_end = (align_x > 0) ? width - 1: width - 1 + align_x;
+
+    T *p_wr_data = p_wr_line + channel;
+    if (y < active_y_start || y >= active_y_end) {
+        // Blank line
+        for (int x = 0; x < width; x++) {
+            *p_wr_data = 0;
+            p_wr_data += 3;
+        }
 
+        return;
+    }
 
-    //
-    // Blue channel
-    //
-    if (m_blue_align_x != 0 || m_blue_align_y != 0) {
-        T *p_wr_data = p_new_buffer;
-        int blue_active_y_start = (m_blue_align_y < 0) ? 0 : m_blue_align_y;
-        int blue_active_y_end = (m_blue_align_y > 0) ? m_height - 1 : m_height - 1 + m_blue_align_y;
-        int blue_active_x_start = (m_blue_align_x < 0) ? 0 : m_blue_align_x;
-        int blue_active_x_end = (m_blue_align_x > 0) ? m_width - 1: m_width - 1 + m_blue_align_x;
-
-        // Copy blue channel to new buffer
-        int y;
-        for (y = 0; y < blue_active_y_start; y++) {
-            // Write inital blank lines to new buffer (if any)
-            for (int x = 0; x < m_width; x++) {
-                *p_wr_data = 0;  // Blue data
-                p_wr_data += 3;
-            }
-        }
+    // Write inital blank pixels at start of the line (if any)
+    int x;
+    for (x = 0; x < active_x_start && x < width; x++) {
+        *p_wr_data = 0;
+        p_wr_data += 3;
+    }
 
-        // Active lines
-        for ( ; y < blue_active_y_end; y++) {
-            // Write inital blank pixels at start of the line (if any)
-            int x;
-            for (x = 0; x < blue_active_x_start; x++) {
-                *p_wr_data = 0;  // Blue data
-                p_wr_data += 3;
-            }
+    // Write active pixels to new buffer
+    const T *p_rd_data = p_rd_buffer + (int64_t)(y - align_y) * width * 3 + (x - align_x) * 3 + channel;
+    for ( ; x < active_x_end; x++) {
+        *p_wr_data = *p_rd_data;
+        p_rd_data += 3;
+        p_wr_data += 3;
+    }
 
-            // Write active pixels to new buffer
-            T *p_blue_rd_data = ((T *)mp_buffer) + (y - m_blue_align_y) * m_width * 3 + (x - m_blue_align_x)* 3;
-            for ( ; x < blue_active_x_end; x++) {
-                *p_wr_data = *p_blue_rd_data;
-                p_blue_rd_data += 3;
-                p_wr_data += 3;
-            }
+    // Write final blank pixels at end of line (if any)
+    for ( ; x < width; x++) {
+        *p_wr_data = 0;
+        p_wr_data += 3;
+    }
+}
 
-            // Write final blank pixels at end of line (if any)
-            for ( ; x < m_width; x++) {
-                *p_wr_data = 0;  // Blue data
-                p_wr_data += 3;
-            }
 
-        }
+template <typename T>
+void c_image::align_colour_channels_int()
+{
+    T *p_new_buffer = new T[(size_t)m_width * m_height * 3];  // Create new buffer
+    const T *p_rd_buffer = (T *)mp_buffer;
+    const bool align_blue = (m_blue_align_x != 0 || m_blue_align_y != 0);
+    const bool align_red = (m_red_align_x != 0 || m_red_align_y != 0);
 
-        // Copy final blank lines to new buffer (if any)
-        for ( ; y < m_height; y++) {
-            for (int x = 0; x < m_width; x++) {
-                *p_wr_data = 0;  // Blue data
-                p_wr_data += 3;
-            }
-        }
-    }
+    for_each_row_band(m_height, m_width, [&](int32_t start_row, int32_t end_row) {
+        // Copy current data into new buffer
+        memcpy(p_new_buffer + (int64_t)start_row * m_width * 3,
+               p_rd_buffer + (int64_t)start_row * m_width * 3,
+               (size_t)(end_row - start_row) * m_width * 3 * sizeof(T));
 
-    //
-    // Red channel
-    //
-    if (m_red_align_x != 0 || m_red_align_y != 0) {
-        T *p_wr_data = p_new_buffer + 2;
-        int red_active_y_start = (m_red_align_y < 0) ? 0 : m_red_align_y;
-        int red_active_y_end = (m_red_align_y > 0) ? m_height - 1 : m_height - 1 + m_red_align_y;
-        int red_active_x_start = (m_red_align_x < 0) ? 0 : m_red_align_x;
-        int red_active_x_end = (m_red_align_x > 0) ? m_width - 1: m_width - 1 + m_red_align_x;
-
-        // Copy blue channel to new buffer
-        int y;
-        for (y = 0; y < red_active_y_start; y++) {
-            // Write inital blank lines to new buffer (if any)
-            for (int x = 0; x < m_width; x++) {
-                *p_wr_data = 0;  // Red data
-                p_wr_data += 3;
-            }
-        }
+        for (int32_t y = start_row; y < end_row; y++) {
+            T *p_wr_line = p_new_buffer + (int64_t)y * m_width * 3;
 
-        // Active lines
-        for ( ; y < red_active_y_end; y++) {
-            // Write inital blank pixels at start of the line (if any)
-            int x;
-            for (x = 0; x < red_active_x_start; x++) {
-                *p_wr_data = 0;  // Red data
-                p_wr_data += 3;
+            // Blue channel
+            if (align_blue) {
+                align_colour_channel_line(p_rd_buffer, p_wr_line, m_width, m_height, y, 0, m_blue_align_x, m_blue_align_y);
             }
 
-            // Write active pixels to new buffer
-            T *p_red_rd_data = ((T *)mp_buffer) + (y - m_red_align_y) * m_width * 3 + (x - m_red_align_x)* 3 + 2;
-            for ( ; x < red_active_x_end; x++) {
-                *p_wr_data = *p_red_rd_data;
-                p_red_rd_data += 3;
-                p_wr_data += 3;
+            // Red channel
+            if (align_red) {
+                align_colour_channel_line(p_rd_buffer, p_wr_line, m_width, m_height, y, 2, m_red_align_x, m_red_align_y);
             }
+        }
+    });
 
-            // Write final blank pixels at end of line (if any)
-            for ( ; x < m_width; x++) {
-                *p_wr_data = 0;  // Red data
-                p_wr_data += 3;
-            }
+    set_new_buffer((uint8_t *)p_new_buffer, (size_t)m_width * m_height * 3 * sizeof(T));
+}
 
-        }
 
-        // Copy final blank lines to new buffer (if any)
-        for ( ; y < m_height; y++) {
-            for (int x = 0; x < m_width; x++) {
-                *p_wr_data = 0;  // Red data
-                p_wr_data += 3;
-            }
-        }
+// ------------------------------------------
+// Apply colour saturation to a single BGR pixel
+// ------------------------------------------
+template <typename T>
+static inline void change_pixel_saturation(
+        T &blue,
+        T &green,
+        T &red,
+        double saturation)
+{
+    const double C_Pr = .299;
+    const double C_Pg = .587;
+    const double C_Pb = .114;
+
+    if (blue != green || blue != red) {
+        // This is not a monochrome pixel - apply colour saturation
+        double P = sqrt( C_Pr * red * red +
+                         C_Pg * green * green +
+                         C_Pb * blue * blue );
+
+        double dred = P + ((double)red - P) * saturation;
+        double dgreen = P + ((double)green - P) * saturation;
+        double dblue = P + ((double)blue - P) * saturation;
+
+        // Clip values in 0 to 255 range
+        dred = (dred < 0) ? 0 : dred;
+        dgreen = (dgreen < 0) ? 0 : dgreen;
+        dblue = (dblue < 0) ? 0 : dblue;
+
+        dred = (dred > std::numeric_limits<T>::max()) ? std::numeric_limits<T>::max() : dred;
+        dgreen = (dgreen > std::numeric_limits<T>::max()) ? std::numeric_limits<T>::max() : dgreen;
+        dblue = (dblue > std::numeric_limits<T>::max()) ? std::numeric_limits<T>::max() : dblue;
+
+        red = (T)dred;
+        green = (T)dgreen;
+        blue = (T)dblue;
     }
-
-    set_new_buffer((uint8_t *)p_new_buffer, m_width * m_height * 3 * sizeof(T));
 }
 
 
@@ -667,40 +776,13 @@ void c_image::change_colour_saturation_int(
     // Only chnage colour saturation for colour images
     // saturation == 1.0 means no change so do nothing
     if (m_colour && saturation != 1.0) {
-        const double C_Pr = .299;
-        const double C_Pg = .587;
-        const double C_Pb = .114;
-
-        T *p_frame_data = (T *)mp_buffer;
-        for (int pixel = 0; pixel < m_width * m_height; pixel++) {
-            T *p_blue = p_frame_data++;
-            T *p_green = p_frame_data++;
-            T *p_red = p_frame_data++;
-
-            if (*p_blue != *p_green || *p_blue != *p_red) {
-                // This is not a monochrome pixel - apply colour saturation
-                double P = sqrt( C_Pr * (*p_red) * (*p_red) +
-                                 C_Pg * (*p_green) * (*p_green) +
-                                 C_Pb * (*p_blue) * (*p_blue) );
-
-                double dred = P + ((double)(*p_red) - P) * saturation;
-                double dgreen = P + ((double)(*p_green) - P) * saturation;
-                double dblue = P + ((double)(*p_blue) - P) * saturation;
-
-                // Clip values in 0 to 255 range
-                dred = (dred < 0) ? 0 : dred;
-                dgreen = (dgreen < 0) ? 0 : dgreen;
-                dblue = (dblue < 0) ? 0 : dblue;
-
-                dred = (dred > std::numeric_limits<T>::max()) ? std::numeric_limits<T>::max() : dred;
-                dgreen = (dgreen > std::numeric_limits<T>::max()) ? std::numeric_limits<T>::max() : dgreen;
-                dblue = (dblue > std::numeric_limits<T>::max()) ? std::numeric_limits<T>::max() : dblue;
-
-                *p_red = (T)dred;
-                *p_green = (T)dgreen;
-                *p_blue = (T)dblue;
+        for_each_row_band(m_height, m_width, [&](int32_t start_row, int32_t end_row) {
+            T *p_frame_data = (T *)mp_buffer + (int64_t)start_row * m_width * 3;
+            for (int64_t pixel = 0; pixel < (int64_t)(end_row - start_row) * m_width; pixel++) {
+                change_pixel_saturation(p_frame_data[0], p_frame_data[1], p_frame_data[2], saturation);
+                p_frame_data += 3;
             }
-        }
+        });
     }
 }
 
@@ -789,7 +871,7 @@ bool c_image::crop_image(
         return true;
     }
 
-    int line_length = m_width;
+    int64_t line_length = m_width;
     int x_start_pos = top_left_x;
     int y_start_pos = m_height - crop_height - top_left_y;  // Allow for the fact line 0 is the bottom of the image, not the top
     int crop_width_length = crop_width;
@@ -870,7 +952,7 @@ template <typename T>
 void c_image::add_horizontal_bars(int top_bar, int bottom_bar)
 {
    int new_height =  m_height + top_bar + bottom_bar;
-   int line_length = m_width;
+   size_t line_length = m_width;
    if (m_colour) {
        line_length *= 3;
    }
@@ -901,8 +983,8 @@ void c_image::add_vertical_bars(
         int right_bar)
 {
     int new_width =  m_width + left_bar + right_bar;
-    int line_length = m_width;
-    int new_line_length = new_width;
+    size_t line_length = m_width;
+    size_t new_line_length = new_width;
     if (m_colour) {
         line_length *= 3;
         new_line_length *= 3;
@@ -941,11 +1023,11 @@ void c_image::resize_image_size_by_half()
 
     if (m_colour) {
         // Do the resize for colour data
-        const int read_line_length = m_width * 3;
+        const int64_t read_line_length = m_width * 3;
 
         T *p_write_data = (T *)mp_buffer;
         for (int y = 0; y < new_height; y++) {
-            T *p_read_data = ((T *)mp_buffer) + y * 2 * read_line_length;
+            T *p_read_data = ((T *)mp_buffer) + (int64_t)y * 2 * read_line_length;
             for (int x = 0; x < new_width; x++) {
                 // Blue
                 uint32_t pix = *(p_read_data + 0) + *(p_read_data + 3) +
@@ -970,11 +1052,11 @@ void c_image::resize_image_size_by_half()
         }
     } else {
         // Do the resize for monochrome data
-        const int read_line_length = m_width;
+        const int64_t read_line_length = m_width;
 
         T *p_write_data = (T *)mp_buffer;
         for (int y = 0; y < new_height; y++) {
-            T *p_read_data = ((T *)mp_buffer) + y * 2 * read_line_length;
+            T *p_read_data = ((T *)mp_buffer) + (int64_t)y * 2 * read_line_length;
             for (int x = 0; x < new_width; x++) {
                 // Monochrome
                 uint32_t pix = *(p_read_data + 0) + *(p_read_data + 1) +
@@ -1001,10 +1083,10 @@ void c_image::resize_image_width_by_half()
 
     if (m_colour) {
         // Do the resize for colour data
-        const int read_line_length = m_width * 3;
+        const int64_t read_line_length = m_width * 3;
         T *p_write_data = (T *)mp_buffer;
         for (int y = 0; y < m_height; y++) {
-            T *p_read_data = ((T *)mp_buffer) + y * read_line_length;
+            T *p_read_data = ((T *)mp_buffer) + (int64_t)y * read_line_length;
             for (int x = 0; x < new_width; x++) {
                 // Blue
                 uint32_t pix = *(p_read_data + 0) + *(p_read_data + 3);
@@ -1026,10 +1108,10 @@ void c_image::resize_image_width_by_half()
         }
     } else {
         // Do the resize for monochrome data
-        const int read_line_length = m_width;
+        const int64_t read_line_length = m_width;
         T *p_write_data = (T *)mp_buffer;
         for (int y = 0; y < m_height; y++) {
-            T *p_read_data = ((T *)mp_buffer) + y * read_line_length;
+            T *p_read_data = ((T *)mp_buffer) + (int64_t)y * read_line_length;
             for (int x = 0; x < new_width; x++) {
                 // Monochrome
                 uint32_t pix = *(p_read_data + 0) + *(p_read_data + 1);
@@ -1054,10 +1136,10 @@ void c_image::resize_image_height_by_half()
 
     if (m_colour) {
         // Do the resize for colour data
-        const int read_line_length = m_width * 3;
+        const int64_t read_line_length = m_width * 3;
         T *p_write_data = (T *)mp_buffer;
         for (int y = 0; y < new_height; y++) {
-            T *p_read_data = ((T *)mp_buffer) + y * 2 * read_line_length;
+            T *p_read_data = ((T *)mp_buffer) + (int64_t)y * 2 * read_line_length;
             for (int x = 0; x < m_width; x++) {
                 // Blue
                 uint32_t pix = *(p_read_data + 0) + *(p_read_data + read_line_length);
@@ -1077,10 +1159,10 @@ void c_image::resize_image_height_by_half()
         }
     } else {
         // Do the resize for monochrome data
-        const int read_line_length = m_width;
+        const int64_t read_line_length = m_width;
         T *p_write_data = (T *)mp_buffer;
         for (int y = 0; y < new_height; y++) {
-            T *p_read_data = ((T *)mp_buffer) + y * 2 * read_line_length;
+            T *p_read_data = ((T *)mp_buffer) + (int64_t)y * 2 * read_line_length;
             for (int x = 0; x < m_width; x++) {
                 // Monochrome
                 uint32_t pix = *(p_read_data + 0) + *(p_read_data + read_line_length);
@@ -1100,55 +1182,39 @@ void c_image::resize_image_bilinear(
         int req_width,
         int req_height)
 {
+    const int channels = (m_colour) ? 3 : 1;
+
     // Start by reducing the height
     if (req_height < m_height) {
         double y_spacing = (double)m_height / (double)req_height;
         double y_start = (double(m_height-1) - double(req_height-1) * y_spacing) / 2;
 
-        if (m_colour) {
-            // Do reduction for colour data
-            T *p_write_data = (T *)mp_buffer;
-            const int read_line_length = m_width * 3;
-            for (int y = 0; y < req_height; y++) {
+        // When the reduction is split into bands it is written to a new buffer, otherwise
+        // the writes from one band would overwrite lines that an earlier band has yet to read
+        const int32_t band_count = get_row_band_count(req_height, m_width);
+        T *p_read_buffer = (T *)mp_buffer;
+        T *p_write_buffer = (band_count > 1) ? new T[(size_t)req_height * m_width * channels] : p_read_buffer;
+        const int64_t read_line_length = m_width * channels;
+
+        // Colour and monochrome data are handled the same way, just with different line lengths
+        run_row_bands(req_height, band_count, [=](int32_t start_row, int32_t end_row) {
+            T *p_write_data = p_write_buffer + (int64_t)start_row * read_line_length;
+            for (int y = start_row; y < end_row; y++) {
                 double new_y_pos = y_start + y_spacing * y;
                 int row = int(new_y_pos);  // Remove fractional part
                 double fraction_1 = new_y_pos - row;  // Keep just fractional part
                 double fraction_2 = 1 - fraction_1;
-                T *p_read_data = ((T *)mp_buffer) + row * 3 * m_width;
-                for (int x = 0; x < m_width; x++) {
-                    // Blue
-                    T pix = (T)(fraction_2 * (*p_read_data) + fraction_1 * (*(p_read_data + read_line_length)));
-                    *p_write_data++ = pix;
-                    p_read_data++;
-
-                    // Green
-                    pix = (T)(fraction_2 * (*p_read_data) + fraction_1 * (*(p_read_data + read_line_length)));
-                    *p_write_data++ = pix;
-                    p_read_data++;
-
-                    // Blue
-                    pix = (T)(fraction_2 * (*p_read_data) + fraction_1 * (*(p_read_data + read_line_length)));
-                    *p_write_data++ = pix;
-                    p_read_data++;
-                }
-            }
-        } else {
-            // Do reduction for monochrome data
-            T *p_write_data = (T *)mp_buffer;
-            const int read_line_length = m_width;
-            for (int y = 0; y < req_height; y++) {
-                double new_y_pos = y_start + y_spacing * y;
-                int row = int(new_y_pos);  // Remove fractional part
-                double fraction_1 = new_y_pos - row;  // Keep just fractional part
-                double fraction_2 = 1 - fraction_1;
-                T *p_read_data = ((T *)mp_buffer) + row * m_width;
-                for (int x = 0; x < m_width; x++) {
-                    // Monochrome
+                T *p_read_data = p_read_buffer + row * read_line_length;
+                for (int x = 0; x < read_line_length; x++) {
                     T pix = (T)(fraction_2 * (*p_read_data) + fraction_1 * (*(p_read_data + read_line_length)));
                     *p_write_data++ = pix;
                     p_read_data++;
                 }
             }
+        });
+
+        if (p_write_buffer != p_read_buffer) {
+            set_new_buffer((uint8_t *) p_write_buffer, (size_t)req_height * m_width * channels * sizeof(T));
         }
 
         m_height = req_height;  // Height has been reduced
@@ -1159,54 +1225,34 @@ void c_image::resize_image_bilinear(
         double x_spacing = (double)m_width / (double)req_width;
         double x_start = (double(m_width-1) - double(req_width-1) * x_spacing) / 2;
 
-        if (m_colour) {
-            // Do reduction for colour data
-            T *p_reduced_buffer = new T[req_width * req_height * 3];  // New (smaller) buffer
-            for (int x = 0; x < req_width; x++) {
-                double new_x_pos = x_start + x_spacing * x;
-                int col = int(new_x_pos);  // Remove fractional part
-                double fraction_1 = new_x_pos - col;  // Keep just fractional part
-                double fraction_2 = 1 - fraction_1;
-                for (int y = 0; y < req_height; y++) {
-                    T *p_read_data = ((T *)mp_buffer) + y * 3 * m_width + 3 * col;
-                    T *p_write_data = p_reduced_buffer + y * 3 * req_width + 3 * x;
-                    // Blue
-                    T pix = (T)(fraction_2 * (*p_read_data) + fraction_1 * (*(p_read_data + 3)));
-                    *p_write_data++ = pix;
-                    p_read_data++;
-
-                    // Green
-                    pix = (T)(fraction_2 * (*p_read_data) + fraction_1 * (*(p_read_data + 3)));
-                    *p_write_data++ = pix;
-                    p_read_data++;
-
-                    // Blue
-                    pix = (T)(fraction_2 * (*p_read_data) + fraction_1 * (*(p_read_data + 3)));
-                    *p_write_data++ = pix;
-                }
-            }
+        // Work out the source column and fractions for each output column up front
+        std::vector<int> cols(req_width);
+        std::vector<double> fractions(req_width);
+        for (int x = 0; x < req_width; x++) {
+            double new_x_pos = x_start + x_spacing * x;
+            cols[x] = int(new_x_pos);  // Remove fractional part
+            fractions[x] = new_x_pos - cols[x];  // Keep just fractional part
+        }
 
-            set_new_buffer((uint8_t *) p_reduced_buffer, req_width * req_height * 3 * sizeof(T));
-        } else {
-            // Do reduction for monochrome data
-            T *p_reduced_buffer = new T[req_width * req_height];  // New (smaller) buffer
-            for (int x = 0; x < req_width; x++) {
-                double new_x_pos = x_start + x_spacing * x;
-                int col = int(new_x_pos);  // Remove fractional part
-                double fraction_1 = new_x_pos - col;  // Keep just fractional part
-                double fraction_2 = 1 - fraction_1;
-                for (int y = 0; y < req_height; y++) {
-                    T *p_read_data = ((T *)mp_buffer) + y * m_width + col;
-                    T *p_write_data = p_reduced_buffer + y * req_width + x;
-                    // Monochrome
-                    T pix = (T)(fraction_2 * (*p_read_data) + fraction_1 * (*(p_read_data + 1)));
-                    *p_write_data++ = pix;
+        T *p_reduced_buffer = new T[(size_t)req_width * req_height * channels];  // New (smaller) buffer
+        for_each_row_band(req_height, req_width, [&](int32_t start_row, int32_t end_row) {
+            for (int y = start_row; y < end_row; y++) {
+                T *p_write_data = p_reduced_buffer + (int64_t)y * channels * req_width;
+                for (int x = 0; x < req_width; x++) {
+                    double fraction_1 = fractions[x];
+                    double fraction_2 = 1 - fraction_1;
+                    T *p_read_data = ((T *)mp_buffer) + (int64_t)y * channels * m_width + channels * cols[x];
+                    for (int c = 0; c < channels; c++) {
+                        // Blue, green and red for colour data, just the one value for monochrome
+                        T pix = (T)(fraction_2 * (*p_read_data) + fraction_1 * (*(p_read_data + channels)));
+                        *p_write_data++ = pix;
+                        p_read_data++;
+                    }
                 }
             }
+        });
 
-            set_new_buffer((uint8_t *) p_reduced_buffer, req_width * req_height * sizeof(T));
-        }
-
+        set_new_buffer((uint8_t *) p_reduced_buffer, (size_t)req_width * req_height * channels * sizeof(T));
         m_width = req_width;  // Width has been reduced
     }
 }
@@ -1214,7 +1260,7 @@ void c_image::resize_image_bilinear(
 
 void c_image::conv_data_ready_for_gif()
 {
-    int buffer_size = m_width * m_height;
+    size_t buffer_size = (size_t)m_width * m_height;
     buffer_size = (m_colour) ? 3 * buffer_size : buffer_size;
     uint8_t *p_output_buffer = new uint8_t [buffer_size];
     if (m_colour) {
@@ -1223,7 +1269,7 @@ void c_image::conv_data_ready_for_gif()
             // 8-bit data
             uint8_t *p_write_data = p_output_buffer;
             for (int y = m_height-1; y >= 0; y--) {
-                uint8_t *p_read_data = mp_buffer + y * m_width * 3;
+                uint8_t *p_read_data = mp_buffer + (int64_t)y * m_width * 3;
                 for (int x = 0; x < m_width; x++) {
                     uint8_t b = (*p_read_data++);
                     uint8_t g = (*p_read_data++);
@@ -1237,7 +1283,7 @@ void c_image::conv_data_ready_for_gif()
             // 16-bit data
             uint8_t *p_write_data = p_output_buffer;
             for (int y = m_height-1; y >= 0; y--) {
-                uint16_t *p_read_data = ((uint16_t *)mp_buffer) + y * m_width * 3;
+                uint16_t *p_read_data = ((uint16_t *)mp_buffer) + (int64_t)y * m_width * 3;
                 for (int x = 0; x < m_width; x++) {
                     uint8_t b = (uint8_t)(*p_read_data++ >> 8);
                     uint8_t g = (uint8_t)(*p_read_data++ >> 8);
@@ -1254,7 +1300,7 @@ void c_image::conv_data_ready_for_gif()
             // 8-bit data
             uint8_t *p_write_data = p_output_buffer;
             for (int y = m_height-1; y >= 0; y--) {
-                uint8_t *p_read_data = mp_buffer + y * m_width;
+                uint8_t *p_read_data = mp_buffer + (int64_t)y * m_width;
                 for (int x = 0; x < m_width; x++) {
                     *p_write_data++ = (*p_read_data++);
                 }
@@ -1263,7 +1309,7 @@ void c_image::conv_data_ready_for_gif()
             // 16-bit data
             uint8_t *p_write_data = p_output_buffer;
             for (int y = m_height-1; y >= 0; y--) {
-                uint16_t *p_read_data = ((uint16_t *)mp_buffer) + y * m_width;
+                uint16_t *p_read_data = ((uint16_t *)mp_buffer) + (int64_t)y * m_width;
                 for (int x = 0; x < m_width ; x++) {
                     *p_write_data++ = (uint8_t)(*p_read_data++ >> 8);
                 }
@@ -1285,85 +1331,434 @@ void c_image::conv_data_ready_for_qimage()
         line_pad = 4 - line_pad;
     }
 
-    int32_t buffer_size = (m_width + line_pad) * m_height * 3;
+    size_t buffer_size = (size_t)(m_width + line_pad) * m_height * 3;
     uint8_t *p_output_buffer = new uint8_t [buffer_size];
+    const int32_t output_line_length = m_width * 3 + line_pad;
 
-    if (m_colour) {
-        // Colour data needs to be changed from BGR to RGB format and flipped vertically
-        uint8_t *p_write_data = p_output_buffer;
-        if (m_byte_depth == 1) {
-            // 8-bit data
-            for (int32_t y = m_height - 1; y >= 0; y--) {
-                uint8_t *p_read_data = mp_buffer + y * m_width * 3;
-                for (int32_t x = 0; x < m_width; x++) {
-                    uint8_t b_pixel = *p_read_data++;
-                    uint8_t g_pixel = *p_read_data++;
-                    uint8_t r_pixel = *p_read_data++;
-                    *p_write_data++ = r_pixel;
-                    *p_write_data++ = g_pixel;
-                    *p_write_data++ = b_pixel;
-                }
+    // Bands are made up of output lines, output line n is read from input line (m_height - 1 - n)
+    for_each_row_band(m_height, m_width, [&](int32_t start_line, int32_t end_line) {
+        uint8_t *p_write_data = p_output_buffer + (int64_t)start_line * output_line_length;
+        const int32_t y_start = m_height - 1 - start_line;
+        const int32_t y_end = m_height - 1 - end_line;
 
-                for (int32_t x = 0; x < line_pad; x++) {
-                    *p_write_data++ = 0;
+        if (m_colour) {
+            // Colour data needs to be changed from BGR to RGB format and flipped vertically
+            if (m_byte_depth == 1) {
+                // 8-bit data
+                for (int32_t y = y_start; y > y_end; y--) {
+                    uint8_t *p_read_data = mp_buffer + (int64_t)y * m_width * 3;
+                    for (int32_t x = 0; x < m_width; x++) {
+                        uint8_t b_pixel = *p_read_data++;
+                        uint8_t g_pixel = *p_read_data++;
+                        uint8_t r_pixel = *p_read_data++;
+                        *p_write_data++ = r_pixel;
+                        *p_write_data++ = g_pixel;
+                        *p_write_data++ = b_pixel;
+                    }
+
+                    for (int32_t x = 0; x < line_pad; x++) {
+                        *p_write_data++ = 0;
+                    }
+                }
+            } else {
+                // 16-bit data
+                for (int32_t y = y_start; y > y_end; y--) {
+                    uint16_t *p_read_data = ((uint16_t *)mp_buffer) + (int64_t)y * m_width * 3;
+                    for (int32_t x = 0; x < m_width; x++) {
+                        uint8_t b_pixel = (*p_read_data++) >> 8;
+                        uint8_t g_pixel = (*p_read_data++) >> 8;
+                        uint8_t r_pixel = (*p_read_data++) >> 8;
+                        *p_write_data++ = r_pixel;
+                        *p_write_data++ = g_pixel;
+                        *p_write_data++ = b_pixel;
+                    }
+
+                    for (int32_t x = 0; x < line_pad; x++) {
+                        *p_write_data++ = 0;
+                    }
                 }
             }
         } else {
-            // 16-bit data
-            for (int32_t y = m_height - 1; y >= 0; y--) {
-                uint16_t *p_read_data = ((uint16_t *)mp_buffer) + y * m_width * 3;
-                for (int32_t x = 0; x < m_width; x++) {
-                    uint8_t b_pixel = (*p_read_data++) >> 8;
-                    uint8_t g_pixel = (*p_read_data++) >> 8;
-                    uint8_t r_pixel = (*p_read_data++) >> 8;
-                    *p_write_data++ = r_pixel;
-                    *p_write_data++ = g_pixel;
-                    *p_write_data++ = b_pixel;
+            // Monochrome data just needs to be flipped vertically
+            if (m_byte_depth == 1) {
+                // 8-bit data
+                for (int32_t y = y_start; y > y_end; y--) {
+                    uint8_t *p_read_data = mp_buffer + (int64_t)y * m_width;
+                    for (int32_t x = 0; x < m_width; x++) {
+                        *p_write_data++ = *p_read_data;
+                        *p_write_data++ = *p_read_data;
+                        *p_write_data++ = *p_read_data++;
+                    }
+
+                    for (int32_t x = 0; x < line_pad; x++) {
+                        *p_write_data++ = 0;
+                    }
                 }
-
-                for (int32_t x = 0; x < line_pad; x++) {
-                    *p_write_data++ = 0;
+            } else {
+                // 16-bit data
+                for (int32_t y = y_start; y > y_end; y--) {
+                    uint16_t *p_read_data = ((uint16_t *)mp_buffer) + (int64_t)y * m_width;
+                    for (int32_t x = 0; x < m_width; x++) {
+                        uint8_t temp = (*p_read_data++) >> 8;
+                        *p_write_data++ = temp;
+                        *p_write_data++ = temp;
+                        *p_write_data++ = temp;
+                    }
+
+                    for (int32_t x = 0; x < line_pad; x++) {
+                        *p_write_data++ = 0;
+                    }
                 }
             }
         }
-    } else {
-        // Monochrome data just needs to be flipped vertically
-        uint8_t *p_write_data = p_output_buffer;
-        if (m_byte_depth == 1) {
-            // 8-bit data
-            for (int32_t y = m_height - 1; y >= 0; y--) {
-                uint8_t *p_read_data = mp_buffer + y * m_width;
-                for (int32_t x = 0; x < m_width; x++) {
-                    *p_write_data++ = *p_read_data;
-                    *p_write_data++ = *p_read_data;
-                    *p_write_data++ = *p_read_data++;
-                }
+    });
+
+    delete[] mp_buffer;  // Free input buffer
+    mp_buffer = p_output_buffer;  // Update pointer to output buffer
+    m_buffer_size = buffer_size;
+}
+
+
+// ------------------------------------------
+// Single pass version of crop_image(), monochrome_conversion(), do_lut_based_processing(),
+// change_colour_saturation() and conv_data_ready_for_qimage() for 8-bit images.
+// Each output line is produced straight from the source line so the frame is only walked
+// once.  Returns false without touching the image if the single pass cannot be used.
+// ------------------------------------------
+bool c_image::process_and_conv_data_ready_for_qimage(
+        bool crop_enable,
+        int crop_x_pos,
+        int crop_y_pos,
+        int crop_width,
+        int crop_height,
+        int monochrome_conversion_type,
+        double saturation)
+{
+    // Colour alignment shifts data between lines so it must be done as a pass of its own
+    if (m_byte_depth != 1 || (m_colour && m_rgb_align_enabled)) {
+        return false;
+    }
 
-                for (int32_t x = 0; x < line_pad; x++) {
-                    *p_write_data++ = 0;
+    // Crop (crop_image() leaves the image alone if the crop does not fit)
+    if (!crop_enable || (crop_x_pos + crop_width) > m_width || (crop_y_pos + crop_height) > m_height) {
+        crop_x_pos = 0;
+        crop_y_pos = 0;
+        crop_width = m_width;
+        crop_height = m_height;
+    }
+
+    // Monochrome conversion weights for the blue, green and red channels and the divisor
+    static const uint32_t C_MONO_WEIGHTS[7][4] = {
+        {114, 587, 299, 1000},  // RG & B channels
+        {0, 0, 1, 1},  // R channel only
+        {0, 1, 0, 1},  // G channel only
+        {1, 0, 0, 1},  // B channel only
+        {0, 587, 299, 886},  // R & G channels
+        {114, 0, 299, 413},  // R & B channels
+        {114, 587, 0, 701}};  // G & B channels
+
+    const bool mono_conversion = m_colour && monochrome_conversion_type >= 0 && monochrome_conversion_type <= 6;
+    const uint32_t *p_mono_weights = (mono_conversion) ? C_MONO_WEIGHTS[monochrome_conversion_type] : C_MONO_WEIGHTS[0];
+    const bool colour_output = m_colour && !mono_conversion;
+
+    // Pick the LUTs, using an identity LUT when do_lut_based_processing() would leave the data alone
+    uint8_t identity_lut[256];
+    for (int x = 0; x < 256; x++) {
+        identity_lut[x] = (uint8_t)x;
+    }
+
+    const uint8_t *p_mono_lut = (m_gain != 1.0 || m_gamma != 1.0 || m_invert) ? m_mono_lut : identity_lut;
+    const bool use_colour_luts = m_colour_balance_enabled || m_gain != 1.0 || m_gamma != 1.0 || m_invert;
+    const uint8_t *p_blue_lut = (use_colour_luts) ? m_blue_lut : identity_lut;
+    const uint8_t *p_green_lut = (use_colour_luts) ? m_green_lut : identity_lut;
+    const uint8_t *p_red_lut = (use_colour_luts) ? m_red_lut : identity_lut;
+    const bool do_saturation = colour_output && saturation != 1.0;
+
+    // Create buffer for converted data
+    int line_pad = (crop_width * 3) % 4;
+    if (line_pad != 0) {
+        line_pad = 4 - line_pad;
+    }
+
+    size_t buffer_size = (size_t)(crop_width + line_pad) * crop_height * 3;
+    uint8_t *p_output_buffer = new uint8_t [buffer_size];
+    const int32_t output_line_length = crop_width * 3 + line_pad;
+    const int32_t input_line_length = (m_colour) ? m_width * 3 : m_width;
+    const int32_t input_x_offset = (m_colour) ? crop_x_pos * 3 : crop_x_pos;
+    const int32_t y_start_pos = m_height - crop_height - crop_y_pos;  // Line 0 is the bottom of the image, not the top
+
+    // Bands are made up of output lines, the output is flipped vertically
+    for_each_row_band(crop_height, crop_width, [&](int32_t start_line, int32_t end_line) {
+        for (int32_t line = start_line; line < end_line; line++) {
+            const uint8_t *p_read_data = mp_buffer + (int64_t)(y_start_pos + crop_height - 1 - line) * input_line_length + input_x_offset;
+            uint8_t *p_write_data = p_output_buffer + (int64_t)line * output_line_length;
+
+            if (colour_output) {
+                for (int32_t x = 0; x < crop_width; x++) {
+                    uint8_t b_pixel = p_blue_lut[*p_read_data++];
+                    uint8_t g_pixel = p_green_lut[*p_read_data++];
+                    uint8_t r_pixel = p_red_lut[*p_read_data++];
+                    if (do_saturation) {
+                        change_pixel_saturation(b_pixel, g_pixel, r_pixel, saturation);
+                    }
+
+                    *p_write_data++ = r_pixel;
+                    *p_write_data++ = g_pixel;
+                    *p_write_data++ = b_pixel;
                 }
-            }
-        } else {
-            // 16-bit data
-            for (int32_t y = m_height - 1; y >= 0; y--) {
-                uint16_t *p_read_data = ((uint16_t *)mp_buffer) + y * m_width;
-                for (int32_t x = 0; x < m_width; x++) {
-                    uint8_t temp = (*p_read_data++) >> 8;
-                    *p_write_data++ = temp;
-                    *p_write_data++ = temp;
-                    *p_write_data++ = temp;
+            } else if (mono_conversion) {
+                for (int32_t x = 0; x < crop_width; x++) {
+                    uint32_t luminance = (p_mono_weights[0] * p_read_data[0] +
+                                          p_mono_weights[1] * p_read_data[1] +
+                                          p_mono_weights[2] * p_read_data[2]) / p_mono_weights[3];
+                    p_read_data += 3;
+                    uint8_t mono_pixel = p_mono_lut[(uint8_t)luminance];
+                    *p_write_data++ = mono_pixel;
+                    *p_write_data++ = mono_pixel;
+                    *p_write_data++ = mono_pixel;
                 }
-
-                for (int32_t x = 0; x < line_pad; x++) {
-                    *p_write_data++ = 0;
+            } else {
+                for (int32_t x = 0; x < crop_width; x++) {
+                    uint8_t mono_pixel = p_mono_lut[*p_read_data++];
+                    *p_write_data++ = mono_pixel;
+                    *p_write_data++ = mono_pixel;
+                    *p_write_data++ = mono_pixel;
                 }
             }
+
+            for (int32_t x = 0; x < line_pad; x++) {
+                *p_write_data++ = 0;
+            }
         }
-    }
+    });
 
     delete[] mp_buffer;  // Free input buffer
     mp_buffer = p_output_buffer;  // Update pointer to output buffer
     m_buffer_size = buffer_size;
+    m_width = crop_width;
+    m_height = crop_height;
+    if (mono_conversion) {
+        m_colour_id = COLOURID_MONO;
+        m_colour = false;
+    }
+
+    return true;
+}
+
+
+// ------------------------------------------
+// Bilinear debayer helpers
+// Work out the interpolated values for every inside pixel of a line:
+//  horiz   = (left + right) / 2
+//  vert    = (below + above) / 2
+//  corners = (4 diagonal neighbours) / 4
+//  green   = (left + right + p_third + above) / 4
+// ------------------------------------------
+template <typename T>
+static void debayer_line_planes_scalar(
+    const T *p_below,
+    const T *p_line,
+    const T *p_above,
+    const T *p_third,
+    int32_t x,
+    int32_t width,
+    T *p_horiz,
+    T *p_vert,
+    T *p_corners,
+    T *p_green)
+{
+    for (; x < width-1; x++) {
+        p_horiz[x] = ( p_line[x-1] + p_line[x+1] ) / 2;
+        p_vert[x] = ( p_below[x] + p_above[x] ) / 2;
+        p_corners[x] = ( p_below[x-1] + p_below[x+1] + p_above[x-1] + p_above[x+1] ) / 4;
+        p_green[x] = ( p_line[x-1] + p_line[x+1] + p_third[x] + p_above[x] ) / 4;
+    }
+}
+
+
+#if defined(__SSE2__)
+// Pack 2 vectors of 32-bit values (all < 65536) to one vector of 16-bit values
+static inline __m128i pack_u32_to_u16(__m128i lo, __m128i hi)
+{
+    // SSE2 only has a signed pack, so move the values into signed range and back again
+    const __m128i bias32 = _mm_set1_epi32(0x8000);
+    const __m128i bias16 = _mm_set1_epi16((short)0x8000);
+    return _mm_xor_si128(_mm_packs_epi32(_mm_sub_epi32(lo, bias32), _mm_sub_epi32(hi, bias32)), bias16);
+}
+#endif
+
+
+#if defined(__AVX2__)
+static inline __m256i pack_u32_to_u16_avx2(__m256i lo, __m256i hi)
+{
+    const __m256i bias32 = _mm256_set1_epi32(0x8000);
+    const __m256i bias16 = _mm256_set1_epi16((short)0x8000);
+    return _mm256_xor_si256(_mm256_packs_epi32(_mm256_sub_epi32(lo, bias32), _mm256_sub_epi32(hi, bias32)), bias16);
+}
+#endif
+
+
+static void debayer_line_planes(
+    const uint8_t *p_below,
+    const uint8_t *p_line,
+    const uint8_t *p_above,
+    const uint8_t *p_third,
+    int32_t width,
+    uint8_t *p_horiz,
+    uint8_t *p_vert,
+    uint8_t *p_corners,
+    uint8_t *p_green)
+{
+    int32_t x = 1;
+
+#if defined(__AVX2__)
+    // 32 pixels at a time, widened to 16 bits for the sums
+    const __m256i zero256 = _mm256_setzero_si256();
+    for (; x + 32 < width; x += 32) {
+        __m256i l = _mm256_loadu_si256((const __m256i *)(p_line + x - 1));
+        __m256i r = _mm256_loadu_si256((const __m256i *)(p_line + x + 1));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(p_below + x));
+        __m256i bl = _mm256_loadu_si256((const __m256i *)(p_below + x - 1));
+        __m256i br = _mm256_loadu_si256((const __m256i *)(p_below + x + 1));
+        __m256i a = _mm256_loadu_si256((const __m256i *)(p_above + x));
+        __m256i al = _mm256_loadu_si256((const __m256i *)(p_above + x - 1));
+        __m256i ar = _mm256_loadu_si256((const __m256i *)(p_above + x + 1));
+        __m256i t = _mm256_loadu_si256((const __m256i *)(p_third + x));
+
+        __m256i lr_lo = _mm256_add_epi16(_mm256_unpacklo_epi8(l, zero256), _mm256_unpacklo_epi8(r, zero256));
+        __m256i lr_hi = _mm256_add_epi16(_mm256_unpackhi_epi8(l, zero256), _mm256_unpackhi_epi8(r, zero256));
+        __m256i ba_lo = _mm256_add_epi16(_mm256_unpacklo_epi8(b, zero256), _mm256_unpacklo_epi8(a, zero256));
+        __m256i ba_hi = _mm256_add_epi16(_mm256_unpackhi_epi8(b, zero256), _mm256_unpackhi_epi8(a, zero256));
+        __m256i c_lo = _mm256_add_epi16(_mm256_add_epi16(_mm256_unpacklo_epi8(bl, zero256), _mm256_unpacklo_epi8(br, zero256)),
+                                        _mm256_add_epi16(_mm256_unpacklo_epi8(al, zero256), _mm256_unpacklo_epi8(ar, zero256)));
+        __m256i c_hi = _mm256_add_epi16(_mm256_add_epi16(_mm256_unpackhi_epi8(bl, zero256), _mm256_unpackhi_epi8(br, zero256)),
+                                        _mm256_add_epi16(_mm256_unpackhi_epi8(al, zero256), _mm256_unpackhi_epi8(ar, zero256)));
+        __m256i g_lo = _mm256_add_epi16(lr_lo, _mm256_add_epi16(_mm256_unpacklo_epi8(t, zero256), _mm256_unpacklo_epi8(a, zero256)));
+        __m256i g_hi = _mm256_add_epi16(lr_hi, _mm256_add_epi16(_mm256_unpackhi_epi8(t, zero256), _mm256_unpackhi_epi8(a, zero256)));
+
+        _mm256_storeu_si256((__m256i *)(p_horiz + x), _mm256_packus_epi16(_mm256_srli_epi16(lr_lo, 1), _mm256_srli_epi16(lr_hi, 1)));
+        _mm256_storeu_si256((__m256i *)(p_vert + x), _mm256_packus_epi16(_mm256_srli_epi16(ba_lo, 1), _mm256_srli_epi16(ba_hi, 1)));
+        _mm256_storeu_si256((__m256i *)(p_corners + x), _mm256_packus_epi16(_mm256_srli_epi16(c_lo, 2), _mm256_srli_epi16(c_hi, 2)));
+        _mm256_storeu_si256((__m256i *)(p_green + x), _mm256_packus_epi16(_mm256_srli_epi16(g_lo, 2), _mm256_srli_epi16(g_hi, 2)));
+    }
+#endif
+
+#if defined(__SSE2__)
+    // 16 pixels at a time, widened to 16 bits for the sums
+    const __m128i zero = _mm_setzero_si128();
+    for (; x + 16 < width; x += 16) {
+        __m128i l = _mm_loadu_si128((const __m128i *)(p_line + x - 1));
+        __m128i r = _mm_loadu_si128((const __m128i *)(p_line + x + 1));
+        __m128i b = _mm_loadu_si128((const __m128i *)(p_below + x));
+        __m128i bl = _mm_loadu_si128((const __m128i *)(p_below + x - 1));
+        __m128i br = _mm_loadu_si128((const __m128i *)(p_below + x + 1));
+        __m128i a = _mm_loadu_si128((const __m128i *)(p_above + x));
+        __m128i al = _mm_loadu_si128((const __m128i *)(p_above + x - 1));
+        __m128i ar = _mm_loadu_si128((const __m128i *)(p_above + x + 1));
+        __m128i t = _mm_loadu_si128((const __m128i *)(p_third + x));
+
+        __m128i lr_lo = _mm_add_epi16(_mm_unpacklo_epi8(l, zero), _mm_unpacklo_epi8(r, zero));
+        __m128i lr_hi = _mm_add_epi16(_mm_unpackhi_epi8(l, zero), _mm_unpackhi_epi8(r, zero));
+        __m128i ba_lo = _mm_add_epi16(_mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(a, zero));
+        __m128i ba_hi = _mm_add_epi16(_mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(a, zero));
+        __m128i c_lo = _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(bl, zero), _mm_unpacklo_epi8(br, zero)),
+                                     _mm_add_epi16(_mm_unpacklo_epi8(al, zero), _mm_unpacklo_epi8(ar, zero)));
+        __m128i c_hi = _mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(bl, zero), _mm_unpackhi_epi8(br, zero)),
+                                     _mm_add_epi16(_mm_unpackhi_epi8(al, zero), _mm_unpackhi_epi8(ar, zero)));
+        __m128i g_lo = _mm_add_epi16(lr_lo, _mm_add_epi16(_mm_unpacklo_epi8(t, zero), _mm_unpacklo_epi8(a, zero)));
+        __m128i g_hi = _mm_add_epi16(lr_hi, _mm_add_epi16(_mm_unpackhi_epi8(t, zero), _mm_unpackhi_epi8(a, zero)));
+
+        _mm_storeu_si128((__m128i *)(p_horiz + x), _mm_packus_epi16(_mm_srli_epi16(lr_lo, 1), _mm_srli_epi16(lr_hi, 1)));
+        _mm_storeu_si128((__m128i *)(p_vert + x), _mm_packus_epi16(_mm_srli_epi16(ba_lo, 1), _mm_srli_epi16(ba_hi, 1)));
+        _mm_storeu_si128((__m128i *)(p_corners + x), _mm_packus_epi16(_mm_srli_epi16(c_lo, 2), _mm_srli_epi16(c_hi, 2)));
+        _mm_storeu_si128((__m128i *)(p_green + x), _mm_packus_epi16(_mm_srli_epi16(g_lo, 2), _mm_srli_epi16(g_hi, 2)));
+    }
+#endif
+
+    // Remaining pixels
+    debayer_line_planes_scalar <uint8_t> (p_below, p_line, p_above, p_third, x, width, p_horiz, p_vert, p_corners, p_green);
+}
+
+
+static void debayer_line_planes(
+    const uint16_t *p_below,
+    const uint16_t *p_line,
+    const uint16_t *p_above,
+    const uint16_t *p_third,
+    int32_t width,
+    uint16_t *p_horiz,
+    uint16_t *p_vert,
+    uint16_t *p_corners,
+    uint16_t *p_green)
+{
+    int32_t x = 1;
+
+#if defined(__AVX2__)
+    // 16 pixels at a time, widened to 32 bits for the sums
+    const __m256i zero256 = _mm256_setzero_si256();
+    for (; x + 16 < width; x += 16) {
+        __m256i l = _mm256_loadu_si256((const __m256i *)(p_line + x - 1));
+        __m256i r = _mm256_loadu_si256((const __m256i *)(p_line + x + 1));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(p_below + x));
+        __m256i bl = _mm256_loadu_si256((const __m256i *)(p_below + x - 1));
+        __m256i br = _mm256_loadu_si256((const __m256i *)(p_below + x + 1));
+        __m256i a = _mm256_loadu_si256((const __m256i *)(p_above + x));
+        __m256i al = _mm256_loadu_si256((const __m256i *)(p_above + x - 1));
+        __m256i ar = _mm256_loadu_si256((const __m256i *)(p_above + x + 1));
+        __m256i t = _mm256_loadu_si256((const __m256i *)(p_third + x));
+
+        __m256i lr_lo = _mm256_add_epi32(_mm256_unpacklo_epi16(l, zero256), _mm256_unpacklo_epi16(r, zero256));
+        __m256i lr_hi = _mm256_add_epi32(_mm256_unpackhi_epi16(l, zero256), _mm256_unpackhi_epi16(r, zero256));
+        __m256i ba_lo = _mm256_add_epi32(_mm256_unpacklo_epi16(b, zero256), _mm256_unpacklo_epi16(a, zero256));
+        __m256i ba_hi = _mm256_add_epi32(_mm256_unpackhi_epi16(b, zero256), _mm256_unpackhi_epi16(a, zero256));
+        __m256i c_lo = _mm256_add_epi32(_mm256_add_epi32(_mm256_unpacklo_epi16(bl, zero256), _mm256_unpacklo_epi16(br, zero256)),
+                                        _mm256_add_epi32(_mm256_unpacklo_epi16(al, zero256), _mm256_unpacklo_epi16(ar, zero256)));
+        __m256i c_hi = _mm256_add_epi32(_mm256_add_epi32(_mm256_unpackhi_epi16(bl, zero256), _mm256_unpackhi_epi16(br, zero256)),
+                                        _mm256_add_epi32(_mm256_unpackhi_epi16(al, zero256), _mm256_unpackhi_epi16(ar, zero256)));
+        __m256i g_lo = _mm256_add_epi32(lr_lo, _mm256_add_epi32(_mm256_unpacklo_epi16(t, zero256), _mm256_unpacklo_epi16(a, zero256)));
+        __m256i g_hi = _mm256_add_epi32(lr_hi, _mm256_add_epi32(_mm256_unpackhi_epi16(t, zero256), _mm256_unpackhi_epi16(a, zero256)));
+
+        _mm256_storeu_si256((__m256i *)(p_horiz + x), pack_u32_to_u16_avx2(_mm256_srli_epi32(lr_lo, 1), _mm256_srli_epi32(lr_hi, 1)));
+        _mm256_storeu_si256((__m256i *)(p_vert + x), pack_u32_to_u16_avx2(_mm256_srli_epi32(ba_lo, 1), _mm256_srli_epi32(ba_hi, 1)));
+        _mm256_storeu_si256((__m256i *)(p_corners + x), pack_u32_to_u16_avx2(_mm256_srli_epi32(c_lo, 2), _mm256_srli_epi32(c_hi, 2)));
+        _mm256_storeu_si256((__m256i *)(p_green + x), pack_u32_to_u16_avx2(_mm256_srli_epi32(g_lo, 2), _mm256_srli_epi32(g_hi, 2)));
+    }
+#endif
+
+#if defined(__SSE2__)
+    // 8 pixels at a time, widened to 32 bits for the sums
+    const __m128i zero = _mm_setzero_si128();
+    for (; x + 8 < width; x += 8) {
+        __m128i l = _mm_loadu_si128((const __m128i *)(p_line + x - 1));
+        __m128i r = _mm_loadu_si128((const __m128i *)(p_line + x + 1));
+        __m128i b = _mm_loadu_si128((const __m128i *)(p_below + x));
+        __m128i bl = _mm_loadu_si128((const __m128i *)(p_below + x - 1));
+        __m128i br = _mm_loadu_si128((const __m128i *)(p_below + x + 1));
+        __m128i a = _mm_loadu_si128((const __m128i *)(p_above + x));
+        __m128i al = _mm_loadu_si128((const __m128i *)(p_above + x - 1));
+        __m128i ar = _mm_loadu_si128((const __m128i *)(p_above + x + 1));
+        __m128i t = _mm_loadu_si128((const __m128i *)(p_third + x));
+
+        __m128i lr_lo = _mm_add_epi32(_mm_unpacklo_epi16(l, zero), _mm_unpacklo_epi16(r, zero));
+        __m128i lr_hi = _mm_add_epi32(_mm_unpackhi_epi16(l, zero), _mm_unpackhi_epi16(r, zero));
+        __m128i ba_lo = _mm_add_epi32(_mm_unpacklo_epi16(b, zero), _mm_unpacklo_epi16(a, zero));
+        __m128i ba_hi = _mm_add_epi32(_mm_unpackhi_epi16(b, zero), _mm_unpackhi_epi16(a, zero));
+        __m128i c_lo = _mm_add_epi32(_mm_add_epi32(_mm_unpacklo_epi16(bl, zero), _mm_unpacklo_epi16(br, zero)),
+                                     _mm_add_epi32(_mm_unpacklo_epi16(al, zero), _mm_unpacklo_epi16(ar, zero)));
+        __m128i c_hi = _mm_add_epi32(_mm_add_epi32(_mm_unpackhi_epi16(bl, zero), _mm_unpackhi_epi16(br, zero)),
+                                     _mm_add_epi32(_mm_unpackhi_epi16(al, zero), _mm_unpackhi_epi16(ar, zero)));
+        __m128i g_lo = _mm_add_epi32(lr_lo, _mm_add_epi32(_mm_unpacklo_epi16(t, zero), _mm_unpacklo_epi16(a, zero)));
+        __m128i g_hi = _mm_add_epi32(lr_hi, _mm_add_epi32(_mm_unpackhi_epi16(t, zero), _mm_unpackhi_epi16(a, zero)));
+
+        _mm_storeu_si128((__m128i *)(p_horiz + x), pack_u32_to_u16(_mm_srli_epi32(lr_lo, 1), _mm_srli_epi32(lr_hi, 1)));
+        _mm_storeu_si128((__m128i *)(p_vert + x), pack_u32_to_u16(_mm_srli_epi32(ba_lo, 1), _mm_srli_epi32(ba_hi, 1)));
+        _mm_storeu_si128((__m128i *)(p_corners + x), pack_u32_to_u16(_mm_srli_epi32(c_lo, 2), _mm_srli_epi32(c_hi, 2)));
+        _mm_storeu_si128((__m128i *)(p_green + x), pack_u32_to_u16(_mm_srli_epi32(g_lo, 2), _mm_srli_epi32(g_hi, 2)));
+    }
+#endif
+
+    // Remaining pixels
+    debayer_line_planes_scalar <uint16_t> (p_below, p_line, p_above, p_third, x, width, p_horiz, p_vert, p_corners, p_green);
 }
 
 
@@ -1387,8 +1782,8 @@ void c_image::debayer_pixel_bilinear(
     T *raw_data,
     T *rgb_data)
 {
-    T *raw_data_ptr = ((T *)raw_data) + (y * m_width + x);
-    T *rgb_data_ptr = ((T *)rgb_data) + ((y * m_width + x) * 3);
+    T *raw_data_ptr = ((T *)raw_data) + ((int64_t)y * m_width + x);
+    T *rgb_data_ptr = ((T *)rgb_data) + (((int64_t)y * m_width + x) * 3);
 
     uint32_t count;
     uint32_t total;
@@ -1671,14 +2066,13 @@ bool c_image::debayer_image_bilinear_int(int32_t colour_id)
     }
 
     int32_t x, y;
-    T *raw_data_ptr;
     T *rgb_data_ptr1;
 
     uint32_t bayer_x = bayer_code % 2;
     uint32_t bayer_y = ((bayer_code/2) % 2) ^ (m_height % 2);
 
     // Buffer to create RGB image in
-    T *rgb_data = (T *)new uint8_t[3 * m_width * m_height * m_byte_depth];
+    T *rgb_data = (T *)new uint8_t[(size_t)3 * m_width * m_height * m_byte_depth];
 
     // Debayer bottom line
     y = 0;
@@ -1708,70 +2102,73 @@ bool c_image::debayer_image_bilinear_int(int32_t colour_id)
         debayer_pixel_bilinear <T> (bayer, x, y, (T *)mp_buffer, rgb_data);
     }
 
-    // Debayer to create blue, green and red data
-    rgb_data_ptr1 = rgb_data + (3 * (m_width + 1));
-    raw_data_ptr = ((T *)mp_buffer) + (m_width + 1);
+    // Debayer the inside of the image a line at a time.  The interpolated values for the
+    // whole line are worked out first with SIMD instructions and then picked out per pixel
+    if (m_width > 2) {
+        std::unique_ptr<T[]> p_planes(new T[4 * m_width]);
+        T *p_horiz = p_planes.get();  // Average of left and right pixels
+        T *p_vert = p_horiz + m_width;  // Average of above and below pixels
+        T *p_corners = p_vert + m_width;  // Average of 4 corners
+        T *p_green = p_corners + m_width;  // Green from 4 nearest neighbours
+
+        for (y = 1; y < (m_height-1); y++) {
+            T *p_line = ((T *)mp_buffer) + (int64_t)y * m_width;
+            T *p_line_below = p_line - m_width;
+            T *p_line_above = p_line + m_width;
+            bool blue_red_line = ((y + bayer_y) % 2) == 0;
+
+            // Note: the green value for the default bayer position uses the line above twice
+            debayer_line_planes(
+                p_line_below,
+                p_line,
+                p_line_above,
+                (blue_red_line) ? p_line_below : p_line_above,
+                m_width,
+                p_horiz,
+                p_vert,
+                p_corners,
+                p_green);
+
+            // Blue, green and red sources for even and odd pixels on this line
+            const T *p_even_b, *p_even_g, *p_even_r;
+            const T *p_odd_b, *p_odd_g, *p_odd_r;
+            if (blue_red_line) {
+                // Bayer positions 0 and 1
+                p_even_b = p_corners; p_even_g = p_green; p_even_r = p_line;
+                p_odd_b = p_vert; p_odd_g = p_line; p_odd_r = p_horiz;
+            } else {
+                // Bayer positions 2 and 3
+                p_even_b = p_horiz; p_even_g = p_line; p_even_r = p_vert;
+                p_odd_b = p_line; p_odd_g = p_green; p_odd_r = p_corners;
+            }
+
+            rgb_data_ptr1 = rgb_data + 3 * ((int64_t)y * m_width + 1);
+            x = 1;
+            if ((x + bayer_x) % 2 != 0) {
+                // First pixel is an odd one
+                *rgb_data_ptr1++ = p_odd_b[x];
+                *rgb_data_ptr1++ = p_odd_g[x];
+                *rgb_data_ptr1++ = p_odd_r[x];
+                x++;
+            }
 
-    for (y = 1; y < (m_height-1); y++) {
-        for (x = 1; x < (m_width-1); x++) {
-            uint32_t bayer = ((x + bayer_x) % 2) + (2 * ((y + bayer_y) % 2));
-            // Blue channel
-            switch (bayer) {
-                case 0:
-                    // Blue - Average of 4 corners;
-                    *rgb_data_ptr1++ = ( *(raw_data_ptr-m_width-1) + *(raw_data_ptr-m_width+1) +
-                                         *(raw_data_ptr+m_width-1) + *(raw_data_ptr+m_width+1) ) / 4;
-
-                    // Green - Return average of 4 nearest neighbours
-                    *rgb_data_ptr1++ = ( *(raw_data_ptr-1) + *(raw_data_ptr+1) +
-                                         *(raw_data_ptr+m_width) + *(raw_data_ptr-m_width) ) /4;
-
-                    // Red - Simple case just return data at this position
-                    *rgb_data_ptr1++ = *raw_data_ptr++;
-                    break;
-
-                case 1:
-                    // Blue - Average of above and below pixels
-                    *rgb_data_ptr1++ = ( *(raw_data_ptr-m_width) + *(raw_data_ptr+m_width) ) / 2;
-
-                    // Green - just this position
-                    *rgb_data_ptr1++ = *raw_data_ptr;
-
-                    // Red - Average of left and right pixels
-                    *rgb_data_ptr1++ = ( *(raw_data_ptr-1) + *(raw_data_ptr+1) ) / 2;
-                    raw_data_ptr++;
-                    break;
-
-                case 2:
-                    // Blue - Average of left and right pixels
-                    *rgb_data_ptr1++ = ( *(raw_data_ptr-1) + *(raw_data_ptr+1) ) / 2;
-
-                    // Green - just this position
-                    *rgb_data_ptr1++ = *raw_data_ptr;
-
-                    // Red - Average of above and below pixels
-                    *rgb_data_ptr1++ = ( *(raw_data_ptr-m_width) + *(raw_data_ptr+m_width) ) / 2;
-                    raw_data_ptr++;
-                    break;
-
-                default:
-                    // Blue - Simple case just return data at this position
-                    *rgb_data_ptr1++ = *raw_data_ptr;
-
-                    // Green - Return average of 4 nearest neighbours
-                    *rgb_data_ptr1++ = ( *(raw_data_ptr-1) + *(raw_data_ptr+1) +
-                                         *(raw_data_ptr+m_width) + *(raw_data_ptr+m_width) ) /4;
-
-                    // Red - Average of 4 corners;
-                    *rgb_data_ptr1++ = ( *(raw_data_ptr-m_width-1) + *(raw_data_ptr-m_width+1) +
-                                         *(raw_data_ptr+m_width-1) + *(raw_data_ptr+m_width+1) ) / 4;
-                    raw_data_ptr++;
-                    break;
+            // Even and odd pairs of pixels
+            for (; x < m_width-2; x += 2) {
+                *rgb_data_ptr1++ = p_even_b[x];
+                *rgb_data_ptr1++ = p_even_g[x];
+                *rgb_data_ptr1++ = p_even_r[x];
+                *rgb_data_ptr1++ = p_odd_b[x+1];
+                *rgb_data_ptr1++ = p_odd_g[x+1];
+                *rgb_data_ptr1++ = p_odd_r[x+1];
             }
-        }
 
-        rgb_data_ptr1 += 6;
-        raw_data_ptr += 2;
+            if (x < m_width-1) {
+                // Last pixel is an even one
+                *rgb_data_ptr1++ = p_even_b[x];
+                *rgb_data_ptr1++ = p_even_g[x];
+                *rgb_data_ptr1++ = p_even_r[x];
+            }
+        }
     }
 
     if (colour_id == COLOURID_BAYER_CYYM ||
@@ -1807,7 +2204,7 @@ bool c_image::debayer_image_bilinear_int(int32_t colour_id)
 // Private functions below here
 //
 
-void c_image::set_buffer_size(int32_t size)
+void c_image::set_buffer_size(size_t size)
 {
     if (size > m_buffer_size) {
         delete [] mp_buffer;
@@ -1817,7 +2214,7 @@ void c_image::set_buffer_size(int32_t size)
 }
 
 
-void c_image::set_new_buffer(uint8_t *p_buffer, int32_t size)
+void c_image::set_new_buffer(uint8_t *p_buffer, size_t size)
 {
     delete [] mp_buffer;
     mp_buffer = p_buffer;
@@ -34,7 +34,7 @@ class c_image
         int32_t m_colour_id;
         bool m_colour;
         uint8_t *mp_buffer;
-        int32_t m_buffer_size;
+        size_t m_buffer_size;
         uint8_t m_mono_lut[256];
         uint8_t m_red_lut[256];
         uint8_t m_green_lut[256];
@@ -99,6 +99,13 @@ class c_image
                                int32_t byte_depth,
                                int32_t colour_id,
                                bool colour);
+
+        // Copy the size, format and frame data of another image, but not its processing settings
+        void copy_image_data(const c_image &source);
+
+        // Fill the image from frame data that has its top line first, such as a SER frame view.
+        // The image details must already be set, 16-bit data is reduced to 8 bits on the way if conv_to_8_bit is set
+        void copy_top_down_data(const uint8_t *p_data, bool conv_to_8_bit);
                       
 
         int32_t get_width()
@@ -172,6 +179,10 @@ class c_image
             int blue_align_y);
 
 
+        void copy_processing_settings(
+            const c_image &source);
+
+
         void do_lut_based_processing();
 
 
@@ -196,14 +207,26 @@ class c_image
 
         void conv_data_ready_for_qimage();
 
+        bool process_and_conv_data_ready_for_qimage(
+                bool crop_enable,
+                int crop_x_pos,
+                int crop_y_pos,
+                int crop_width,
+                int crop_height,
+                int monochrome_conversion_type,  // -1 for no monochrome conversion
+                double saturation);
+
         void conv_data_ready_for_gif();
         
         
     private:
-        void set_buffer_size(int32_t size);
-        void set_new_buffer(uint8_t *p_buffer, int32_t size);
+        void set_buffer_size(size_t size);
+        void set_new_buffer(uint8_t *p_buffer, size_t size);
         void setup_luts();
 
+        template <typename T>
+        void monochrome_conversion_int(int conv_type);
+
         template <typename T>
         void change_colour_saturation_int(
             double saturation);
@@ -22,6 +22,9 @@
 #include <QDebug>
 #include <QPainter>
 #include <QPaintEvent>
+#include <QtConcurrent>
+#include <algorithm>
+#include <cstring>
 
 namespace {
     enum e_drag_handles {
@@ -42,6 +45,10 @@ namespace {
 
 c_image_Widget::c_image_Widget(QWidget *parent) :
     QWidget(parent),
+    m_front_upload_buffer(0),
+    m_back_upload_buffer_pending(false),
+    m_scale_running(false),
+    m_scaled_Pixmap_valid(false),
     m_zoom_level(100),
     m_scale_factor(1.0),
     m_active_drag_handle(m_drag_handle_bottom_right)
@@ -73,6 +80,14 @@ c_image_Widget::c_image_Widget(QWidget *parent) :
     connect(mp_selection_box_dialog, SIGNAL(selection_box_changed(QRect)), this, SLOT(set_selection_slot(QRect)));
     connect(mp_selection_box_dialog, SIGNAL(selection_box_complete(bool,QRect)), this, SIGNAL(selection_box_complete_signal(bool,QRect)));
     connect(mp_selection_box_dialog, SIGNAL(update_request_signal()), this, SLOT(update()));
+    connect(this, SIGNAL(scale_done_signal()), this, SLOT(scale_done_slot()), Qt::QueuedConnection);
+}
+
+
+c_image_Widget::~c_image_Widget()
+{
+    // The scaling thread writes to this object
+    m_scale_thread.waitForFinished();
 }
 
 
@@ -211,14 +226,14 @@ void c_image_Widget::mouseMoveEvent(QMouseEvent *p_event)
                 m_selected_area_bottom_right += correction;
             }
 
-            int max_x = (m_image_Pixmap.width() - 1);
+            int max_x = (m_image_size.width() - 1);
             if (m_selected_area_bottom_right.x() > max_x) {
                 QPoint correction = QPoint(max_x - m_selected_area_bottom_right.x(), 0);
                 m_selected_area_top_left += correction;
                 m_selected_area_bottom_right += correction;
             }
 
-            int max_y = (m_image_Pixmap.height() - 1);
+            int max_y = (m_image_size.height() - 1);
             if (m_selected_area_bottom_right.y() > max_y) {
                 QPoint correction = QPoint(0, max_y - m_selected_area_bottom_right.y());
                 m_selected_area_top_left += correction;
@@ -234,12 +249,12 @@ void c_image_Widget::mouseMoveEvent(QMouseEvent *p_event)
                 m_selected_area_top_left.setY(0);
             }
 
-            int max_x = (qreal)(m_image_Pixmap.width() - 1);
+            int max_x = (qreal)(m_image_size.width() - 1);
             if (m_selected_area_bottom_right.x() > max_x) {
                 m_selected_area_bottom_right.setX(max_x);
             }
 
-            int max_y = (qreal)(m_image_Pixmap.height() - 1);
+            int max_y = (qreal)(m_image_size.height() - 1);
             if (m_selected_area_bottom_right.y() > max_y) {
                 m_selected_area_bottom_right.setY(max_y);
             }
@@ -301,29 +316,51 @@ void c_image_Widget::paintEvent(QPaintEvent *p_event)
     QWidget::paintEvent(p_event);
 
     // Early return
-    if (m_image_Pixmap.isNull()) {
+    const QImage &frame_Image = m_upload_Image[m_front_upload_buffer];
+    if (frame_Image.isNull()) {
         return;
     }
 
     QPainter painter(this);
     painter.setRenderHint(QPainter::Antialiasing);
 
-    QSize pixSize = m_image_Pixmap.size();
-    pixSize.scale(p_event->rect().size(), Qt::KeepAspectRatio);
+    QSize pixSize = get_display_size();
 
-//    m_zoom_level = (pixSize.width() * 100) / m_image_Pixmap.size().width();
+//    m_zoom_level = (pixSize.width() * 100) / m_image_size.width();
 
-    QPixmap scaled_Pixmap = m_image_Pixmap.scaled(pixSize,
-                                     Qt::KeepAspectRatio,
-                                     Qt::SmoothTransformation);
+    // A frame of a new size that is waiting for the scaling thread is drawn when that finishes
+    if ((!m_scaled_Pixmap_valid || m_scaled_Pixmap.size() != pixSize) && frame_Image.size() == m_image_size) {
+        // The display size has changed or no scaled frame is available yet, scale the current frame now
+        if (pixSize == frame_Image.size()) {
+            m_scaled_Pixmap = QPixmap::fromImage(frame_Image);
+        } else {
+            m_scaled_Pixmap = QPixmap::fromImage(frame_Image.scaled(pixSize,
+                                                                    Qt::KeepAspectRatio,
+                                                                    Qt::SmoothTransformation));
+        }
+
+        m_scaled_Pixmap_valid = true;
+    }
+
+    // The cached pixmap is shared, drawing the selection rectangle on it makes a copy
+    QPixmap scaled_Pixmap = m_scaled_Pixmap;
+    if (scaled_Pixmap.isNull()) {
+        return;
+    }
+
+    if (scaled_Pixmap.size() != pixSize) {
+        // Until the frame of the new size has been scaled, keep showing the previous frame
+        // stretched to the new display size rather than an empty widget
+        scaled_Pixmap = scaled_Pixmap.scaled(pixSize, Qt::IgnoreAspectRatio, Qt::FastTransformation);
+    }
 
     if (mp_selection_box_dialog->isVisible()) {
         draw_selection_rectangle(scaled_Pixmap);
     }
 
     // Calculate position to draw image in middle of widget
-    int x = (p_event->rect().size().width() - scaled_Pixmap.size().width()) / 2;
-    int y = (p_event->rect().size().height() - scaled_Pixmap.size().height()) / 2;
+    int x = (rect().size().width() - scaled_Pixmap.size().width()) / 2;
+    int y = (rect().size().height() - scaled_Pixmap.size().height()) / 2;
     m_sel_top_left_Rect.translate(x, y);
     m_sel_top_right_Rect.translate(x, y);
     m_sel_bottom_left_Rect.translate(x, y);
@@ -341,9 +378,9 @@ void c_image_Widget::paintEvent(QPaintEvent *p_event)
 void c_image_Widget::draw_selection_rectangle(QPixmap &pixmap)
 {
     int x_scale_num = pixmap.width()-1;
-    int x_scale_denum = m_image_Pixmap.size().width()-1;
+    int x_scale_denum = m_image_size.width()-1;
     int y_scale_num = pixmap.height()-1;
-    int y_scale_denum = m_image_Pixmap.size().height()-1;
+    int y_scale_denum = m_image_size.height()-1;
 
     if (y_scale_num > x_scale_num) {
         m_scale_factor = qreal(y_scale_num) / y_scale_denum;
@@ -405,12 +442,6 @@ void c_image_Widget::draw_selection_rectangle(QPixmap &pixmap)
 }
 
 
-const QPixmap* c_image_Widget::pixmap() const
-{
-    return &m_image_Pixmap;
-}
-
-
 QSize c_image_Widget::minimumSizeHint() const
 {
     return QSize(100, 100);
@@ -419,7 +450,7 @@ QSize c_image_Widget::minimumSizeHint() const
 
 QSize c_image_Widget::sizeHint() const
 {
-    if (m_image_Pixmap.isNull()) {
+    if (m_upload_Image[m_front_upload_buffer].isNull()) {
         return QSize(100, 100);
     } else {
         // To do
@@ -444,7 +475,7 @@ void c_image_Widget::resizeEvent(QResizeEvent *e)
 
     m_current_Size = QSize(w, h);
     updateGeometry();
-    int zoom_level = (w * 100) / m_image_Pixmap.size().width();
+    int zoom_level = (w * 100) / m_image_size.width();
     if (zoom_level != m_zoom_level) {
         m_zoom_level = zoom_level;
         emit zoom_changed_signal(zoom_level);
@@ -454,23 +485,115 @@ void c_image_Widget::resizeEvent(QResizeEvent *e)
 
 int c_image_Widget::heightForWidth(int width) const
 {
-    int height = ((qreal)m_image_Pixmap.height()*width)/m_image_Pixmap.width();
+    int height = ((qreal)m_image_size.height()*width)/m_image_size.width();
     return height;
 }
 
 
 int c_image_Widget::widthForHeight(int height) const
 {
-    int width = ((qreal)m_image_Pixmap.width()*height)/m_image_Pixmap.height();
+    int width = ((qreal)m_image_size.width()*height)/m_image_size.height();
     return width;
 }
 
 
 void c_image_Widget::setPixmap (const QPixmap &pixmap){
-    m_image_Pixmap = pixmap;
-    m_image_size = pixmap.size();
-    //m_current_Size = pixmap.size();
-    updateGeometry();
-    repaint();
+    set_frame_image(pixmap.toImage());
+}
+
+
+void c_image_Widget::set_frame_image(const QImage &frame_image)
+{
+    // Copy the frame into the back buffer if the scaling thread is using the front buffer.
+    // A frame that is already waiting in the back buffer is replaced by this newer one.
+    int upload_buffer = (m_scale_running) ? 1 - m_front_upload_buffer : m_front_upload_buffer;
+    QImage &upload_Image = m_upload_Image[upload_buffer];
+    if (upload_Image.size() != frame_image.size()) {
+        // Upload buffers are only reallocated when the frame size changes
+        upload_Image = QImage(frame_image.size(), QImage::Format_RGB888);
+    }
+
+    const QImage rgb_image = (frame_image.format() == QImage::Format_RGB888) ?
+                                frame_image : frame_image.convertToFormat(QImage::Format_RGB888);
+    int line_length = std::min(rgb_image.bytesPerLine(), upload_Image.bytesPerLine());
+    for (int y = 0; y < rgb_image.height(); y++) {
+        memcpy(upload_Image.scanLine(y), rgb_image.constScanLine(y), line_length);
+    }
+
+    if (m_image_size != frame_image.size()) {
+        // The cached pixmap is for a different frame size
+        m_image_size = frame_image.size();
+        m_scaled_Pixmap_valid = false;
+        //m_current_Size = frame_image.size();
+        updateGeometry();
+    }
+
+    if (m_scale_running) {
+        m_back_upload_buffer_pending = true;
+    } else {
+        front_upload_buffer_changed();
+    }
+}
+
+
+void c_image_Widget::front_upload_buffer_changed()
+{
+    QSize display_size = get_display_size();
+    if (display_size.isEmpty()) {
+        // Not displayed yet, the frame is scaled when it is first painted
+        m_scaled_Pixmap_valid = false;
+        update();
+    } else {
+        // Scale the frame on a worker thread, the previous frame stays on display until it is done
+        m_scale_running = true;
+        m_scale_thread_size = display_size;
+        m_scale_thread = QtConcurrent::run(this, &c_image_Widget::scale_frame);
+    }
+}
+
+
+void c_image_Widget::scale_frame()
+{
+    // Runs on a worker thread, the front upload buffer is not written to until scale_done_slot()
+    const QImage &frame_Image = m_upload_Image[m_front_upload_buffer];
+    if (m_scale_thread_size == frame_Image.size()) {
+        m_scale_thread_Image = frame_Image.convertToFormat(QImage::Format_RGB32);
+    } else {
+        m_scale_thread_Image = frame_Image.scaled(m_scale_thread_size,
+                                                  Qt::KeepAspectRatio,
+                                                  Qt::SmoothTransformation).convertToFormat(QImage::Format_RGB32);
+    }
+
+    emit scale_done_signal();
 }
 
+
+void c_image_Widget::scale_done_slot()
+{
+    m_scale_running = false;
+
+    // Ignore the result if the widget has been resized while the frame was being scaled
+    if (m_scale_thread_size == get_display_size()) {
+        m_scaled_Pixmap = QPixmap::fromImage(m_scale_thread_Image);
+        m_scaled_Pixmap_valid = true;
+    }
+
+    m_scale_thread_Image = QImage();
+
+    if (m_back_upload_buffer_pending) {
+        // Start scaling the latest frame
+        m_back_upload_buffer_pending = false;
+        m_front_upload_buffer = 1 - m_front_upload_buffer;
+        front_upload_buffer_changed();
+    }
+
+    update();
+}
+
+
+QSize c_image_Widget::get_display_size() const
+{
+    QSize display_size = m_image_size;
+    display_size.scale(rect().size(), Qt::KeepAspectRatio);
+    return display_size;
+}
@@ -19,6 +19,9 @@
 #ifndef IMAGE_WIDGET_H
 #define IMAGE_WIDGET_H
 
+#include <QFuture>
+#include <QImage>
+#include <QPixmap>
 #include <QWidget>
 
 // Forward declarations
@@ -31,7 +34,7 @@ class c_image_Widget : public QWidget
 
 public:
     explicit c_image_Widget(QWidget *parent = 0);
-    const QPixmap* pixmap() const;
+    ~c_image_Widget();
     int get_zoom_level();
     QSize get_image_size();
     void disable_area_selection();
@@ -40,9 +43,11 @@ signals:
     void double_click_signal();
     void selection_box_complete_signal(bool accepted, QRect selection_rect);
     void zoom_changed_signal(int zoom);
+    void scale_done_signal();
 
 public slots:
     void setPixmap(const QPixmap&);
+    void set_frame_image(const QImage &frame_image);
     void enable_area_selection_slot(const QSize &frame_size, const QRect &selected_area);
     void set_selection_slot(QRect selection);
     void cancel_area_selection_slot();
@@ -59,11 +64,31 @@ protected:
     void mouseReleaseEvent(QMouseEvent *p_event);
     void mouseDoubleClickEvent(QMouseEvent *p_event);
 
+private slots:
+    void scale_done_slot();
+
 private:
     void draw_selection_rectangle(QPixmap &pixmap);
+    void front_upload_buffer_changed();
+    void scale_frame();
+    QSize get_display_size() const;
 
     c_selection_box_dialog *mp_selection_box_dialog;
-    QPixmap m_image_Pixmap;
+
+    // Frames are copied into two preallocated upload buffers.  The front buffer is scaled to the
+    // display size by a worker thread while the next frame is copied into the back buffer.
+    QImage m_upload_Image[2];
+    int m_front_upload_buffer;
+    bool m_back_upload_buffer_pending;
+    bool m_scale_running;
+    QFuture<void> m_scale_thread;
+    QSize m_scale_thread_size;
+    QImage m_scale_thread_Image;
+
+    // The current frame scaled to the display size, only rescaled when the frame or the size changes
+    QPixmap m_scaled_Pixmap;
+    bool m_scaled_Pixmap_valid;
+
     QSize m_image_size;
     QSize m_current_Size;
     int m_zoom_level;
@@ -18,6 +18,7 @@
 
 #include "lzw_compressor.h"
 #include <QDebug>
+#include <cstring>  // memset()
 
 #define LOSSY_LZW_SUPPORT 1
 
@@ -25,7 +26,34 @@
 // ------------------------------------------
 // Constructor
 // ------------------------------------------
-c_lzw_compressor::c_lzw_compressor(
+c_lzw_compressor::c_lzw_compressor() :
+    m_width(0),
+    m_height(0),
+    m_x_start(0),
+    m_x_end(0),
+    m_y_start(0),
+    m_y_end(0),
+    m_bit_depth(0),
+    mp_image_data(nullptr),
+    m_lossy_compression_level(0),
+    mp_index_to_index_colour_difference_lut(nullptr),
+    m_transparent_index(0),
+    m_dictionary_generation(0)
+{
+    // Create the LZW dictonary tree, all entries start as generation 0
+    mp_lzw_tree.reset(new s_lzw_tree());
+
+    // Buffer for compressed data
+    mp_compressed_data_buffer.reset(new uint8_t[262]);
+}
+
+
+c_lzw_compressor::~c_lzw_compressor()
+{
+}
+
+
+void c_lzw_compressor::set_image(
         uint16_t width,
         uint16_t height,
         uint16_t x_start,
@@ -33,19 +61,20 @@ c_lzw_compressor::c_lzw_compressor(
         uint16_t y_start,
         uint16_t y_end,
         uint8_t bit_depth,
-        uint8_t *p_image_data) :
-    m_width(width),
-    m_height(height),
-    m_x_start(x_start),
-    m_x_end(x_end),
-    m_y_start(y_start),
-    m_y_end(y_end),
-    m_bit_depth(bit_depth),
-    mp_image_data(p_image_data),
-    m_lossy_compression_level(0),
-    mp_index_to_index_colour_difference_lut(nullptr),
-    m_transparent_index(0)
+        uint8_t *p_image_data)
 {
+    m_width = width;
+    m_height = height;
+    m_x_start = x_start;
+    m_x_end = x_end;
+    m_y_start = y_start;
+    m_y_end = y_end;
+    m_bit_depth = bit_depth;
+    mp_image_data = p_image_data;
+    m_lossy_compression_level = 0;
+    mp_index_to_index_colour_difference_lut = nullptr;
+    m_transparent_index = 0;
+
     // Special codes
     m_clear_code = 1 << m_bit_depth;
     m_end_of_information_code = m_clear_code + 1;
@@ -54,8 +83,8 @@ c_lzw_compressor::c_lzw_compressor(
     m_code_length = m_bit_depth + 1;  // Current length of codes in bits
     m_current_code = 0xFFFF;
 
-    // Create a new LZW dictonary tree
-    mp_lzw_tree.reset(new s_lzw_tree());
+    // Start with an empty LZW dictonary tree
+    clear_dictionary();
 
     // Reset input position variables
     m_input_x = m_x_start;
@@ -63,14 +92,6 @@ c_lzw_compressor::c_lzw_compressor(
 
     // Reset output byte and bit
     m_output_bit = 8;
-
-    // Buffer for compressed data
-    mp_compressed_data_buffer.reset(new uint8_t[262]);
-}
-
-
-c_lzw_compressor::~c_lzw_compressor()
-{
 }
 
 
@@ -116,7 +137,7 @@ bool c_lzw_compressor::compress_data()
 #ifdef LOSSY_LZW_SUPPORT
         // Lossy LZW experimental code - start
         if (/*mp_index_lut != nullptr && */  next_code != m_transparent_index) {
-            if (m_current_code != 0xFFFF && mp_lzw_tree->m_current[m_current_code].m_next[next_code] == 0) {
+            if (m_current_code != 0xFFFF && get_dictionary_code(m_current_code, next_code) == 0) {
                 // Lossy compression code
                 bool match_found = false;
                 for (int compress_level = 1; compress_level <= (m_lossy_compression_level); compress_level++) {
@@ -124,7 +145,7 @@ bool c_lzw_compressor::compress_data()
                     for (int compare_index = 0; compare_index < (1 << m_bit_depth); compare_index++) {
                         uint8_t colour_diff = mp_index_to_index_colour_difference_lut[index | compare_index];
                         if (colour_diff == compress_level) {
-                            if (mp_lzw_tree->m_current[m_current_code].m_next[compare_index] != 0) {
+                            if (get_dictionary_code(m_current_code, compare_index) != 0) {
                                 next_code = compare_index;
                                 *(p_data_ptr) = next_code;
                                 match_found = true;
@@ -146,15 +167,15 @@ bool c_lzw_compressor::compress_data()
             // First pixel - do nothing but save next_code as current_code
             m_current_code = next_code;
             output_code_to_buffer(m_clear_code, m_code_length, mp_compressed_data_buffer.get());
-        } else if (mp_lzw_tree->m_current[m_current_code].m_next[next_code] != 0) {
+        } else if (get_dictionary_code(m_current_code, next_code) != 0) {
             // Current run is already in the dictionary tree
-            m_current_code = mp_lzw_tree->m_current[m_current_code].m_next[next_code];
+            m_current_code = get_dictionary_code(m_current_code, next_code);
         } else { // Finish current run
             // Write current code out
             output_code_to_buffer(m_current_code, m_code_length, mp_compressed_data_buffer.get());
 
             // Add new run into the dictionary tree
-            mp_lzw_tree->m_current[m_current_code].m_next[next_code] = m_next_free_code;
+            set_dictionary_code(m_current_code, next_code, m_next_free_code);
 
             if(m_next_free_code >= (1ul << m_code_length))
             {
@@ -168,7 +189,7 @@ bool c_lzw_compressor::compress_data()
             {
                 // Dictionary full, delete it and start again
                 output_code_to_buffer(m_clear_code, m_code_length, mp_compressed_data_buffer.get());
-                mp_lzw_tree.reset(new s_lzw_tree());
+                clear_dictionary();
                 m_code_length = m_bit_depth + 1;
                 m_next_free_code = m_clear_code + 2;
             }
@@ -206,6 +227,20 @@ bool c_lzw_compressor::compress_data()
 }
 
 
+// ------------------------------------------
+// Clear the dictionary by moving on to the next generation
+// ------------------------------------------
+void c_lzw_compressor::clear_dictionary()
+{
+    m_dictionary_generation++;
+    if (m_dictionary_generation >= (1 << 20)) {
+        // Generation count has wrapped, this time the entries really do need to be cleared
+        memset(mp_lzw_tree.get(), 0, sizeof(s_lzw_tree));
+        m_dictionary_generation = 1;
+    }
+}
+
+
 // ------------------------------------------
 // Output code to output buffer
 // ------------------------------------------
@@ -26,8 +26,21 @@ class c_lzw_compressor {
     public:
         // ------------------------------------------
         // Constructor
+        // The dictionary is allocated once and reused for every image compressed
         // ------------------------------------------
-        c_lzw_compressor(
+        c_lzw_compressor();
+
+
+        // ------------------------------------------
+        // Destructor
+        // ------------------------------------------
+        ~c_lzw_compressor();
+
+
+        // ------------------------------------------
+        // Set the image to compress and reset the compressor ready to compress it
+        // ------------------------------------------
+        void set_image(
                 uint16_t width,
                 uint16_t height,
                 uint16_t x_start,
@@ -38,12 +51,6 @@ class c_lzw_compressor {
                 uint8_t *p_image_data);
 
 
-        // ------------------------------------------
-        // Destructor
-        // ------------------------------------------
-        ~c_lzw_compressor();
-
-
         // ------------------------------------------
         // Set lossy compression details
         // ------------------------------------------
@@ -80,6 +87,30 @@ class c_lzw_compressor {
                 uint32_t code_length,
                 uint8_t *p_output_buffer);
 
+        // ------------------------------------------
+        // Dictionary access
+        // Each entry holds a code in its bottom 12 bits and the generation it was written in
+        // above that.  Entries from older generations read as empty, so clearing the
+        // dictionary is just a case of moving on to the next generation.
+        // ------------------------------------------
+        uint32_t get_dictionary_code(
+                uint32_t current_code,
+                uint32_t next_code)
+        {
+            uint32_t entry = mp_lzw_tree->m_current[current_code].m_next[next_code];
+            return ((entry >> 12) == m_dictionary_generation) ? (entry & 0xFFF) : 0;
+        }
+
+        void set_dictionary_code(
+                uint32_t current_code,
+                uint32_t next_code,
+                uint32_t code)
+        {
+            mp_lzw_tree->m_current[current_code].m_next[next_code] = (m_dictionary_generation << 12) | code;
+        }
+
+        void clear_dictionary();
+
         //
         // Private structures
         //
@@ -87,7 +118,7 @@ class c_lzw_compressor {
         // LZW dictionary
         struct s_lzw_node
         {
-            uint16_t m_next[256];
+            uint32_t m_next[256];
         };
 
         struct s_lzw_tree
@@ -120,6 +151,7 @@ class c_lzw_compressor {
 
         // LZW dictonary tree
         std::unique_ptr<s_lzw_tree> mp_lzw_tree;
+        uint32_t m_dictionary_generation;
 
         int m_input_x;
         int m_input_y;
@@ -23,6 +23,16 @@
 #include "neuquant.h"
 
 
+/* The network state is per thread so that several GIF frames can be
+   quantised at the same time
+   --------------------------------------------------------------------- */
+#if defined(_MSC_VER)
+    #define NQ_THREAD_LOCAL __declspec(thread)
+#else
+    #define NQ_THREAD_LOCAL __thread
+#endif
+
+
 /* Network Definitions
    ------------------- */
 
@@ -47,7 +57,7 @@
 /* defs for decreasing alpha factor */
 #define alphabiasshift	10			/* alpha starts at 1.0 */
 #define initalpha	(((int) 1)<<alphabiasshift)
-int alphadec;					/* biased by 10 bits */
+NQ_THREAD_LOCAL int alphadec;					/* biased by 10 bits */
 
 /* radbias and alpharadbias used for radpower calculation */
 #define radbiasshift	8
@@ -59,25 +69,25 @@ int alphadec;					/* biased by 10 bits */
 /* Types and Global Variables
    -------------------------- */
 #define maxnetsize		256			/* number of colours used */
-static int netsize = maxnetsize;
-static int maxnetpos = (maxnetsize - 1);
-static int initrad = (maxnetsize >> 3);		/* for 256 cols, radius starts */
+static NQ_THREAD_LOCAL int netsize = maxnetsize;
+static NQ_THREAD_LOCAL int maxnetpos = (maxnetsize - 1);
+static NQ_THREAD_LOCAL int initrad = (maxnetsize >> 3);		/* for 256 cols, radius starts */
 
    
-static unsigned char *thepicture;		/* the input image itself */
-static int lengthcount;				/* lengthcount = H*W*3 */
+static NQ_THREAD_LOCAL unsigned char *thepicture;		/* the input image itself */
+static NQ_THREAD_LOCAL int lengthcount;				/* lengthcount = H*W*3 */
 
-static int samplefac;				/* sampling factor 1..30 */
+static NQ_THREAD_LOCAL int samplefac;				/* sampling factor 1..30 */
 
 
 typedef int pixel[4];				/* BGRc */
-static pixel network[maxnetsize];			/* the network itself */
+static NQ_THREAD_LOCAL pixel network[maxnetsize];			/* the network itself */
 
-static int netindex[256];			/* for network lookup - really 256 */
+static NQ_THREAD_LOCAL int netindex[256];			/* for network lookup - really 256 */
 
-static int bias[maxnetsize];			/* bias and freq arrays for learning */
-static int freq[maxnetsize];
-static int radpower[maxnetsize];			/* radpower for precomputation */
+static NQ_THREAD_LOCAL int bias[maxnetsize];			/* bias and freq arrays for learning */
+static NQ_THREAD_LOCAL int freq[maxnetsize];
+static NQ_THREAD_LOCAL int radpower[maxnetsize];			/* radpower for precomputation */
 
 
 /* Initialise network in range (0,0,0) to (255,255,255) and set parameters
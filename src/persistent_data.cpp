@@ -19,6 +19,8 @@
 #include <QDebug>
 #include <QSettings>
 #include "persistent_data.h"
+#include "png_write.h"
+#include "ser_io_backend.h"
 
 #if QT_VERSION >= 0x050000
 #include <QStandardPaths>
@@ -48,10 +50,15 @@ QStringList c_persistent_data::m_recent_save_folders = QStringList();
 bool c_persistent_data::m_check_for_updates = true;
 bool c_persistent_data::m_disconnect_playback_controls = false;
 bool c_persistent_data::m_repeat = false;
+bool c_persistent_data::m_follow_ser_files = false;
 int c_persistent_data::m_play_direction = 0;
 bool c_persistent_data::m_histogram_enabled = false;
 bool c_persistent_data::m_markers_enabled = false;
 int c_persistent_data::m_selection_box_colour = 0;
+int c_persistent_data::m_ser_read_mode = c_ser_io_backend::IO_MODE_BUFFERED;
+int c_persistent_data::m_ser_export_read_mode = c_ser_io_backend::IO_MODE_FADVISE;
+int c_persistent_data::m_frame_cache_size_mb = 512;
+int c_persistent_data::m_png_compression = PNG_COMPRESSION_BALANCED;
 
 
 //
@@ -97,6 +104,10 @@ void c_persistent_data::load()
         m_repeat = settings.value("playback_repeat").toBool();
     }
 
+    if (settings.value("follow_ser_files") != QVariant::Invalid) {
+        m_follow_ser_files = settings.value("follow_ser_files").toBool();
+    }
+
     if (settings.value("play_direction") != QVariant::Invalid) {
         m_play_direction = settings.value("play_direction").toInt();
     }
@@ -112,6 +123,22 @@ void c_persistent_data::load()
     if (settings.value("selection_box_colour") != QVariant::Invalid) {
         m_selection_box_colour = settings.value("selection_box_colour").toInt();
     }
+
+    if (settings.value("ser_read_mode") != QVariant::Invalid) {
+        m_ser_read_mode = settings.value("ser_read_mode").toInt();
+    }
+
+    if (settings.value("ser_export_read_mode") != QVariant::Invalid) {
+        m_ser_export_read_mode = settings.value("ser_export_read_mode").toInt();
+    }
+
+    if (settings.value("frame_cache_size_mb") != QVariant::Invalid) {
+        m_frame_cache_size_mb = settings.value("frame_cache_size_mb").toInt();
+    }
+
+    if (settings.value("png_compression") != QVariant::Invalid) {
+        m_png_compression = settings.value("png_compression").toInt();
+    }
 }
 	
 	
@@ -130,8 +157,13 @@ void c_persistent_data::save()
     settings.setValue("check_for_updates", m_check_for_updates);
     settings.setValue("disconnect_playback_controls", m_disconnect_playback_controls);
     settings.setValue("playback_repeat", m_repeat);
+    settings.setValue("follow_ser_files", m_follow_ser_files);
     settings.setValue("play_direction", m_play_direction);   
     settings.setValue("histogram_enabled", m_histogram_enabled);
     settings.setValue("markers_enabled", m_markers_enabled);
     settings.setValue("selection_box_colour", m_selection_box_colour);
+    settings.setValue("ser_read_mode", m_ser_read_mode);
+    settings.setValue("ser_export_read_mode", m_ser_export_read_mode);
+    settings.setValue("frame_cache_size_mb", m_frame_cache_size_mb);
+    settings.setValue("png_compression", m_png_compression);
 }
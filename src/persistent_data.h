@@ -38,10 +38,15 @@ public:
     static bool m_check_for_updates;
     static bool m_disconnect_playback_controls;
     static bool m_repeat;
+    static bool m_follow_ser_files;
     static int m_play_direction;
     static bool m_histogram_enabled;
     static bool m_markers_enabled;
     static int m_selection_box_colour;
+    static int m_ser_read_mode;  // c_ser_io_backend::e_io_mode used for playback
+    static int m_ser_export_read_mode;  // c_ser_io_backend::e_io_mode used when saving frames
+    static int m_frame_cache_size_mb;  // Memory used to keep recently displayed frames, 0 to disable
+    static int m_png_compression;  // e_png_compression profile used when saving PNG images
 
 
     //
@@ -32,7 +32,6 @@ using namespace std;
 // Constructor
 // ------------------------------------------
 c_pipp_avi_write::c_pipp_avi_write() :
-    mp_avi_file(NULL),
     m_open(false),
     m_split_count(0),
     m_old_avi_format(0),
@@ -220,11 +219,10 @@ void c_pipp_avi_write::fwrite_error_check(
     const void *ptr,
     size_t size,
     size_t count,
-    FILE *p_stream)
+    c_async_file_writer &file)
 {
     if (!m_file_write_error) {  // Do not continue writing after an error has occured
-        size_t size_written = fwrite(ptr, size, count, p_stream);
-        if (size_written != count) {
+        if (!file.write(ptr, size * count)) {
             m_file_write_error = true;
         }
     }
@@ -256,31 +254,31 @@ void c_pipp_avi_write::write_headers()
     }
 
     // Write RIF Header to file
-    fwrite_error_check(&m_avi_riff_header , 1 , sizeof(m_avi_riff_header) , mp_avi_file);
+    fwrite_error_check(&m_avi_riff_header , 1 , sizeof(m_avi_riff_header) , m_avi_file);
 
     // Write hdrl list header to file
-    fwrite_error_check(&m_hdrl_list_header , 1 , sizeof(m_hdrl_list_header) , mp_avi_file);
+    fwrite_error_check(&m_hdrl_list_header , 1 , sizeof(m_hdrl_list_header) , m_avi_file);
 
     // Write avih chunk header to file
-    fwrite_error_check(&m_avih_chunk_header , 1 , sizeof(m_avih_chunk_header) , mp_avi_file);
+    fwrite_error_check(&m_avih_chunk_header , 1 , sizeof(m_avih_chunk_header) , m_avi_file);
 
     // Write Main avi header to file
-    fwrite_error_check(&m_main_avih_header , 1 , sizeof(m_main_avih_header) , mp_avi_file);
+    fwrite_error_check(&m_main_avih_header , 1 , sizeof(m_main_avih_header) , m_avi_file);
 
     // Write strl list header to file
-    fwrite_error_check(&m_strl_list_header , 1 , sizeof(m_strl_list_header) , mp_avi_file);
+    fwrite_error_check(&m_strl_list_header , 1 , sizeof(m_strl_list_header) , m_avi_file);
 
     // Write strh chunk header to file
-    fwrite_error_check(&m_strh_chunk_header , 1 , sizeof(m_strh_chunk_header) , mp_avi_file);
+    fwrite_error_check(&m_strh_chunk_header , 1 , sizeof(m_strh_chunk_header) , m_avi_file);
 
     // Write video stream header to file
-    fwrite_error_check(&m_vids_stream_header , 1 , sizeof(m_vids_stream_header) , mp_avi_file);
+    fwrite_error_check(&m_vids_stream_header , 1 , sizeof(m_vids_stream_header) , m_avi_file);
 
     // Write strf chunk header to file
-    fwrite_error_check(&m_strf_chunk_header , 1 , sizeof(m_strf_chunk_header) , mp_avi_file);
+    fwrite_error_check(&m_strf_chunk_header , 1 , sizeof(m_strf_chunk_header) , m_avi_file);
 
     // Write BITMAPINFO header to file
-    fwrite_error_check(&m_bitmap_info_header , 1 , sizeof(m_bitmap_info_header) , mp_avi_file);
+    fwrite_error_check(&m_bitmap_info_header , 1 , sizeof(m_bitmap_info_header) , m_avi_file);
 
     // Write colour table to file if required (for DIB mono images)
     if (m_write_colour_table) {
@@ -294,20 +292,20 @@ void c_pipp_avi_write::write_headers()
         }
 
         // Write colour table to file
-        fwrite_error_check(colour_table , 1 , 256 * 4, mp_avi_file);
+        fwrite_error_check(colour_table , 1 , 256 * 4, m_avi_file);
     }
 
     if (m_old_avi_format != 0) {
         // Junk chunk moves next pos to 0x2000
-        m_junk_chunk_header.size = 0x2000 - (int32_t)ftell64(mp_avi_file) - sizeof(m_junk_chunk_header);
+        m_junk_chunk_header.size = 0x2000 - (int32_t)m_avi_file.tell() - sizeof(m_junk_chunk_header);
 
         // Write junk header to file
-        fwrite_error_check(&m_junk_chunk_header , 1 , sizeof(m_junk_chunk_header) , mp_avi_file);
+        fwrite_error_check(&m_junk_chunk_header , 1 , sizeof(m_junk_chunk_header) , m_avi_file);
 
         // Write junk data to file
         uint8_t junk_byte = 0;
         for (uint32_t junk_count = 0; junk_count < m_junk_chunk_header.size; junk_count++) {
-            fwrite_error_check(&junk_byte , 1 , 1, mp_avi_file);
+            fwrite_error_check(&junk_byte , 1 , 1, m_avi_file);
         }
     } else {
         // These fields are not present with the old AVI format
@@ -326,22 +324,22 @@ void c_pipp_avi_write::write_headers()
         }
 
         // Write indx chunk header to file
-        fwrite_error_check(&m_indx_chunk_header , 1 , sizeof(m_indx_chunk_header) , mp_avi_file);
+        fwrite_error_check(&m_indx_chunk_header , 1 , sizeof(m_indx_chunk_header) , m_avi_file);
 
         // Write AVI Superindex header to file
-        fwrite_error_check(&m_avi_superindex_header , 1 , sizeof(m_avi_superindex_header), mp_avi_file);
+        fwrite_error_check(&m_avi_superindex_header , 1 , sizeof(m_avi_superindex_header), m_avi_file);
 
         // Write AVI Superindex entries to file
-        fwrite_error_check(m_avi_superindex_entries , 1 , sizeof(m_avi_superindex_entries[0]) * NUMBER_SUPERINDEX_ENTRIES, mp_avi_file);
+        fwrite_error_check(m_avi_superindex_entries , 1 , sizeof(m_avi_superindex_entries[0]) * NUMBER_SUPERINDEX_ENTRIES, m_avi_file);
 
         // Write odml list header to file
-        fwrite_error_check(&m_odml_list_header , 1 , sizeof(m_odml_list_header) , mp_avi_file);
+        fwrite_error_check(&m_odml_list_header , 1 , sizeof(m_odml_list_header) , m_avi_file);
 
         // Write dmlh chunk header to file
-        fwrite_error_check(&m_dmlh_chunk_header , 1 , sizeof(m_dmlh_chunk_header) , mp_avi_file);
+        fwrite_error_check(&m_dmlh_chunk_header , 1 , sizeof(m_dmlh_chunk_header) , m_avi_file);
 
         // Write extended AVI header to file
-        fwrite_error_check(&m_extended_avi_header , 1 , sizeof(m_extended_avi_header) , mp_avi_file);
+        fwrite_error_check(&m_extended_avi_header , 1 , sizeof(m_extended_avi_header) , m_avi_file);
 
         if (m_big_endian_processor) {
             // Change structures back from little-endian to big-endian on big-endian systems
@@ -359,7 +357,7 @@ void c_pipp_avi_write::write_headers()
     }
 
     // Write movi list header
-    fwrite_error_check(&m_movi_list_header , 1 , sizeof(m_movi_list_header) , mp_avi_file);
+    fwrite_error_check(&m_movi_list_header , 1 , sizeof(m_movi_list_header) , m_avi_file);
 
     if (m_big_endian_processor) {
         // Change structures back from little-endian to big-endian on big-endian systems
@@ -399,7 +397,7 @@ void c_pipp_avi_write::frame_added()
     if (m_total_frame_count == 0) {
         // Grab position of first frame in this RIFF for the base offset
         m_avi_superindex_header.entries_in_use++;
-        uint64_t base_offset = ftell64(mp_avi_file) + sizeof(m_00db_chunk_header);
+        uint64_t base_offset = m_avi_file.tell() + sizeof(m_00db_chunk_header);
         //uint64_t base_offset = ftell64(avi_fp) - frame_size;
         m_avi_stdindex_header.base_offset[1] = (uint32_t)(base_offset >> 32);
         m_avi_stdindex_header.base_offset[0] = (uint32_t)(base_offset & 0xFFFFFFFF);
@@ -420,10 +418,10 @@ void c_pipp_avi_write::frame_added()
             }
 
             // Start the next RIFF
-            fwrite_error_check(&m_avix_riff_header , 1, sizeof(m_avix_riff_header), mp_avi_file);
+            fwrite_error_check(&m_avix_riff_header , 1, sizeof(m_avix_riff_header), m_avi_file);
 
             // Start the new movi LIST
-            fwrite_error_check(&m_movi_avix_list_header , 1, sizeof(m_movi_avix_list_header), mp_avi_file);
+            fwrite_error_check(&m_movi_avix_list_header , 1, sizeof(m_movi_avix_list_header), m_avi_file);
 
             if (m_big_endian_processor) {
                 // Change structures back from little-endian to big-endian on big-endian systems
@@ -433,7 +431,7 @@ void c_pipp_avi_write::frame_added()
 
             // Grab position of first frame in this RIFF for the base offset
             m_avi_superindex_header.entries_in_use++;
-            uint64_t base_offset = ftell64(mp_avi_file) + sizeof(m_00db_chunk_header);
+            uint64_t base_offset = m_avi_file.tell() + sizeof(m_00db_chunk_header);
             m_avi_stdindex_header.base_offset[1] = (uint32_t)(base_offset >> 32);
             m_avi_stdindex_header.base_offset[0] = (uint32_t)(base_offset & 0xFFFFFFFF);
             m_current_frame_count = 0;
@@ -602,11 +600,9 @@ bool c_pipp_avi_write::create(
                           + sizeof(m_movi_avix_list_header) - sizeof(m_movi_avix_list_header.four_cc)
                           + m_movi_avix_list_header.size;
 
-    mp_avi_file = fopen_utf8(filename, "wb+");
-
     // Check file opened
     // Return if file did not open
-    if (mp_avi_file) {
+    if (m_avi_file.open(filename)) {
         m_open = true;
     } else {
         m_open = false;
@@ -618,7 +614,7 @@ bool c_pipp_avi_write::create(
 
     // Handle case where file opened but subsequent write failed
     if (m_open && m_file_write_error) {
-        fclose(mp_avi_file);
+        m_avi_file.close();
         m_open = false;
     }
 
@@ -659,11 +655,9 @@ void c_pipp_avi_write::split_create()
     }
 
     // Open new file
-    mp_avi_file = fopen_utf8(p_split_filename.get(), "wb+");
-
     // Check file opened
     // Return if file did not open
-    if (mp_avi_file) {
+    if (m_avi_file.open(p_split_filename.get())) {
         m_open = true;
     } else {
         m_file_write_error = true;
@@ -692,7 +686,7 @@ void c_pipp_avi_write::finish_riff()
 
         // Grab position of the ix00 chunk
         m_avi_superindex_entries[m_riff_count].duration = m_current_frame_count;
-        m_avi_superindex_entries[m_riff_count].offset = ftell64(mp_avi_file);
+        m_avi_superindex_entries[m_riff_count].offset = m_avi_file.tell();
         m_avi_superindex_entries[m_riff_count].size = sizeof(m_ix00_chunk_header) + m_ix00_chunk_header.size;
 
         m_avi_stdindex_header.entries_in_use = m_current_frame_count;
@@ -704,10 +698,10 @@ void c_pipp_avi_write::finish_riff()
         }
 
         // Write ix00 chunk header to file
-        fwrite_error_check(&m_ix00_chunk_header, 1, sizeof(m_ix00_chunk_header), mp_avi_file);
+        fwrite_error_check(&m_ix00_chunk_header, 1, sizeof(m_ix00_chunk_header), m_avi_file);
 
         // Write AVI standard header to file
-        fwrite_error_check(&m_avi_stdindex_header, 1, sizeof(m_avi_stdindex_header), mp_avi_file);
+        fwrite_error_check(&m_avi_stdindex_header, 1, sizeof(m_avi_stdindex_header), m_avi_file);
 
         if (m_big_endian_processor) {
             // Change structures back from little-endian to big-endian on big-endian systems
@@ -726,7 +720,7 @@ void c_pipp_avi_write::finish_riff()
                 swap_structure_endianess(&m_avi_stdindex_entry);
             }
 
-            fwrite_error_check(&m_avi_stdindex_entry, 1, sizeof(m_avi_stdindex_entry), mp_avi_file);
+            fwrite_error_check(&m_avi_stdindex_entry, 1, sizeof(m_avi_stdindex_entry), m_avi_file);
 
             if (m_big_endian_processor) {
                 // Change structures back from little-endian to big-endian on big-endian systems
@@ -764,7 +758,7 @@ void c_pipp_avi_write::finish_riff()
         }
 
         // Write index chunk header to file
-        fwrite_error_check(&m_idx1_chunk_header , 1 , sizeof(m_idx1_chunk_header), mp_avi_file);
+        fwrite_error_check(&m_idx1_chunk_header , 1 , sizeof(m_idx1_chunk_header), m_avi_file);
 
         if (m_big_endian_processor) {
             // Change structures back from little-endian to big-endian on big-endian systems
@@ -781,7 +775,7 @@ void c_pipp_avi_write::finish_riff()
                 swap_structure_endianess(&m_avi_index_entry);
             }
 
-            fwrite_error_check(&m_avi_index_entry , 1 , sizeof(m_avi_index_entry), mp_avi_file);  // Write entry to file
+            fwrite_error_check(&m_avi_index_entry , 1 , sizeof(m_avi_index_entry), m_avi_file);  // Write entry to file
 
             if (m_big_endian_processor) {
                 // Change structures back from little-endian to big-endian on big-endian systems
@@ -792,14 +786,14 @@ void c_pipp_avi_write::finish_riff()
         }
 
         // Get the filesize
-        int64_t filesize = ftell64(mp_avi_file);
+        int64_t filesize = m_avi_file.tell();
 
         // Update final headers
         m_avi_riff_header.size = (uint32_t)filesize - 8;
     } 
 
     // Grab start position of the next RIFF
-    int64_t riff_end_position = ftell64(mp_avi_file);
+    int64_t riff_end_position = m_avi_file.tell();
 
     // Processing for subsequent RIFFs
     if (m_riff_count > 0 && m_current_frame_count != m_max_frames_in_other_riffs) {
@@ -807,7 +801,7 @@ void c_pipp_avi_write::finish_riff()
         // We need to correct the RIFF and LIST sizes as it is not completely full
 
         // Go back to the start of this RIFF
-        fseek64(mp_avi_file, m_riff_start_position, SEEK_SET);
+        m_avi_file.seek(m_riff_start_position);
 
         // Write RIFF header again with correct length now that we know it
         m_avix_riff_header.size = (int32_t)(riff_end_position - m_riff_start_position) - sizeof(m_avix_riff_header) + sizeof(m_avix_riff_header.four_cc);
@@ -817,7 +811,7 @@ void c_pipp_avi_write::finish_riff()
             swap_structure_endianess(&m_avix_riff_header);
         }
 
-        fwrite_error_check(&m_avix_riff_header , 1, sizeof(m_avix_riff_header), mp_avi_file);
+        fwrite_error_check(&m_avix_riff_header , 1, sizeof(m_avix_riff_header), m_avi_file);
 
         if (m_big_endian_processor) {
             // Change structures back from little-endian to big-endian on big-endian systems
@@ -832,7 +826,7 @@ void c_pipp_avi_write::finish_riff()
             swap_structure_endianess(&m_movi_avix_list_header);
         }
 
-        fwrite_error_check(&m_movi_avix_list_header , 1 , sizeof(m_movi_avix_list_header) , mp_avi_file);
+        fwrite_error_check(&m_movi_avix_list_header , 1 , sizeof(m_movi_avix_list_header) , m_avi_file);
 
         if (m_big_endian_processor) {
             // Change structures back from little-endian to big-endian on big-endian systems
@@ -840,7 +834,7 @@ void c_pipp_avi_write::finish_riff()
         }
 
         // Go back to the end of this RIFF
-        fseek64(mp_avi_file, riff_end_position, SEEK_SET);
+        m_avi_file.seek(riff_end_position);
     }
 
     // Grab start position of the next RIFF
@@ -865,7 +859,7 @@ bool c_pipp_avi_write::close()
         finish_riff();
 
         // Go back to start of file
-        fseek64(mp_avi_file, 0, SEEK_SET);
+        m_avi_file.seek(0);
 
         // Write the updated headers to the file
         write_headers();
@@ -873,8 +867,9 @@ bool c_pipp_avi_write::close()
         // Note that the AVI file is closed
         m_open = false;
 
-        fclose(mp_avi_file);
-        mp_avi_file = NULL;
+        if (!m_avi_file.close()) {
+            m_file_write_error = true;
+        }
     }
 
     bool ret = m_file_write_error;
@@ -883,6 +878,27 @@ bool c_pipp_avi_write::close()
 }
 
 
+// ------------------------------------------
+// Reserve space for the frames that are going to be written
+// ------------------------------------------
+void c_pipp_avi_write::set_expected_frame_count(
+    int32_t frame_count)
+{
+    if (!m_open) {
+        return;
+    }
+
+    // Only the first file is reserved when old format AVI files are split
+    int64_t frames = frame_count;
+    if (m_old_avi_format != 0 && frames > m_max_frames_in_first_riff) {
+        frames = m_max_frames_in_first_riff;
+    }
+
+    int64_t frame_space = sizeof(m_00db_chunk_header) + m_frame_size + sizeof(m_avi_stdindex_entry) + sizeof(m_avi_index_entry);
+    m_avi_file.preallocate(0x2000 + frames * frame_space);
+}
+
+
 // ------------------------------------------
 // Write header and close AVI file
 // ------------------------------------------
@@ -892,13 +908,14 @@ void c_pipp_avi_write::split_close()
     finish_riff();
 
     // Go back to start of file
-    fseek64(mp_avi_file, 0, SEEK_SET);
+    m_avi_file.seek(0);
 
     // Write the updated headers to the file
     write_headers();
 
-    fclose(mp_avi_file);
-    mp_avi_file = NULL;
+    if (!m_avi_file.close()) {
+        m_file_write_error = true;
+    }
 }
 
 
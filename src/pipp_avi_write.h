@@ -8,6 +8,7 @@
 
 #include "pipp_video_write.h"
 #include "pipp_buffer.h"
+#include "async_file_writer.h"
 
 #define DEBUGF //printf
 
@@ -226,7 +227,7 @@ class c_pipp_avi_write: public c_pipp_video_write {
         // Member variables
         std::unique_ptr<char[]> mp_filename;
         std::unique_ptr<char[]> mp_extension;
-        FILE *mp_avi_file;
+        c_async_file_writer m_avi_file;
         bool m_open;
         int32_t m_split_count;
         int32_t m_old_avi_format;
@@ -338,6 +339,13 @@ class c_pipp_avi_write: public c_pipp_video_write {
         bool close();
 
 
+        // ------------------------------------------
+        // Reserve space for the frames that are going to be written
+        // ------------------------------------------
+        void set_expected_frame_count(
+            int32_t frame_count);
+
+
     protected:
         // ------------------------------------------
         // Write headers to file
@@ -346,7 +354,7 @@ class c_pipp_avi_write: public c_pipp_video_write {
                 const void *ptr,
                 size_t size,
                 size_t count,
-                FILE *p_stream);
+                c_async_file_writer &file);
 
 
         // ------------------------------------------
@@ -73,7 +73,7 @@ bool c_pipp_avi_write_dib::write_frame(
         swap_structure_endianess(&m_00db_chunk_header);
     }
 
-    fwrite_error_check(&m_00db_chunk_header, 1, sizeof(m_00db_chunk_header), mp_avi_file);
+    fwrite_error_check(&m_00db_chunk_header, 1, sizeof(m_00db_chunk_header), m_avi_file);
 
     if (m_big_endian_processor) {
         // Change structures back from little-endian to big-endian on big-endian systems
@@ -145,12 +145,12 @@ bool c_pipp_avi_write_dib::write_frame(
     }
 
     // Write image data to file
-    m_last_frame_pos = ftell64(mp_avi_file);  // Grab position of last file
-    fwrite_error_check(buffer , 1 , (m_width * m_bytes_per_pixel + m_line_gap) * m_height, mp_avi_file);
+    m_last_frame_pos = m_avi_file.tell();  // Grab position of last file
+    fwrite_error_check(buffer , 1 , (m_width * m_bytes_per_pixel + m_line_gap) * m_height, m_avi_file);
 
     // Tidy up after write failures
     if (m_file_write_error) {
-        fclose(mp_avi_file);
+        m_avi_file.close();
         m_open = false;
     }
 
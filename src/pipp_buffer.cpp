@@ -30,7 +30,7 @@ using namespace std;
 // Member function to get a new buffer
 // ------------------------------------------
 uint8_t *c_pipp_buffer::get_buffer(
-    uint32_t size)
+    size_t size)
 {
     if (size > m_buffer_size) {
         // The current buffer is not big enough
@@ -48,7 +48,7 @@ uint8_t *c_pipp_buffer::get_buffer(
             mp_buffer = new uint8_t[m_buffer_size];
         } catch(...) {
             cout << "FATAL ERROR: memory allocation (";
-            cout << dec << (size * sizeof(m_buffer_size));
+            cout << dec << size;
             cout << ") failed in c_pipp_buffer::get_buffer()" << endl;
             exit(-1);
         }
@@ -63,7 +63,7 @@ uint8_t *c_pipp_buffer::get_buffer(
 // Member function to get a new zeroed buffer
 // ------------------------------------------
 uint8_t *c_pipp_buffer::get_zero_buffer(
-    uint32_t size)
+    size_t size)
 {
     // Call get_buffer() method to create buffer as usual
     get_buffer(size);
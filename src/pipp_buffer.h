@@ -32,7 +32,7 @@ class c_pipp_buffer {
     // Private definitions
     // ------------------------------------------
     private:
-        uint32_t m_buffer_size;
+        size_t m_buffer_size;
         uint8_t *mp_buffer;
 
     // ------------------------------------------
@@ -63,6 +63,10 @@ class c_pipp_buffer {
             return mp_buffer;
         }
 
+        inline const uint8_t *get_buffer_ptr() const {
+            return mp_buffer;
+        }
+
 
         // ------------------------------------------
         // Member function to set a new  buffer
@@ -80,14 +84,14 @@ class c_pipp_buffer {
         // Member function to get a new  buffer
         // ------------------------------------------
         uint8_t *get_buffer(
-            uint32_t size);
+            size_t size);
 
 
         // ------------------------------------------
         // Member function to get a new zeroed buffer
         // ------------------------------------------
         uint8_t *get_zero_buffer(
-            uint32_t size);
+            size_t size);
 
 
         // ------------------------------------------
@@ -18,7 +18,9 @@
 #include "pipp_ser.h"
 #include "pipp_timestamp.h"
 #include "pipp_utf8.h"
+#include "ser_unpack.h"
 
+#include <cstddef>
 #include <cstdlib>
 #include <cstdint>
 #include <cstdio>
@@ -28,6 +30,27 @@
 #include <cstring>
 #include <cmath>
 
+#if defined(__unix__) || defined(__APPLE__)
+    #include <sys/mman.h>
+    #include <sys/types.h>
+    #define PIPP_SER_MMAP_SUPPORT
+#endif
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace {
+    // Maximum amount of raw frame data get_frames() reads in one batch
+    const uint64_t C_GET_FRAMES_BATCH_SIZE = 32 * 1024 * 1024;
+
+    // Frame data is checked for the pixel depth in pieces this size so the check can stop early
+    const uint64_t C_PIXEL_DEPTH_CHUNK_SIZE = 256 * 1024;
+
+    // Number of frames spread through the file that are checked for the pixel depth
+    const int C_FRAMES_TO_CHECK_FOR_PIXEL_DEPTH = 10;
+}
+
 using namespace std;
 
 
@@ -45,8 +68,20 @@ int32_t c_pipp_ser::open(
     m_fps_scale = 1;
     m_utc_to_local_offset = 0L;
     m_timestamp_correction_value = 0L;
+    m_metadata = s_metadata();
+    m_metadata.fps_scale = 1;
+    m_following = false;
+
+    // Cached metadata is only used for this open
+    const bool use_cached_metadata = m_use_cached_metadata;
+    m_use_cached_metadata = false;
 
     // Ensure no previous file is still open
+    unmap_file();
+    {
+        std::lock_guard<std::mutex> lock(m_io_backend_mutex);
+        mp_io_backend.reset();
+    }
     if (mp_ser_file != nullptr) {
         fclose(mp_ser_file);  // Close file
     }
@@ -144,7 +179,7 @@ int32_t c_pipp_ser::open(
         return ERROR_INVALID_HEADER_VALUE;
     }
 
-    if (m_header.frame_count <= 0) {
+    if (m_header.frame_count <= 0 && !m_follow_mode) {
         // Invalid frame count
         m_error_string += QCoreApplication::tr("Error: File '%1' has an invalid frame count of %2", "SER File error message")
                           .arg(filename_utf8.c_str())
@@ -182,8 +217,11 @@ int32_t c_pipp_ser::open(
 
     int32_t total_bytes_per_sample = m_byte_depth_in * (1 + m_colour * 2);
 
+    // Size of all the frame data, this can be much larger than 4GB
+    const int64_t image_data_size = (int64_t)m_header.frame_count * m_header.image_height * m_header.image_width * total_bytes_per_sample;
+
     // Check that the file is large enough to hold all the frames
-    if (m_filesize < (m_header.frame_count * m_header.image_height * m_header.image_width * total_bytes_per_sample + 178)) {
+    if (!m_follow_mode && (m_header.frame_count < 0 || m_filesize < image_data_size + 178)) {
         m_error_string += QCoreApplication::tr("Error: File '%1' is too short to hold all the frames", "SER File error message")
                           .arg(filename_utf8.c_str()).toUtf8().constData();
         m_error_string += "\n";
@@ -194,19 +232,61 @@ int32_t c_pipp_ser::open(
 
 
     // Store size of frame
-    m_framesize_in = m_header.image_width * m_header.image_height;
+    m_framesize_in = (uint64_t)m_header.image_width * m_header.image_height;
     m_framesize_in *= m_byte_depth_in;  // Allow for 2 bytes per pixel
 
     if (m_header.colour_id == COLOURID_RGB || m_header.colour_id == COLOURID_BGR) {
         m_framesize_in *= 3;
     }
 
+    if (m_follow_mode) {
+        // Only use the frames that have been completely written
+        int32_t complete_frames = get_complete_frames(m_filesize);
+        if (m_header.frame_count <= 0 || m_header.frame_count > complete_frames) {
+            // File is still being recorded
+            m_header.frame_count = complete_frames;
+            m_following = true;
+        }
+
+        if (m_header.frame_count <= 0) {
+            m_error_string += QCoreApplication::tr("Error: File '%1' has no complete frames yet", "SER File error message")
+                              .arg(filename_utf8.c_str()).toUtf8().constData();
+            m_error_string += "\n";
+            fclose(mp_ser_file);  // Close file
+            mp_ser_file = nullptr;
+            return ERROR_ZERO_FRAME_COUNT;
+        }
+    }
+
+    // Map the file into memory if this has been requested
+    if (m_memory_mapped_mode) {
+        map_file();
+    }
+
+    // Open the file again for frame data reads
+    std::shared_ptr<c_ser_io_backend> p_io_backend = c_ser_io_backend::create(m_io_mode, filename_utf8);
+    {
+        std::lock_guard<std::mutex> lock(m_io_backend_mutex);
+        mp_io_backend = p_io_backend;
+    }
+
+    if (p_io_backend == nullptr) {
+        m_error_string += QCoreApplication::tr("Error: Could not open file '%1'", "SER file error message")
+                          .arg(filename_utf8.c_str()).toUtf8().constData();
+        m_error_string += '\n';
+        unmap_file();
+        fclose(mp_ser_file);  // Close file
+        mp_ser_file = nullptr;
+        return ERROR_CANNOT_OPEN_FILE;
+    }
+
     // Check for timestamps
-    if (m_header.date_time_msw != 0 || m_header.date_time_lsw != 0) {
+    // These are only written once recording has finished, so a followed file does not have them yet
+    if (!m_following && (m_header.date_time_msw != 0 || m_header.date_time_lsw != 0)) {
         // Timestamps should exist
 
         // Check file is large enough to have timestamps
-        if (m_filesize >= (178 + m_header.frame_count * m_header.image_height * m_header.image_width * total_bytes_per_sample + 8 * m_header.frame_count)) {
+        if (m_filesize >= (178 + image_data_size + (int64_t)8 * m_header.frame_count)) {
 
             // Get current position in file
             uint64_t start_of_image_data_pos = ftell64(mp_ser_file);
@@ -214,16 +294,16 @@ int32_t c_pipp_ser::open(
             // Seek to start of timestamps
             read_ret = fseek64(
                 mp_ser_file,
-                (int64_t)m_header.frame_count * m_header.image_height * m_header.image_width * total_bytes_per_sample,
+                image_data_size,
                 SEEK_CUR);
 
             // Get buffer to store timestamps in
-            mp_timestamp = (uint64_t *)m_timestamp_buffer.get_buffer(8 * m_header.frame_count);
+            mp_timestamp = (uint64_t *)m_timestamp_buffer.get_buffer((size_t)8 * m_header.frame_count);
 
             // Load timestamp data into buffer
-            read_ret = fread(mp_timestamp, 1, 8 * m_header.frame_count, mp_ser_file);
+            read_ret = fread(mp_timestamp, 1, (size_t)8 * m_header.frame_count, mp_ser_file);
 
-            if ((int32_t)read_ret != 8 * m_header.frame_count) {
+            if (read_ret != (size_t)8 * m_header.frame_count) {
                 // Timestamps did not read correctly
                 m_header.date_time_msw = 0;
                 m_header.date_time_lsw = 0;
@@ -238,63 +318,88 @@ int32_t c_pipp_ser::open(
             fseek64(mp_ser_file, start_of_image_data_pos, SEEK_SET);
 
             if (m_header.date_time_msw != 0 || m_header.date_time_lsw != 0) {
-                // Analyse timestamps to ensure that they are all increasing and in order
-                // Plus get earliest ts
-                uint64_t first_ts = *mp_timestamp;
-                uint64_t min_ts = *mp_timestamp;
-                uint64_t last_ts = *(mp_timestamp + (m_header.frame_count - 1));
-
-                uint64_t last_current_ts = 0;
-                for (int32_t ts_count = 0; ts_count < m_header.frame_count; ts_count++) {
-                    uint64_t current_ts = *(mp_timestamp + ts_count);
-
-                    if (current_ts < min_ts) {
-                        min_ts = current_ts;  // Get earliest timestamp
-                    }
-
-                    if (current_ts < last_current_ts) {
-                        last_ts = first_ts;  // Out of order
-                    }
-
-                    last_current_ts = current_ts;  // This is not the last timestamp
-                }
-
                 // Check if timestamps are local time instead as universal time
                 int64_t start_time_uct_minus_min_ts = (uint64_t)(m_header.date_time_utc_msw) << 32 | m_header.date_time_utc_lsw;
                 int64_t start_time_minus_min_ts = (uint64_t)(m_header.date_time_msw) << 32 | m_header.date_time_lsw;
                 m_utc_to_local_offset = start_time_uct_minus_min_ts - start_time_minus_min_ts;
 
-                start_time_uct_minus_min_ts -= min_ts;
-                if (start_time_uct_minus_min_ts < 0) {
-                    start_time_uct_minus_min_ts *= -1L;
-                }
+                if (use_cached_metadata) {
+                    // Timestamps have already been analysed
+                    m_metadata.fps_rate = m_cached_metadata.fps_rate;
+                    m_metadata.fps_scale = m_cached_metadata.fps_scale;
+                    m_metadata.timestamp_correction_value = m_cached_metadata.timestamp_correction_value;
+                    m_metadata.min_timestamp = m_cached_metadata.min_timestamp;
+                    m_metadata.max_timestamp = m_cached_metadata.max_timestamp;
+                    m_metadata.timestamps_in_order = m_cached_metadata.timestamps_in_order;
+                } else {
+                    // Analyse timestamps to ensure that they are all increasing and in order
+                    // Plus get earliest and latest ts
+                    uint64_t first_ts = *mp_timestamp;
+                    uint64_t min_ts = *mp_timestamp;
+                    uint64_t max_ts = *mp_timestamp;
+                    uint64_t last_ts = *(mp_timestamp + (m_header.frame_count - 1));
+                    bool timestamps_in_order = true;
+
+                    uint64_t last_current_ts = 0;
+                    for (int32_t ts_count = 0; ts_count < m_header.frame_count; ts_count++) {
+                        uint64_t current_ts = *(mp_timestamp + ts_count);
+
+                        if (current_ts < min_ts) {
+                            min_ts = current_ts;  // Get earliest timestamp
+                        }
 
-                start_time_minus_min_ts -= min_ts;
-                if (start_time_minus_min_ts < 0) {
-                    start_time_minus_min_ts *= -1L;
-                }
+                        if (current_ts > max_ts) {
+                            max_ts = current_ts;  // Get latest timestamp
+                        }
 
-                if (start_time_uct_minus_min_ts <= start_time_minus_min_ts) {
-                    // Timestamps are in universal time
-                    m_timestamp_correction_value = 0L;
-                } else {
-                    m_timestamp_correction_value = m_utc_to_local_offset;
-                }
+                        if (current_ts < last_current_ts) {
+                            last_ts = first_ts;  // Out of order
+                            timestamps_in_order = false;
+                        }
 
-                uint64_t diff_ts = (last_ts - first_ts) / 1000;  // Now in units of 100 us
+                        last_current_ts = current_ts;  // This is not the last timestamp
+                    }
 
-                if (diff_ts > 0) {
-                    // There is a positive time difference between first and last timestamps
-                    // We can calculate a frames per second value
-                    double d_fps = ((double)(m_header.frame_count - 1) * 10000) / (double)diff_ts;
-                    m_fps_rate = (int32_t)(d_fps * 1000.0);
-                    m_fps_scale = 1000;
-                } else {
-                    // The time difference between first and last timestamps is 0 or -ve
-                    // No valid frames per second value can be calculated
-                    m_fps_rate = -1;
-                    m_fps_scale = 1;
+                    start_time_uct_minus_min_ts -= min_ts;
+                    if (start_time_uct_minus_min_ts < 0) {
+                        start_time_uct_minus_min_ts *= -1L;
+                    }
+
+                    start_time_minus_min_ts -= min_ts;
+                    if (start_time_minus_min_ts < 0) {
+                        start_time_minus_min_ts *= -1L;
+                    }
+
+                    if (start_time_uct_minus_min_ts <= start_time_minus_min_ts) {
+                        // Timestamps are in universal time
+                        m_metadata.timestamp_correction_value = 0L;
+                    } else {
+                        m_metadata.timestamp_correction_value = m_utc_to_local_offset;
+                    }
+
+                    uint64_t diff_ts = (last_ts - first_ts) / 1000;  // Now in units of 100 us
+
+                    if (diff_ts > 0) {
+                        // There is a positive time difference between first and last timestamps
+                        // We can calculate a frames per second value
+                        double d_fps = ((double)(m_header.frame_count - 1) * 10000) / (double)diff_ts;
+                        m_metadata.fps_rate = (int32_t)(d_fps * 1000.0);
+                        m_metadata.fps_scale = 1000;
+                    } else {
+                        // The time difference between first and last timestamps is 0 or -ve
+                        // No valid frames per second value can be calculated
+                        m_metadata.fps_rate = -1;
+                        m_metadata.fps_scale = 1;
+                    }
+
+                    m_metadata.min_timestamp = min_ts;
+                    m_metadata.max_timestamp = max_ts;
+                    m_metadata.timestamps_in_order = timestamps_in_order;
                 }
+
+                m_timestamp_correction_value = m_metadata.timestamp_correction_value;
+                m_fps_rate = m_metadata.fps_rate;
+                m_fps_scale = m_metadata.fps_scale;
             } else {
                 // Timestamp read failed
                 mp_timestamp = nullptr;
@@ -310,29 +415,49 @@ int32_t c_pipp_ser::open(
 
     // Code to check m_header.pixel_depth since many software packages seem to set this incorrectly
     if (m_byte_depth_in == 2 && m_header.frame_count > 0) {
-        const int FRAMES_TO_CHECK_FOR_PIXEL_DEPTH = 10;
-        int32_t pixel_depth[FRAMES_TO_CHECK_FOR_PIXEL_DEPTH];
-        pixel_depth[0] = find_pixel_depth(1);  // First frame
-        for (int x = 1; x < FRAMES_TO_CHECK_FOR_PIXEL_DEPTH-1; x++){  // Middle frames
-            int32_t frame_to_check = (m_header.frame_count * x)/(FRAMES_TO_CHECK_FOR_PIXEL_DEPTH-1);
-            if (frame_to_check == 0) {
-                frame_to_check = 1;
+        int32_t max_pixel_depth = 0;
+        if (use_cached_metadata && m_cached_metadata.pixel_depth > 0) {
+            // Pixel depth has already been found
+            max_pixel_depth = m_cached_metadata.pixel_depth;
+        } else {
+            // First, middle and last frames
+            uint32_t frames_to_check[C_FRAMES_TO_CHECK_FOR_PIXEL_DEPTH];
+            frames_to_check[0] = 1;
+            for (int x = 1; x < C_FRAMES_TO_CHECK_FOR_PIXEL_DEPTH-1; x++){
+                int32_t frame_to_check = ((int64_t)m_header.frame_count * x)/(C_FRAMES_TO_CHECK_FOR_PIXEL_DEPTH-1);
+                frames_to_check[x] = (frame_to_check == 0) ? 1 : frame_to_check;
             }
 
-            pixel_depth[x] = find_pixel_depth(frame_to_check);
-        }
+            frames_to_check[C_FRAMES_TO_CHECK_FOR_PIXEL_DEPTH-1] = m_header.frame_count;
 
-        pixel_depth[FRAMES_TO_CHECK_FOR_PIXEL_DEPTH-1] = find_pixel_depth(m_header.frame_count);    // Last frame
+            // Check the frames on several threads, all of them stop as soon as a full 16-bit pixel is seen
+            int32_t pixel_depth[C_FRAMES_TO_CHECK_FOR_PIXEL_DEPTH] = {};
+            std::atomic<bool> full_depth_found(false);
+            std::atomic<int> next_frame(0);
+            auto check_frames = [&]() {
+                int x;
+                while (!full_depth_found && (x = next_frame++) < C_FRAMES_TO_CHECK_FOR_PIXEL_DEPTH) {
+                    pixel_depth[x] = find_pixel_depth(frames_to_check[x], full_depth_found);
+                }
+            };
+
+            const int thread_count = std::min(C_FRAMES_TO_CHECK_FOR_PIXEL_DEPTH, (int)std::max(1U, std::thread::hardware_concurrency()));
+            std::vector<std::thread> threads;
+            for (int x = 1; x < thread_count; x++) {
+                threads.emplace_back(check_frames);
+            }
 
-        int32_t max_pixel_depth = pixel_depth[0];
-        for (int x = 1; x < FRAMES_TO_CHECK_FOR_PIXEL_DEPTH; x++) {
-            if (pixel_depth[x] > max_pixel_depth) {
-                max_pixel_depth = pixel_depth[x];
+            check_frames();
+            for (auto &thread : threads) {
+                thread.join();
             }
+
+            max_pixel_depth = (full_depth_found) ? 16 : *std::max_element(pixel_depth, pixel_depth + C_FRAMES_TO_CHECK_FOR_PIXEL_DEPTH);
         }
 
         // Use largest pixel depth found instead of the value from the SER header field
         m_header.pixel_depth = max_pixel_depth;
+        m_metadata.pixel_depth = max_pixel_depth;
         if (max_pixel_depth < 9) {
             m_byte_depth_out = 1;
         }
@@ -379,7 +504,7 @@ int32_t c_pipp_ser::fix_broken_ser_file(
     }
 
     // Calculate the size in bytes of each frame
-    int32_t frame_size = ser_header.image_width * ser_header.image_height;
+    int64_t frame_size = (int64_t)ser_header.image_width * ser_header.image_height;
     if (ser_header.colour_id == COLOURID_RGB || ser_header.colour_id == COLOURID_BGR) {
         frame_size *= 3;  // Colour images have twice as many samples
     }
@@ -391,7 +516,8 @@ int32_t c_pipp_ser::fix_broken_ser_file(
     // Use the frame size to calculate how many whole frames are in the file
     filesize -= 14;  // Remove File ID size from file size
     filesize -= sizeof(ser_header);  // Remove header size from file size
-    int32_t frame_count_calculated = filesize / frame_size;
+    // The header can only hold a 32-bit frame count
+    int32_t frame_count_calculated = (frame_size > 0) ? (int32_t)std::min((int64_t)INT32_MAX, filesize / frame_size) : 0;
 
     // Update the frame_count field in the SER file header
     ser_header.frame_count = frame_count_calculated;
@@ -416,20 +542,39 @@ int32_t c_pipp_ser::fix_broken_ser_file(
 
 
 int32_t c_pipp_ser::find_pixel_depth(
-    uint32_t frame_number)
+    uint32_t frame_number,
+    std::atomic<bool> &full_depth_found) const
 {
-    std::unique_ptr<uint8_t[]> p_temp_buffer(new uint8_t[m_header.image_width * m_header.image_height * 2 * 3]);
-    int32_t stored_pixel_depth = m_header.pixel_depth;
-    m_header.pixel_depth = 16;  // Do not shift data this time
-    get_frame(frame_number, p_temp_buffer.get());  // Get the first frame to analyse
-    m_header.pixel_depth = stored_pixel_depth;  // Restore pixel depth
-
+    // OR together the raw samples, this works whatever the endianess of the data
+    const uint64_t frame_offset = ((uint64_t)(frame_number - 1) * m_framesize_in) + 178;
+    std::unique_ptr<uint8_t[]> p_chunk_buffer;
+    uint16_t raw_max_pixel = 0;
     uint16_t max_pixel = 0;
-    uint16_t *p_temp_ptr = (uint16_t *)p_temp_buffer.get();
-    for (int x = 0; x < m_header.image_width * m_header.image_height; x++) {
-        max_pixel |= *p_temp_ptr++;
-        max_pixel |= *p_temp_ptr++;
-        max_pixel |= *p_temp_ptr++;
+    for (uint64_t chunk_start = 0; chunk_start < m_framesize_in && !full_depth_found; chunk_start += C_PIXEL_DEPTH_CHUNK_SIZE) {
+        const uint64_t chunk_size = std::min(C_PIXEL_DEPTH_CHUNK_SIZE, m_framesize_in - chunk_start);
+        const uint8_t *p_data = get_mapped_data(frame_offset + chunk_start, chunk_size);
+        if (p_data == nullptr) {
+            if (p_chunk_buffer == nullptr) {
+                p_chunk_buffer.reset(new uint8_t[C_PIXEL_DEPTH_CHUNK_SIZE]);
+            }
+
+            if (!read_at(frame_offset + chunk_start, p_chunk_buffer.get(), chunk_size)) {
+                break;
+            }
+
+            p_data = p_chunk_buffer.get();
+        }
+
+        raw_max_pixel |= c_ser_unpack::or_16(p_data, chunk_size / 2);
+
+        // Read the result the same way get_frame() reads samples
+        uint8_t raw_bytes[2];
+        memcpy(raw_bytes, &raw_max_pixel, sizeof(raw_bytes));
+        max_pixel = (m_same_data_and_processor_endian) ? raw_max_pixel : (uint16_t)((raw_bytes[0] << 8) + raw_bytes[1]);
+        if (max_pixel >= 0x8000) {
+            // No point looking any further
+            full_depth_found = true;
+        }
     }
 
     // Find the pixel depth from max_pixel
@@ -448,9 +593,9 @@ int32_t c_pipp_ser::find_pixel_depth(
 // ------------------------------------------
 // Get size of buffer required to store frame
 // ------------------------------------------
-int32_t c_pipp_ser::get_buffer_size()
+int64_t c_pipp_ser::get_buffer_size()
 {
-    int size = m_header.image_width * m_header.image_height * m_byte_depth_out;
+    int64_t size = (int64_t)m_header.image_width * m_header.image_height * m_byte_depth_out;
 
     if (m_header.colour_id == COLOURID_RGB || m_header.colour_id == COLOURID_BGR) {
         size *= 3;
@@ -460,6 +605,55 @@ int32_t c_pipp_ser::get_buffer_size()
 }
 
 
+// ------------------------------------------
+// Get size of buffer required to store a region of a frame
+// ------------------------------------------
+int64_t c_pipp_ser::get_buffer_size(
+    const s_roi &roi) const
+{
+    int64_t size = (int64_t)roi.width * roi.height * m_byte_depth_out;
+
+    if (m_header.colour_id == COLOURID_RGB || m_header.colour_id == COLOURID_BGR) {
+        size *= 3;
+    }
+
+    return size;
+}
+
+
+// ------------------------------------------
+// Get the region that has to be read to crop frames
+// ------------------------------------------
+c_pipp_ser::s_roi c_pipp_ser::get_crop_roi(
+    int32_t crop_x,
+    int32_t crop_y,
+    int32_t crop_width,
+    int32_t crop_height,
+    bool cfa_margin) const
+{
+    s_roi roi = {crop_x, crop_y, crop_width, crop_height};
+    if (!is_valid_roi(roi)) {
+        // c_image::crop_image() does not crop in this case either
+        return get_full_roi();
+    }
+
+    if (cfa_margin) {
+        // Bilinear debayering uses the neighbouring pixels, so keep 2 pixels each side
+        // and round the start down to keep the 2x2 pattern in step with the whole frame
+        int32_t left = std::max(0, crop_x - 2) & ~1;
+        int32_t top = std::max(0, crop_y - 2) & ~1;
+        int32_t right = std::min(m_header.image_width, crop_x + crop_width + 2);
+        int32_t bottom = std::min(m_header.image_height, crop_y + crop_height + 2);
+        roi.x = left;
+        roi.y = top;
+        roi.width = right - left;
+        roi.height = bottom - top;
+    }
+
+    return roi;
+}
+
+
 // ------------------------------------------
 // Get observer string
 // ------------------------------------------
@@ -513,32 +707,10 @@ std::string c_pipp_ser::get_timestamp_info()
     std::string info_string;
 
     if (mp_timestamp != nullptr) {
-        //mp_timestamp = (uint64_t *)(m_timestamp_buffer.get_buffer_ptr() + (8 * m_current_frame));
-        uint64_t *timestamp_ptr = (uint64_t *)m_timestamp_buffer.get_buffer_ptr();
-        bool timestamps_in_order = true;
-        uint64_t previous_ts = 0L;
-        uint64_t min_ts = *timestamp_ptr;
-        uint64_t max_ts = *timestamp_ptr;
-        for (int x = 0; x < m_header.frame_count; x++) {
-            if (*timestamp_ptr < previous_ts) {
-                // Timestamps are not in order
-                timestamps_in_order = false;
-            }
-
-            previous_ts = *timestamp_ptr;
-
-            // Keep track of maximum timestamp value
-            if (*timestamp_ptr > max_ts) {
-                max_ts = *timestamp_ptr;
-            }
-
-            // Keep track of minimum timestamp value
-            if (*timestamp_ptr < min_ts) {
-                min_ts = *timestamp_ptr;
-            }
-
-            timestamp_ptr++;
-        }
+        // Timestamps were analysed by open()
+        bool timestamps_in_order = m_metadata.timestamps_in_order;
+        uint64_t min_ts = m_metadata.min_timestamp;
+        uint64_t max_ts = m_metadata.max_timestamp;
 
         if (timestamps_in_order) {
             if (min_ts == max_ts) {
@@ -643,17 +815,112 @@ std::string c_pipp_ser::get_timestamp_info()
 // Close file
 // ------------------------------------------
 int32_t c_pipp_ser::close() {
+    unmap_file();
     if (mp_ser_file != nullptr) {
         fclose(mp_ser_file);
         mp_ser_file = nullptr;
     }
 
+    {
+        std::lock_guard<std::mutex> lock(m_io_backend_mutex);
+        mp_io_backend.reset();
+    }
+
     m_error_string.clear();
 
     return 0;
 }
 
 
+// ------------------------------------------
+// Recheck the size of a followed file
+// ------------------------------------------
+int32_t c_pipp_ser::update_frame_count()
+{
+    // Early return if the file is not being followed
+    if (!m_following || mp_ser_file == nullptr) {
+        return m_header.frame_count;
+    }
+
+    // Get file size
+    fseek64(mp_ser_file, 0, SEEK_END);
+    int64_t filesize = ftell64(mp_ser_file);
+    int32_t frame_count = get_complete_frames(filesize);
+
+    // Once recording finishes the frame count is written to the header and timestamps may be
+    // added after the frames, which must not be counted as frames
+    int32_t header_frame_count = 0;
+    fseek64(mp_ser_file, 14 + offsetof(s_ser_header, frame_count), SEEK_SET);
+    if (fread(&header_frame_count, 1, sizeof(header_frame_count), mp_ser_file) == sizeof(header_frame_count)) {
+        if (m_big_endian_processor) {
+            header_frame_count = swap_endianess(header_frame_count);
+        }
+    }
+
+    if (header_frame_count > 0) {
+        // The header frame count is right even if timestamps were counted as frames before it was written
+        m_header.frame_count = std::min(frame_count, header_frame_count);
+        if (frame_count >= header_frame_count) {
+            // Recording has finished, there is nothing more to follow
+            m_following = false;
+        }
+    } else if (frame_count > m_header.frame_count) {
+        m_header.frame_count = frame_count;
+    }
+
+    m_filesize = filesize;
+
+    return m_header.frame_count;
+}
+
+
+// ------------------------------------------
+// Number of frames that have been completely written to a file of this size
+// ------------------------------------------
+int32_t c_pipp_ser::get_complete_frames(
+    int64_t filesize) const
+{
+    if (filesize <= 178 || m_framesize_in == 0) {
+        return 0;
+    }
+
+    return (int32_t)std::min((int64_t)INT32_MAX, (filesize - 178) / (int64_t)m_framesize_in);
+}
+
+
+// ------------------------------------------
+// Set how frame data is read from the file
+// ------------------------------------------
+void c_pipp_ser::set_io_mode(
+    c_ser_io_backend::e_io_mode io_mode)
+{
+    if (io_mode == m_io_mode) {
+        return;
+    }
+
+    m_io_mode = io_mode;
+    if (get_io_backend() != nullptr) {
+        // Swap the backend for the open file, keeping the old one if the file cannot be reopened.
+        // The old backend is freed once the last read using it has finished.
+        std::shared_ptr<c_ser_io_backend> p_io_backend = c_ser_io_backend::create(io_mode, m_filename);
+        if (p_io_backend != nullptr) {
+            std::lock_guard<std::mutex> lock(m_io_backend_mutex);
+            mp_io_backend.swap(p_io_backend);
+        }
+    }
+}
+
+
+// ------------------------------------------
+// Get the I/O backend for a read, which stays valid even if set_io_mode() replaces it
+// ------------------------------------------
+std::shared_ptr<c_ser_io_backend> c_pipp_ser::get_io_backend() const
+{
+    std::lock_guard<std::mutex> lock(m_io_backend_mutex);
+    return mp_io_backend;
+}
+
+
 // ------------------------------------------
 // Get error string
 // ------------------------------------------
@@ -663,6 +930,130 @@ std::string c_pipp_ser::get_error_string()
 }
 
 
+// ------------------------------------------
+// Map the open file into memory
+// ------------------------------------------
+void c_pipp_ser::map_file()
+{
+    unmap_file();
+
+#ifdef PIPP_SER_MMAP_SUPPORT
+    // Early return if the file is too large for the address space
+    if ((uint64_t)m_filesize > (uint64_t)SIZE_MAX) {
+        return;
+    }
+
+    // Early return if the file is still being recorded, the recording software could truncate
+    // or rewrite it and reading a mapped page beyond the end of the file raises SIGBUS.
+    // Finished files are not expected to change while they are open, so mapped reads are not checked.
+    if (m_following) {
+        return;
+    }
+
+    void *p_map = mmap(nullptr, (size_t)m_filesize, PROT_READ, MAP_SHARED, fileno(mp_ser_file), 0);
+    if (p_map == MAP_FAILED) {
+        // Mapping failed, fall back to stdio reads
+        return;
+    }
+
+    mp_mapped_file = (uint8_t *)p_map;
+    m_mapped_size = (uint64_t)m_filesize;
+#endif
+}
+
+
+// ------------------------------------------
+// Unmap the file from memory
+// ------------------------------------------
+void c_pipp_ser::unmap_file()
+{
+#ifdef PIPP_SER_MMAP_SUPPORT
+    if (mp_mapped_file != nullptr) {
+        munmap(mp_mapped_file, (size_t)m_mapped_size);
+    }
+#endif
+
+    mp_mapped_file = nullptr;
+    m_mapped_size = 0;
+}
+
+
+// ------------------------------------------
+// Get a pointer into the mapped file
+// ------------------------------------------
+const uint8_t *c_pipp_ser::get_mapped_data(
+    uint64_t offset,
+    uint64_t size) const
+{
+    // Other I/O modes are chosen to control the page cache, which reading the mapping would get around
+    if (mp_mapped_file == nullptr || m_io_mode != c_ser_io_backend::IO_MODE_BUFFERED || offset + size > m_mapped_size) {
+        return nullptr;
+    }
+
+    return mp_mapped_file + offset;
+}
+
+
+// ------------------------------------------
+// Get pointer to the raw data of the current frame
+// ------------------------------------------
+const uint8_t *c_pipp_ser::read_frame_data(
+    uint64_t size)
+{
+    // m_current_frame has already been incremented to this frame
+    uint64_t offset = ((uint64_t)(m_current_frame - 1) * (uint64_t)m_framesize_in) + 178;
+    const uint8_t *p_mapped_data = get_mapped_data(offset, size);
+    if (p_mapped_data != nullptr) {
+        return p_mapped_data;
+    }
+
+    // Not mapped, read frame into temp buffer
+    uint8_t *temp_buffer_ptr = m_temp_buffer.get_buffer(size);
+    read_at(offset, temp_buffer_ptr, size);
+    return temp_buffer_ptr;
+}
+
+
+// ------------------------------------------
+// Get a read-only view of a frame's raw data
+// ------------------------------------------
+const uint8_t *c_pipp_ser::get_frame_view(
+    uint32_t frame_number) const
+{
+    // Early return if there is no frame
+    if (frame_number == 0 || m_header.frame_count <= 0) {
+        return nullptr;
+    }
+
+    // Ensure frame is in range
+    if (frame_number > (uint32_t)m_header.frame_count) {
+        frame_number = (uint32_t)m_header.frame_count;
+    }
+
+    uint64_t offset = ((uint64_t)(frame_number - 1) * (uint64_t)m_framesize_in) + 178;
+    return get_mapped_data(offset, m_framesize_in);
+}
+
+
+// ------------------------------------------
+// Does get_frame_view() data only differ from get_frame() data by line order
+// ------------------------------------------
+bool c_pipp_ser::frame_view_is_native() const
+{
+    if (m_header.colour_id == COLOURID_RGB) {
+        // get_frame() swaps RGB data to BGR
+        return false;
+    }
+
+    if (m_byte_depth_in == 1) {
+        return true;
+    }
+
+    // 16-bit data must not need byte swapping, shifting or reducing to 8 bits
+    return m_byte_depth_out == 2 && m_header.pixel_depth == 16 && m_same_data_and_processor_endian;
+}
+
+
 // ------------------------------------------
 // Get particular frame from SER file
 // ------------------------------------------
@@ -678,8 +1069,6 @@ int32_t c_pipp_ser::get_frame (
     if (frame_number != m_current_frame + 1) {
         // This is not the next frame, seek to the correct frame
         m_current_frame = frame_number - 1;
-        uint64_t offset = ((uint64_t)m_current_frame * (uint64_t)m_framesize_in) + 178;
-        fseek64(mp_ser_file, offset, SEEK_SET);
 
         // Update timestamp pointer
         if (mp_timestamp != nullptr) {
@@ -714,493 +1103,289 @@ int32_t c_pipp_ser::get_frame (
         m_timestamp = *mp_timestamp++;
     }
 
-    if (m_byte_depth_in == 2 && m_byte_depth_out == 2) {
-        // More than 8 bits per pixel
-        if (m_header.colour_id == COLOURID_RGB) {
-            // Colour RGB data
+    // Skip frame if required
+    if (buffer == nullptr) {
+        return 0;
+    }
 
-            // Skip frame if required
-            if (buffer == nullptr) {
-                fseek64(mp_ser_file, m_header.image_width * m_header.image_height * 6 ,SEEK_CUR);
-                return 0;
-            }
+    // Get the frame data, either from the mapped file or loaded into a temp buffer
+    const uint8_t *p_frame_data = read_frame_data(m_framesize_in);
 
-            // Create a temp buffer and load frame from file into it
-            uint16_t *temp_buffer_ptr = (uint16_t *)m_temp_buffer.get_buffer(m_header.image_width * m_header.image_height * 2 * 3);
-            fread(temp_buffer_ptr, 1, m_header.image_width * m_header.image_height * 2 * 3, mp_ser_file);
-
-            // Copy data into supplied buffer 
-            uint8_t *read_ptr8;
-            uint16_t *read_ptr;
-            uint16_t *write_ptr = (uint16_t *)buffer;
-
-            if (m_header.pixel_depth == 16) {
-                //if (m_header.little_endian == 0) {
-                if (m_same_data_and_processor_endian) {
-                    // 16-bit data with same endianess as the processor
-                    for (int32_t y = m_header.image_height-1; y >= 0; y--) {
-                        read_ptr = temp_buffer_ptr + y * m_header.image_width * 3;
-                        for (int32_t x = 0; x < m_header.image_width; x++) {
-                            uint16_t r = *read_ptr++;
-                            uint16_t g = *read_ptr++;
-                            uint16_t b = *read_ptr++;
-
-                            *write_ptr++ = b;
-                            *write_ptr++ = g;
-                            *write_ptr++ = r;
-                        }
-                    }
-                } else {
-                    // 16-bit data with different endianess as the processor
-                    for (int32_t y = m_header.image_height-1; y >= 0; y--) {
-                        read_ptr8 = (uint8_t *)(temp_buffer_ptr + y * m_header.image_width * 3);
-                        for (int32_t x = 0; x < m_header.image_width; x++) {
-                            uint16_t r = (*read_ptr8++) << 8;
-                            r += *read_ptr8++;
-                            uint16_t g = (*read_ptr8++) << 8;
-                            g += *read_ptr8++;
-                            uint16_t b = (*read_ptr8++) << 8;
-                            b += *read_ptr8++;
-
-                            *write_ptr++ = b;
-                            *write_ptr++ = g;
-                            *write_ptr++ = r;
-                        }
-                    }
-                }
-            } else {
-                //if (m_header.little_endian == 0) {
-                if (m_same_data_and_processor_endian) {
-                    // bits per pixel > 8 but < 16 data with same endianess as the processor
-                    uint16_t r, g, b;
-                    uint32_t shift1 = 16 - m_header.pixel_depth;
-                    uint32_t shift2 = m_header.pixel_depth - shift1;
-                    for (int32_t y = m_header.image_height-1; y >= 0; y--) {
-                        read_ptr = temp_buffer_ptr + y * m_header.image_width * 3;
-                        for (int32_t x = 0; x < m_header.image_width; x++) {
-                            r = *read_ptr++;
-                            r = (r << shift1) + (r >> shift2);
-                            g = *read_ptr++;
-                            g = (g << shift1) + (g >> shift2);
-                            b = *read_ptr++;
-                            b = (b << shift1) + (b >> shift2);
-
-                            *write_ptr++ = b;
-                            *write_ptr++ = g;
-                            *write_ptr++ = r;
-                        }
-                    }
-                } else {
-                    // bits per pixel > 8 but < 16 data with different endianess as the processor
-                    uint32_t shift1 = 16 - m_header.pixel_depth;
-                    uint32_t shift2 = m_header.pixel_depth - shift1;
-                    for (int32_t y = m_header.image_height-1; y >= 0; y--) {
-                        read_ptr8 = (uint8_t *)(temp_buffer_ptr + y * m_header.image_width * 3);
-                        for (int32_t x = 0; x < m_header.image_width; x++) {
-                            uint16_t r = (*read_ptr8++) << 8;
-                            r += *read_ptr8++;
-                            uint16_t g = (*read_ptr8++) << 8;
-                            g += *read_ptr8++;
-                            uint16_t b = (*read_ptr8++) << 8;
-                            b += *read_ptr8++;
-
-                            *write_ptr++ = (b << shift1) + (b >> shift2);
-                            *write_ptr++ = (g << shift1) + (g >> shift2);
-                            *write_ptr++ = (r << shift1) + (r >> shift2);
-                        }
-                    }
-                }
-            }
+    // Copy data into supplied buffer
+    convert_frame_data(p_frame_data, buffer, get_full_roi());
+    return 0;
+}
 
-        } else if (m_header.colour_id == COLOURID_BGR) {
-            // Colour BGR data
 
-            // Skip frame if required
-            if (buffer == nullptr) {
-                fseek64(mp_ser_file, m_header.image_width * m_header.image_height * 6 ,SEEK_CUR);
-                return 0;
-            }
+// ------------------------------------------
+// Read a particular frame without changing the current frame
+// ------------------------------------------
+int32_t c_pipp_ser::read_frame (
+    uint32_t frame_number,
+    uint8_t *buffer) const
+{
+    return read_frame(frame_number, get_full_roi(), buffer);
+}
 
-            // Create a temp buffer and load frame from file into it
-            uint16_t *temp_buffer_ptr = (uint16_t *)m_temp_buffer.get_buffer(m_header.image_width * m_header.image_height * 2 * 3);
-            fread(temp_buffer_ptr, 1, m_header.image_width * m_header.image_height * 2 * 3, mp_ser_file);
-
-            // Copy data into supplied buffer 
-            uint8_t *read_ptr8;
-            uint16_t *read_ptr;
-            uint16_t *write_ptr = (uint16_t *)buffer;
-
-            if (m_header.pixel_depth == 16) {
-                //if (m_header.little_endian == 0) {
-                if (m_same_data_and_processor_endian) {
-                    // 16-bit data with same endianess as the processor
-                    for (int32_t y = m_header.image_height-1; y >= 0; y--) {
-                        read_ptr = temp_buffer_ptr + y * m_header.image_width * 3;
-                        for (int32_t x = 0; x < m_header.image_width; x++) {
-                            *write_ptr++ = *read_ptr++;
-                            *write_ptr++ = *read_ptr++;
-                            *write_ptr++ = *read_ptr++;
-                        }
-                    }
-                } else {
-                    // 16-bit data with different endianess as the processor
-                    for (int32_t y = m_header.image_height-1; y >= 0; y--) {
-                        read_ptr8 = (uint8_t *)(temp_buffer_ptr + y * m_header.image_width * 3);
-                        for (int32_t x = 0; x < m_header.image_width; x++) {
-                            uint16_t b = (*read_ptr8++) << 8;
-                            b += *read_ptr8++;
-                            uint16_t g = (*read_ptr8++) << 8;
-                            g += *read_ptr8++;
-                            uint16_t r = (*read_ptr8++) << 8;
-                            r += *read_ptr8++;
-
-                            *write_ptr++ = b;
-                            *write_ptr++ = g;
-                            *write_ptr++ = r;
-                        }
-                    }
-                }
-            } else if (m_header.pixel_depth > 8) {
-                //if (m_header.little_endian == 0) {
-                if (m_same_data_and_processor_endian) {
-                    // bits per pixel > 8 but < 16 data with same endianess as the processor
-                    uint16_t r, g, b;
-                    uint32_t shift1 = 16 - m_header.pixel_depth;
-                    uint32_t shift2 = m_header.pixel_depth - shift1;
-                    for (int32_t y = m_header.image_height-1; y >= 0; y--) {
-                        read_ptr = temp_buffer_ptr + y * m_header.image_width * 3;
-                        for (int32_t x = 0; x < m_header.image_width; x++) {
-                            b = *read_ptr++;
-                            b = (b << shift1) + (b >> shift2);
-                            g = *read_ptr++;
-                            g = (g << shift1) + (g >> shift2);
-                            r = *read_ptr++;
-                            r = (r << shift1) + (r >> shift2);
-
-                            *write_ptr++ = b;
-                            *write_ptr++ = g;
-                            *write_ptr++ = r;
-                        }
-                    }
-                } else {
-                    // bits per pixel > 8 but < 16 data with different endianess as the processor
-                    uint32_t shift1 = 16 - m_header.pixel_depth;
-                    uint32_t shift2 = m_header.pixel_depth - shift1;
-                    for (int32_t y = m_header.image_height-1; y >= 0; y--) {
-                        read_ptr8 = (uint8_t *)(temp_buffer_ptr + y * m_header.image_width * 3);
-                        for (int32_t x = 0; x < m_header.image_width; x++) {
-                            uint16_t b = (*read_ptr8++) << 8;
-                            b += *read_ptr8++;
-                            b = (b << shift1) + (b >> shift2);
-                            uint16_t g = (*read_ptr8++) << 8;
-                            g += *read_ptr8++;
-                            g = (g << shift1) + (g >> shift2);
-                            uint16_t r = (*read_ptr8++) << 8;
-                            r += *read_ptr8++;
-                            r = (r << shift1) + (r >> shift2);
-
-                            *write_ptr++ = b;
-                            *write_ptr++ = g;
-                            *write_ptr++ = r;
-                        }
-                    }
-                }
-            }
-        } else {
-            // Mono data
 
-            // Skip frame if required
-            if (buffer == nullptr) {
-                fseek64(mp_ser_file, m_header.image_width * m_header.image_height * 2 ,SEEK_CUR);
-                return 0;
-            }
+// ------------------------------------------
+// Read a region of a particular frame without changing the current frame
+// ------------------------------------------
+int32_t c_pipp_ser::read_frame (
+    uint32_t frame_number,
+    const s_roi &roi,
+    uint8_t *buffer) const
+{
+    // Early return checks
+    if (mp_ser_file == nullptr || buffer == nullptr || frame_number == 0 || !is_valid_roi(roi)) {
+        return -1;
+    }
 
-            // Create a temp buffer and load frame from file into it
-            uint16_t *temp_buffer_ptr = (uint16_t *)m_temp_buffer.get_buffer(m_header.image_width * m_header.image_height * 2);
-            fread(temp_buffer_ptr, 1, m_header.image_width * m_header.image_height * 2, mp_ser_file);
-
-            // Copy data into supplied buffer 
-            uint8_t *read_ptr8;
-            uint16_t *read_ptr;
-            uint16_t *write_ptr = (uint16_t *)buffer;
-
-            if (m_header.pixel_depth == 16) {
-                //if (m_header.little_endian == 0) {
-                if (m_same_data_and_processor_endian) {
-                    // 16-bit data with same endianess as the processor
-                    for (int32_t y = m_header.image_height-1; y >= 0; y--) {
-                        read_ptr = temp_buffer_ptr + y * m_header.image_width;
-                        for (int32_t x = 0; x < m_header.image_width; x++) {
-                            *write_ptr++ = *read_ptr++;
-                        }
-                    }
-                } else {
-                    // 16-bit data with different endianess as the processor
-                    for (int32_t y = m_header.image_height-1; y >= 0; y--) {
-                        read_ptr8 = (uint8_t *)(temp_buffer_ptr + y * m_header.image_width);
-                        for (int32_t x = 0; x < m_header.image_width; x++) {
-                            uint16_t value = (*read_ptr8++) << 8;
-                            value += *read_ptr8++;
-                            *write_ptr++ = value;
-                        }
-                    }
-                }
-            } else  {
-                //if (m_header.little_endian == 0) {
-                if (m_same_data_and_processor_endian) {
-                    // bits per pixel > 8 but < 16 data with same endianess as the processor
-                    uint16_t value;
-                    uint32_t shift1 = 16 - m_header.pixel_depth;
-                    uint32_t shift2 = m_header.pixel_depth - shift1;
-                    for (int32_t y = m_header.image_height-1; y >= 0; y--) {
-                        read_ptr = temp_buffer_ptr + y * m_header.image_width;
-                        for (int32_t x = 0; x < m_header.image_width; x++) {
-                            value = *read_ptr++;
-                            value = (value << shift1) + (value >> shift2);
-                            *write_ptr++ = value;
-                        }
-                    }
-                } else {
-                    // bits per pixel > 8 but < 16 data with different endianess as the processor
-                    uint32_t shift1 = 16 - m_header.pixel_depth;
-                    uint32_t shift2 = m_header.pixel_depth - shift1;
-                    for (int32_t y = m_header.image_height-1; y >= 0; y--) {
-                        read_ptr8 = (uint8_t *)(temp_buffer_ptr + y * m_header.image_width);
-                        for (int32_t x = 0; x < m_header.image_width; x++) {
-                            uint16_t value = (*read_ptr8++) << 8;
-                            value += *read_ptr8++;
-                            value = (value << shift1) + (value >> shift2);
-                            *write_ptr++ = value;
-                        }
-                    }
-                }
-            }
-        }
-    } else if (m_byte_depth_in == 2 && m_byte_depth_out == 1) {
-        // More than 8 bits per pixel
-        if (m_header.colour_id == COLOURID_RGB) {
-            // Colour RGB data
+    // Ensure frame is in range
+    if (frame_number > (uint32_t)m_header.frame_count) {
+        frame_number = (uint32_t)m_header.frame_count;
+    }
 
-            // Skip frame if required
-            if (buffer == nullptr) {
-                fseek64(mp_ser_file, m_header.image_width * m_header.image_height * 6 ,SEEK_CUR);
-                return 0;
-            }
+    // Only the lines the region covers are read
+    const uint64_t line_size = get_line_size_in();
+    const uint64_t read_size = (uint64_t)roi.height * line_size;
+    uint64_t offset = ((uint64_t)(frame_number - 1) * (uint64_t)m_framesize_in) + 178 + (uint64_t)roi.y * line_size;
+    const uint8_t *p_mapped_data = get_mapped_data(offset, read_size);
+    if (p_mapped_data != nullptr) {
+        // Convert straight from the mapped file
+        convert_frame_data(p_mapped_data, buffer, roi);
+        return 0;
+    }
 
-            // Create a temp buffer and load frame from file into it
-            uint16_t *temp_buffer_ptr = (uint16_t *)m_temp_buffer.get_buffer(m_header.image_width * m_header.image_height * 2 * 3);
-            fread(temp_buffer_ptr, 1, m_header.image_width * m_header.image_height * 2 * 3, mp_ser_file);
-
-            // Copy data into supplied buffer
-            uint8_t *read_ptr8;
-            uint8_t *write_ptr8 = (uint8_t *)buffer;
-
-            if (m_header.little_endian == 0) {
-                // Little endian (16-bit data) but pixel depth is only 8-bits
-                for (int32_t y = m_header.image_height-1; y >= 0; y--) {
-                    read_ptr8 = (uint8_t *)(temp_buffer_ptr + y * m_header.image_width * 3);
-                    for (int32_t x = 0; x < m_header.image_width; x++) {
-                        uint8_t r = *read_ptr8;
-                        read_ptr8 += 2;
-                        uint8_t g = *read_ptr8;
-                        read_ptr8 += 2;
-                        uint8_t b = *read_ptr8;
-                        read_ptr8 += 2;
-
-                        *write_ptr8++ = b;
-                        *write_ptr8++ = g;
-                        *write_ptr8++ = r;
-                    }
-                }
-            } else {
-                // Big endian (16-bit data) but pixel depth is only 8-bits
-                for (int32_t y = m_header.image_height-1; y >= 0; y--) {
-                    read_ptr8 = (uint8_t *)(temp_buffer_ptr + y * m_header.image_width * 3);
-                    read_ptr8++;
-                    for (int32_t x = 0; x < m_header.image_width; x++) {
-                        uint8_t r = *read_ptr8;
-                        read_ptr8 += 2;
-                        uint8_t g = *read_ptr8;
-                        read_ptr8 += 2;
-                        uint8_t b = *read_ptr8;
-                        read_ptr8 += 2;
-
-                        *write_ptr8++ = b;
-                        *write_ptr8++ = g;
-                        *write_ptr8++ = r;
-                    }
-                }
-            }
-        } else if (m_header.colour_id == COLOURID_BGR) {
-            // Colour BGR data
+    // Scratch buffer is per call so that calls on different threads share nothing
+    std::unique_ptr<uint8_t[]> p_frame_data(new uint8_t[read_size]);
+    if (!read_at(offset, p_frame_data.get(), read_size)) {
+        return -1;
+    }
 
-            // Skip frame if required
-            if (buffer == nullptr) {
-                fseek64(mp_ser_file, m_header.image_width * m_header.image_height * 6 ,SEEK_CUR);
-                return 0;
-            }
+    convert_frame_data(p_frame_data.get(), buffer, roi);
+    return 0;
+}
 
-            // Create a temp buffer and load frame from file into it
-            uint16_t *temp_buffer_ptr = (uint16_t *)m_temp_buffer.get_buffer(m_header.image_width * m_header.image_height * 2 * 3);
-            fread(temp_buffer_ptr, 1, m_header.image_width * m_header.image_height * 2 * 3, mp_ser_file);
-
-            // Copy data into supplied buffer
-            uint8_t *read_ptr8;
-            uint8_t *write_ptr8 = (uint8_t *)buffer;
-
-            if (m_header.little_endian == 0) {
-                // Little endian (16-bit data) but pixel depth is only 8-bits
-                for (int32_t y = m_header.image_height-1; y >= 0; y--) {
-                    read_ptr8 = (uint8_t *)(temp_buffer_ptr + y * m_header.image_width * 3);
-                    for (int32_t x = 0; x < m_header.image_width; x++) {
-                        uint8_t b = *read_ptr8;
-                        read_ptr8 += 2;
-                        uint8_t g = *read_ptr8;
-                        read_ptr8 += 2;
-                        uint8_t r = *read_ptr8;
-                        read_ptr8 += 2;
-
-                        *write_ptr8++ = b;
-                        *write_ptr8++ = g;
-                        *write_ptr8++ = r;
-                    }
-                }
-            } else {
-                // Big endian (16-bit data) but pixel depth is only 8-bits
-                for (int32_t y = m_header.image_height-1; y >= 0; y--) {
-                    read_ptr8 = (uint8_t *)(temp_buffer_ptr + y * m_header.image_width * 3);
-                    read_ptr8++;
-                    for (int32_t x = 0; x < m_header.image_width; x++) {
-                        uint8_t b = *read_ptr8;
-                        read_ptr8 += 2;
-                        uint8_t g = *read_ptr8;
-                        read_ptr8 += 2;
-                        uint8_t r = *read_ptr8;
-                        read_ptr8 += 2;
-
-                        *write_ptr8++ = b;
-                        *write_ptr8++ = g;
-                        *write_ptr8++ = r;
-                    }
-                }
-            }
-        } else {
-            // Mono Data
 
-            // Skip frame if required
-            if (buffer == nullptr) {
-                fseek64(mp_ser_file, m_header.image_width * m_header.image_height * 2 ,SEEK_CUR);
-                return 0;
-            }
+// ------------------------------------------
+// Read from an absolute file offset without using the file position
+// ------------------------------------------
+bool c_pipp_ser::read_at(
+    uint64_t offset,
+    uint8_t *p_buffer,
+    size_t size) const
+{
+    return get_io_backend()->read_at(offset, p_buffer, size);
+}
 
-            // Create a temp buffer and load frame from file into it
-            uint16_t *temp_buffer_ptr = (uint16_t *)m_temp_buffer.get_buffer(m_header.image_width * m_header.image_height * 2);
-            fread(temp_buffer_ptr, 1, m_header.image_width * m_header.image_height * 2, mp_ser_file);
 
-            // Copy data into supplied buffer
-            uint8_t *read_ptr8;
-            uint8_t *write_ptr8 = (uint8_t *)buffer;
+// ------------------------------------------
+// Read a run of evenly spaced frames
+// ------------------------------------------
+int32_t c_pipp_ser::get_frames (
+    uint32_t first_frame,
+    uint32_t last_frame,
+    uint32_t stride,
+    const t_frame_function &frame_function) const
+{
+    return get_frames(first_frame, last_frame, stride, get_full_roi(), frame_function);
+}
 
-            if (m_header.little_endian == 0) {
-                // Little endian (16-bit data) but pixel depth is only 8-bits
-                for (int32_t y = m_header.image_height-1; y >= 0; y--) {
-                    read_ptr8 = (uint8_t *)(temp_buffer_ptr + y * m_header.image_width);
-                    for (int32_t x = 0; x < m_header.image_width; x++) {
-                        uint8_t value = *read_ptr8;
-                        read_ptr8 += 2;
 
-                        *write_ptr8++ = value;
-                    }
-                }
-            } else {
-                // Big endian (16-bit data) but pixel depth is only 8-bits
-                for (int32_t y = m_header.image_height-1; y >= 0; y--) {
-                    read_ptr8 = (uint8_t *)(temp_buffer_ptr + y * m_header.image_width);
-                    read_ptr8++;
-                    for (int32_t x = 0; x < m_header.image_width; x++) {
-                        uint8_t value = *read_ptr8;
-                        read_ptr8 += 2;
-
-                        *write_ptr8++ = value;
-                    }
-                }
-            }
-        }
-    } else {
-        // 8 bits per pixel
-        if (m_header.colour_id == COLOURID_RGB) {
-            // 24-bit RGB data
+// ------------------------------------------
+// Read a region of a run of evenly spaced frames
+// ------------------------------------------
+int32_t c_pipp_ser::get_frames (
+    uint32_t first_frame,
+    uint32_t last_frame,
+    uint32_t stride,
+    const s_roi &roi,
+    const t_frame_function &frame_function) const
+{
+    // Early return checks
+    if (mp_ser_file == nullptr || first_frame == 0 || last_frame == 0 || stride == 0 || !is_valid_roi(roi)) {
+        return -1;
+    }
 
-            // Skip frame if required
-            if (buffer == nullptr) {
-                fseek64(mp_ser_file, m_header.image_width * m_header.image_height * 3, SEEK_CUR);
-                return 0;
+    // Ensure frames are in range
+    first_frame = std::min(first_frame, (uint32_t)m_header.frame_count);
+    last_frame = std::min(last_frame, (uint32_t)m_header.frame_count);
+
+    const bool reverse = last_frame < first_frame;
+    const uint32_t total_frames = ((reverse) ? first_frame - last_frame : last_frame - first_frame) / stride + 1;
+    const uint64_t frame_spacing = (uint64_t)stride * m_framesize_in;
+
+    // Only the lines the region covers are read from each frame
+    const uint64_t line_size = get_line_size_in();
+    const uint64_t read_size = (uint64_t)roi.height * line_size;
+    const uint64_t roi_offset = (uint64_t)roi.y * line_size;
+
+    std::unique_ptr<uint8_t[]> p_frame_buffer(new uint8_t[(size_t)get_buffer_size(roi)]);
+    const uint32_t batch_frames = (uint32_t)std::max((uint64_t)1, C_GET_FRAMES_BATCH_SIZE / read_size);
+    std::unique_ptr<uint8_t[]> p_raw_buffer;  // Only allocated if the frames are not mapped
+
+    const uint64_t *p_timestamps = (mp_timestamp == nullptr) ? nullptr : (const uint64_t *)m_timestamp_buffer.get_buffer_ptr();
+    int32_t frames_done = 0;
+    for (uint32_t batch_start = 0; batch_start < total_frames; batch_start += batch_frames) {
+        const uint32_t count = std::min(batch_frames, total_frames - batch_start);
+
+        // Lowest numbered frame in this batch
+        uint32_t batch_first_frame = (reverse) ? first_frame - (batch_start + count - 1) * stride :
+                                                 first_frame + batch_start * stride;
+        uint64_t offset = ((uint64_t)(batch_first_frame - 1) * (uint64_t)m_framesize_in) + 178 + roi_offset;
+
+        const uint8_t *p_raw_data = get_mapped_data(offset, (count - 1) * frame_spacing + read_size);
+        uint64_t raw_frame_spacing;
+        if (p_raw_data != nullptr) {
+            // Convert straight from the mapped file
+            raw_frame_spacing = frame_spacing;
+        } else {
+            if (p_raw_buffer == nullptr) {
+                p_raw_buffer.reset(new uint8_t[(uint64_t)std::min(batch_frames, total_frames) * read_size]);
             }
 
-            // Create a temp buffer to load frame from file into 
-            uint8_t *temp_buffer_ptr = m_temp_buffer.get_buffer(m_header.image_width * m_header.image_height * 3);
-            fread(temp_buffer_ptr, 1, m_header.image_width * m_header.image_height * 3, mp_ser_file);
-
-            // Copy data into supplied buffer 
-            uint8_t *read_ptr;
-            uint8_t *write_ptr = buffer;
-            for (int32_t y = m_header.image_height-1; y >= 0; y--) {
-                read_ptr = temp_buffer_ptr + y * m_header.image_width * 3;
-                for (int32_t x = 0; x < m_header.image_width; x++) {
-                    uint8_t r = *read_ptr++;
-                    uint8_t g = *read_ptr++;
-                    uint8_t b = *read_ptr++;
-                    *write_ptr++ = b;
-                    *write_ptr++ = g;
-                    *write_ptr++ = r;
-                }
+            if (!read_frames_at(offset, frame_spacing, count, read_size, p_raw_buffer.get())) {
+                return -1;
             }
-        } else if (m_header.colour_id == COLOURID_BGR) {
-            // 24-bit BGR data
 
-            // Skip frame if required
-            if (buffer == nullptr) {
-                fseek64(mp_ser_file, m_header.image_width * m_header.image_height * 3, SEEK_CUR);
-                return 0;
-            }
+            p_raw_data = p_raw_buffer.get();
+            raw_frame_spacing = read_size;
+        }
 
-            // Create a temp buffer to load frame from file into 
-            uint8_t *temp_buffer_ptr = m_temp_buffer.get_buffer(m_header.image_width * m_header.image_height * 3);
-            fread(temp_buffer_ptr, 1, m_header.image_width * m_header.image_height * 3, mp_ser_file);
-
-            // Copy data into supplied buffer 
-            uint8_t *read_ptr;
-            uint8_t *write_ptr = buffer;
-            int32_t line_size = m_header.image_width * 3;
-            for (int32_t y = m_header.image_height-1; y >= 0; y--) {
-                read_ptr = temp_buffer_ptr + y * m_header.image_width * 3;
-                memcpy(write_ptr, read_ptr, line_size);
-                write_ptr += line_size;
-            }
-        } else {
-            // 8-bit mono data
+        // Hand the frames over in the requested order
+        for (uint32_t x = 0; x < count; x++) {
+            uint32_t index = (reverse) ? count - 1 - x : x;  // Position in ascending file order
+            uint32_t frame_number = batch_first_frame + index * stride;
+            convert_frame_data(p_raw_data + index * raw_frame_spacing, p_frame_buffer.get(), roi);
 
-            // Skip frame if required
-            if (buffer == nullptr) {
-                fseek64(mp_ser_file, m_header.image_width * m_header.image_height, SEEK_CUR);
-                return 0;
+            uint64_t timestamp = (p_timestamps == nullptr) ? 0 : p_timestamps[frame_number - 1];
+            if (!frame_function(frame_number, timestamp + m_timestamp_correction_value, p_frame_buffer.get())) {
+                return frames_done;
             }
 
-            // Create a temp buffer to load frame from file into 
-            uint8_t *temp_buffer_ptr = m_temp_buffer.get_buffer(m_header.image_width * m_header.image_height);
-            fread(temp_buffer_ptr, 1, m_header.image_width * m_header.image_height, mp_ser_file);
-
-            // Copy data into supplied buffer 
-            uint8_t *read_ptr;
-            uint8_t *write_ptr = buffer;
-            for (int32_t y = 0; y < m_header.image_height; y++) {
-                read_ptr = temp_buffer_ptr + (m_header.image_height - 1 - y) * m_header.image_width;
-                memcpy(write_ptr, read_ptr, m_header.image_width);
-                write_ptr += m_header.image_width;
-            }
+            frames_done++;
         }
     }
 
-    return 0;
+    return frames_done;
+}
+
+
+// ------------------------------------------
+// Read evenly spaced frames in ascending file order
+// ------------------------------------------
+bool c_pipp_ser::read_frames_at(
+    uint64_t offset,
+    uint64_t frame_spacing,
+    uint32_t count,
+    uint64_t read_size,
+    uint8_t *p_buffer) const
+{
+    if (frame_spacing == read_size) {
+        // Contiguous frames - one read
+        return read_at(offset, p_buffer, count * read_size);
+    }
+
+    // The backend decides whether to read through the gaps or seek over them
+    std::vector<c_ser_io_backend::s_read_request> requests(count);
+    for (uint32_t frame = 0; frame < count; frame++) {
+        requests[frame].m_offset = offset + frame * frame_spacing;
+        requests[frame].mp_buffer = p_buffer + (uint64_t)frame * read_size;
+        requests[frame].m_size = read_size;
+    }
+
+    return get_io_backend()->read_many(requests.data(), count);
 }
 
+
+// ------------------------------------------
+// Is a region inside the frame
+// ------------------------------------------
+bool c_pipp_ser::is_valid_roi(
+    const s_roi &roi) const
+{
+    return roi.x >= 0 && roi.y >= 0 && roi.width > 0 && roi.height > 0 &&
+           roi.x + roi.width <= m_header.image_width && roi.y + roi.height <= m_header.image_height;
+}
+
+
+// ------------------------------------------
+// Size of a line of raw frame data in the file
+// ------------------------------------------
+uint64_t c_pipp_ser::get_line_size_in() const
+{
+    uint64_t line_size = (uint64_t)m_header.image_width * m_byte_depth_in;
+    if (m_header.colour_id == COLOURID_RGB || m_header.colour_id == COLOURID_BGR) {
+        line_size *= 3;
+    }
+
+    return line_size;
+}
+
+
+// ------------------------------------------
+// Convert raw frame data into the supplied buffer
+// ------------------------------------------
+void c_pipp_ser::convert_frame_data(
+    const uint8_t *p_line_data,
+    uint8_t *buffer,
+    const s_roi &roi) const
+{
+    const bool colour = m_header.colour_id == COLOURID_RGB || m_header.colour_id == COLOURID_BGR;
+    const bool swap_rb = m_header.colour_id == COLOURID_RGB;  // Output is always BGR
+    const int32_t samples_per_pixel = (colour) ? 3 : 1;
+    const int32_t samples_per_line = m_header.image_width * samples_per_pixel;  // Raw data line
+    const int32_t samples_per_roi_line = roi.width * samples_per_pixel;  // Output line
+
+    // Only the region's columns are converted
+    const int64_t first_sample = (int64_t)roi.x * samples_per_pixel;
+
+    // Lines are stored top-down in the file and bottom-up in the output buffer
+    if (m_byte_depth_in == 2 && m_byte_depth_out == 2) {
+        // More than 8 bits per pixel
+        // Data with different endianess to the processor is byte swapped and data with
+        // fewer than 16 bits per pixel is scaled up to fill 16 bits
+        const uint16_t *temp_buffer_ptr = (const uint16_t *)p_line_data + first_sample;
+        uint16_t *write_ptr = (uint16_t *)buffer;
+        for (int32_t y = roi.height-1; y >= 0; y--) {
+            const uint8_t *read_ptr8 = (const uint8_t *)(temp_buffer_ptr + (int64_t)y * samples_per_line);
+            c_ser_unpack::line_16(
+                read_ptr8,
+                write_ptr,
+                roi.width,
+                colour,
+                swap_rb,
+                !m_same_data_and_processor_endian,
+                m_header.pixel_depth);
+            write_ptr += samples_per_roi_line;
+        }
+    } else if (m_byte_depth_in == 2 && m_byte_depth_out == 1) {
+        // 16-bit data but pixel depth is only 8-bits
+        // Little endian data has the value in the first byte, big endian in the second
+        const int32_t byte_offset = (m_header.little_endian == 0) ? 0 : 1;
+        const uint16_t *temp_buffer_ptr = (const uint16_t *)p_line_data + first_sample;
+        uint8_t *write_ptr8 = buffer;
+        for (int32_t y = roi.height-1; y >= 0; y--) {
+            const uint8_t *read_ptr8 = (const uint8_t *)(temp_buffer_ptr + (int64_t)y * samples_per_line);
+            c_ser_unpack::line_16_to_8(read_ptr8, write_ptr8, roi.width, colour, swap_rb, byte_offset);
+            write_ptr8 += samples_per_roi_line;
+        }
+    } else {
+        // 8 bits per pixel
+        const uint8_t *temp_buffer_ptr = p_line_data + first_sample;
+        uint8_t *write_ptr = buffer;
+        for (int32_t y = roi.height-1; y >= 0; y--) {
+            const uint8_t *read_ptr = temp_buffer_ptr + (int64_t)y * samples_per_line;
+            if (swap_rb) {
+                // 24-bit RGB data
+                c_ser_unpack::line_8_swap_rb(read_ptr, write_ptr, roi.width);
+            } else {
+                // 24-bit BGR or 8-bit mono data
+                memcpy(write_ptr, read_ptr, samples_per_roi_line);
+            }
+
+            write_ptr += samples_per_roi_line;
+        }
+    }
+}
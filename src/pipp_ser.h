@@ -21,7 +21,12 @@
 
 #include <QCoreApplication>
 #include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include "pipp_buffer.h"
+#include "ser_io_backend.h"
 
 
 // Codes for ColourID
@@ -68,7 +73,7 @@ class c_pipp_ser {
         std::string m_filename;
         FILE *mp_ser_file;
         int64_t m_filesize;
-        uint32_t m_framesize_in;
+        uint64_t m_framesize_in;
         s_ser_header m_header;
         int32_t m_byte_depth_in;
         int32_t m_byte_depth_out;
@@ -88,11 +93,58 @@ class c_pipp_ser {
         bool m_big_endian_processor;
         bool m_same_data_and_processor_endian;
 
+        // Follow files that are still being recorded
+        bool m_follow_mode;
+        bool m_following;
+
+        // Memory mapped file access
+        bool m_memory_mapped_mode;
+        uint8_t *mp_mapped_file;
+        uint64_t m_mapped_size;
+
+    public:
+        // Details worked out by open() from the timestamps and frame data
+        // These can be cached to save rescanning the file each time it is opened
+        struct s_metadata {
+            int32_t pixel_depth;  // Pixel depth found from the frame data, 0 if not checked
+            int32_t fps_rate;
+            int32_t fps_scale;
+            int64_t timestamp_correction_value;
+            uint64_t min_timestamp;
+            uint64_t max_timestamp;
+            bool timestamps_in_order;
+        };
+
+    private:
+        s_metadata m_metadata;
+        s_metadata m_cached_metadata;
+        bool m_use_cached_metadata;
+
+        // Frame data reads go through the I/O backend, the header and timestamps are read with mp_ser_file.
+        // set_io_mode() can swap the backend while other threads are reading, so readers hold a
+        // reference to the backend they are using, taken under m_io_backend_mutex.
+        std::atomic<c_ser_io_backend::e_io_mode> m_io_mode;
+        std::shared_ptr<c_ser_io_backend> mp_io_backend;
+        mutable std::mutex m_io_backend_mutex;
+
+        std::shared_ptr<c_ser_io_backend> get_io_backend() const;
+
 
     // ------------------------------------------
     // Public definitions
     // ------------------------------------------
     public:
+        // Called by get_frames() for each frame in turn, return false to stop
+        typedef std::function<bool (uint32_t frame_number, uint64_t timestamp, const uint8_t *p_frame)> t_frame_function;
+
+        // Region of interest within a frame, line 0 is the top line of the image
+        struct s_roi {
+            int32_t x;
+            int32_t y;
+            int32_t width;
+            int32_t height;
+        };
+
         enum e_error_code {
             ERROR_NO_ERROR = 1,
             ERROR_ZERO_FRAME_COUNT = -1,
@@ -112,7 +164,16 @@ class c_pipp_ser {
             m_colour(0),
             mp_timestamp(nullptr),
             m_error_string(""),
-            m_same_data_and_processor_endian(false)
+            m_same_data_and_processor_endian(false),
+            m_follow_mode(false),
+            m_following(false),
+            m_memory_mapped_mode(false),
+            mp_mapped_file(nullptr),
+            m_mapped_size(0),
+            m_metadata(),
+            m_cached_metadata(),
+            m_use_cached_metadata(false),
+            m_io_mode(c_ser_io_backend::IO_MODE_BUFFERED)
         {
             // Detect endianess of the processor
             m_big_endian_processor = (*(uint16_t *)"\0\xff" < 0x100);
@@ -123,6 +184,97 @@ class c_pipp_ser {
         // Destructor
         // ------------------------------------------
         ~c_pipp_ser() {
+            close();
+        }
+
+
+        // ------------------------------------------
+        // Enable/disable memory mapped file access
+        // Takes effect the next time a file is opened, files that are still being recorded are not mapped
+        // ------------------------------------------
+        void set_memory_mapped_mode(
+            bool enable)
+        {
+            m_memory_mapped_mode = enable;
+        }
+
+
+        // ------------------------------------------
+        // Enable/disable following files that are still being recorded
+        // Takes effect the next time a file is opened.  A file with no frame count in its header,
+        // or that is too short for its frame count, is then opened with just its complete frames
+        // and update_frame_count() picks up frames as they are written.
+        // ------------------------------------------
+        void set_follow_mode(
+            bool enable)
+        {
+            m_follow_mode = enable;
+        }
+
+
+        // ------------------------------------------
+        // Is the current file being followed as it grows
+        // ------------------------------------------
+        bool is_following() const
+        {
+            return m_following;
+        }
+
+
+        // ------------------------------------------
+        // Recheck the size of a followed file
+        // Returns the new frame count, which only counts complete frames.  This only goes down if
+        // timestamps written at the end of recording were briefly counted as frames.
+        // Following stops once the header frame count has been written and the file holds all of
+        // those frames.  The file must then be opened again to read its timestamps.
+        // ------------------------------------------
+        int32_t update_frame_count();
+
+
+        // ------------------------------------------
+        // Set how frame data is read from the file
+        // Takes effect straight away if a file is open, otherwise when the next file is opened.
+        // Reads already in progress finish with the previous backend.
+        // The memory mapped file is only used in IO_MODE_BUFFERED mode.
+        // ------------------------------------------
+        void set_io_mode(
+            c_ser_io_backend::e_io_mode io_mode);
+
+
+        // ------------------------------------------
+        // Get the I/O mode that was requested with set_io_mode()
+        // ------------------------------------------
+        c_ser_io_backend::e_io_mode get_io_mode() const
+        {
+            return m_io_mode;
+        }
+
+
+        // ------------------------------------------
+        // Is the current file memory mapped
+        // ------------------------------------------
+        bool is_memory_mapped() {
+            return mp_mapped_file != nullptr;
+        }
+
+
+        // ------------------------------------------
+        // Supply metadata from an earlier open() of the same file
+        // The next open() uses this rather than scanning the timestamps and frame data
+        // ------------------------------------------
+        void set_cached_metadata(
+            const s_metadata &metadata)
+        {
+            m_cached_metadata = metadata;
+            m_use_cached_metadata = true;
+        }
+
+
+        // ------------------------------------------
+        // Get the metadata worked out by the last open()
+        // ------------------------------------------
+        const s_metadata &get_metadata() {
+            return m_metadata;
         }
 
 
@@ -156,11 +308,59 @@ class c_pipp_ser {
         }
 
 
+        // ------------------------------------------
+        // Get file size, kept up to date by update_frame_count() while following
+        // ------------------------------------------
+        int64_t get_file_size() const
+        {
+            return m_filesize;
+        }
+
+
 
         // ------------------------------------------
         // Get size of buffer required to store frame
         // ------------------------------------------
-        int32_t get_buffer_size();
+        int64_t get_buffer_size();
+
+
+        // ------------------------------------------
+        // Get size of buffer required to store a region of a frame
+        // ------------------------------------------
+        int64_t get_buffer_size(
+            const s_roi &roi) const;
+
+
+        // ------------------------------------------
+        // Get a region covering the whole frame
+        // ------------------------------------------
+        s_roi get_full_roi() const {
+            s_roi roi = {0, 0, m_header.image_width, m_header.image_height};
+            return roi;
+        }
+
+
+        // ------------------------------------------
+        // Get the region that has to be read to crop frames
+        // With cfa_margin set the region keeps a margin around the crop for debayering and starts
+        // on an even line and column, so the Bayer pattern lines up with the whole frame and the
+        // debayered pixels inside the crop are the same as if the whole frame had been debayered.
+        // Returns the whole frame if the crop does not fit in the frame.
+        // ------------------------------------------
+        s_roi get_crop_roi(
+            int32_t crop_x,
+            int32_t crop_y,
+            int32_t crop_width,
+            int32_t crop_height,
+            bool cfa_margin) const;
+
+
+        // ------------------------------------------
+        // Get frame count
+        // ------------------------------------------
+        int32_t get_frame_count() const {
+            return m_header.frame_count;
+        }
 
 
         // ------------------------------------------
@@ -313,6 +513,70 @@ class c_pipp_ser {
             uint32_t frame_number,
             uint8_t *buffer);
 
+        // ------------------------------------------
+        // Read particular frame from SER file
+        // Does not change the current frame or timestamp so it is safe to call
+        // from several threads at once, including alongside get_frame()
+        // ------------------------------------------
+        int32_t read_frame (
+            uint32_t frame_number,
+            uint8_t *buffer) const;
+
+
+        // ------------------------------------------
+        // Read a region of a particular frame from SER file
+        // Only the lines of the region are read from the file and only its columns are
+        // converted, the buffer is filled as read_frame() would for a frame the size of the region.
+        // Returns -1 if the region is not inside the frame.
+        // ------------------------------------------
+        int32_t read_frame (
+            uint32_t frame_number,
+            const s_roi &roi,
+            uint8_t *buffer) const;
+
+
+        // ------------------------------------------
+        // Read every stride'th frame from first_frame to last_frame
+        // Counts backwards if last_frame is before first_frame.  Frames are read from the
+        // file in batches in ascending file order, so runs of frames become a few large
+        // reads, but frame_function is called in the requested order.
+        // Returns the number of frames passed to frame_function or -1 on a read error.
+        // Like read_frame() this can be called from several threads at once.
+        // ------------------------------------------
+        int32_t get_frames (
+            uint32_t first_frame,
+            uint32_t last_frame,
+            uint32_t stride,
+            const t_frame_function &frame_function) const;
+
+
+        // ------------------------------------------
+        // Read a region of every stride'th frame from first_frame to last_frame
+        // As get_frames() but each frame is read and converted like read_frame() with a region
+        // ------------------------------------------
+        int32_t get_frames (
+            uint32_t first_frame,
+            uint32_t last_frame,
+            uint32_t stride,
+            const s_roi &roi,
+            const t_frame_function &frame_function) const;
+
+
+        // ------------------------------------------
+        // Get a read-only view of a frame's raw data, borrowed from the memory mapped file
+        // Data is in file order (top line first) and file endianess, and stays valid until the file is closed.
+        // Returns nullptr if the file is not memory mapped or the I/O mode does not use the mapping.
+        // ------------------------------------------
+        const uint8_t *get_frame_view(
+            uint32_t frame_number) const;
+
+
+        // ------------------------------------------
+        // Does get_frame_view() data only differ from get_frame() data by line order
+        // ------------------------------------------
+        bool frame_view_is_native() const;
+
+
         //
         // Return is SER file has timestamps
         //
@@ -344,6 +608,31 @@ class c_pipp_ser {
         }
 
 
+        //
+        // Get the timestamp get_frame() returns for a particular frame (1 to frame count)
+        //
+        uint64_t get_frame_timestamp(uint32_t frame_number) const {
+            if (mp_timestamp == nullptr || frame_number == 0 || frame_number > (uint32_t)m_header.frame_count) {
+                return 0;
+            }
+
+            const uint64_t *p_timestamp_buffer = (const uint64_t *)m_timestamp_buffer.get_buffer_ptr();
+            return p_timestamp_buffer[frame_number - 1] + m_timestamp_correction_value;
+        }
+
+
+        //
+        // Get the file offset and size of a frame's raw data, for copying frames without decoding them
+        //
+        uint64_t get_frame_offset(uint32_t frame_number) const {
+            return ((uint64_t)(frame_number - 1) * m_framesize_in) + 178;
+        }
+
+        uint64_t get_frame_size() const {
+            return m_framesize_in;
+        }
+
+
         //
         // Get diff between universal time and local time
         //
@@ -354,10 +643,75 @@ class c_pipp_ser {
 
     private:
         //
-        // Find pixel depth from specified frame
+        // Map/unmap the open file into memory
+        //
+        void map_file();
+        void unmap_file();
+
+        //
+        // Number of frames that have been completely written to a file of this size
+        //
+        int32_t get_complete_frames(
+            int64_t filesize) const;
+
+        //
+        // Get a pointer into the mapped file, or nullptr if the data should be read with the I/O backend
+        //
+        const uint8_t *get_mapped_data(
+            uint64_t offset,
+            uint64_t size) const;
+
+        //
+        // Get pointer to the raw data of the current frame
+        // Points straight into the mapped file if possible, otherwise the frame is read into m_temp_buffer
+        //
+        const uint8_t *read_frame_data(
+            uint64_t size);
+
+        //
+        // Read from an absolute file offset, safe to call from several threads
+        //
+        bool read_at(
+            uint64_t offset,
+            uint8_t *p_buffer,
+            size_t size) const;
+
+        //
+        // Read count blocks of read_size bytes that are frame_spacing bytes apart into consecutive blocks of p_buffer
+        //
+        bool read_frames_at(
+            uint64_t offset,
+            uint64_t frame_spacing,
+            uint32_t count,
+            uint64_t read_size,
+            uint8_t *p_buffer) const;
+
+        //
+        // Is a region inside the frame
+        //
+        bool is_valid_roi(
+            const s_roi &roi) const;
+
+        //
+        // Size of a line of raw frame data in the file
+        //
+        uint64_t get_line_size_in() const;
+
+        //
+        // Convert raw frame data into get_frame() output format
+        // p_line_data points to the raw data of the region's top line
+        //
+        void convert_frame_data(
+            const uint8_t *p_line_data,
+            uint8_t *buffer,
+            const s_roi &roi) const;
+
+        //
+        // Find pixel depth from specified frame, stops early if full_depth_found is set
         //
         int32_t find_pixel_depth(
-            uint32_t frame_number);
+            uint32_t frame_number,
+            std::atomic<bool> &full_depth_found) const;
 
         template <typename T>
         static T swap_endianess(T data)
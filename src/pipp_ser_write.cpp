@@ -1,6 +1,7 @@
 #include "pipp_ser_write.h"
 #include "pipp_utf8.h"
 
+#include <algorithm>
 #include <cstdlib>
 #include <cstdint>
 #include <cstring>
@@ -10,16 +11,119 @@
 #include <memory>
 #include <QDebug>
 
+#if defined(__unix__) || defined(__APPLE__)
+    #include <unistd.h>
+    #include <sys/types.h>
+#endif
+
+#if defined(__linux__)
+    #include <sys/sendfile.h>
+    #define PIPP_SER_WRITE_SENDFILE
+    #if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+        #define PIPP_SER_WRITE_COPY_FILE_RANGE
+    #endif
+#endif
+
 using namespace std;
 
 
+namespace {
+    // Largest single request to the kernel when copying frames between files
+    const uint64_t C_MAX_KERNEL_COPY_SIZE = 1024 * 1024 * 1024;
+
+    // Buffer size for copying frames when the kernel cannot do the copy
+    const size_t C_COPY_BUFFER_SIZE = 8 * 1024 * 1024;
+
+
+    // ------------------------------------------
+    // Copy a block of data from one file to another
+    // The kernel does the copy where possible, so the data never passes through this
+    // process and can be shared rather than copied on filesystems with reflinks.
+    // Returns false on an error.
+    // ------------------------------------------
+    bool copy_file_data(
+        FILE *p_src_file,
+        uint64_t src_offset,
+        FILE *p_dst_file,
+        uint64_t dst_offset,
+        uint64_t size)
+    {
+#ifdef PIPP_SER_WRITE_COPY_FILE_RANGE
+        {
+            loff_t src_pos = src_offset;
+            loff_t dst_pos = dst_offset;
+            while (size > 0) {
+                ssize_t copied = copy_file_range(fileno(p_src_file), &src_pos,
+                                                 fileno(p_dst_file), &dst_pos,
+                                                 (size_t)std::min(size, C_MAX_KERNEL_COPY_SIZE), 0);
+                if (copied <= 0) {
+                    // Not supported for these files, such as across filesystems on older kernels
+                    break;
+                }
+
+                size -= copied;
+            }
+
+            src_offset = src_pos;
+            dst_offset = dst_pos;
+        }
+#endif
+
+#ifdef PIPP_SER_WRITE_SENDFILE
+        // sendfile() writes at the current position of the destination file
+        if (size > 0 && sizeof(off_t) >= 8 &&
+            lseek(fileno(p_dst_file), (off_t)dst_offset, SEEK_SET) == (off_t)dst_offset) {
+            off_t src_pos = src_offset;
+            while (size > 0) {
+                ssize_t sent = sendfile(fileno(p_dst_file), fileno(p_src_file), &src_pos,
+                                        (size_t)std::min(size, C_MAX_KERNEL_COPY_SIZE));
+                if (sent <= 0) {
+                    break;
+                }
+
+                size -= sent;
+                dst_offset += sent;
+            }
+
+            src_offset = src_pos;
+        }
+#endif
+
+        if (size == 0) {
+            return true;
+        }
+
+        // Fall back to copying through a buffer
+        if (fseek64(p_src_file, src_offset, SEEK_SET) != 0 || fseek64(p_dst_file, dst_offset, SEEK_SET) != 0) {
+            return false;
+        }
+
+        std::unique_ptr<uint8_t[]> p_buffer(new uint8_t[C_COPY_BUFFER_SIZE]);
+        while (size > 0) {
+            size_t chunk_size = (size_t)std::min(size, (uint64_t)C_COPY_BUFFER_SIZE);
+            if (fread(p_buffer.get(), 1, chunk_size, p_src_file) != chunk_size ||
+                fwrite(p_buffer.get(), 1, chunk_size, p_dst_file) != chunk_size) {
+                return false;
+            }
+
+            size -= chunk_size;
+        }
+
+        return true;
+    }
+}
+
+
 // ------------------------------------------
 // Constructor
 // ------------------------------------------
 c_pipp_ser_write::c_pipp_ser_write() :
-    mp_ser_file(nullptr),
     m_open(false),
-    m_file_write_error(false)
+    m_file_write_error(false),
+    mp_raw_source_file(nullptr),
+    m_raw_colour_id(0),
+    m_raw_little_endian(0),
+    m_raw_pixel_depth(0)
 {
     // Detect endianess of the processor
     m_big_endian_processor = (*(uint16_t *)"\0\xff" < 0x100);
@@ -52,11 +156,9 @@ bool c_pipp_ser_write::create(
     }
 
     // Open new file
-    mp_ser_file = fopen_utf8(filename.toUtf8().data(), "wb+");
-
     // Check file opened
     // Return if file did not open
-    if (!mp_ser_file) {
+    if (!m_ser_file.open(filename.toUtf8().data())) {
         return true;
     }
     
@@ -73,19 +175,19 @@ bool c_pipp_ser_write::create(
     // Return if file did not open
     if (!mp_ser_index_file) {
         // Close main SER file first
-        fclose(mp_ser_file);
+        m_ser_file.close();
         return true;
     }
 
     // Write SER FILE ID to start of the file
-    fwrite_error_check("LUCAM-RECORDER" , 1 , 14 , mp_ser_file );
+    fwrite_error_check("LUCAM-RECORDER" , 1 , 14 , m_ser_file );
 
     // Write dummy header to file - to be overwritten later
-    fwrite_error_check(&m_header, 1, sizeof(s_ser_header), mp_ser_file );
+    fwrite_error_check(&m_header, 1, sizeof(s_ser_header), m_ser_file );
 
     if (m_file_write_error) {
         // There were file errors, handle them
-        fclose(mp_ser_file);
+        m_ser_file.close();
         fclose(mp_ser_index_file);
     } else {
         m_open = true;
@@ -109,76 +211,80 @@ bool c_pipp_ser_write::write_frame(
         return true;
     }
 
-    // Grab first timestamp
-    if (m_header.frame_count == 0) {
-        m_date_time_utc = timestamp;
+    // Write the lines bottom line first, straight into the write buffers
+    const size_t line_size = (size_t)m_width * m_bytes_per_sample;
+    for (int32_t y = m_height-1; y >= 0; y--) {
+        fwrite_error_check(data + (int64_t)y * line_size, 1, line_size, m_ser_file);
     }
 
-    // Generate buffer
-    std::unique_ptr<uint8_t[]> p_buffer(new uint8_t[m_width * m_height * m_bytes_per_sample]);
+    add_frame_timestamp(timestamp);
 
-    if (m_bytes_per_sample == 1) {
-        // 8-bit mono data
-        uint8_t *write_ptr = p_buffer.get();
-        uint8_t *read_ptr;
+    // Tidy up after write failures
+    if (m_file_write_error) {
+        close_after_error();
+    }
 
-        for (int32_t y = m_height-1; y >= 0; y--) {
-            read_ptr = data + (y * m_width);
-            memcpy(write_ptr, read_ptr, m_width);
-            write_ptr += m_width;
-        }
-    } else if (m_bytes_per_sample == 2) {
-        // 16-bit mono data write
-        uint16_t *write_ptr = (uint16_t *)p_buffer.get();
-        uint16_t *read_ptr;
-        uint16_t *data_16 = (uint16_t *)data;
-        for (int32_t y = m_height-1; y >= 0; y--) {
-            read_ptr = data_16 + (y * m_width);
-            memcpy(write_ptr, read_ptr, m_width * 2);
-            write_ptr += m_width;
-        }
-    } else if (m_bytes_per_sample == 3) {
-        // 24-bit colour data
-        uint8_t *write_ptr = p_buffer.get();
-        uint8_t *read_ptr;
-
-        for (int32_t y = m_height-1; y >= 0; y--) {
-            read_ptr = data + (y * m_width * 3);
-            memcpy(write_ptr, read_ptr, m_width * 3);
-            write_ptr += m_width * 3;
-        }
-    } else if (m_bytes_per_sample == 6) {
-        // 48-bit colour data
-        uint16_t *write_ptr = (uint16_t *)p_buffer.get();
-        uint16_t *read_ptr;
-        uint16_t *data_16 = (uint16_t *)data;
-        for (int32_t y = m_height-1; y >= 0; y--) {
-            read_ptr = data_16 + y * m_width * 3;
-            memcpy(write_ptr, read_ptr, m_width * 3 * 2);
-            write_ptr += m_width * 3;
-        }
+    bool ret = m_file_write_error;
+    m_file_write_error = false;
+    return ret;
+}
+
+
+// ------------------------------------------
+// Open the SER file that frames are copied from
+// ------------------------------------------
+bool c_pipp_ser_write::open_raw_source(
+    const std::string &filename,
+    int32_t colour_id,
+    int32_t little_endian,
+    int32_t pixel_depth)
+{
+    if (mp_raw_source_file != nullptr) {
+        fclose(mp_raw_source_file);
     }
 
-    fwrite_error_check(p_buffer.get(), 1, m_width * m_height * m_bytes_per_sample, mp_ser_file);
-    p_buffer.reset(nullptr);
+    mp_raw_source_file = fopen_utf8(filename, "rb");
+    m_raw_colour_id = colour_id;
+    m_raw_little_endian = little_endian;
+    m_raw_pixel_depth = pixel_depth;
+    return mp_raw_source_file == nullptr;
+}
 
-    if (m_date_time_utc != 0) {
-        if (m_big_endian_processor) {
-            timestamp = swap_endianess(timestamp);  // timestamp must be in little endian format
-        }
 
-        // Write timestamp to temp timestamp file
-        fwrite_error_check(&timestamp, 8, 1, mp_ser_index_file);
+// ------------------------------------------
+// Copy frames from the raw source file
+// ------------------------------------------
+bool c_pipp_ser_write::write_raw_frames(
+    uint64_t offset,
+    int32_t count,
+    const uint64_t *p_timestamps)
+{
+    // Early return if the files are not open
+    if (!m_open || mp_raw_source_file == nullptr) {
+        return true;
     }
 
-    // Increment frame count
-    m_header.frame_count++;
+    // Anything still queued must be written out before the file is written to directly
+    if (!m_ser_file.flush()) {
+        m_file_write_error = true;
+    }
+
+    int64_t write_offset = m_ser_file.tell();
+    uint64_t size = (uint64_t)count * m_width * m_height * m_bytes_per_sample;
+    if (!m_file_write_error) {
+        if (!copy_file_data(mp_raw_source_file, offset, m_ser_file.get_file(), (uint64_t)write_offset, size) ||
+            !m_ser_file.seek(write_offset + (int64_t)size)) {
+            m_file_write_error = true;
+        }
+    }
+
+    for (int32_t frame = 0; frame < count; frame++) {
+        add_frame_timestamp((p_timestamps == nullptr) ? 0 : p_timestamps[frame]);
+    }
 
     // Tidy up after write failures
     if (m_file_write_error) {
-        fclose(mp_ser_file);
-        fclose(mp_ser_index_file);
-        m_open = false;
+        close_after_error();
     }
 
     bool ret = m_file_write_error;
@@ -214,6 +320,13 @@ bool c_pipp_ser_write::set_details(
         m_header.colour_id = COLOURID_BGR;  // We only support this value for colour files
     }
 
+    if (mp_raw_source_file != nullptr) {
+        // Copied frames are still in the source file's format
+        m_header.colour_id = m_raw_colour_id;
+        m_header.little_endian = m_raw_little_endian;
+        m_header.pixel_depth = m_raw_pixel_depth;
+    }
+
     m_header.date_time = m_date_time_utc - utc_to_local_diff;
     m_header.date_time_utc = m_date_time_utc;
 
@@ -248,15 +361,15 @@ bool c_pipp_ser_write::close()
             fseek64(mp_ser_index_file, 0, SEEK_SET);
 
             // Get buffer to store index in
-            std::unique_ptr<uint8_t[]> p_buffer(new uint8_t[(uint32_t)filesize]);
+            std::unique_ptr<uint8_t[]> p_buffer(new uint8_t[filesize]);
 
             // Read data into buffer
-            size_t read_size = fread(p_buffer.get(), filesize, 1, mp_ser_index_file);
+            size_t read_size = fread(p_buffer.get(), 1, filesize, mp_ser_index_file);
             fclose(mp_ser_index_file);
 
             // Write index data to output file
             if (read_size == filesize) {
-                fwrite_error_check(p_buffer.get(), 1, (uint32_t)filesize, mp_ser_file);
+                fwrite_error_check(p_buffer.get(), 1, filesize, m_ser_file);
             }
 
             p_buffer.reset(nullptr);
@@ -266,15 +379,18 @@ bool c_pipp_ser_write::close()
         remove_utf8(mp_index_filename.get());
 
         // Goto start of file after SER FILE ID field
-        fseek64(mp_ser_file, 14, SEEK_SET);
+        m_ser_file.seek(14);
 
         // Write header to file
         if (m_big_endian_processor) {
-            m_header.little_endian = 1;  // Note data is in big-endian format on big-endian systems
+            if (mp_raw_source_file == nullptr) {
+                m_header.little_endian = 1;  // Note data is in big-endian format on big-endian systems
+            }
+
             swap_header_endianess(&m_header);  // Header must be in little-endian format
         }
 
-        fwrite_error_check(&m_header, 1, sizeof(s_ser_header), mp_ser_file );
+        fwrite_error_check(&m_header, 1, sizeof(s_ser_header), m_ser_file );
 
         if (m_big_endian_processor) {
             swap_header_endianess(&m_header);  // Reverse endianess change - probably not required!
@@ -283,8 +399,14 @@ bool c_pipp_ser_write::close()
         // Note that the SER file is closed
         m_open = false;
 
-        fclose(mp_ser_file);
-        mp_ser_file = nullptr;
+        if (!m_ser_file.close()) {
+            m_file_write_error = true;
+        }
+    }
+
+    if (mp_raw_source_file != nullptr) {
+        fclose(mp_raw_source_file);
+        mp_raw_source_file = nullptr;
     }
 
     // Release filename memory
@@ -315,3 +437,67 @@ void c_pipp_ser_write::fwrite_error_check(
         }
     }
 }
+
+
+// ------------------------------------------
+// Queue data for the SER file with error checking
+// ------------------------------------------
+void c_pipp_ser_write::fwrite_error_check(
+    const void *ptr,
+    size_t size,
+    size_t count,
+    c_async_file_writer &file)
+{
+    if (!m_file_write_error) {  // Do not continue writing after an error has occured
+        if (!file.write(ptr, size * count)) {
+            m_file_write_error = true;
+        }
+    }
+}
+
+
+// ------------------------------------------
+// Reserve space for the frames that are going to be written
+// ------------------------------------------
+void c_pipp_ser_write::set_expected_frame_count(
+    int32_t frame_count)
+{
+    uint64_t frame_size = (uint64_t)m_width * m_height * m_bytes_per_sample;
+    m_ser_file.preallocate(14 + sizeof(s_ser_header) + (uint64_t)frame_count * (frame_size + 8));
+}
+
+
+// ------------------------------------------
+// Write a frame's timestamp to the index file and count the frame
+// ------------------------------------------
+void c_pipp_ser_write::add_frame_timestamp(
+    uint64_t timestamp)
+{
+    // Grab first timestamp
+    if (m_header.frame_count == 0) {
+        m_date_time_utc = timestamp;
+    }
+
+    if (m_date_time_utc != 0) {
+        if (m_big_endian_processor) {
+            timestamp = swap_endianess(timestamp);  // timestamp must be in little endian format
+        }
+
+        // Write timestamp to temp timestamp file
+        fwrite_error_check(&timestamp, 8, 1, mp_ser_index_file);
+    }
+
+    // Increment frame count
+    m_header.frame_count++;
+}
+
+
+// ------------------------------------------
+// Close the files after a write error
+// ------------------------------------------
+void c_pipp_ser_write::close_after_error()
+{
+    m_ser_file.close();
+    fclose(mp_ser_index_file);
+    m_open = false;
+}
@@ -2,8 +2,11 @@
 #define PIPP_SER_WRITE_H
 
 #include <cstdint>
+#include <cstdio>
 #include <memory>
+#include <string>
 #include <QString>
+#include "async_file_writer.h"
 
 
 // Codes for ColourID
@@ -45,7 +48,7 @@ class c_pipp_ser_write {
 static_assert (sizeof(s_ser_header) == 7 * 4 + 3 * 40 + 2 * 8, "Unexpected size for structure s_ser_header");
 
         // Member variables
-        FILE *mp_ser_file;
+        c_async_file_writer m_ser_file;
         std::unique_ptr<char[]> mp_index_filename;
         FILE *mp_ser_index_file;
         s_ser_header m_header;
@@ -58,6 +61,12 @@ static_assert (sizeof(s_ser_header) == 7 * 4 + 3 * 40 + 2 * 8, "Unexpected size
         bool m_file_write_error;
         bool m_big_endian_processor;
 
+        // Source file for frames copied by write_raw_frames()
+        FILE *mp_raw_source_file;
+        int32_t m_raw_colour_id;
+        int32_t m_raw_little_endian;
+        int32_t m_raw_pixel_depth;
+
 
     // ------------------------------------------
     // Public definitions
@@ -96,6 +105,14 @@ static_assert (sizeof(s_ser_header) == 7 * 4 + 3 * 40 + 2 * 8, "Unexpected size
             int32_t  byte_depth);
             
 
+        // ------------------------------------------
+        // Give the number of frames that will be written so disk space
+        // can be reserved for them up front
+        // ------------------------------------------
+        void set_expected_frame_count(
+            int32_t frame_count);
+
+
         // ------------------------------------------
         // Write frame to SER file
         // ------------------------------------------
@@ -104,6 +121,29 @@ static_assert (sizeof(s_ser_header) == 7 * 4 + 3 * 40 + 2 * 8, "Unexpected size
             uint64_t timestamp);
             
           
+        // ------------------------------------------
+        // Open the SER file that write_raw_frames() copies frames from
+        // The frame data is not decoded, so the header keeps the source file's
+        // colour ID, byte order and pixel depth
+        // ------------------------------------------
+        bool open_raw_source(
+            const std::string &filename,
+            int32_t colour_id,
+            int32_t little_endian,
+            int32_t pixel_depth);
+
+
+        // ------------------------------------------
+        // Copy consecutive frames straight from the raw source file
+        // offset is the file offset of the first frame's data and p_timestamps
+        // holds a timestamp for each frame, or is nullptr if there are none
+        // ------------------------------------------
+        bool write_raw_frames(
+            uint64_t offset,
+            int32_t count,
+            const uint64_t *p_timestamps);
+
+
         // ------------------------------------------
         // Set details for SER file
         // ------------------------------------------
@@ -137,6 +177,29 @@ static_assert (sizeof(s_ser_header) == 7 * 4 + 3 * 40 + 2 * 8, "Unexpected size
                 FILE *p_stream);
 
 
+        // ------------------------------------------
+        // Queue data for the SER file with error checking
+        // ------------------------------------------
+        void fwrite_error_check(
+                const void *ptr,
+                size_t size,
+                size_t count,
+                c_async_file_writer &file);
+
+
+        // ------------------------------------------
+        // Write a frame's timestamp to the index file and count the frame
+        // ------------------------------------------
+        void add_frame_timestamp(
+                uint64_t timestamp);
+
+
+        // ------------------------------------------
+        // Close the files after a write error
+        // ------------------------------------------
+        void close_after_error();
+
+
         template <typename T>
         static T swap_endianess(T data)
         {
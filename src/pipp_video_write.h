@@ -53,6 +53,16 @@ class c_pipp_video_write {
         // Write header and close AVI file
         // ------------------------------------------
         virtual bool close() = 0;
+
+
+        // ------------------------------------------
+        // Hint at how many frames are going to be written
+        // ------------------------------------------
+        virtual void set_expected_frame_count(
+            int32_t frame_count)
+        {
+            (void)frame_count;
+        }
 };
 
     
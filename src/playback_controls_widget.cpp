@@ -297,6 +297,12 @@ bool c_playback_controls_widget::goto_next_frame()
 }
 
 
+QVector<int> c_playback_controls_widget::get_next_frames(int count)
+{
+    return mp_frame_Slider->get_next_frames(count);
+}
+
+
 int c_playback_controls_widget::get_start_frame()
 {
     return mp_frame_Slider->get_start_frame();
@@ -333,6 +339,12 @@ void c_playback_controls_widget::set_maximum_frame(int max_frame)
 }
 
 
+void c_playback_controls_widget::follow_maximum_frame(int max_frame)
+{
+    return mp_frame_Slider->follow_maximum_frame(max_frame);
+}
+
+
 void c_playback_controls_widget::set_start_marker_to_current()
 {
     return mp_frame_Slider->set_start_marker_to_current();
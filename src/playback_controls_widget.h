@@ -20,6 +20,7 @@
 #define PLAYBACK_CONTROLS_WIDGET_H
 
 #include <QWidget>
+#include <QVector>
 #include <cstdint>
 
 class QLabel;
@@ -42,6 +43,7 @@ public:
     void set_repeat(bool repeat);
     void goto_first_frame();
     bool goto_next_frame();
+    QVector<int> get_next_frames(int count);
     int get_start_frame();
     int get_end_frame();
     bool is_playing();
@@ -68,6 +70,7 @@ public slots:
     void set_markers_show(bool show);
     void set_markers_enable(bool active);
     void set_maximum_frame(int max_frame);
+    void follow_maximum_frame(int max_frame);
     void set_start_marker_to_current();
     void set_start_marker_slot(int frame);
     void set_end_marker_to_current();
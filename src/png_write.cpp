@@ -17,9 +17,11 @@
 
 
 #include "pipp_utf8.h"
+#include "png_write.h"
 
 extern "C" {
     #include "png.h"
+    #include "zlib.h"
 }
 
 #include <cstdint>
@@ -31,133 +33,76 @@ extern "C" {
     #error "libpng 2.x.x is not supported"
 #elif PNG_LIBPNG_VER_MAJOR==1 && PNG_LIBPNG_VER_MINOR==7
     #error "libpng 1.7.x is not supported"
-#elif PNG_LIBPNG_VER_MAJOR==1 && PNG_LIBPNG_VER_MINOR==6
+#elif PNG_LIBPNG_VER_MAJOR==1 && PNG_LIBPNG_VER_MINOR==5
+    #error "libpng 1.5.x is not supported"
+#elif PNG_LIBPNG_VER_MAJOR==1 && PNG_LIBPNG_VER_MINOR==4
+    #error "libpng 1.4.x is not supported"
+#elif PNG_LIBPNG_VER_MAJOR==1 && PNG_LIBPNG_VER_MINOR==3
+    #error "libpng 1.3.x is not supported"
+#elif !(PNG_LIBPNG_VER_MAJOR==1 && (PNG_LIBPNG_VER_MINOR==6 || PNG_LIBPNG_VER_MINOR==2))
+    #error "Unsuported libpng version"
+#endif
+
 
 // ------------------------------------------
-// Save PNG image
+// zlib and filter settings for each compression profile
 // ------------------------------------------
-int32_t save_png_file(
-    const char *filename,
-    const uint8_t *p_image_data,
-    uint32_t width,
-    uint32_t height,
-    uint32_t bytes_per_sample,
-    bool is_colour)
-{
-    int32_t ret = -1;
-    png_image image; // The control structure used by libpng
+// Frames are noisy, so deflate's string matching finds little and the time goes on the
+// filtering and on the matching itself.  Z_RLE only looks for runs, which still catches
+// black borders and dark sky, and a single filter type means libpng does not have to try
+// every filter on each row to pick one.  Smaller windows were measured to be slower.
+static const struct {
+    int zlib_level;
+    int zlib_strategy;
+    int zlib_window_bits;
+    int filters;
+} png_compression_profiles[PNG_COMPRESSION_COUNT] = {
+    {1, Z_RLE, 15, PNG_FILTER_UP},  // PNG_COMPRESSION_FASTEST
+    {1, Z_RLE, 15, PNG_ALL_FILTERS},  // PNG_COMPRESSION_BALANCED
+    {9, Z_FILTERED, 15, PNG_ALL_FILTERS}  // PNG_COMPRESSION_SMALLEST
+};
 
-    // Initialize the 'png_image' structure.
-    memset(&image, 0, (sizeof image));
-    image.version = PNG_IMAGE_VERSION;
-    image.width = width;
-    image.height = height;
 
-    int row_stride;
-    if (is_colour) {
-        row_stride = image.width * -3;
-        image.format = PNG_FORMAT_BGR;
-        if (bytes_per_sample == 2) {
-            image.format |= PNG_FORMAT_FLAG_LINEAR;
-        }
-    } else {
-        row_stride = image.width * -1;
-        if (bytes_per_sample == 1) {
-            image.format = PNG_FORMAT_GRAY;  // 8-bit data
-        } else {
-            image.format = PNG_FORMAT_LINEAR_Y;  // 16-bit data
-        }
-    }
+// ------------------------------------------
+// Write function used to find the size of a PNG file without writing it
+// ------------------------------------------
+static void count_png_data(
+    png_structp png_ptr,
+    png_bytep data,
+    png_size_t length)
+{
+    (void)data;
+    *(int64_t *)png_get_io_ptr(png_ptr) += length;
+}
 
-    FILE *p_png_file = fopen_utf8(filename, "wb");
 
-    if (p_png_file != nullptr) {
-        png_image_write_to_stdio(
-            &image,
-            p_png_file,
-            0,  // convert_to_8bit
-            (png_bytep)(p_image_data),
-            row_stride,
-            NULL);  // colormap
-        ret = 0;
-        fclose(p_png_file);
-    }
-
-    return ret;
+static void flush_png_data(
+    png_structp png_ptr)
+{
+    (void)png_ptr;
 }
 
-#elif PNG_LIBPNG_VER_MAJOR==1 && PNG_LIBPNG_VER_MINOR==5
-    #error "libpng 1.5.x is not supported"
-#elif PNG_LIBPNG_VER_MAJOR==1 && PNG_LIBPNG_VER_MINOR==4
-    #error "libpng 1.4.x is not supported"
-#elif PNG_LIBPNG_VER_MAJOR==1 && PNG_LIBPNG_VER_MINOR==3
-    #error "libpng 1.3.x is not supported"
-#elif PNG_LIBPNG_VER_MAJOR==1 && PNG_LIBPNG_VER_MINOR==2
 
 // ------------------------------------------
-// Save PNG image
+// Compress and write out the image
+// Nothing here may need destructing as libpng errors longjmp back to the setjmp(),
+// and no variables may be changed after it, so compression must already be valid
 // ------------------------------------------
-int32_t save_png_file(
-    const char *filename,
-    const uint8_t *p_image_data,
+static bool write_png_image(
+    png_structp png_ptr,
+    png_infop info_ptr,
+    png_bytep *row_pointers,
     uint32_t width,
     uint32_t height,
     uint32_t bytes_per_sample,
-    bool is_colour)
+    bool is_colour,
+    int compression)
 {
-    int32_t ret = -1;
-    png_structp png_ptr;
-    png_infop info_ptr;
-
-    FILE *p_png_file = fopen_utf8(filename, "wb");
-    if (p_png_file == nullptr) {
-        return ret;
-    }
-
-    /* Create and initialize the png_struct with the desired error handler
-     * functions.  If you want to use the default stderr and longjump method,
-     * you can supply NULL for the last three parameters.  We also check that
-     * the library version is compatible with the one used at compile time,
-     * in case we are using dynamically linked libraries.  REQUIRED.
-     */
-    png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-    if (png_ptr == nullptr) {
-        fclose(p_png_file);
-        return ret;
-    }
-
-    /* Allocate/initialize the image information data.  REQUIRED */
-    info_ptr = png_create_info_struct(png_ptr);
-    if (info_ptr == NULL)
-    {
-       fclose(p_png_file);
-       png_destroy_write_struct(&png_ptr,  png_infopp_NULL);
-       return ret;
+    if (setjmp(png_jmpbuf(png_ptr))) {
+        // If we get here, we had a problem writing the file
+        return false;
     }
 
-
-    /* Set error handling.  REQUIRED if you aren't supplying your own
-     * error handling functions in the png_create_write_struct() call.
-     */
-    if (setjmp(png_jmpbuf(png_ptr)))
-    {
-       /* If we get here, we had a problem writing the file */
-       fclose(p_png_file);
-       png_destroy_write_struct(&png_ptr, &info_ptr);
-       return ret;
-    }
-
-    /* Set up the output control if you are using standard C streams */
-    png_init_io(png_ptr, p_png_file);
-
-    /* Set the image information here.  Width and height are up to 2^31,
-     * bit_depth is one of 1, 2, 4, 8, or 16, but valid values also depend on
-     * the color_type selected. color_type is one of PNG_COLOR_TYPE_GRAY,
-     * PNG_COLOR_TYPE_GRAY_ALPHA, PNG_COLOR_TYPE_PALETTE, PNG_COLOR_TYPE_RGB,
-     * or PNG_COLOR_TYPE_RGB_ALPHA.  interlace is either PNG_INTERLACE_NONE or
-     * PNG_INTERLACE_ADAM7, and the compression_type and filter_type MUST
-     * currently be PNG_COMPRESSION_TYPE_BASE and PNG_FILTER_TYPE_BASE. REQUIRED
-     */
     if (is_colour) {
         png_set_IHDR(png_ptr, info_ptr, width, height, bytes_per_sample*8, PNG_COLOR_TYPE_RGB,
            PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
@@ -166,42 +111,144 @@ int32_t save_png_file(
            PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
     }
 
-    /* Write the file header information.  REQUIRED */
+    // Colour space chunks, the same as the libpng simplified API writes
+    if (bytes_per_sample == 2) {
+        // 16-bit data is linear with sRGB primaries
+        png_set_gAMA_fixed(png_ptr, info_ptr, 100000);
+        png_set_cHRM_fixed(png_ptr, info_ptr,
+                           31270, 32900,  // White
+                           64000, 33000,  // Red
+                           30000, 60000,  // Green
+                           15000, 6000);  // Blue
+    } else {
+        png_set_sRGB(png_ptr, info_ptr, PNG_sRGB_INTENT_PERCEPTUAL);
+    }
+
+    // Compression settings
+    png_set_compression_level(png_ptr, png_compression_profiles[compression].zlib_level);
+    png_set_compression_strategy(png_ptr, png_compression_profiles[compression].zlib_strategy);
+    png_set_compression_window_bits(png_ptr, png_compression_profiles[compression].zlib_window_bits);
+    png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, png_compression_profiles[compression].filters);
+
+    // Write the file header information
     png_write_info(png_ptr, info_ptr);
 
-    /* Flip BGR pixels to RGB */
+    // Flip BGR pixels to RGB
     png_set_bgr(png_ptr);
 
-    /* Swap bytes of 16-bit files to most significant byte first */
-    png_set_swap(png_ptr);
+    // Swap bytes of 16-bit data to most significant byte first
+    bool big_endian_processor = (*(uint16_t *)"\0\xff" < 0x100);
+    if (bytes_per_sample == 2 && !big_endian_processor) {
+        png_set_swap(png_ptr);
+    }
 
     // Write out image
-    uint8_t *row_pointers[height];
-    int samples_per_pixel;
-    if (is_colour) {
-        samples_per_pixel = 3;
+    png_write_image(png_ptr, row_pointers);
+    png_write_end(png_ptr, info_ptr);
+    return true;
+}
+
+
+// ------------------------------------------
+// Write PNG image to a file, or just count its size if p_png_file is null
+// ------------------------------------------
+static bool write_png(
+    FILE *p_png_file,
+    int64_t *p_file_size,
+    const uint8_t *p_image_data,
+    uint32_t width,
+    uint32_t height,
+    uint32_t bytes_per_sample,
+    bool is_colour,
+    int compression)
+{
+    png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    if (png_ptr == nullptr) {
+        return false;
+    }
+
+    png_infop info_ptr = png_create_info_struct(png_ptr);
+    if (info_ptr == nullptr) {
+        png_destroy_write_struct(&png_ptr, NULL);
+        return false;
+    }
+
+    if (p_png_file != nullptr) {
+        png_init_io(png_ptr, p_png_file);
     } else {
-        samples_per_pixel = 1;
+        *p_file_size = 0;
+        png_set_write_fn(png_ptr, p_file_size, count_png_data, flush_png_data);
     }
 
+    // Image data is stored bottom line first
+    const int samples_per_pixel = (is_colour) ? 3 : 1;
+    std::unique_ptr<png_bytep[]> row_pointers(new png_bytep[height]);
     for (uint32_t i = 0; i < height; i++) {
-        // Yuck!  Casting away the const from the pointer as this version of libpng is sloppily written!
-        row_pointers[i] = (uint8_t *)p_image_data + (height - 1 - i) * width * bytes_per_sample * samples_per_pixel;
+        // Casting away the const from the pointer as older versions of libpng do not take const rows
+        row_pointers[i] = (png_bytep)p_image_data + (int64_t)(height - 1 - i) * width * bytes_per_sample * samples_per_pixel;
     }
 
-    png_write_image(png_ptr, row_pointers);
+    if (compression < 0 || compression >= PNG_COMPRESSION_COUNT) {
+        compression = PNG_COMPRESSION_BALANCED;
+    }
 
-    /* Clean up after the write, and free any memory allocated */
+    bool ret = write_png_image(
+                png_ptr,
+                info_ptr,
+                row_pointers.get(),
+                width,
+                height,
+                bytes_per_sample,
+                is_colour,
+                compression);
+
+    // Clean up after the write, and free any memory allocated
     png_destroy_write_struct(&png_ptr, &info_ptr);
+    return ret;
+}
+
+
+// ------------------------------------------
+// Save PNG image
+// ------------------------------------------
+int32_t save_png_file(
+    const char *filename,
+    const uint8_t *p_image_data,
+    uint32_t width,
+    uint32_t height,
+    uint32_t bytes_per_sample,
+    bool is_colour,
+    int compression)
+{
+    int32_t ret = -1;
+    FILE *p_png_file = fopen_utf8(filename, "wb");
+    if (p_png_file != nullptr) {
+        if (write_png(p_png_file, nullptr, p_image_data, width, height, bytes_per_sample, is_colour, compression)) {
+            ret = 0;
+        }
 
-    /* Close the file */
-    fclose(p_png_file);
+        fclose(p_png_file);
+    }
 
-    ret = 0;
     return ret;
 }
 
-#else
-    #error "Unsuported libpng version"
-#endif
 
+// ------------------------------------------
+// Get size of PNG image
+// ------------------------------------------
+int64_t get_png_file_size(
+    const uint8_t *p_image_data,
+    uint32_t width,
+    uint32_t height,
+    uint32_t bytes_per_sample,
+    bool is_colour,
+    int compression)
+{
+    int64_t file_size = 0;
+    if (!write_png(nullptr, &file_size, p_image_data, width, height, bytes_per_sample, is_colour, compression)) {
+        return -1;
+    }
+
+    return file_size;
+}
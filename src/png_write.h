@@ -23,13 +23,33 @@
 #include <memory>
 
 
+// PNG compression profiles, from quickest to write to smallest files
+enum e_png_compression {
+    PNG_COMPRESSION_FASTEST = 0,
+    PNG_COMPRESSION_BALANCED,
+    PNG_COMPRESSION_SMALLEST,
+    PNG_COMPRESSION_COUNT
+};
+
+
 extern int32_t save_png_file(
     const char *filename,
     const uint8_t *p_image_data,
     uint32_t width,
     uint32_t height,
     uint32_t bytes_per_sample,
-    bool is_colour);
+    bool is_colour,
+    int compression = PNG_COMPRESSION_BALANCED);
+
+
+// Compress an image without writing it anywhere, returns the size the PNG file would be or -1 on error
+extern int64_t get_png_file_size(
+    const uint8_t *p_image_data,
+    uint32_t width,
+    uint32_t height,
+    uint32_t bytes_per_sample,
+    bool is_colour,
+    int compression);
 
     
 #endif  // PNG_WRITE_H
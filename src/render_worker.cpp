@@ -0,0 +1,183 @@
+// ---------------------------------------------------------------------
+// Copyright (C) 2015 Chris Garry
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>
+// ---------------------------------------------------------------------
+
+#include <QMutexLocker>
+#include <QtConcurrent>
+#include <algorithm>
+
+#include "render_worker.h"
+#include "image.h"
+
+
+c_render_worker::c_render_worker(int stage_count)
+    : m_stage_count(stage_count),
+      mp_pending_image(new c_image),
+      m_pending_first_stage(0),
+      m_pending_colour_saturation(1.0),
+      m_pending_keep_processed_image(false),
+      m_request_pending(false),
+      m_is_running(false),
+      m_request_id(0),
+      mp_render_image(new c_image),
+      m_stage_images(stage_count),
+      m_stage_changed(stage_count, false),
+      mp_processed_image(new c_image),
+      m_keep_processed_image(false)
+{
+    for (int stage = 0; stage < m_stage_count; stage++) {
+        m_stage_images[stage] = new c_image;
+    }
+}
+
+
+c_render_worker::~c_render_worker()
+{
+    cancel();
+    m_render_thread.waitForFinished();
+    delete mp_pending_image;
+    delete mp_render_image;
+    delete mp_processed_image;
+    for (int stage = 0; stage < m_stage_count; stage++) {
+        delete m_stage_images[stage];
+    }
+}
+
+
+int c_render_worker::request_render(
+        const c_image &image,
+        int first_stage,
+        const t_stage_function &stage_function,
+        double colour_saturation,
+        bool keep_processed_image)
+{
+    QMutexLocker locker(&m_mutex);
+
+    // Any request that has not been started yet is simply overwritten
+    mp_pending_image->copy_image_data(image);
+    mp_pending_image->copy_processing_settings(image);
+    m_pending_first_stage = first_stage;
+    m_pending_stage_function = stage_function;
+    m_pending_colour_saturation = colour_saturation;
+    m_pending_keep_processed_image = keep_processed_image;
+    m_request_pending = true;
+    m_request_id++;
+
+    if (!m_is_running) {
+        m_is_running = true;
+        m_render_thread = QtConcurrent::run(this, &c_render_worker::render_frames);
+    }
+
+    return m_request_id;
+}
+
+
+void c_render_worker::cancel()
+{
+    QMutexLocker locker(&m_mutex);
+    m_request_pending = false;
+    m_request_id++;
+}
+
+
+bool c_render_worker::is_current_request(int request_id)
+{
+    QMutexLocker locker(&m_mutex);
+    return request_id == m_request_id;
+}
+
+
+bool c_render_worker::take_results(
+        int request_id,
+        c_image **pp_stage_images,
+        bool *p_stage_changed,
+        c_image *p_processed_image)
+{
+    // The render thread is finished with the newest request once its result has been passed back
+    QMutexLocker locker(&m_mutex);
+    if (request_id != m_request_id) {
+        return false;
+    }
+
+    for (int stage = 0; stage < m_stage_count; stage++) {
+        p_stage_changed[stage] = m_stage_changed[stage];
+        if (m_stage_changed[stage]) {
+            std::swap(pp_stage_images[stage], m_stage_images[stage]);
+            m_stage_changed[stage] = false;
+        }
+    }
+
+    if (m_keep_processed_image && p_processed_image != nullptr) {
+        p_processed_image->copy_image_data(*mp_processed_image);
+    }
+
+    return true;
+}
+
+
+void c_render_worker::render_frames()
+{
+    while (true) {
+        // Take the newest request
+        int first_stage;
+        t_stage_function stage_function;
+        double colour_saturation;
+        int request_id;
+        {
+            QMutexLocker locker(&m_mutex);
+            if (!m_request_pending) {
+                m_is_running = false;
+                return;
+            }
+
+            std::swap(mp_pending_image, mp_render_image);
+            first_stage = m_pending_first_stage;
+            stage_function = m_pending_stage_function;
+            colour_saturation = m_pending_colour_saturation;
+            m_keep_processed_image = m_pending_keep_processed_image;
+            request_id = m_request_id;
+            m_request_pending = false;
+        }
+
+        // Run the stages that are not valid, keeping a copy of the frame after each one that changes it
+        for (int stage = 0; stage < m_stage_count; stage++) {
+            m_stage_changed[stage] = stage >= first_stage && stage_function(stage, mp_render_image);
+            if (m_stage_changed[stage]) {
+                m_stage_images[stage]->copy_image_data(*mp_render_image);
+            }
+        }
+
+        if (m_keep_processed_image) {
+            mp_render_image->do_lut_based_processing();
+            mp_render_image->change_colour_saturation(colour_saturation);
+            mp_processed_image->copy_image_data(*mp_render_image);
+            mp_render_image->conv_data_ready_for_qimage();
+        } else if (!mp_render_image->process_and_conv_data_ready_for_qimage(false, 0, 0, 0, 0, -1, colour_saturation)) {
+            mp_render_image->do_lut_based_processing();
+            mp_render_image->change_colour_saturation(colour_saturation);
+            mp_render_image->conv_data_ready_for_qimage();
+        }
+
+        // Do not bother passing back a frame that has already been superseded
+        if (is_current_request(request_id)) {
+            QImage frame_image = QImage(mp_render_image->get_p_buffer(),
+                                        mp_render_image->get_width(),
+                                        mp_render_image->get_height(),
+                                        QImage::Format_RGB888).copy();
+            emit render_done(frame_image, request_id);
+        }
+    }
+}
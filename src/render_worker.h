@@ -0,0 +1,108 @@
+// ---------------------------------------------------------------------
+// Copyright (C) 2015 Chris Garry
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>
+// ---------------------------------------------------------------------
+
+#ifndef RENDER_WORKER_H
+#define RENDER_WORKER_H
+
+#include <QFuture>
+#include <QImage>
+#include <QMutex>
+#include <QObject>
+#include <QVector>
+#include <functional>
+
+
+class c_image;
+
+
+// ------------------------------------------
+// Does the processing stages, LUT based processing, colour saturation and conversion for
+// display of a frame in the background, so dragging a processing option slider does not
+// hold up the GUI thread.  Only the newest request is ever rendered: a request that has not
+// been started yet is replaced by any later one, and the result of a render is only
+// passed back if no newer request has been made while it was running.
+// ------------------------------------------
+class c_render_worker : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Runs one processing stage on the render thread, returns true if the stage changed the image
+    typedef std::function<bool (int stage, c_image *p_image)> t_stage_function;
+
+    // Constructor
+    c_render_worker(int stage_count);
+
+    // Destructor - waits for any render to finish
+    ~c_render_worker();
+
+    // Queue a copy of image, along with its processing settings, to be rendered.
+    // Stages first_stage onwards are run with stage_function before the LUT based processing.
+    // Returns the ID that render_done() will be emitted with for this request
+    int request_render(
+            const c_image &image,
+            int first_stage,
+            const t_stage_function &stage_function,
+            double colour_saturation,
+            bool keep_processed_image);
+
+    // Drop any queued request and ignore the result of the render in progress
+    void cancel();
+
+    // Check if a request is still the newest one, results for older requests should be ignored
+    bool is_current_request(int request_id);
+
+    // Take the results of a finished request, only valid for the newest request.
+    // The frame after each stage that changed it is swapped into pp_stage_images with
+    // p_stage_changed set, and if it was asked for the frame before it was converted for
+    // display is copied to p_processed_image.  Returns false if the request is not the newest
+    bool take_results(
+            int request_id,
+            c_image **pp_stage_images,
+            bool *p_stage_changed,
+            c_image *p_processed_image);
+
+
+signals:
+    // Signal to pass the frame back once it is ready for display
+    void render_done(QImage frame_image, int request_id);
+
+
+private:
+    void render_frames();
+
+    QMutex m_mutex;
+    const int m_stage_count;
+    c_image *mp_pending_image;  // Newest request that has not been started
+    int m_pending_first_stage;
+    t_stage_function m_pending_stage_function;
+    double m_pending_colour_saturation;
+    bool m_pending_keep_processed_image;
+    bool m_request_pending;
+    bool m_is_running;
+    int m_request_id;  // ID of the newest request
+
+    // Only touched by the render thread while it is running
+    c_image *mp_render_image;
+    QVector<c_image *> m_stage_images;  // Frame after each stage that changed it
+    QVector<bool> m_stage_changed;
+    c_image *mp_processed_image;  // Frame before conversion for display
+    bool m_keep_processed_image;
+    QFuture<void> m_render_thread;
+};
+
+#endif // RENDER_WORKER_H
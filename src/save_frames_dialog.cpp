@@ -18,8 +18,10 @@
 #include <QDebug>
 
 #include <Qt>
+#include <QtConcurrent>
 #include <QCheckBox>
 #include <QComboBox>
+#include <QElapsedTimer>
 #include <QFormLayout>
 #include <QGroupBox>
 #include <QHBoxLayout>
@@ -29,15 +31,22 @@
 #include <QRadioButton>
 #include <QSpinBox>
 #include <QVBoxLayout>
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 
 #include "save_frames_dialog.h"
+#include "image.h"
+#include "persistent_data.h"
 #include "utf8_validator.h"
 
 
 #define INSIDE_GBOX_SPACING 8
 #define INSIDE_GBOX_MARGIN 10
 
+// Largest part of the current frame used to measure the PNG compression profiles
+#define PNG_TEST_MAX_SIZE 512
+
 
 c_save_frames_dialog::c_save_frames_dialog(QWidget *parent,
                                            e_save_type save_type,
@@ -68,8 +77,13 @@ c_save_frames_dialog::c_save_frames_dialog(QWidget *parent,
       m_end_frame(total_frames),
       m_frame_start_end_spin_boxes_valid(true),
 //      m_multiple_files_spin_boxes_valid(true),
-      m_last_save_dir("")
+      m_last_save_dir(""),
 //      m__by_frames(false)
+      m_png_test_running(false),
+      m_png_test_width(0),
+      m_png_test_height(0),
+      m_png_test_byte_depth(1),
+      m_png_test_colour(false)
 {
     switch (save_type) {
     case SAVE_IMAGES:
@@ -402,6 +416,57 @@ c_save_frames_dialog::c_save_frames_dialog(QWidget *parent,
     }
 
 
+    //
+    // PNG compression - Only for saving as image files
+    //
+    const QString png_profile_names[PNG_COMPRESSION_COUNT] = {
+        tr("Fastest", "PNG compression profile"),
+        tr("Balanced", "PNG compression profile"),
+        tr("Smallest", "PNG compression profile")
+    };
+
+    mp_png_compression_ComboBox = new QComboBox;
+    for (int profile = 0; profile < PNG_COMPRESSION_COUNT; profile++) {
+        mp_png_compression_ComboBox->addItem(png_profile_names[profile]);
+    }
+
+    if (c_persistent_data::m_png_compression >= 0 && c_persistent_data::m_png_compression < PNG_COMPRESSION_COUNT) {
+        mp_png_compression_ComboBox->setCurrentIndex(c_persistent_data::m_png_compression);
+    } else {
+        mp_png_compression_ComboBox->setCurrentIndex(PNG_COMPRESSION_BALANCED);
+    }
+
+    mp_png_compression_ComboBox->setToolTip(tr("Trade the time taken to write each PNG file against its size.  "
+                                               "The PNG files hold exactly the same image whichever is chosen.",
+                                               "Save frames dialog") + "<b></b>");
+    connect(mp_png_compression_ComboBox, SIGNAL(currentIndexChanged(int)), this, SLOT(png_compression_changed_slot()));
+    connect(this, SIGNAL(png_compression_measured()), this, SLOT(png_compression_measured_slot()));
+
+    QFormLayout *png_compression_FLayout = new QFormLayout;
+    png_compression_FLayout->setHorizontalSpacing(10);
+    png_compression_FLayout->setVerticalSpacing(5);
+    png_compression_FLayout->addRow(tr("Compression:", "Save frames dialog"), mp_png_compression_ComboBox);
+    for (int profile = 0; profile < PNG_COMPRESSION_COUNT; profile++) {
+        mp_png_profile_result_Labels[profile] = new QLabel;
+        mp_png_profile_result_Labels[profile]->setToolTip(tr("Measured by compressing part of the current frame on one thread",
+                                                             "Save frames dialog") + "<b></b>");
+        png_compression_FLayout->addRow(png_profile_names[profile] + ":", mp_png_profile_result_Labels[profile]);
+    }
+
+    QHBoxLayout *png_compression_HLayout = new QHBoxLayout;
+    png_compression_HLayout->setMargin(INSIDE_GBOX_MARGIN);
+    png_compression_HLayout->setSpacing(0);
+    png_compression_HLayout->addLayout(png_compression_FLayout);
+    png_compression_HLayout->addStretch();
+
+    QGroupBox *png_compression_GBox = new QGroupBox(tr("PNG Image Options", "Save frames dialog"));
+    png_compression_GBox->setLayout(png_compression_HLayout);
+    if (save_type != SAVE_IMAGES) {
+        png_compression_GBox->hide();
+        png_compression_GBox->setFixedHeight(0);
+    }
+
+
     //
     // SER file saving specific options
     //
@@ -644,6 +709,7 @@ c_save_frames_dialog::c_save_frames_dialog(QWidget *parent,
     groupbox_list << mp_processing_GBox;
     groupbox_list << mp_resize_GBox;
     groupbox_list << filename_generation_GBox;
+    groupbox_list << png_compression_GBox;
     groupbox_list << ser_file_options_GBox;
     groupbox_list << avi_file_options_GBox;
     groupbox_list << gif_file_options_GBox;
@@ -736,6 +802,8 @@ c_save_frames_dialog::c_save_frames_dialog(QWidget *parent,
 
 c_save_frames_dialog::~c_save_frames_dialog()
 {
+    // The measuring thread uses the dialog's buffers
+    m_png_test_thread.waitForFinished();
     delete mp_utf8_validator;
 }
 
@@ -859,6 +927,18 @@ void c_save_frames_dialog::multiple_files_overlap_frames_changed_slot()
 }
 */
 
+void c_save_frames_dialog::set_total_frames(int total_frames)
+{
+    // Frame count has changed because the SER file is still being recorded
+    m_total_frames = total_frames;
+    mp_save_all_frames_RButton->setText(tr("Save All %1 Frames", "Save frames dialog").arg(total_frames));
+    mp_start_Spinbox->setMaximum(total_frames);
+    mp_end_Spinbox->setMaximum(total_frames);
+    mp_frame_decimation_SpinBox->setMaximum(total_frames);
+    update_num_frames_slot();
+}
+
+
 void c_save_frames_dialog::set_markers(int marker_start_frame,
                  int marker_end_frame,
                  bool markers_enabled)
@@ -1543,3 +1623,100 @@ int c_save_frames_dialog::get_avi_max_size()
 {
     return mp_avi_max_size_Combox->currentData().toInt();
 }
+
+
+// PNG file options
+int c_save_frames_dialog::get_png_compression()
+{
+    return mp_png_compression_ComboBox->currentIndex();
+}
+
+
+void c_save_frames_dialog::png_compression_changed_slot()
+{
+    c_persistent_data::m_png_compression = mp_png_compression_ComboBox->currentIndex();
+}
+
+
+void c_save_frames_dialog::set_png_test_frame(c_image *p_image)
+{
+    if (m_png_test_running) {
+        // Still measuring the last frame
+        return;
+    }
+
+    // Copy the middle of the frame, a part of it is enough to compare the profiles
+    m_png_test_width = std::min(p_image->get_width(), (int32_t)PNG_TEST_MAX_SIZE);
+    m_png_test_height = std::min(p_image->get_height(), (int32_t)PNG_TEST_MAX_SIZE);
+    m_png_test_byte_depth = p_image->get_byte_depth();
+    m_png_test_colour = p_image->get_colour();
+    if (m_png_test_width <= 0 || m_png_test_height <= 0) {
+        return;
+    }
+
+    const size_t pixel_size = (size_t)m_png_test_byte_depth * ((m_png_test_colour) ? 3 : 1);
+    const size_t src_line_size = (size_t)p_image->get_width() * pixel_size;
+    const size_t dst_line_size = (size_t)m_png_test_width * pixel_size;
+    const int x_offset = (p_image->get_width() - m_png_test_width) / 2;
+    const int y_offset = (p_image->get_height() - m_png_test_height) / 2;
+    mp_png_test_buffer.reset(new uint8_t[dst_line_size * m_png_test_height]);
+    for (int y = 0; y < m_png_test_height; y++) {
+        memcpy(mp_png_test_buffer.get() + y * dst_line_size,
+               p_image->get_p_buffer() + (y + y_offset) * src_line_size + x_offset * pixel_size,
+               dst_line_size);
+    }
+
+    for (int profile = 0; profile < PNG_COMPRESSION_COUNT; profile++) {
+        mp_png_profile_result_Labels[profile]->setText(tr("Measuring...", "Save frames dialog"));
+    }
+
+    m_png_test_running = true;
+    m_png_test_thread = QtConcurrent::run(this, &c_save_frames_dialog::measure_png_compression);
+}
+
+
+void c_save_frames_dialog::measure_png_compression()
+{
+    // Runs on a worker thread, repeat each profile for long enough to get a steady rate
+    const qint64 min_test_time_ns = 50 * 1000 * 1000;
+    const double raw_size = (double)m_png_test_width * m_png_test_height * m_png_test_byte_depth * ((m_png_test_colour) ? 3 : 1);
+    for (int profile = 0; profile < PNG_COMPRESSION_COUNT; profile++) {
+        int64_t file_size = 0;
+        int runs = 0;
+        QElapsedTimer timer;
+        timer.start();
+        do {
+            file_size = get_png_file_size(
+                        mp_png_test_buffer.get(),
+                        m_png_test_width,
+                        m_png_test_height,
+                        m_png_test_byte_depth,
+                        m_png_test_colour,
+                        profile);
+            runs++;
+        } while (file_size >= 0 && timer.nsecsElapsed() < min_test_time_ns);
+
+        const double seconds = (double)timer.nsecsElapsed() / (1000.0 * 1000.0 * 1000.0);
+        m_png_mbytes_per_second[profile] = (file_size < 0 || seconds <= 0) ? 0 : (raw_size * runs) / (seconds * 1024 * 1024);
+        m_png_size_percent[profile] = (file_size < 0) ? 0 : (100.0 * file_size) / raw_size;
+    }
+
+    emit png_compression_measured();
+}
+
+
+void c_save_frames_dialog::png_compression_measured_slot()
+{
+    m_png_test_running = false;
+    mp_png_test_buffer.reset(nullptr);  // Free test image buffer
+    for (int profile = 0; profile < PNG_COMPRESSION_COUNT; profile++) {
+        if (m_png_mbytes_per_second[profile] > 0) {
+            mp_png_profile_result_Labels[profile]->setText(
+                        tr("%1 MB/s, %2% of uncompressed size", "Save frames dialog")
+                        .arg(m_png_mbytes_per_second[profile], 0, 'f', 0)
+                        .arg(m_png_size_percent[profile], 0, 'f', 1));
+        } else {
+            mp_png_profile_result_Labels[profile]->setText(tr("Not available", "Save frames dialog"));
+        }
+    }
+}
@@ -20,7 +20,11 @@
 #define SAVE_FRAMES_DIALOG_H
 
 #include <QDialog>
+#include <QFuture>
 #include <QString>
+#include <cstdint>
+#include <memory>
+#include "png_write.h"
 
 
 class QRadioButton;
@@ -32,6 +36,7 @@ class QGroupBox;
 class QCheckBox;
 class QComboBox;
 class c_utf8_validator;
+class c_image;
 
 
 class c_save_frames_dialog : public QDialog
@@ -63,6 +68,8 @@ public:
 
     void set_gif_frametime(double frametime);
 
+    void set_total_frames(int total_frames);
+
     void set_colour_details(bool is_colour_raw,
                             bool is_colour_processed);
 
@@ -111,6 +118,12 @@ public:
     bool get_avi_old_format();
     int get_avi_max_size();
 
+    // PNG file options
+    int get_png_compression();
+
+    // Frame used to measure the speed and file size of each PNG compression profile
+    void set_png_test_frame(c_image *p_image);
+
     // Last save directory
     void set_last_save_directory(QString dir)
     {
@@ -124,6 +137,8 @@ public:
 
 
 signals:
+    // Emitted from the measuring thread once every PNG compression profile has been tried
+    void png_compression_measured();
 
 
 private slots:
@@ -134,6 +149,8 @@ private slots:
     void gif_apply_preset_options();
     void gif_unchanged_border_tolerance_changed_slot();
     void gif_test_options_button_pressed_slot();
+    void png_compression_changed_slot();
+    void png_compression_measured_slot();
 //    void multiple_files_frames_changed_slot();
 //    void multiple_files_files_changed_slot();
 //    void multiple_files_overlap_frames_changed_slot();
@@ -144,6 +161,7 @@ private:
     void helper_method();
     void colour_updated();
     bool is_select_radio_button_checked();
+    void measure_png_compression();
     
     // Widgets
     QRadioButton *mp_save_current_frame_RButton;
@@ -206,6 +224,10 @@ private:
     QCheckBox *mp_gif_reduce_pixel_depth_CBox;
     QSpinBox *mp_gif_reduce_pixel_depth_SpinBox;
 
+    // PNG options
+    QComboBox *mp_png_compression_ComboBox;
+    QLabel *mp_png_profile_result_Labels[PNG_COMPRESSION_COUNT];
+
 
     QLabel *mp_total_frames_to_save_Label;
 
@@ -232,6 +254,17 @@ private:
 //    bool m_multiple_files_spin_boxes_valid;
     bool m_test_run;
     QString m_last_save_dir;
+
+    // PNG compression measurement, the results are only read once the thread has finished
+    bool m_png_test_running;
+    std::unique_ptr<uint8_t[]> mp_png_test_buffer;
+    int m_png_test_width;
+    int m_png_test_height;
+    int m_png_test_byte_depth;
+    bool m_png_test_colour;
+    double m_png_mbytes_per_second[PNG_COMPRESSION_COUNT];
+    double m_png_size_percent[PNG_COMPRESSION_COUNT];
+    QFuture<void> m_png_test_thread;
 //    bool m_multiple_files_by_frames;
 };
 
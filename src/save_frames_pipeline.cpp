@@ -0,0 +1,220 @@
+// ---------------------------------------------------------------------
+// Copyright (C) 2015 Chris Garry
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>
+// ---------------------------------------------------------------------
+
+#include <QtConcurrent>
+#include <QThread>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "save_frames_pipeline.h"
+#include "image.h"
+#include "pipp_ser.h"
+#include "persistent_data.h"
+#include "ser_metadata_cache.h"
+
+
+c_save_frames_pipeline::c_save_frames_pipeline(
+    c_pipp_ser *p_ser_file,
+    c_image *p_settings_image,
+    c_ser_metadata_cache *p_metadata_cache)
+    : mp_ser_file(p_ser_file),
+      mp_settings_image(p_settings_image),
+      mp_metadata_cache(p_metadata_cache),
+      m_read_roi(p_ser_file->get_full_roi())
+{
+    // Keep every core busy with a frame waiting behind each one
+    m_frames_in_flight = QThread::idealThreadCount() * 2;
+    if (m_frames_in_flight < 2) {
+        m_frames_in_flight = 2;
+    }
+}
+
+
+QVector<int> c_save_frames_pipeline::get_frame_numbers(
+    int min_frame,
+    int max_frame,
+    int decimate_value,
+    int sequence_direction)
+{
+    QVector<int> frame_numbers;
+
+    // Direction loop
+    int start_dir = (sequence_direction == 1) ? 1 : 0;
+    int end_dir = (sequence_direction == 0) ? 0 : 1;
+    for (int current_dir = start_dir; current_dir <= end_dir; current_dir++) {
+        int start_frame = min_frame;
+        int end_frame = max_frame;
+        if (current_dir == 1) {  // Reverse direction - count backwards
+            // Use negative numbers so for loop works counting up or down
+            start_frame = -max_frame;
+            end_frame = -min_frame;
+        }
+
+        for (int frame_number = start_frame; frame_number <= end_frame; frame_number += decimate_value) {
+            frame_numbers.append(abs(frame_number));
+        }
+    }
+
+    return frame_numbers;
+}
+
+
+void c_save_frames_pipeline::set_read_roi(const c_pipp_ser::s_roi &roi)
+{
+    m_read_roi = roi;
+}
+
+
+void c_save_frames_pipeline::set_save_function(t_save_function save_function)
+{
+    m_save_function = save_function;
+}
+
+
+bool c_save_frames_pipeline::run(
+    const QVector<int> &frame_numbers,
+    t_process_function process_function,
+    t_write_function write_function)
+{
+    struct s_slot {
+        std::unique_ptr<c_image> mp_image;
+        QFuture<void> m_future;
+        int m_frame_number;
+        bool m_valid;
+        uint64_t m_timestamp;
+    };
+
+    std::vector<s_slot> frame_slots(m_frames_in_flight);
+    for (auto &frame_slot : frame_slots) {
+        frame_slot.mp_image.reset(new c_image);
+        frame_slot.mp_image->copy_processing_settings(*mp_settings_image);
+    }
+
+    bool is_colour = (mp_ser_file->get_colour_id() == COLOURID_RGB || mp_ser_file->get_colour_id() == COLOURID_BGR);
+    int frame_count = frame_numbers.size();
+    int next_read = 0;
+    int next_write = 0;
+    bool read_error = false;
+    bool ret = true;
+    const size_t frame_size = mp_ser_file->get_buffer_size(m_read_roi);
+    const int32_t byte_depth = mp_ser_file->get_byte_depth();
+
+    // Statistics can only be worked out from whole frames
+    c_ser_metadata_cache *p_metadata_cache = nullptr;
+    if (m_read_roi.width == mp_ser_file->get_width() && m_read_roi.height == mp_ser_file->get_height()) {
+        p_metadata_cache = mp_metadata_cache;
+    }
+
+    // Saving reads each frame once, so use the export read mode to stop it filling the page cache
+    const c_ser_io_backend::e_io_mode playback_io_mode = mp_ser_file->get_io_mode();
+    mp_ser_file->set_io_mode((c_ser_io_backend::e_io_mode)c_persistent_data::m_ser_export_read_mode);
+
+    while (next_write < frame_count) {
+        // Reader stage - fill any free slots and start processing them.
+        // Evenly spaced frames are read together so the reads can be coalesced.
+        while (!read_error && next_read < frame_count && next_read - next_write < m_frames_in_flight) {
+            int free_slots = m_frames_in_flight - (next_read - next_write);
+            int run_length = 1;
+            int stride = 1;
+            if (free_slots > 1 && next_read + 1 < frame_count && frame_numbers[next_read + 1] != frame_numbers[next_read]) {
+                stride = frame_numbers[next_read + 1] - frame_numbers[next_read];
+                run_length = 2;
+                while (run_length < free_slots &&
+                       next_read + run_length < frame_count &&
+                       frame_numbers[next_read + run_length] - frame_numbers[next_read + run_length - 1] == stride) {
+                    run_length++;
+                }
+            }
+
+            int frames_read = 0;
+            mp_ser_file->get_frames(
+                        frame_numbers[next_read],  // first_frame
+                        frame_numbers[next_read + run_length - 1],  // last_frame
+                        abs(stride),  // stride
+                        m_read_roi,  // roi
+                        [&](uint32_t frame_number, uint64_t timestamp, const uint8_t *p_frame) {
+                s_slot &frame_slot = frame_slots[(next_read + frames_read) % m_frames_in_flight];
+                c_image *p_image = frame_slot.mp_image.get();
+                p_image->set_image_details(
+                            m_read_roi.width,  // width
+                            m_read_roi.height,  // height
+                            mp_ser_file->get_byte_depth(),  // byte_depth
+                            mp_ser_file->get_colour_id(),  // colour_id
+                            is_colour);  // colour
+
+                memcpy(p_image->get_p_buffer(), p_frame, frame_size);
+                frame_slot.m_frame_number = frame_number;
+                frame_slot.m_valid = true;
+                frame_slot.m_timestamp = timestamp;
+                int index = next_read + frames_read;
+                const t_save_function &save_function = m_save_function;
+                frame_slot.m_future = QtConcurrent::run([process_function, save_function, p_metadata_cache, p_image, frame_size, byte_depth, index, frame_number, timestamp]() {
+                    if (p_metadata_cache != nullptr && p_metadata_cache->frame_stats_needed(frame_number)) {
+                        p_metadata_cache->set_frame_stats(
+                                    frame_number,
+                                    c_ser_metadata_cache::calculate_frame_stats(p_image->get_p_buffer(), frame_size / byte_depth, byte_depth));
+                    }
+
+                    process_function(p_image);
+                    if (save_function) {
+                        save_function(p_image, index, (int)frame_number, timestamp);
+                    }
+                });
+
+                frames_read++;
+                return true;
+            });
+
+            if (frames_read < run_length) {
+                // Read failed, the writer stage stops when it reaches this slot
+                s_slot &frame_slot = frame_slots[(next_read + frames_read) % m_frames_in_flight];
+                frame_slot.m_frame_number = frame_numbers[next_read + frames_read];
+                frame_slot.m_valid = false;
+                frame_slot.m_future = QFuture<void>();
+                next_read += frames_read + 1;
+                read_error = true;
+            } else {
+                next_read += run_length;
+            }
+        }
+
+        // Writer stage - hand back the oldest frame once it has been processed
+        s_slot &frame_slot = frame_slots[next_write % m_frames_in_flight];
+        frame_slot.m_future.waitForFinished();
+        next_write++;
+
+        if (!frame_slot.m_valid) {
+            ret = false;
+            break;
+        }
+
+        if (!write_function(frame_slot.mp_image.get(), frame_slot.m_frame_number, frame_slot.m_timestamp)) {
+            // Saving has been stopped
+            break;
+        }
+    }
+
+    // Ensure no workers are still using the slots before they are freed
+    for (auto &frame_slot : frame_slots) {
+        frame_slot.m_future.waitForFinished();
+    }
+
+    mp_ser_file->set_io_mode(playback_io_mode);
+    return ret;
+}
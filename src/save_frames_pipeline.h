@@ -0,0 +1,88 @@
+// ---------------------------------------------------------------------
+// Copyright (C) 2015 Chris Garry
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>
+// ---------------------------------------------------------------------
+
+
+#ifndef SAVE_FRAMES_PIPELINE_H
+#define SAVE_FRAMES_PIPELINE_H
+
+#include <QVector>
+#include <cstdint>
+#include <functional>
+#include "pipp_ser.h"
+
+
+class c_image;
+class c_ser_metadata_cache;
+
+
+//
+// Staged pipeline used when saving frames:
+//  * Reader - frames are read from the SER file on the calling thread, runs of evenly
+//             spaced frames are read together with c_pipp_ser::get_frames()
+//  * Workers - frames are processed in parallel on the global thread pool, and can also be
+//              saved there when each frame goes to a file of its own
+//  * Writer - processed frames are handed back in order on the calling thread
+//
+class c_save_frames_pipeline
+{
+public:
+    // Processing done on a worker thread - must not touch any widgets
+    typedef std::function<void (c_image *p_image)> t_process_function;
+
+    // Called in frame order on the calling thread, return false to stop saving
+    typedef std::function<bool (c_image *p_image, int frame_number, uint64_t timestamp)> t_write_function;
+
+    // Called on a worker thread after the process function, index is the frame's position in frame_numbers
+    typedef std::function<void (c_image *p_image, int index, int frame_number, uint64_t timestamp)> t_save_function;
+
+    // Constructor
+    // Whole frames that are read fill in their statistics in p_metadata_cache if it is not null
+    c_save_frames_pipeline(
+        c_pipp_ser *p_ser_file,
+        c_image *p_settings_image,
+        c_ser_metadata_cache *p_metadata_cache = nullptr);
+
+    // Build the list of frame numbers to save from the save frames dialog settings
+    static QVector<int> get_frame_numbers(
+        int min_frame,
+        int max_frame,
+        int decimate_value,
+        int sequence_direction);
+
+    // Only read this region of each frame, the process function gets images the size of the region
+    void set_read_roi(const c_pipp_ser::s_roi &roi);
+
+    // Save frames on the worker threads, the write function is still called in frame order
+    void set_save_function(t_save_function save_function);
+
+    // Run the pipeline, returns false if a frame could not be read
+    bool run(
+        const QVector<int> &frame_numbers,
+        t_process_function process_function,
+        t_write_function write_function);
+
+
+private:
+    c_pipp_ser *mp_ser_file;
+    c_image *mp_settings_image;
+    c_ser_metadata_cache *mp_metadata_cache;
+    c_pipp_ser::s_roi m_read_roi;
+    t_save_function m_save_function;
+    int m_frames_in_flight;
+};
+
+#endif // SAVE_FRAMES_PIPELINE_H
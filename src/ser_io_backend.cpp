@@ -0,0 +1,754 @@
+// ---------------------------------------------------------------------
+// Copyright (C) 2015 Chris Garry
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>
+// ---------------------------------------------------------------------
+
+
+
+#include "ser_io_backend.h"
+#include "pipp_utf8.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <cerrno>
+    #include <fcntl.h>
+    #include <sys/types.h>
+    #include <unistd.h>
+    #define SER_IO_POSIX_SUPPORT
+#endif
+
+#if defined(__linux__)
+    #include <climits>
+    #include <sys/uio.h>
+    #define SER_IO_PREADV_SUPPORT
+    #define SER_IO_FADVISE_SUPPORT
+    #define SER_IO_DIRECT_SUPPORT
+#endif
+
+#ifdef PIPP_SER_IO_URING
+    #include <liburing.h>
+#endif
+
+
+namespace {
+    // Gaps between reads up to this size are read and discarded rather than seeked over
+    const uint64_t C_MAX_COALESCE_GAP = 1024 * 1024;
+
+    // How far ahead of the reads the fadvise backend asks the kernel to read
+    const uint64_t C_FADVISE_READAHEAD = 16 * 1024 * 1024;
+
+    // How far behind the reads the fadvise backend lets the kernel drop cached data
+    const uint64_t C_FADVISE_DROP_BEHIND = 64 * 1024 * 1024;
+
+    // O_DIRECT reads are aligned to this, which covers the logical block size of all common devices
+    const uint64_t C_DIRECT_ALIGNMENT = 4096;
+
+    // Size of the aligned buffer the O_DIRECT backend reads into, larger reads are done a chunk at a time
+    const uint64_t C_DIRECT_CHUNK_SIZE = 8 * 1024 * 1024;
+
+    // io_uring queue depth and the size reads are split into so several are in flight
+    const unsigned C_URING_QUEUE_DEPTH = 32;
+    const size_t C_URING_PIECE_SIZE = 1024 * 1024;
+
+
+    // ------------------------------------------
+    // Split sorted reads into groups that are close enough together to read as one span
+    // Returns the index one past the end of the group starting at first
+    // ------------------------------------------
+    size_t get_read_group_end(
+        const c_ser_io_backend::s_read_request *p_requests,
+        size_t first,
+        size_t count,
+        uint64_t max_span,
+        size_t max_reads)
+    {
+        size_t last = first + 1;
+        uint64_t span_start = p_requests[first].m_offset;
+        uint64_t span_end = span_start + p_requests[first].m_size;
+        while (last < count && last - first < max_reads) {
+            const c_ser_io_backend::s_read_request &request = p_requests[last];
+            if (request.m_offset < span_end ||
+                request.m_offset - span_end > C_MAX_COALESCE_GAP ||
+                request.m_offset + request.m_size - span_start > max_span) {
+                break;
+            }
+
+            span_end = request.m_offset + request.m_size;
+            last++;
+        }
+
+        return last;
+    }
+
+
+#ifdef SER_IO_POSIX_SUPPORT
+    // ------------------------------------------
+    // pread() the whole block, retrying after signals and short reads
+    // ------------------------------------------
+    bool pread_all(
+        int fd,
+        uint64_t offset,
+        uint8_t *p_buffer,
+        size_t size)
+    {
+        while (size > 0) {
+            ssize_t bytes_read = pread(fd, p_buffer, size, (off_t)offset);
+            if (bytes_read < 0 && errno == EINTR) {
+                continue;
+            }
+
+            if (bytes_read <= 0) {
+                // Read error or unexpected end of file
+                return false;
+            }
+
+            p_buffer += bytes_read;
+            offset += bytes_read;
+            size -= (size_t)bytes_read;
+        }
+
+        return true;
+    }
+#endif
+
+
+    // ------------------------------------------
+    // Buffered reads through the page cache
+    // ------------------------------------------
+    class c_ser_io_buffered : public c_ser_io_backend
+    {
+    public:
+        c_ser_io_buffered(e_io_mode io_mode = IO_MODE_BUFFERED) :
+            c_ser_io_backend(io_mode),
+            m_fd(-1),
+            mp_file(nullptr)
+        {
+        }
+
+        ~c_ser_io_buffered()
+        {
+#ifdef SER_IO_POSIX_SUPPORT
+            if (m_fd >= 0) {
+                ::close(m_fd);
+            }
+#endif
+            if (mp_file != nullptr) {
+                fclose(mp_file);
+            }
+        }
+
+        virtual bool open(
+            const std::string &filename_utf8)
+        {
+#ifdef SER_IO_POSIX_SUPPORT
+            m_fd = ::open(filename_utf8.c_str(), O_RDONLY);
+            return m_fd >= 0;
+#else
+            mp_file = fopen_utf8(filename_utf8, "rb");
+            return mp_file != nullptr;
+#endif
+        }
+
+        bool read_at(
+            uint64_t offset,
+            uint8_t *p_buffer,
+            size_t size)
+        {
+#ifdef SER_IO_POSIX_SUPPORT
+            return pread_all(m_fd, offset, p_buffer, size);
+#else
+            // No positional reads, seek and read under the lock instead
+            std::lock_guard<std::mutex> lock(m_file_mutex);
+            if (fseek64(mp_file, offset, SEEK_SET) != 0) {
+                return false;
+            }
+
+            return fread(p_buffer, 1, size, mp_file) == size;
+#endif
+        }
+
+        bool read_many(
+            const s_read_request *p_requests,
+            size_t count)
+        {
+#ifdef SER_IO_PREADV_SUPPORT
+            // Reads separated by small gaps become one vectored read, the gaps go to a scratch buffer
+            std::vector<size_t> group_ends;
+            for (size_t first = 0; first < count; first = group_ends.back()) {
+                group_ends.push_back(get_read_group_end(p_requests, first, count, UINT64_MAX, (IOV_MAX + 1) / 2));
+            }
+
+            if (group_ends.size() > 1) {
+                // Gaps too big to read through, let the kernel fetch all the reads at once before they are done in turn
+                size_t first = 0;
+                for (size_t last : group_ends) {
+                    if (last - first == 1) {
+                        posix_fadvise(m_fd, (off_t)p_requests[first].m_offset, (off_t)p_requests[first].m_size, POSIX_FADV_WILLNEED);
+                    }
+
+                    first = last;
+                }
+            }
+
+            std::unique_ptr<uint8_t[]> p_gap_buffer;
+            std::vector<struct iovec> iov;
+            size_t first = 0;
+            for (size_t last : group_ends) {
+                if (last - first == 1) {
+                    if (!c_ser_io_buffered::read_at(p_requests[first].m_offset, p_requests[first].mp_buffer, p_requests[first].m_size)) {
+                        return false;
+                    }
+
+                    first = last;
+                    continue;
+                }
+
+                iov.clear();
+                size_t read_size = 0;
+                uint64_t position = p_requests[first].m_offset;
+                for (size_t x = first; x < last; x++) {
+                    size_t gap = (size_t)(p_requests[x].m_offset - position);
+                    if (gap > 0) {
+                        if (p_gap_buffer == nullptr) {
+                            p_gap_buffer.reset(new uint8_t[C_MAX_COALESCE_GAP]);
+                        }
+
+                        iov.push_back({p_gap_buffer.get(), gap});
+                        read_size += gap;
+                    }
+
+                    iov.push_back({p_requests[x].mp_buffer, p_requests[x].m_size});
+                    read_size += p_requests[x].m_size;
+                    position = p_requests[x].m_offset + p_requests[x].m_size;
+                }
+
+                ssize_t bytes_read;
+                do {
+                    bytes_read = preadv(m_fd, iov.data(), (int)iov.size(), (off_t)p_requests[first].m_offset);
+                } while (bytes_read < 0 && errno == EINTR);
+
+                if (bytes_read != (ssize_t)read_size) {
+                    // Short read, do these reads one at a time
+                    for (size_t x = first; x < last; x++) {
+                        if (!c_ser_io_buffered::read_at(p_requests[x].m_offset, p_requests[x].mp_buffer, p_requests[x].m_size)) {
+                            return false;
+                        }
+                    }
+                }
+
+                first = last;
+            }
+
+            return true;
+#else
+            return c_ser_io_backend::read_many(p_requests, count);
+#endif
+        }
+
+    protected:
+        int m_fd;
+        FILE *mp_file;
+        std::mutex m_file_mutex;
+    };
+
+
+#ifdef SER_IO_FADVISE_SUPPORT
+    // ------------------------------------------
+    // Buffered reads with posix_fadvise() hints that follow the direction of the reads.
+    // The kernel is asked to read ahead in the direction of travel and to drop data
+    // that is well behind it, so long runs do not push everything else out of the page cache.
+    // ------------------------------------------
+    class c_ser_io_fadvise : public c_ser_io_buffered
+    {
+    public:
+        c_ser_io_fadvise() :
+            c_ser_io_buffered(IO_MODE_FADVISE),
+            m_direction(0),
+            m_last_offset(0),
+            m_hinted_position(0),
+            m_dropped_position(0)
+        {
+        }
+
+        bool read_at(
+            uint64_t offset,
+            uint8_t *p_buffer,
+            size_t size)
+        {
+            give_hints(offset, size);
+            return c_ser_io_buffered::read_at(offset, p_buffer, size);
+        }
+
+        bool read_many(
+            const s_read_request *p_requests,
+            size_t count)
+        {
+            if (count > 0) {
+                const s_read_request &last_request = p_requests[count - 1];
+                give_hints(p_requests[0].m_offset, last_request.m_offset + last_request.m_size - p_requests[0].m_offset);
+            }
+
+            return c_ser_io_buffered::read_many(p_requests, count);
+        }
+
+    private:
+        void give_hints(
+            uint64_t offset,
+            uint64_t size)
+        {
+            std::lock_guard<std::mutex> lock(m_hint_mutex);
+            int direction = (offset >= m_last_offset) ? 1 : -1;
+            m_last_offset = offset;
+            if (direction != m_direction) {
+                // Kernel readahead only works forwards, switch it off when reading backwards
+                m_direction = direction;
+                posix_fadvise(m_fd, 0, 0, (direction > 0) ? POSIX_FADV_SEQUENTIAL : POSIX_FADV_RANDOM);
+                m_hinted_position = (direction > 0) ? offset + size : offset;
+                m_dropped_position = m_hinted_position;
+            }
+
+            if (direction > 0) {
+                uint64_t end = offset + size;
+                if (end + C_FADVISE_READAHEAD / 2 > m_hinted_position) {
+                    uint64_t start = std::max(end, m_hinted_position);
+                    posix_fadvise(m_fd, (off_t)start, (off_t)(end + C_FADVISE_READAHEAD - start), POSIX_FADV_WILLNEED);
+                    m_hinted_position = end + C_FADVISE_READAHEAD;
+                }
+
+                if (offset > C_FADVISE_DROP_BEHIND && offset - C_FADVISE_DROP_BEHIND > m_dropped_position) {
+                    uint64_t drop_end = offset - C_FADVISE_DROP_BEHIND;
+                    posix_fadvise(m_fd, (off_t)m_dropped_position, (off_t)(drop_end - m_dropped_position), POSIX_FADV_DONTNEED);
+                    m_dropped_position = drop_end;
+                }
+            } else {
+                if (offset < m_hinted_position + C_FADVISE_READAHEAD / 2) {
+                    uint64_t start = (offset > C_FADVISE_READAHEAD) ? offset - C_FADVISE_READAHEAD : 0;
+                    uint64_t end = std::min(offset, m_hinted_position);
+                    if (end > start) {
+                        posix_fadvise(m_fd, (off_t)start, (off_t)(end - start), POSIX_FADV_WILLNEED);
+                    }
+
+                    m_hinted_position = start;
+                }
+
+                uint64_t drop_start = offset + size + C_FADVISE_DROP_BEHIND;
+                if (drop_start < m_dropped_position) {
+                    posix_fadvise(m_fd, (off_t)drop_start, (off_t)(m_dropped_position - drop_start), POSIX_FADV_DONTNEED);
+                    m_dropped_position = drop_start;
+                }
+            }
+        }
+
+        std::mutex m_hint_mutex;
+        int m_direction;
+        uint64_t m_last_offset;
+        uint64_t m_hinted_position;  // Readahead has been requested up to here in the direction of travel
+        uint64_t m_dropped_position;  // Data behind here has been dropped
+    };
+#endif
+
+
+#ifdef SER_IO_DIRECT_SUPPORT
+    // ------------------------------------------
+    // O_DIRECT reads that do not go through the page cache.
+    // Reads are widened to the alignment O_DIRECT needs and copied out of an aligned buffer,
+    // which is shared by all reads so they are done one at a time.
+    // ------------------------------------------
+    class c_ser_io_direct : public c_ser_io_buffered
+    {
+    public:
+        c_ser_io_direct() :
+            c_ser_io_buffered(IO_MODE_DIRECT),
+            m_direct_fd(-1),
+            mp_aligned_buffer(nullptr, free)
+        {
+        }
+
+        ~c_ser_io_direct()
+        {
+            if (m_direct_fd >= 0) {
+                ::close(m_direct_fd);
+            }
+        }
+
+        bool open(
+            const std::string &filename_utf8)
+        {
+            // The buffered handle is kept for reads that O_DIRECT rejects
+            if (!c_ser_io_buffered::open(filename_utf8)) {
+                return false;
+            }
+
+            m_direct_fd = ::open(filename_utf8.c_str(), O_RDONLY | O_DIRECT);
+            return m_direct_fd >= 0;
+        }
+
+        bool read_at(
+            uint64_t offset,
+            uint8_t *p_buffer,
+            size_t size)
+        {
+            s_read_request request = {offset, p_buffer, size};
+            return read_many(&request, 1);
+        }
+
+        bool read_many(
+            const s_read_request *p_requests,
+            size_t count)
+        {
+            std::lock_guard<std::mutex> lock(m_direct_mutex);
+            if (mp_aligned_buffer == nullptr) {
+                void *p_aligned = nullptr;
+                if (posix_memalign(&p_aligned, C_DIRECT_ALIGNMENT, C_DIRECT_CHUNK_SIZE) != 0) {
+                    return c_ser_io_buffered::read_many(p_requests, count);
+                }
+
+                mp_aligned_buffer.reset((uint8_t *)p_aligned);
+            }
+
+            size_t first = 0;
+            while (first < count) {
+                // Nearby reads are done as one aligned read, which usually fits in the buffer
+                size_t last = get_read_group_end(p_requests, first, count, C_DIRECT_CHUNK_SIZE - C_DIRECT_ALIGNMENT, SIZE_MAX);
+                uint64_t span_start = p_requests[first].m_offset;
+                uint64_t span_end = p_requests[last - 1].m_offset + p_requests[last - 1].m_size;
+                uint64_t aligned_start = span_start & ~(C_DIRECT_ALIGNMENT - 1);
+                uint64_t aligned_end = (span_end + C_DIRECT_ALIGNMENT - 1) & ~(C_DIRECT_ALIGNMENT - 1);
+
+                bool direct_read_ok = true;
+                for (uint64_t chunk_start = aligned_start; chunk_start < span_end; chunk_start += C_DIRECT_CHUNK_SIZE) {
+                    size_t chunk_size = (size_t)std::min(C_DIRECT_CHUNK_SIZE, aligned_end - chunk_start);
+                    size_t bytes_read = read_direct(chunk_start, mp_aligned_buffer.get(), chunk_size);
+                    uint64_t chunk_end = std::min(chunk_start + chunk_size, span_end);
+                    if (chunk_start + bytes_read < chunk_end) {
+                        direct_read_ok = false;
+                        break;
+                    }
+
+                    // Copy out the parts of the reads in this chunk
+                    for (size_t x = first; x < last; x++) {
+                        uint64_t copy_start = std::max(p_requests[x].m_offset, chunk_start);
+                        uint64_t copy_end = std::min(p_requests[x].m_offset + p_requests[x].m_size, chunk_end);
+                        if (copy_start < copy_end) {
+                            memcpy(p_requests[x].mp_buffer + (copy_start - p_requests[x].m_offset),
+                                   mp_aligned_buffer.get() + (copy_start - chunk_start),
+                                   (size_t)(copy_end - copy_start));
+                        }
+                    }
+                }
+
+                if (!direct_read_ok) {
+                    // O_DIRECT read failed, fall back to buffered reads
+                    for (size_t x = first; x < last; x++) {
+                        if (!c_ser_io_buffered::read_at(p_requests[x].m_offset, p_requests[x].mp_buffer, p_requests[x].m_size)) {
+                            return false;
+                        }
+                    }
+                }
+
+                first = last;
+            }
+
+            return true;
+        }
+
+    private:
+        // Returns the number of bytes read, which is short at the end of the file
+        size_t read_direct(
+            uint64_t offset,
+            uint8_t *p_buffer,
+            size_t size)
+        {
+            size_t total_read = 0;
+            while (total_read < size) {
+                ssize_t bytes_read = pread(m_direct_fd, p_buffer + total_read, size - total_read, (off_t)(offset + total_read));
+                if (bytes_read < 0 && errno == EINTR) {
+                    continue;
+                }
+
+                if (bytes_read <= 0) {
+                    break;
+                }
+
+                total_read += (size_t)bytes_read;
+                if ((total_read & (C_DIRECT_ALIGNMENT - 1)) != 0) {
+                    // Only the end of the file gives an unaligned read
+                    break;
+                }
+            }
+
+            return total_read;
+        }
+
+        int m_direct_fd;
+        std::mutex m_direct_mutex;
+        std::unique_ptr<uint8_t, void (*)(void *)> mp_aligned_buffer;
+    };
+#endif
+
+
+#ifdef PIPP_SER_IO_URING
+    // ------------------------------------------
+    // io_uring reads.  Reads are split into pieces so that several are in flight at once,
+    // which keeps deep queues on NVMe and network storage busy.
+    // ------------------------------------------
+    class c_ser_io_uring : public c_ser_io_buffered
+    {
+    public:
+        c_ser_io_uring() :
+            c_ser_io_buffered(IO_MODE_URING),
+            m_ring_valid(false)
+        {
+        }
+
+        ~c_ser_io_uring()
+        {
+            if (m_ring_valid) {
+                io_uring_queue_exit(&m_ring);
+            }
+        }
+
+        bool open(
+            const std::string &filename_utf8)
+        {
+            if (!c_ser_io_buffered::open(filename_utf8)) {
+                return false;
+            }
+
+            // Fails on kernels without io_uring or where it has been disabled
+            m_ring_valid = (io_uring_queue_init(C_URING_QUEUE_DEPTH, &m_ring, 0) == 0);
+            return m_ring_valid;
+        }
+
+        bool read_at(
+            uint64_t offset,
+            uint8_t *p_buffer,
+            size_t size)
+        {
+            s_read_request request = {offset, p_buffer, size};
+            return read_many(&request, 1);
+        }
+
+        bool read_many(
+            const s_read_request *p_requests,
+            size_t count)
+        {
+            std::vector<s_read_request> pieces;
+            for (size_t x = 0; x < count; x++) {
+                for (size_t done = 0; done < p_requests[x].m_size; done += C_URING_PIECE_SIZE) {
+                    s_read_request piece = {
+                        p_requests[x].m_offset + done,
+                        p_requests[x].mp_buffer + done,
+                        std::min(C_URING_PIECE_SIZE, p_requests[x].m_size - done)};
+                    pieces.push_back(piece);
+                }
+            }
+
+            // The ring is not thread safe
+            std::lock_guard<std::mutex> lock(m_ring_mutex);
+            if (!m_ring_valid) {
+                return c_ser_io_buffered::read_many(p_requests, count);
+            }
+
+            bool ret = true;
+            size_t next_piece = 0;
+            unsigned in_flight = 0;  // Submitted to the kernel and not yet completed
+            unsigned queued = 0;  // Prepared but not yet submitted
+            while (next_piece < pieces.size() || in_flight > 0 || queued > 0) {
+                // Keep the queue full
+                while (next_piece < pieces.size() && in_flight + queued < C_URING_QUEUE_DEPTH) {
+                    struct io_uring_sqe *p_sqe = io_uring_get_sqe(&m_ring);
+                    if (p_sqe == nullptr) {
+                        break;
+                    }
+
+                    const s_read_request &piece = pieces[next_piece];
+                    io_uring_prep_read(p_sqe, m_fd, piece.mp_buffer, (unsigned)piece.m_size, piece.m_offset);
+                    io_uring_sqe_set_data(p_sqe, (void *)(uintptr_t)next_piece);
+                    next_piece++;
+                    queued++;
+                }
+
+                int submit_ret = io_uring_submit(&m_ring);
+                if (submit_ret > 0) {
+                    in_flight += (unsigned)submit_ret;
+                    queued -= std::min(queued, (unsigned)submit_ret);
+                } else if (submit_ret < 0 && submit_ret != -EINTR &&
+                           !(in_flight > 0 && (submit_ret == -EAGAIN || submit_ret == -EBUSY))) {
+                    // Busy errors clear once completions are reaped, anything else means the ring is unusable
+                    abandon_ring(in_flight);
+                    return c_ser_io_buffered::read_many(p_requests, count);
+                }
+
+                if (in_flight == 0) {
+                    continue;
+                }
+
+                struct io_uring_cqe *p_cqe;
+                int wait_ret = io_uring_wait_cqe(&m_ring, &p_cqe);
+                if (wait_ret == -EINTR) {
+                    continue;
+                }
+
+                if (wait_ret < 0) {
+                    // Reads still in flight would write into the caller's buffers after they
+                    // have been freed, so wait for them before falling back to plain reads
+                    abandon_ring(in_flight);
+                    return c_ser_io_buffered::read_many(p_requests, count);
+                }
+
+                const s_read_request &piece = pieces[(size_t)(uintptr_t)io_uring_cqe_get_data(p_cqe)];
+                int result = p_cqe->res;
+                io_uring_cqe_seen(&m_ring, p_cqe);
+                in_flight--;
+
+                if (result <= 0) {
+                    ret = false;
+                } else if ((size_t)result < piece.m_size) {
+                    // Short read, finish this piece with a plain read
+                    ret &= pread_all(m_fd, piece.m_offset + result, piece.mp_buffer + result, piece.m_size - result);
+                }
+            }
+
+            return ret;
+        }
+
+    private:
+        // Stop using the ring once it has gone wrong
+        // Waits for every submitted read to complete, then closes the ring which also
+        // cancels and waits for anything that could not be waited for here.
+        void abandon_ring(
+            unsigned in_flight)
+        {
+            while (in_flight > 0) {
+                struct io_uring_cqe *p_cqe;
+                int wait_ret = io_uring_wait_cqe(&m_ring, &p_cqe);
+                if (wait_ret == -EINTR) {
+                    continue;
+                }
+
+                if (wait_ret < 0) {
+                    break;
+                }
+
+                io_uring_cqe_seen(&m_ring, p_cqe);
+                in_flight--;
+            }
+
+            io_uring_queue_exit(&m_ring);
+            m_ring_valid = false;
+        }
+
+        std::mutex m_ring_mutex;
+        struct io_uring m_ring;
+        bool m_ring_valid;
+    };
+#endif
+}
+
+
+// ------------------------------------------
+// Is a mode built in on this system
+// ------------------------------------------
+bool c_ser_io_backend::is_available(
+    e_io_mode io_mode)
+{
+    switch (io_mode) {
+    case IO_MODE_BUFFERED:
+        return true;
+#ifdef SER_IO_FADVISE_SUPPORT
+    case IO_MODE_FADVISE:
+        return true;
+#endif
+#ifdef SER_IO_DIRECT_SUPPORT
+    case IO_MODE_DIRECT:
+        return true;
+#endif
+#ifdef PIPP_SER_IO_URING
+    case IO_MODE_URING:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+
+// ------------------------------------------
+// Open a backend for a file
+// ------------------------------------------
+std::unique_ptr<c_ser_io_backend> c_ser_io_backend::create(
+    e_io_mode io_mode,
+    const std::string &filename_utf8)
+{
+    std::unique_ptr<c_ser_io_buffered> p_backend;
+    switch (io_mode) {
+#ifdef SER_IO_FADVISE_SUPPORT
+    case IO_MODE_FADVISE:
+        p_backend.reset(new c_ser_io_fadvise);
+        break;
+#endif
+#ifdef SER_IO_DIRECT_SUPPORT
+    case IO_MODE_DIRECT:
+        p_backend.reset(new c_ser_io_direct);
+        break;
+#endif
+#ifdef PIPP_SER_IO_URING
+    case IO_MODE_URING:
+        p_backend.reset(new c_ser_io_uring);
+        break;
+#endif
+    default:
+        break;
+    }
+
+    if (p_backend != nullptr && !p_backend->open(filename_utf8)) {
+        // This mode is not available for this file or system
+        p_backend.reset();
+    }
+
+    if (p_backend == nullptr) {
+        // Fall back to buffered reads
+        p_backend.reset(new c_ser_io_buffered);
+        if (!p_backend->open(filename_utf8)) {
+            return std::unique_ptr<c_ser_io_backend>();
+        }
+    }
+
+    return std::unique_ptr<c_ser_io_backend>(p_backend.release());
+}
+
+
+// ------------------------------------------
+// Read a list of blocks one at a time
+// ------------------------------------------
+bool c_ser_io_backend::read_many(
+    const s_read_request *p_requests,
+    size_t count)
+{
+    for (size_t x = 0; x < count; x++) {
+        if (!read_at(p_requests[x].m_offset, p_requests[x].mp_buffer, p_requests[x].m_size)) {
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,97 @@
+// ---------------------------------------------------------------------
+// Copyright (C) 2015 Chris Garry
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>
+// ---------------------------------------------------------------------
+
+
+
+#ifndef SER_IO_BACKEND_H
+#define SER_IO_BACKEND_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+
+// ------------------------------------------
+// Reads frame data from a SER file for c_pipp_ser.
+// Each backend opens its own handle to the file and all reads are positional, so
+// read_at() and read_many() can be called from several threads at once.
+// ------------------------------------------
+class c_ser_io_backend
+{
+public:
+    enum e_io_mode {
+        IO_MODE_BUFFERED = 0,  // Plain reads through the page cache
+        IO_MODE_FADVISE,       // Page cache reads with readahead and drop-behind hints that follow the read direction
+        IO_MODE_DIRECT,        // O_DIRECT reads that bypass the page cache, for one-pass exports
+        IO_MODE_URING,         // io_uring with several reads in flight
+        IO_MODE_COUNT
+    };
+
+    // A single read for read_many()
+    struct s_read_request {
+        uint64_t m_offset;
+        uint8_t *mp_buffer;
+        size_t m_size;
+    };
+
+    // ------------------------------------------
+    // Open a backend for a file
+    // Falls back to the buffered backend if the requested mode is not available,
+    // returns nullptr if the file cannot be opened at all
+    // ------------------------------------------
+    static std::unique_ptr<c_ser_io_backend> create(
+        e_io_mode io_mode,
+        const std::string &filename_utf8);
+
+    // ------------------------------------------
+    // Is a mode built in on this system, create() may still fall back if a file does not support it
+    // ------------------------------------------
+    static bool is_available(
+        e_io_mode io_mode);
+
+    virtual ~c_ser_io_backend() {}
+
+    // The mode actually in use, after any fallback
+    e_io_mode get_io_mode() const
+    {
+        return m_io_mode;
+    }
+
+    // Read size bytes from offset, returns false on a read error or short read
+    virtual bool read_at(
+        uint64_t offset,
+        uint8_t *p_buffer,
+        size_t size) = 0;
+
+    // Read a list of blocks sorted by ascending offset, returns false if any read fails
+    virtual bool read_many(
+        const s_read_request *p_requests,
+        size_t count);
+
+
+protected:
+    c_ser_io_backend(e_io_mode io_mode) :
+        m_io_mode(io_mode)
+    {
+    }
+
+    e_io_mode m_io_mode;
+};
+
+
+#endif  // SER_IO_BACKEND_H
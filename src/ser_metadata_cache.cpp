@@ -0,0 +1,307 @@
+// ---------------------------------------------------------------------
+// Copyright (C) 2015 Chris Garry
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>
+// ---------------------------------------------------------------------
+
+
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+
+#if QT_VERSION >= 0x050000
+#include <QStandardPaths>
+#else
+#include <QDesktopServices>
+#endif
+
+#include "ser_metadata_cache.h"
+
+
+namespace {
+    const quint32 C_CACHE_MAGIC = 0x53455243;  // "SERC"
+    const quint32 C_CACHE_VERSION = 3;  // Version 2 had no per-frame statistics
+
+    // Statistics of a frame that has not been decoded yet
+    const c_ser_metadata_cache::s_frame_stats C_UNKNOWN_FRAME_STATS = {0xffff, 0, 0.0f};
+
+
+    template <typename T>
+    c_ser_metadata_cache::s_frame_stats get_stats(
+            const T *p_data,
+            int64_t sample_count)
+    {
+        T min_value = p_data[0];
+        T max_value = p_data[0];
+        uint64_t total = 0;
+        for (int64_t x = 0; x < sample_count; x++) {
+            T value = p_data[x];
+            min_value = (value < min_value) ? value : min_value;
+            max_value = (value > max_value) ? value : max_value;
+            total += value;
+        }
+
+        c_ser_metadata_cache::s_frame_stats stats;
+        stats.m_min = min_value;
+        stats.m_max = max_value;
+        stats.m_mean = (float)((double)total / sample_count);
+        return stats;
+    }
+}
+
+
+c_ser_metadata_cache::c_ser_metadata_cache()
+    : m_file_size(0),
+      m_file_modified(0),
+      m_metadata_valid(false),
+      m_metadata(),
+      m_frame_count(0),
+      m_frame_stats_changed(false)
+{
+}
+
+
+c_ser_metadata_cache::~c_ser_metadata_cache()
+{
+    close();
+}
+
+
+bool c_ser_metadata_cache::open(const QString &filename, c_pipp_ser::s_metadata &metadata)
+{
+    QMutexLocker locker(&m_mutex);
+    close_locked();
+
+    QFileInfo file_info(filename);
+    m_filename = file_info.absoluteFilePath();
+    m_file_size = file_info.size();
+    m_file_modified = file_info.lastModified().toMSecsSinceEpoch();
+
+    m_metadata_valid = read_cache_file();
+    if (m_metadata_valid) {
+        metadata = m_metadata;
+    }
+
+    return m_metadata_valid;
+}
+
+
+void c_ser_metadata_cache::set_metadata(const c_pipp_ser::s_metadata &metadata, int32_t frame_count)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_filename.isEmpty()) {
+        return;
+    }
+
+    bool write_needed = !m_metadata_valid || frame_count != m_frame_count;
+    if (frame_count != m_frame_count || m_frame_stats.isEmpty()) {
+        // Statistics for a different frame count are no use
+        m_frame_stats.fill(C_UNKNOWN_FRAME_STATS, frame_count);
+        m_frame_stats_changed = false;
+    }
+
+    m_metadata = metadata;
+    m_frame_count = frame_count;
+    m_metadata_valid = true;
+    if (write_needed) {
+        write_cache_file();
+    }
+}
+
+
+void c_ser_metadata_cache::close()
+{
+    QMutexLocker locker(&m_mutex);
+    close_locked();
+}
+
+
+bool c_ser_metadata_cache::frame_stats_needed(int32_t frame_number)
+{
+    QMutexLocker locker(&m_mutex);
+    if (frame_number < 1 || frame_number > m_frame_stats.size()) {
+        return false;
+    }
+
+    const s_frame_stats &stats = m_frame_stats[frame_number - 1];
+    return stats.m_min > stats.m_max;
+}
+
+
+void c_ser_metadata_cache::set_frame_stats(int32_t frame_number, const s_frame_stats &stats)
+{
+    QMutexLocker locker(&m_mutex);
+    if (frame_number < 1 || frame_number > m_frame_stats.size()) {
+        return;
+    }
+
+    m_frame_stats[frame_number - 1] = stats;
+    m_frame_stats_changed = true;
+}
+
+
+bool c_ser_metadata_cache::get_frame_stats(int32_t frame_number, s_frame_stats &stats)
+{
+    QMutexLocker locker(&m_mutex);
+    if (frame_number < 1 || frame_number > m_frame_stats.size()) {
+        return false;
+    }
+
+    stats = m_frame_stats[frame_number - 1];
+    return stats.m_min <= stats.m_max;
+}
+
+
+c_ser_metadata_cache::s_frame_stats c_ser_metadata_cache::calculate_frame_stats(
+    const uint8_t *p_frame_data,
+    int64_t sample_count,
+    int32_t byte_depth)
+{
+    if (byte_depth == 1) {
+        return get_stats(p_frame_data, sample_count);
+    } else {
+        return get_stats((const uint16_t *)p_frame_data, sample_count);
+    }
+}
+
+
+//
+// Private functions below here
+//
+
+void c_ser_metadata_cache::close_locked()
+{
+    if (m_frame_stats_changed && m_metadata_valid) {
+        // Keep the statistics of the frames that were decoded for next time
+        write_cache_file();
+    }
+
+    m_filename.clear();
+    m_metadata_valid = false;
+    m_frame_count = 0;
+    m_frame_stats.clear();
+    m_frame_stats_changed = false;
+}
+
+
+bool c_ser_metadata_cache::read_cache_file()
+{
+    QFile file(get_cache_filename());
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+    quint32 magic, version;
+    stream >> magic >> version;
+    if (magic != C_CACHE_MAGIC || version != C_CACHE_VERSION) {
+        return false;
+    }
+
+    // Check the entry is for this version of the SER file
+    QString filename;
+    qint64 file_size, file_modified;
+    stream >> filename >> file_size >> file_modified;
+    if (filename != m_filename || file_size != m_file_size || file_modified != m_file_modified) {
+        return false;
+    }
+
+    qint32 pixel_depth, fps_rate, fps_scale, frame_count, stats_count;
+    qint64 timestamp_correction_value;
+    quint64 min_timestamp, max_timestamp;
+    bool timestamps_in_order;
+    stream >> pixel_depth >> fps_rate >> fps_scale >> timestamp_correction_value;
+    stream >> min_timestamp >> max_timestamp >> timestamps_in_order;
+    stream >> frame_count >> stats_count;
+    if (stream.status() != QDataStream::Ok || (stats_count != 0 && stats_count != frame_count)) {
+        return false;
+    }
+
+    QVector<s_frame_stats> frame_stats(stats_count);
+    for (int x = 0; x < stats_count; x++) {
+        quint16 min_value, max_value;
+        float mean_value;
+        stream >> min_value >> max_value >> mean_value;
+        frame_stats[x].m_min = min_value;
+        frame_stats[x].m_max = max_value;
+        frame_stats[x].m_mean = mean_value;
+    }
+
+    if (stream.status() != QDataStream::Ok) {
+        return false;
+    }
+
+    m_metadata.pixel_depth = pixel_depth;
+    m_metadata.fps_rate = fps_rate;
+    m_metadata.fps_scale = fps_scale;
+    m_metadata.timestamp_correction_value = timestamp_correction_value;
+    m_metadata.min_timestamp = min_timestamp;
+    m_metadata.max_timestamp = max_timestamp;
+    m_metadata.timestamps_in_order = timestamps_in_order;
+    m_frame_count = frame_count;
+    m_frame_stats = frame_stats;
+    return true;
+}
+
+
+void c_ser_metadata_cache::write_cache_file()
+{
+    QString cache_filename = get_cache_filename();
+    QDir().mkpath(QFileInfo(cache_filename).absolutePath());
+
+    // Write to a temporary file first so a partly written entry is never read
+    QString temp_filename = cache_filename + ".tmp";
+    QFile file(temp_filename);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return;
+    }
+
+    QDataStream stream(&file);
+    stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+    stream << C_CACHE_MAGIC << C_CACHE_VERSION;
+    stream << m_filename << m_file_size << m_file_modified;
+    stream << (qint32)m_metadata.pixel_depth << (qint32)m_metadata.fps_rate << (qint32)m_metadata.fps_scale;
+    stream << (qint64)m_metadata.timestamp_correction_value;
+    stream << (quint64)m_metadata.min_timestamp << (quint64)m_metadata.max_timestamp << m_metadata.timestamps_in_order;
+    stream << (qint32)m_frame_count << (qint32)m_frame_stats.size();
+    for (int x = 0; x < m_frame_stats.size(); x++) {
+        stream << (quint16)m_frame_stats[x].m_min << (quint16)m_frame_stats[x].m_max << m_frame_stats[x].m_mean;
+    }
+
+    file.close();
+    m_frame_stats_changed = false;
+
+    QFile::remove(cache_filename);
+    QFile::rename(temp_filename, cache_filename);
+}
+
+
+QString c_ser_metadata_cache::get_cache_filename()
+{
+#if QT_VERSION >= 0x050000
+    QString cache_directory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+#else
+    QString cache_directory = QDesktopServices::storageLocation(QDesktopServices::CacheLocation);
+#endif
+
+    QString key = QCryptographicHash::hash(m_filename.toUtf8(), QCryptographicHash::Sha1).toHex();
+    return cache_directory + "/ser_metadata/" + key + ".cache";
+}
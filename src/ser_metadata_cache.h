@@ -0,0 +1,97 @@
+// ---------------------------------------------------------------------
+// Copyright (C) 2015 Chris Garry
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>
+// ---------------------------------------------------------------------
+
+
+
+#ifndef SER_METADATA_CACHE_H
+#define SER_METADATA_CACHE_H
+
+#include <QMutex>
+#include <QString>
+#include <QVector>
+#include <cstdint>
+#include "pipp_ser.h"
+
+
+// ------------------------------------------
+// Small on-disk cache of the details that are slow to work out when a SER file is opened.
+// Entries are kept in the user's cache directory and are keyed on the SER file's path,
+// size and modification time, so an entry is ignored as soon as the file changes.
+// Per-frame statistics are added as frames are decoded for playback or saving, the file is
+// never read just to work them out.  All functions can be called from any thread.
+// ------------------------------------------
+class c_ser_metadata_cache
+{
+public:
+    // Statistics for a single frame, taken over all pixels and colour channels of the
+    // frame data as c_pipp_ser returns it
+    struct s_frame_stats {
+        uint16_t m_min;
+        uint16_t m_max;
+        float m_mean;
+    };
+
+    // Constructor
+    c_ser_metadata_cache();
+
+    // Destructor
+    ~c_ser_metadata_cache();
+
+    // Look up the cache entry for a SER file, returns false if there is no valid entry
+    bool open(const QString &filename, c_pipp_ser::s_metadata &metadata);
+
+    // Update the cache entry with the metadata from opening the SER file
+    void set_metadata(const c_pipp_ser::s_metadata &metadata, int32_t frame_count);
+
+    // Write out any new frame statistics and forget the current SER file
+    void close();
+
+    // Are the statistics of a frame (1 to frame count) still to be worked out
+    bool frame_stats_needed(int32_t frame_number);
+
+    // Store the statistics of a frame (1 to frame count) that has been decoded
+    void set_frame_stats(int32_t frame_number, const s_frame_stats &stats);
+
+    // Get the statistics of a frame (1 to frame count), returns false if the frame has not been decoded yet
+    bool get_frame_stats(int32_t frame_number, s_frame_stats &stats);
+
+    // Work out the statistics of a whole frame
+    static s_frame_stats calculate_frame_stats(
+        const uint8_t *p_frame_data,
+        int64_t sample_count,
+        int32_t byte_depth);
+
+
+private:
+    // m_mutex must be held when calling these
+    void close_locked();
+    bool read_cache_file();
+    void write_cache_file();
+    QString get_cache_filename();
+
+    QMutex m_mutex;
+    QString m_filename;
+    qint64 m_file_size;
+    qint64 m_file_modified;
+    bool m_metadata_valid;
+    c_pipp_ser::s_metadata m_metadata;
+    int32_t m_frame_count;
+    QVector<s_frame_stats> m_frame_stats;  // Either empty or holds all frames, m_min > m_max if not known yet
+    bool m_frame_stats_changed;  // New statistics that are not in the cache file yet
+};
+
+#endif // SER_METADATA_CACHE_H
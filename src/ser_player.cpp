@@ -42,7 +42,10 @@
 #include <QUrl>
 #include <QWidgetAction>
 
+#include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <vector>
 
 #include "playback_controls_dialog.h"
 #include "playback_controls_widget.h"
@@ -50,6 +53,11 @@
 #include "tiff_write.h"
 #include "png_write.h"
 #include "histogram_thread.h"
+#include "frame_prefetcher.h"
+#include "frame_cache.h"
+#include "render_worker.h"
+#include "ser_metadata_cache.h"
+#include "save_frames_pipeline.h"
 #include "histogram_dialog.h"
 #include "image.h"
 #include "ser_player.h"
@@ -81,6 +89,9 @@ const QString c_ser_player::C_DEBIAN_XML_TEXT2 = tr("An easy way to view your SE
 const QString c_ser_player::C_DEBIAN_XML_TEXT3 = tr("SER Player at startup.",
                                                     "Description of an image of SER Player after it has just started up");
 
+const uint64_t c_ser_player::C_RAW_COPY_RUN_SIZE = 256 * 1024 * 1024;
+const int c_ser_player::C_FOLLOW_STALLED_TIME = 10000;
+
 
 c_ser_player::c_ser_player(QWidget *parent)
     : QMainWindow(parent),
@@ -97,6 +108,13 @@ c_ser_player::c_ser_player(QWidget *parent)
     m_has_bayer_pattern = false;
     mp_histogram_thread = new c_histogram_thread;
     connect(mp_histogram_thread, SIGNAL(histogram_done()), this, SLOT(histogram_done_slot()));
+    mp_frame_prefetcher = new c_frame_prefetcher;
+    mp_metadata_cache = new c_ser_metadata_cache;
+    mp_frame_cache = new c_frame_cache;
+    mp_frame_cache->set_budget((int64_t)c_persistent_data::m_frame_cache_size_mb * 1024 * 1024);
+    mp_render_worker = new c_render_worker(STAGE_COUNT);
+    connect(mp_render_worker, SIGNAL(render_done(QImage,int)), this, SLOT(render_done_slot(QImage,int)));
+    m_frame_timestamp = 0;
 
     // Menu Items
     m_ser_directory = "";
@@ -109,6 +127,24 @@ c_ser_player::c_ser_player(QWidget *parent)
     m_crop_y_pos = 0;
     m_crop_width = 10;
     m_crop_height = 10;
+    m_red_align_x = 0;
+    m_red_align_y = 0;
+    m_blue_align_x = 0;
+    m_blue_align_y = 0;
+
+    for (int stage = 0; stage < STAGE_COUNT; stage++) {
+        mp_stage_images[stage] = new c_image;
+        m_stage_image_index[stage] = -1;
+    }
+
+    m_valid_stages = 0;
+    m_stage_frame_number = 0;
+    m_stage_timestamp = 0;
+    m_render_first_stage = 0;
+    m_render_frame_number = 0;
+    m_render_timestamp = 0;
+    mp_histogram_image = new c_image;
+    m_histogram_pending = false;
 
     //
     // File menu
@@ -164,6 +200,46 @@ c_ser_player::c_ser_player(QWidget *parent)
     mp_detach_playback_controls_Act->setCheckable(true);
     connect(mp_detach_playback_controls_Act, SIGNAL(triggered(bool)), this, SLOT(detach_playback_controls_slot(bool)));
 
+    mp_follow_ser_file_Act = playback_menu->addAction(tr("Follow SER Files Being Recorded", "Playback menu"));
+    mp_follow_ser_file_Act->setCheckable(true);
+    mp_follow_ser_file_Act->setChecked(c_persistent_data::m_follow_ser_files);
+    connect(mp_follow_ser_file_Act, SIGNAL(triggered(bool)), this, SLOT(follow_ser_file_slot(bool)));
+
+    // How frame data is read from SER files, set separately for saving frames as each frame is only read once
+    const QString io_mode_names[c_ser_io_backend::IO_MODE_COUNT] = {
+        tr("Buffered", "Read mode menu"),
+        tr("Buffered With Readahead Hints", "Read mode menu"),
+        tr("Direct (Bypass Cache)", "Read mode menu"),
+        tr("io_uring", "Read mode menu")};
+    QMenu *read_mode_Menu = playback_menu->addMenu(tr("SER File Read Mode", "Playback menu"));
+    QMenu *export_read_mode_Menu = playback_menu->addMenu(tr("SER File Read Mode When Saving", "Playback menu"));
+    QActionGroup *read_mode_ActGroup = new QActionGroup(read_mode_Menu);
+    read_mode_ActGroup->setExclusive(true);
+    QActionGroup *export_read_mode_ActGroup = new QActionGroup(export_read_mode_Menu);
+    export_read_mode_ActGroup->setExclusive(true);
+    for (int io_mode = 0; io_mode < c_ser_io_backend::IO_MODE_COUNT; io_mode++) {
+        if (!c_ser_io_backend::is_available((c_ser_io_backend::e_io_mode)io_mode)) {
+            continue;
+        }
+
+        QAction *read_mode_action = new QAction(io_mode_names[io_mode], this);
+        read_mode_action->setCheckable(true);
+        read_mode_action->setChecked(io_mode == c_persistent_data::m_ser_read_mode);
+        read_mode_action->setData(io_mode);
+        read_mode_Menu->addAction(read_mode_action);
+        read_mode_ActGroup->addAction(read_mode_action);
+
+        QAction *export_read_mode_action = new QAction(io_mode_names[io_mode], this);
+        export_read_mode_action->setCheckable(true);
+        export_read_mode_action->setChecked(io_mode == c_persistent_data::m_ser_export_read_mode);
+        export_read_mode_action->setData(io_mode);
+        export_read_mode_Menu->addAction(export_read_mode_action);
+        export_read_mode_ActGroup->addAction(export_read_mode_action);
+    }
+
+    connect(read_mode_ActGroup, SIGNAL(triggered(QAction *)), this, SLOT(ser_read_mode_changed_slot(QAction *)));
+    connect(export_read_mode_ActGroup, SIGNAL(triggered(QAction *)), this, SLOT(ser_export_read_mode_changed_slot(QAction *)));
+
     playback_menu->addSeparator();
 
     const int zoom_levels[] = {25, 50, 75, 100, 125, 150, 200, 250, 300};
@@ -441,10 +517,21 @@ c_ser_player::c_ser_player(QWidget *parent)
     setWindowTitle(C_WINDOW_TITLE_QSTRING);
 
     mp_ser_file = new c_pipp_ser;
+    mp_ser_file->set_memory_mapped_mode(true);  // Read frames straight from the mapped file where possible
+    mp_ser_file->set_io_mode((c_ser_io_backend::e_io_mode)c_persistent_data::m_ser_read_mode);
+    mp_ser_file->set_follow_mode(c_persistent_data::m_follow_ser_files);
+    mp_frame_prefetcher->set_follow_mode(c_persistent_data::m_follow_ser_files);
 
     mp_frame_Timer = new QTimer(this);
     connect(mp_frame_Timer, SIGNAL(timeout()), this, SLOT(frame_timer_timeout_slot()));
 
+    // Checks followed SER files for new frames
+    mp_follow_Timer = new QTimer(this);
+    mp_follow_Timer->setInterval(250);
+    connect(mp_follow_Timer, SIGNAL(timeout()), this, SLOT(follow_timer_timeout_slot()));
+    m_follow_file_size = 0;
+    m_follow_stalled_time = 0;
+
 //    mp_resize_Timer = new QTimer(this);
 //    mp_resize_Timer->setSingleShot(true);
 
@@ -482,6 +569,15 @@ c_ser_player::c_ser_player(QWidget *parent)
 
 c_ser_player::~c_ser_player()
 {
+    delete mp_frame_prefetcher;  // Waits for any prefetching to finish
+    delete mp_metadata_cache;
+    delete mp_frame_cache;
+    delete mp_render_worker;  // Waits for any render to finish
+    for (int stage = 0; stage < STAGE_COUNT; stage++) {
+        delete mp_stage_images[stage];
+    }
+
+    delete mp_histogram_image;
 }
 
 
@@ -635,6 +731,195 @@ void c_ser_player::playback_controls_double_clicked_slot()
 }
 
 
+void c_ser_player::follow_ser_file_slot(bool follow)
+{
+    // Takes effect when the next SER file is opened
+    c_persistent_data::m_follow_ser_files = follow;
+    mp_ser_file->set_follow_mode(follow);
+    mp_frame_prefetcher->set_follow_mode(follow);
+}
+
+
+void c_ser_player::ser_read_mode_changed_slot(QAction *action)
+{
+    if (action != nullptr) {
+        // Takes effect straight away for the open file
+        c_persistent_data::m_ser_read_mode = action->data().toInt();
+        mp_ser_file->set_io_mode((c_ser_io_backend::e_io_mode)c_persistent_data::m_ser_read_mode);
+    }
+}
+
+
+void c_ser_player::ser_export_read_mode_changed_slot(QAction *action)
+{
+    if (action != nullptr) {
+        // Used the next time frames are saved
+        c_persistent_data::m_ser_export_read_mode = action->data().toInt();
+    }
+}
+
+
+void c_ser_player::follow_timer_timeout_slot()
+{
+    int frame_count = mp_ser_file->update_frame_count();
+    if (!mp_ser_file->is_following()) {
+        // Recording has finished
+        mp_follow_Timer->stop();
+        reopen_finished_ser_file();
+        return;
+    }
+
+    if (mp_ser_file->get_file_size() != m_follow_file_size) {
+        m_follow_file_size = mp_ser_file->get_file_size();
+        m_follow_stalled_time = 0;
+    } else {
+        m_follow_stalled_time += mp_follow_Timer->interval();
+        if (m_follow_stalled_time >= C_FOLLOW_STALLED_TIME) {
+            // The capture software has stopped writing without finishing the file
+            mp_follow_Timer->stop();
+            offer_to_fix_stalled_ser_file();
+            return;
+        }
+    }
+
+    if (frame_count == m_total_frames) {
+        // No new frames
+        return;
+    }
+
+    if (!mp_frame_prefetcher->update_frame_count(frame_count)) {
+        // Prefetcher is busy, try again next time
+        return;
+    }
+
+    if (frame_count < m_total_frames) {
+        // Frames past the new end are no longer valid
+        mp_render_worker->cancel();
+        mp_frame_cache->clear();
+        m_valid_stages = 0;
+    }
+
+    m_total_frames = frame_count;
+    c_save_frames_dialog *save_frames_dialogs[] = {mp_save_frames_as_ser_Dialog,
+                                                   mp_save_frames_as_avi_Dialog,
+                                                   mp_save_frames_as_gif_Dialog,
+                                                   mp_save_frames_as_images_Dialog};
+    for (c_save_frames_dialog *p_dialog : save_frames_dialogs) {
+        if (p_dialog != nullptr) {
+            p_dialog->set_total_frames(m_total_frames);
+        }
+    }
+
+    mp_playback_controls_widget->follow_maximum_frame(m_total_frames);
+}
+
+
+// A followed SER file has stopped growing without its frame count being written, which is
+// usually the result of the capture software crashing.  Offer to fix it as open_ser_file() does.
+void c_ser_player::offer_to_fix_stalled_ser_file()
+{
+    const QString filename = QString::fromStdString(mp_ser_file->get_filename());
+    QString error_message = tr("Error: File '%1' has stopped growing before recording finished.  SER Player may be able to fix this file.", "SER File error message")
+                            .arg(filename);
+    error_message += "\n\n";
+    error_message += tr("Fix this SER file?");
+
+    QMessageBox::StandardButton fix_ser_file;
+    fix_ser_file = QMessageBox::question(nullptr,
+                                         tr("Invalid SER File", "Message box title for invalid SER file"),
+                                         error_message,
+                                         QMessageBox::Yes|QMessageBox::No);
+    if (fix_ser_file != QMessageBox::Yes) {
+        // Carry on showing the frames that were written
+        return;
+    }
+
+    // Nothing may read the file while it is being fixed
+    mp_playback_controls_widget->stop_playback();
+    mp_render_worker->cancel();
+    mp_frame_prefetcher->close();
+    mp_ser_file->close();
+    mp_ser_file->fix_broken_ser_file(filename.toUtf8().constData());
+
+    // The fixed file has a frame count so it is opened like any finished file
+    open_ser_file(filename);
+    if (m_ser_file_loaded) {
+        QMessageBox::information(nullptr,
+                                 tr("Invalid SER File", "Message box title for invalid SER file"),
+                                 tr("The SER file has successfully been fixed"));
+    }
+}
+
+
+// Open a followed SER file again once recording has finished so that its timestamps and
+// metadata are read like any other file, without disturbing playback or the processing options
+void c_ser_player::reopen_finished_ser_file()
+{
+    const QString filename = QString::fromStdString(mp_ser_file->get_filename());
+    mp_render_worker->cancel();
+    mp_frame_prefetcher->close();
+    mp_frame_cache->clear();
+    m_valid_stages = 0;
+
+    c_pipp_ser::s_metadata cached_metadata;
+    if (mp_metadata_cache->open(filename, cached_metadata)) {
+        mp_ser_file->set_cached_metadata(cached_metadata);
+    }
+
+    m_total_frames = mp_ser_file->open(filename.toUtf8().constData(), 0, 0);
+    if (m_total_frames <= 0) {
+        // The file has changed under us, open it from scratch to report the problem
+        open_ser_file(filename);
+        return;
+    }
+
+    mp_metadata_cache->set_metadata(mp_ser_file->get_metadata(), m_total_frames);
+    mp_frame_prefetcher->open(filename.toUtf8().constData(), mp_ser_file->get_metadata());
+    mp_frame_cache->reset(mp_ser_file->get_buffer_size());  // Byte depth can change with the pixel depth
+
+    c_save_frames_dialog *save_frames_dialogs[] = {mp_save_frames_as_ser_Dialog,
+                                                   mp_save_frames_as_avi_Dialog,
+                                                   mp_save_frames_as_gif_Dialog,
+                                                   mp_save_frames_as_images_Dialog};
+    for (c_save_frames_dialog *p_dialog : save_frames_dialogs) {
+        if (p_dialog != nullptr) {
+            p_dialog->set_total_frames(m_total_frames);
+        }
+    }
+
+    mp_playback_controls_widget->follow_maximum_frame(m_total_frames);
+    mp_playback_controls_widget->update_pixel_depth_label(mp_ser_file->get_pixel_depth());
+    update_header_details(filename);
+    calculate_display_framerate();
+
+    // Redraw the current frame with its timestamp
+    frame_slider_changed_slot();
+}
+
+
+// Set the header details dialog from the open SER file
+void c_ser_player::update_header_details(const QString &filename)
+{
+    mp_header_details_dialog->set_details(
+            filename,
+            QFileInfo(filename).size(),  // int filesize,
+            QString::fromStdString(mp_ser_file->get_file_id()), // QString file_id,
+            mp_ser_file->get_lu_id(),  // int lu_id,
+            mp_ser_file->get_colour_id(),  // int colour_id,
+            mp_ser_file->get_little_endian(),  // int little_endian,
+            mp_ser_file->get_width(),  // int image_width,
+            mp_ser_file->get_height(),  // int image_height,
+            mp_ser_file->get_pixel_depth(),  // int pixel_depth,
+            m_total_frames,  // int frame_count,
+            QString::fromStdString(mp_ser_file->get_observer_string()),  // QString observer,
+            QString::fromStdString(mp_ser_file->get_instrument_string()),  // QString instrument,
+            QString::fromStdString(mp_ser_file->get_telescope_string()),  // QString telescope,
+            mp_ser_file->get_data_time(),  // uint64_t date_time,
+            mp_ser_file->get_data_time_utc(),  // uint64_t date_time_utc)
+            QString::fromStdString(mp_ser_file->get_timestamp_info()));  // QString timestamp_info
+}
+
+
 void c_ser_player::detach_playback_controls_slot(bool detach)
 {
     c_persistent_data::m_disconnect_playback_controls = detach;
@@ -751,7 +1036,7 @@ void c_ser_player::monochrome_conversion_changed_slot(bool enabled, int selectio
 {
     m_monochrome_conversion_enable = enabled;
     m_monochrome_conversion_type = selection;
-    frame_slider_changed_slot();
+    update_frame_for_processing_change();
 }
 
 
@@ -865,64 +1150,131 @@ void c_ser_player::save_frames_as_ser_slot()
             save_progress_dialog.show();
 
             int saved_frames = 0;
+            int32_t saved_colour_id = mp_frame_image->get_colour_id();
             bool file_create_error = false;
             bool file_write_error = false;
 
-            // Direction loop
-            int start_dir = (sequence_direction == 1) ? 1 : 0;
-            int end_dir = (sequence_direction == 0) ? 0 : 1;
-            bool loop_break = false;
-            for (int current_dir = start_dir; current_dir <= end_dir && !loop_break; current_dir++) {
-                int start_frame = min_frame;
-                int end_frame = max_frame;
-                if (current_dir == 1) {  // Reverse direction - count backwards
-                    // Use negative numbers so for loop works counting up or down
-                    start_frame = -max_frame;
-                    end_frame = -min_frame;
+            QVector<int> frame_numbers = c_save_frames_pipeline::get_frame_numbers(min_frame, max_frame, decimate_value, sequence_direction);
+
+            // Unprocessed frames that are not resized are written exactly as they are in the
+            // source file, so they are copied across without being decoded
+            bool raw_copy = !do_frame_processing &&
+                            frame_active_width == mp_ser_file->get_width() &&
+                            frame_active_height == mp_ser_file->get_height() &&
+                            frame_total_width == frame_active_width &&
+                            frame_total_height == frame_active_height &&
+                            mp_ser_file->get_frame_size() == (uint64_t)mp_ser_file->get_buffer_size();  // Not reduced to 8-bit
+
+            if (raw_copy) {
+                file_create_error |= ser_write_file.create(filename, //  QString filename
+                                                           mp_ser_file->get_width(),  // int32_t  width
+                                                           mp_ser_file->get_height(), // int32_t  height
+                                                           mp_ser_file->get_colour() != 0,  // bool     colour
+                                                           mp_ser_file->get_byte_depth());  // int32_t  byte_depth
+
+                if (!file_create_error) {
+                    file_create_error |= ser_write_file.open_raw_source(
+                        mp_ser_file->get_filename(),
+                        mp_ser_file->get_colour_id(),
+                        mp_ser_file->get_little_endian(),
+                        mp_ser_file->get_pixel_depth());
+                }
+
+                if (!file_create_error) {
+                    ser_write_file.set_expected_frame_count(frames_to_be_saved);
                 }
 
-                for (int frame_number = start_frame; frame_number <= end_frame && !loop_break; frame_number += decimate_value) {
+                saved_colour_id = mp_ser_file->get_colour_id();
+
+                // Runs of consecutive frames are copied in one go, split up so the progress bar still moves
+                const int max_run_frames = (int)std::max((uint64_t)1, C_RAW_COPY_RUN_SIZE / mp_ser_file->get_frame_size());
+                std::vector<uint64_t> timestamps;
+                int run_start = 0;
+                while (run_start < frame_numbers.size() &&
+                       !(save_progress_dialog.was_cancelled() || file_write_error || file_create_error)) {
+                    int run_frames = 1;
+                    while (run_start + run_frames < frame_numbers.size() &&
+                           run_frames < max_run_frames &&
+                           frame_numbers[run_start + run_frames] == frame_numbers[run_start] + run_frames) {
+                        run_frames++;
+                    }
+
+                    timestamps.assign(run_frames, 0);
+                    if (include_timestamps) {
+                        for (int x = 0; x < run_frames; x++) {
+                            timestamps[x] = mp_ser_file->get_frame_timestamp(frame_numbers[run_start + x]);
+                        }
+                    }
+
+                    file_write_error |= ser_write_file.write_raw_frames(
+                        mp_ser_file->get_frame_offset(frame_numbers[run_start]),
+                        run_frames,
+                        timestamps.data());
+
                     // Update progress bar
-                    saved_frames++;
+                    run_start += run_frames;
+                    saved_frames += run_frames;
                     save_progress_dialog.set_value(saved_frames);
+                }
+            } else {
+                // Read, process and write frames in a staged pipeline
+                s_processing_settings processing_settings = get_processing_settings();
+                c_save_frames_pipeline save_pipeline(mp_ser_file, mp_frame_image, mp_metadata_cache);
+                if (do_frame_processing) {
+                    // Only read the part of each frame that the crop keeps
+                    save_pipeline.set_read_roi(get_read_roi(processing_settings));
+                }
 
-                    // Get frame from SER file
-                    bool valid_frame = get_and_process_frame(abs(frame_number),  // frame_number
-                                                             false,  // conv_to_8_bit
-                                                             do_frame_processing);  // do_processing
+                save_pipeline.run(
+                    frame_numbers,
+                    [&](c_image *p_frame_image) {
+                        // Processing done on a worker thread
+                        if (do_frame_processing) {
+                            process_frame(p_frame_image, processing_settings);
+                        }
 
-                    mp_frame_image->resize_image(frame_active_width, frame_active_height);
-                    mp_frame_image->add_bars(frame_total_width, frame_total_height);
+                        p_frame_image->resize_image(frame_active_width, frame_active_height);
+                        p_frame_image->add_bars(frame_total_width, frame_total_height);
+                    },
+                    [&](c_image *p_frame_image, int frame_number, uint64_t frame_timestamp) {
+                        (void)frame_number;  // Remove unused parameter warning
+
+                        // Update progress bar
+                        saved_frames++;
+                        save_progress_dialog.set_value(saved_frames);
 
-                    if (valid_frame) {
                         // Get timestamp for frame if required
                         uint64_t timestamp = 0;
                         if (include_timestamps) {
-                            timestamp = mp_ser_file->get_timestamp();
+                            timestamp = frame_timestamp;
                         }
 
                         if (!ser_write_file.get_open()) {
                             // Create SER file - only done once
                             file_create_error |= ser_write_file.create(filename, //  QString filename
-                                                                 mp_frame_image->get_width(),  // int32_t  width
-                                                                 mp_frame_image->get_height(), // int32_t  height
-                                                                 mp_frame_image->get_colour(),  //mp_ser_file->get_colour() != 0,  // bool     colour
-                                                                 mp_frame_image->get_byte_depth());  //mp_ser_file->get_byte_depth());  // int32_t  byte_depth
+                                                                 p_frame_image->get_width(),  // int32_t  width
+                                                                 p_frame_image->get_height(), // int32_t  height
+                                                                 p_frame_image->get_colour(),  //mp_ser_file->get_colour() != 0,  // bool     colour
+                                                                 p_frame_image->get_byte_depth());  //mp_ser_file->get_byte_depth());  // int32_t  byte_depth
+
+                            if (!file_create_error) {
+                                ser_write_file.set_expected_frame_count(frames_to_be_saved);
+                            }
                         }
 
                         // Write frame to SER file
                         if (!file_create_error && !file_write_error) {
                             file_write_error |= ser_write_file.write_frame(
-                                mp_frame_image->get_p_buffer(),  // uint8_t  *data,
+                                p_frame_image->get_p_buffer(),  // uint8_t  *data,
                                 timestamp);  // uint64_t timestamp);
                         }
-                    }
 
-                    if (save_progress_dialog.was_cancelled() || !valid_frame || file_write_error || file_create_error) {
-                        // Abort frame saving
-                        loop_break = true;
-                    }
-                }
+                        // Colour ID is needed for the SER header
+                        saved_colour_id = p_frame_image->get_colour_id();
+
+                        // Abort frame saving if cancelled or on an error
+                        return !(save_progress_dialog.was_cancelled() || file_write_error || file_create_error);
+                    });
             }
 
             // Get timestamp for this frame
@@ -934,7 +1286,7 @@ void c_ser_player::save_frames_as_ser_slot()
             // Set details for SER file
             file_write_error |= ser_write_file.set_details(
                 0,                  // int32_t lu_id - always 0
-                mp_frame_image->get_colour_id(),  // int32_t colour_id,
+                saved_colour_id,  // int32_t colour_id,
                 utc_to_local_diff,  // int64_t utc_to_local_diff,
                 mp_save_frames_as_ser_Dialog->get_observer_string(),
                 mp_save_frames_as_ser_Dialog->get_instrument_string(),
@@ -1108,62 +1460,62 @@ void c_ser_player::save_frames_as_avi_slot()
             bool file_create_error = false;
             bool file_write_error = false;
 
-            // Direction loop
-            int start_dir = (sequence_direction == 1) ? 1 : 0;
-            int end_dir = (sequence_direction == 0) ? 0 : 1;
-            bool loop_break = false;
-            for(int current_dir = start_dir; current_dir <= end_dir && !loop_break; current_dir++) {
-                int start_frame = min_frame;
-                int end_frame = max_frame;
-                if (current_dir == 1) {  // Reverse direction - count backwards
-                    // Use negative numbers so for loop works counting up or down
-                    start_frame = -max_frame;
-                    end_frame = -min_frame;
-                }
+            // Read, process and write frames in a staged pipeline
+            s_processing_settings processing_settings = get_processing_settings();
+            c_save_frames_pipeline save_pipeline(mp_ser_file, mp_frame_image, mp_metadata_cache);
+            if (do_frame_processing) {
+                // Only read the part of each frame that the crop keeps
+                save_pipeline.set_read_roi(get_read_roi(processing_settings));
+            }
+
+            save_pipeline.run(
+                c_save_frames_pipeline::get_frame_numbers(min_frame, max_frame, decimate_value, sequence_direction),
+                [&](c_image *p_frame_image) {
+                    // Processing done on a worker thread
+                    if (do_frame_processing) {
+                        process_frame(p_frame_image, processing_settings);
+                    }
+
+                    p_frame_image->resize_image(frame_active_width, frame_active_height);
+                    p_frame_image->add_bars(frame_total_width, frame_total_height);
+                },
+                [&](c_image *p_frame_image, int frame_number, uint64_t frame_timestamp) {
+                    (void)frame_number;  // Remove unused parameter warning
+                    (void)frame_timestamp;  // Remove unused parameter warning
 
-                for (int frame_number = start_frame; frame_number <= end_frame && !loop_break; frame_number += decimate_value) {
                     // Update progress bar
                     saved_frames++;
                     save_progress_dialog.set_value(saved_frames);
 
-                    // Get frame from SER file
-                    bool valid_frame = get_and_process_frame(abs(frame_number),  // frame_number
-                                                             false,  // conv_to_8_bit
-                                                             do_frame_processing);  // do_processing
-
-                    mp_frame_image->resize_image(frame_active_width, frame_active_height);
-                    mp_frame_image->add_bars(frame_total_width, frame_total_height);
-
-                    if (valid_frame) {
-                        if (!p_avi_write_file->get_open()) {
-                            // Create AVI file - only done once
-                            file_create_error |= p_avi_write_file->create(
-                                filename.toUtf8().constData(),  // const char *filename
-                                mp_frame_image->get_width(),  // int32_t m_width
-                                mp_frame_image->get_height(),  // int32_t m_height
-                                mp_frame_image->get_colour(),  // bool m_colour
-                                fps_rate,  // int32_t fps_rate
-                                fps_scale, // int32_t fps_scale
-                                old_format,  // int32_t m_old_avi_format
-                                0);  // int32_t quality
+                    if (!p_avi_write_file->get_open()) {
+                        // Create AVI file - only done once
+                        file_create_error |= p_avi_write_file->create(
+                            filename.toUtf8().constData(),  // const char *filename
+                            p_frame_image->get_width(),  // int32_t m_width
+                            p_frame_image->get_height(),  // int32_t m_height
+                            p_frame_image->get_colour(),  // bool m_colour
+                            fps_rate,  // int32_t fps_rate
+                            fps_scale, // int32_t fps_scale
+                            old_format,  // int32_t m_old_avi_format
+                            0);  // int32_t quality
+
+                        if (!file_create_error) {
+                            p_avi_write_file->set_expected_frame_count(frames_to_be_saved);
                         }
+                    }
 
 
-                        // Write frame to AVI file
-                        if (!file_write_error) {
-                            file_write_error |= p_avi_write_file->write_frame(
-                                mp_frame_image->get_p_buffer(),  // uint8_t *data
-                                0,  // int32_t m_colour
-                                mp_frame_image->get_byte_depth());  // uint32_t bpp
-                        }
+                    // Write frame to AVI file
+                    if (!file_write_error) {
+                        file_write_error |= p_avi_write_file->write_frame(
+                            p_frame_image->get_p_buffer(),  // uint8_t *data
+                            0,  // int32_t m_colour
+                            p_frame_image->get_byte_depth());  // uint32_t bpp
                     }
 
-                    if (save_progress_dialog.was_cancelled() || !valid_frame || file_write_error || file_create_error) {
-                        // Abort frame saving
-                        loop_break = true;
-                    }
-                }
-            }
+                    // Abort frame saving if cancelled or on an error
+                    return !(save_progress_dialog.was_cancelled() || file_write_error || file_create_error);
+                });
 
             // Write header and close SER file
             file_write_error |= p_avi_write_file->close();
@@ -1362,76 +1714,72 @@ void c_ser_player::save_frames_as_gif_slot()
                 bool file_create_error = false;
                 bool file_write_error = false;
 
-                // Direction loop
-                int start_dir = (sequence_direction == 1) ? 1 : 0;
-                int end_dir = (sequence_direction == 0) ? 0 : 1;
-                bool loop_break = false;
-                for (int current_dir = start_dir; current_dir <= end_dir && !loop_break; current_dir++) {
-                    int start_frame = min_frame;
-                    int end_frame = max_frame;
-                    if (current_dir == 1) {  // Reverse direction - count backwards
-                        // Use negative numbers so for loop works counting up or down
-                        start_frame = -max_frame;
-                        end_frame = -min_frame;
-                    }
+                // Read, process and write frames in a staged pipeline
+                s_processing_settings processing_settings = get_processing_settings();
+                c_save_frames_pipeline save_pipeline(mp_ser_file, mp_frame_image, mp_metadata_cache);
+                if (do_frame_processing) {
+                    // Only read the part of each frame that the crop keeps
+                    save_pipeline.set_read_roi(get_read_roi(processing_settings));
+                }
+
+                save_pipeline.run(
+                    c_save_frames_pipeline::get_frame_numbers(min_frame, max_frame, decimate_value, sequence_direction),
+                    [&](c_image *p_frame_image) {
+                        // Processing done on a worker thread
+                        if (do_frame_processing) {
+                            process_frame(p_frame_image, processing_settings);
+                        }
+
+                        p_frame_image->resize_image(frame_active_width, frame_active_height);
+                        p_frame_image->add_bars(frame_total_width, frame_total_height);
+                        p_frame_image->conv_data_ready_for_gif();
+                    },
+                    [&](c_image *p_frame_image, int frame_number, uint64_t frame_timestamp) {
+                        (void)frame_number;  // Remove unused parameter warning
+                        (void)frame_timestamp;  // Remove unused parameter warning
 
-                    for (int frame_number = start_frame; frame_number <= end_frame && !loop_break; frame_number += decimate_value) {
                         // Update progress bar
                         saved_frames++;
                         save_progress_dialog.set_value(saved_frames);
 
-                        // Get frame from SER file
-                        bool valid_frame = get_and_process_frame(abs(frame_number),  // frame_number
-                                                                 false,  // conv_to_8_bit
-                                                                 do_frame_processing);  // do_processing
-
-                        if (valid_frame) {
-                            mp_frame_image->resize_image(frame_active_width, frame_active_height);
-                            mp_frame_image->add_bars(frame_total_width, frame_total_height);
-                            mp_frame_image->conv_data_ready_for_gif();
-
-                            if (!gif_write_file.is_open()) {
-                                file_create_error |= gif_write_file.create(
-                                        gif_filename,  // const QString &filename
-                                        frame_total_width,  // int width
-                                        frame_total_height,  // int height
-                                        mp_frame_image->get_byte_depth(), // int byte_depth
-                                        mp_frame_image->get_colour(), // bool colour
-                                        0,  // int repeat_count
-                                        (c_gif_write::e_colour_quant_type)colour_quantisation_type,
-                                        unchanged_border_tolerance, // int unchanged_border_tolerance
-                                        transparent_pixel_enable,  // bool use_transparent_pixels
-                                        transparent_pixel_tolerence, // int transparent_tolerence
-                                        lossy_compression_level,  // int lossy_compression_level
-                                        pixel_depth);  // int bit_depth
-
-                                filesize_after_first_frame = 0;
-                                written_framecount = 0;
-                            }
-
-                            if (saved_frames == frames_to_be_saved) {
-                                // Use final frame time for last frame
-                                frametime = final_frametime;
-                            }
+                        if (!gif_write_file.is_open()) {
+                            file_create_error |= gif_write_file.create(
+                                    gif_filename,  // const QString &filename
+                                    frame_total_width,  // int width
+                                    frame_total_height,  // int height
+                                    p_frame_image->get_byte_depth(), // int byte_depth
+                                    p_frame_image->get_colour(), // bool colour
+                                    0,  // int repeat_count
+                                    (c_gif_write::e_colour_quant_type)colour_quantisation_type,
+                                    unchanged_border_tolerance, // int unchanged_border_tolerance
+                                    transparent_pixel_enable,  // bool use_transparent_pixels
+                                    transparent_pixel_tolerence, // int transparent_tolerence
+                                    lossy_compression_level,  // int lossy_compression_level
+                                    pixel_depth);  // int bit_depth
+
+                            filesize_after_first_frame = 0;
+                            written_framecount = 0;
+                        }
 
-                            if (!file_write_error && !file_create_error) {
-                                written_framecount++;
-                                file_write_error |= gif_write_file.write_frame(
-                                          mp_frame_image->get_p_buffer(),  // uint8_t  *p_data
-                                          frametime);  // uint16_t display_time
-                            }
+                        if (saved_frames == frames_to_be_saved) {
+                            // Use final frame time for last frame
+                            frametime = final_frametime;
+                        }
 
-                            if (filesize_after_first_frame == 0) {
-                                filesize_after_first_frame = gif_write_file.get_current_filesize();
-                            }
+                        if (!file_write_error && !file_create_error) {
+                            written_framecount++;
+                            file_write_error |= gif_write_file.write_frame(
+                                      p_frame_image->get_p_buffer(),  // uint8_t  *p_data
+                                      frametime);  // uint16_t display_time
                         }
 
-                        if (save_progress_dialog.was_cancelled() || !valid_frame || file_write_error || file_create_error) {
-                            // Abort frame saving
-                            loop_break = true;
+                        if (filesize_after_first_frame == 0) {
+                            filesize_after_first_frame = gif_write_file.get_current_filesize();
                         }
-                    }
-                }
+
+                        // Abort frame saving if cancelled or on an error
+                        return !(save_progress_dialog.was_cancelled() || file_write_error || file_create_error);
+                    });
 
                 // Close file
                 filesize_after_last_frame = gif_write_file.get_current_filesize();
@@ -1600,6 +1948,18 @@ void c_ser_player::save_frames_as_images_slot()
         mp_save_frames_as_images_Dialog->set_processed_frame_size(mp_ser_file->get_width(), mp_ser_file->get_height());
     }
 
+    // Give the dialog the current frame to measure the PNG compression profiles with
+    c_image png_test_image;
+    png_test_image.set_image_details(
+                mp_ser_file->get_width(),  // width
+                mp_ser_file->get_height(),  // height
+                mp_ser_file->get_byte_depth(),  // byte_depth
+                mp_ser_file->get_colour_id(),  // colour_id
+                mp_ser_file->get_colour_id() == COLOURID_RGB || mp_ser_file->get_colour_id() == COLOURID_BGR);  // colour
+    if (mp_ser_file->read_frame(mp_playback_controls_widget->slider_value(), png_test_image.get_p_buffer()) >= 0) {
+        mp_save_frames_as_images_Dialog->set_png_test_frame(&png_test_image);
+    }
+
     int ret = mp_save_frames_as_images_Dialog->exec();
 
     if (ret != QDialog::Rejected &&
@@ -1673,6 +2033,7 @@ void c_ser_player::save_frames_as_images_slot()
             bool append_timestamp_to_filename = mp_save_frames_as_images_Dialog->get_append_timestamp_to_filename();
             int required_digits_for_number = mp_save_frames_as_images_Dialog->get_required_digits_for_number();
             bool do_frame_processing = mp_save_frames_as_images_Dialog->get_processing_enable();
+            int png_compression = mp_save_frames_as_images_Dialog->get_png_compression();
 
             // Keep list of last saved folders up to date
             add_string_to_stringlist(c_persistent_data::m_recent_save_folders, QFileInfo(filename).absolutePath());
@@ -1702,118 +2063,135 @@ void c_ser_player::save_frames_as_images_slot()
             save_progress_dialog.show();
 
             int saved_frames = 0;
-            QString timestamp_string = "";
-
-            // Direction loop
-            int start_dir = (sequence_direction == 1) ? 1 : 0;
-            int end_dir = (sequence_direction == 0) ? 0 : 1;
-            for(int current_dir = start_dir; current_dir <= end_dir; current_dir++) {
-                int start_frame = min_frame;
-                int end_frame = max_frame;
-                if (current_dir == 1) {  // Reverse direction - count backwards
-                    // Use negative numbers so for loop works counting up or down
-                    start_frame = -max_frame;
-                    end_frame = -min_frame;
+
+            // Builds the filename for a frame, index is the frame's position in the saved sequence
+            auto get_frame_filename = [&](int index, int frame_number, uint64_t frame_timestamp) {
+                // Get timestamp for frame if required
+                QString timestamp_string = "";
+                if (append_timestamp_to_filename) {
+                    uint64_t ts = frame_timestamp;
+                    timestamp_string = "_" + QString::number(ts);
+                    if (ts > 0) {
+                        int32_t ts_year, ts_month, ts_day, ts_hour, ts_minute, ts_second, ts_microsec;
+                        c_pipp_timestamp::timestamp_to_date(
+                            ts,
+                            &ts_year,
+                            &ts_month,
+                            &ts_day,
+                            &ts_hour,
+                            &ts_minute,
+                            &ts_second,
+                            &ts_microsec);
+                        int32_t ts_millisec = ts_microsec / 1000;
+                        timestamp_string = QString("_%1%2%3_%4%5%6.%7_UT")
+                                           .arg(ts_year, 4, 10, QLatin1Char( '0' ))
+                                           .arg(ts_month, 2, 10, QLatin1Char( '0' ))
+                                           .arg(ts_day, 2, 10, QLatin1Char( '0' ))
+                                           .arg(ts_hour, 2, 10, QLatin1Char( '0' ))
+                                           .arg(ts_minute, 2, 10, QLatin1Char( '0' ))
+                                           .arg(ts_second, 2, 10, QLatin1Char( '0' ))
+                                           .arg(ts_millisec, 3, 10, QLatin1Char( '0' ));
+                    } else {
+                        timestamp_string = tr("_no_timestamp", "Appended to save filename when no timestamp is available");
+                    }
                 }
 
-                for (int frame_number = start_frame; frame_number <= end_frame; frame_number += decimate_value) {
-                    // Update progress bar
-                    saved_frames++;
-                    save_progress_dialog.set_value(saved_frames);
+                // Insert frame number into filename
+                int number_for_filename = (use_framenumber_in_name) ? frame_number : index + 1;
+                QString frame_number_string = QString("%1").arg(number_for_filename, required_digits_for_number, 10, QChar('0'));
+                QString new_filename = save_folder +
+                                       QDir::separator() +
+                                       filename_without_extension;
 
-                    // Get frame from SER file
-                    bool valid_frame = get_and_process_frame(abs(frame_number),  // frame_number
-                                                           false,  // conv_to_8_bit
-                                                           do_frame_processing);  // do_processing
-                    if (valid_frame) {
-                        mp_frame_image->resize_image(frame_active_width, frame_active_height);
-                        mp_frame_image->add_bars(frame_total_width, frame_total_height);
+                if (!save_current_frame_only) {
+                    // Include frame number in filename if not saving only current frame
+                    new_filename += QString("_") +frame_number_string;
+                }
 
-                        // Get timestamp for frame if required
-                        if (append_timestamp_to_filename) {
-                            uint64_t ts = mp_ser_file->get_timestamp();
-                            timestamp_string = "_" + QString::number(ts);
-                            if (ts > 0) {
-                                int32_t ts_year, ts_month, ts_day, ts_hour, ts_minute, ts_second, ts_microsec;
-                                c_pipp_timestamp::timestamp_to_date(
-                                    ts,
-                                    &ts_year,
-                                    &ts_month,
-                                    &ts_day,
-                                    &ts_hour,
-                                    &ts_minute,
-                                    &ts_second,
-                                    &ts_microsec);
-                                int32_t ts_millisec = ts_microsec / 1000;
-                                timestamp_string = QString("_%1%2%3_%4%5%6.%7_UT")
-                                                   .arg(ts_year, 4, 10, QLatin1Char( '0' ))
-                                                   .arg(ts_month, 2, 10, QLatin1Char( '0' ))
-                                                   .arg(ts_day, 2, 10, QLatin1Char( '0' ))
-                                                   .arg(ts_hour, 2, 10, QLatin1Char( '0' ))
-                                                   .arg(ts_minute, 2, 10, QLatin1Char( '0' ))
-                                                   .arg(ts_second, 2, 10, QLatin1Char( '0' ))
-                                                   .arg(ts_millisec, 3, 10, QLatin1Char( '0' ));
-                            } else {
-                                timestamp_string = tr("_no_timestamp", "Appended to save filename when no timestamp is available");
-                            }
-                        }
+                // Add timestamp and file extension to name
+                new_filename += timestamp_string +"." + filename_extension;
+                return new_filename;
+            };
+
+            // Read, process and write frames in a staged pipeline
+            s_processing_settings processing_settings = get_processing_settings();
+            c_save_frames_pipeline save_pipeline(mp_ser_file, mp_frame_image, mp_metadata_cache);
+            if (do_frame_processing) {
+                // Only read the part of each frame that the crop keeps
+                save_pipeline.set_read_roi(get_read_roi(processing_settings));
+            }
 
-                        // Insert frame number into filename
-                        int number_for_filename = (use_framenumber_in_name) ? abs(frame_number) : saved_frames;
-                        QString frame_number_string = QString("%1").arg(number_for_filename, required_digits_for_number, 10, QChar('0'));
-                        QString new_filename = save_folder +
-                                               QDir::separator() +
-                                               filename_without_extension;
+            // TIFF and PNG files are written with our own code and libpng, which keep no state
+            // between files, so they are encoded and saved on the worker threads
+            std::atomic<bool> save_cancelled(false);
+            if (tiff_image || png_image) {
+                save_pipeline.set_save_function([&](c_image *p_frame_image, int index, int frame_number, uint64_t frame_timestamp) {
+                    // Do not start on any more files once saving has been cancelled
+                    if (save_cancelled) {
+                        return;
+                    }
 
-                        if (!save_current_frame_only) {
-                            // Include frame number in filename if not saving only current frame
-                            new_filename += QString("_") +frame_number_string;
-                        }
+                    QString new_filename = get_frame_filename(index, frame_number, frame_timestamp);
+                    if (tiff_image) {
+                        // TIFF files are saved using our own code
+                        save_tiff_file(
+                            new_filename.toUtf8().constData(),
+                            p_frame_image->get_p_buffer(),
+                            p_frame_image->get_width(),
+                            p_frame_image->get_height(),
+                            p_frame_image->get_byte_depth(),
+                            p_frame_image->get_colour());
+                    } else {
+                        save_png_file(
+                            new_filename.toUtf8().constData(),
+                            p_frame_image->get_p_buffer(),
+                            p_frame_image->get_width(),
+                            p_frame_image->get_height(),
+                            p_frame_image->get_byte_depth(),
+                            p_frame_image->get_colour(),
+                            png_compression);
+                    }
+                });
+            }
 
-                        // Add timestamp and file extension to name
-                        new_filename += timestamp_string +"." + filename_extension;
-
-                        if (tiff_image) {
-                            // TIFF files are saved using our own code
-                            save_tiff_file(
-                                new_filename.toUtf8().constData(),
-                                mp_frame_image->get_p_buffer(),
-                                mp_frame_image->get_width(),
-                                mp_frame_image->get_height(),
-                                mp_frame_image->get_byte_depth(),
-                                mp_frame_image->get_colour());
-                        } else if (png_image) {
-                            save_png_file(
-                                new_filename.toUtf8().constData(),
-                                mp_frame_image->get_p_buffer(),
-                                mp_frame_image->get_width(),
-                                mp_frame_image->get_height(),
-                                mp_frame_image->get_byte_depth(),
-                                mp_frame_image->get_colour());
-                        } else {
-                            // Other image files are saved using stangard QT QImage methods
-                            mp_frame_image->conv_data_ready_for_qimage();
-                            QImage save_qimage = QImage(mp_frame_image->get_p_buffer(),
-                                                        mp_frame_image->get_width(),
-                                                        mp_frame_image->get_height(),
-                                                        QImage::Format_RGB888);
-
-                            // Open file for writing
-                            QFile file(new_filename);
-                            file.open(QIODevice::WriteOnly);
-
-                            // Save the frame and close image file
-                            QPixmap::fromImage(save_qimage).save(&file, p_format);
-                            file.close();
-                        }
+            save_pipeline.run(
+                c_save_frames_pipeline::get_frame_numbers(min_frame, max_frame, decimate_value, sequence_direction),
+                [&](c_image *p_frame_image) {
+                    // Processing done on a worker thread
+                    if (do_frame_processing) {
+                        process_frame(p_frame_image, processing_settings);
                     }
 
-                    if (save_progress_dialog.was_cancelled() || !valid_frame) {
-                        // Abort frame saving
-                        break;
+                    p_frame_image->resize_image(frame_active_width, frame_active_height);
+                    p_frame_image->add_bars(frame_total_width, frame_total_height);
+                },
+                [&](c_image *p_frame_image, int frame_number, uint64_t frame_timestamp) {
+                    if (!tiff_image && !png_image) {
+                        // Other image files are saved using stangard QT QImage methods
+                        QString new_filename = get_frame_filename(saved_frames, frame_number, frame_timestamp);
+                        p_frame_image->conv_data_ready_for_qimage();
+                        QImage save_qimage = QImage(p_frame_image->get_p_buffer(),
+                                                    p_frame_image->get_width(),
+                                                    p_frame_image->get_height(),
+                                                    QImage::Format_RGB888);
+
+                        // Open file for writing
+                        QFile file(new_filename);
+                        file.open(QIODevice::WriteOnly);
+
+                        // Save the frame and close image file
+                        QPixmap::fromImage(save_qimage).save(&file, p_format);
+                        file.close();
                     }
-                }
-            }
+
+                    // Update progress bar
+                    saved_frames++;
+                    save_progress_dialog.set_value(saved_frames);
+
+                    // Abort frame saving if cancelled
+                    save_cancelled = save_progress_dialog.was_cancelled();
+                    return !save_cancelled;
+                });
 
             // Processing has completed
             save_progress_dialog.set_complete();
@@ -1858,28 +2236,28 @@ void c_ser_player::open_save_folder_slot(QAction *action)
 void c_ser_player::invert_changed_slot(bool invert)
 {
     mp_frame_image->set_invert_image(invert);
-    frame_slider_changed_slot();
+    update_frame_for_processing_change();
 }
 
 
 void c_ser_player::gain_changed_slot(double gain)
 {
     mp_frame_image->set_gain(gain);
-    frame_slider_changed_slot();
+    update_frame_for_processing_change();
 }
 
 
 void c_ser_player::gamma_changed_slot(double gamma)
 {
     mp_frame_image->set_gamma(gamma);
-    frame_slider_changed_slot();
+    update_frame_for_processing_change();
 }
 
 
 void c_ser_player::colour_balance_changed_slot(double red, double green, double blue)
 {
     mp_frame_image->set_colour_balance(red, green, blue);
-    frame_slider_changed_slot();
+    update_frame_for_processing_change();
 }
 
 
@@ -1889,8 +2267,12 @@ void c_ser_player::colour_align_changed_slot(
         int blue_align_x,
         int blue_align_y)
 {
+    m_red_align_x = red_align_x;
+    m_red_align_y = red_align_y;
+    m_blue_align_x = blue_align_x;
+    m_blue_align_y = blue_align_y;
     mp_frame_image->set_colour_align(red_align_x, red_align_y, blue_align_x, blue_align_y);
-    frame_slider_changed_slot();
+    update_frame_for_processing_change();
 }
 
 
@@ -2008,8 +2390,20 @@ void c_ser_player::open_ser_file(const QString &filename)
     mp_playback_controls_widget->reset_all_markers_slot();  // Ensure start marker is reset
     mp_playback_controls_widget->stop_playback();  // Stop and reset and currently playing frame
 
+    mp_follow_Timer->stop();
+    mp_render_worker->cancel();
+    mp_frame_prefetcher->close();
+    mp_frame_cache->clear();
+    m_valid_stages = 0;
     mp_ser_file->close();
     m_ser_file_loaded = false;
+
+    // Use the cached metadata for this file if there is any, to save scanning the file again
+    c_pipp_ser::s_metadata cached_metadata;
+    if (mp_metadata_cache->open(filename, cached_metadata)) {
+        mp_ser_file->set_cached_metadata(cached_metadata);
+    }
+
     m_total_frames = mp_ser_file->open(filename.toUtf8().constData(), 0, 0);
 
     // Check if SER file is broken but fixable - fix it if possible
@@ -2077,23 +2471,7 @@ void c_ser_player::open_ser_file(const QString &filename)
         mp_save_frames_as_images_Dialog = nullptr;
 
         // Set SER file header details in header details dialog
-        mp_header_details_dialog->set_details(
-                filename,
-                QFileInfo(filename).size(),  // int filesize,
-                QString::fromStdString(mp_ser_file->get_file_id()), // QString file_id,
-                mp_ser_file->get_lu_id(),  // int lu_id,
-                mp_ser_file->get_colour_id(),  // int colour_id,
-                mp_ser_file->get_little_endian(),  // int little_endian,
-                mp_ser_file->get_width(),  // int image_width,
-                mp_ser_file->get_height(),  // int image_height,
-                mp_ser_file->get_pixel_depth(),  // int pixel_depth,
-                m_total_frames,  // int frame_count,
-                QString::fromStdString(mp_ser_file->get_observer_string()),  // QString observer,
-                QString::fromStdString(mp_ser_file->get_instrument_string()),  // QString instrument,
-                QString::fromStdString(mp_ser_file->get_telescope_string()),  // QString telescope,
-                mp_ser_file->get_data_time(),  // uint64_t date_time,
-                mp_ser_file->get_data_time_utc(),  // uint64_t date_time_utc)
-                QString::fromStdString(mp_ser_file->get_timestamp_info()));  // QString timestamp_info
+        update_header_details(filename);
 
         // Keep list of opened SER files up to date
         add_string_to_stringlist(c_persistent_data::m_recent_ser_files, QFileInfo(filename).absoluteFilePath());
@@ -2112,6 +2490,22 @@ void c_ser_player::open_ser_file(const QString &filename)
         // Remember SER file directory
         m_ser_directory = QFileInfo(filename).canonicalPath();
 
+        // Keep the metadata cache up to date
+        mp_metadata_cache->set_metadata(mp_ser_file->get_metadata(), m_total_frames);
+
+        // Frames are read ahead from a second file handle during playback
+        mp_frame_prefetcher->open(filename.toUtf8().constData(), mp_ser_file->get_metadata());
+
+        // Frames from the last file are no use
+        mp_frame_cache->reset(mp_ser_file->get_buffer_size());
+
+        // Keep checking for new frames if the file is still being recorded
+        if (mp_ser_file->is_following()) {
+            m_follow_file_size = mp_ser_file->get_file_size();
+            m_follow_stalled_time = 0;
+            mp_follow_Timer->start();
+        }
+
         // Set up frame slider widget
         mp_playback_controls_widget->set_maximum_frame(m_total_frames);
         mp_playback_controls_widget->reset_all_markers_slot();  // Reset markers to new frame range
@@ -2248,32 +2642,53 @@ void c_ser_player::markers_dialog_closed_slot()
 
 void c_ser_player::frame_slider_changed_slot()
 {
+    // This frame replaces anything the render worker is still working on
+    mp_render_worker->cancel();
+    m_histogram_pending = false;
+
     // Update image to new frame
     if (!m_ser_file_loaded) {
         mp_playback_controls_widget->stop_playback();
     } else {
+        // The histogram is generated from the processed frame before it is converted for display,
+        // otherwise processing and conversion are done together
+        bool generate_histogram = mp_histogram_dialog->isVisible() && !mp_histogram_thread->is_running();
         bool valid_frame = get_and_process_frame(mp_playback_controls_widget->slider_value(),  // frame_number
                                                true,  // conv_to_8_bit
-                                               true);  // do_processing
+                                               true,  // do_processing
+                                               !generate_histogram);  // conv_for_display
 
         if (valid_frame) {
             // Start histogram generation if one is not already being generated
-            if (mp_histogram_dialog->isVisible() && !mp_histogram_thread->is_running()) {
+            if (generate_histogram) {
                 mp_histogram_thread->generate_histogram(mp_frame_image, mp_playback_controls_widget->slider_value());
+                mp_frame_image->conv_data_ready_for_qimage();
             }
 
-            mp_frame_image->conv_data_ready_for_qimage();
-
             QImage frame_qimage = QImage(mp_frame_image->get_p_buffer(),
                                          mp_frame_image->get_width(),
                                          mp_frame_image->get_height(),
                                          QImage::Format_RGB888);
 
             // Upate image in player
-            mp_frame_image_Widget->setPixmap(QPixmap::fromImage(frame_qimage));
+            mp_frame_image_Widget->set_frame_image(frame_qimage);
 
             // Update timestamp label
-            mp_playback_controls_widget->update_timestamp_label(mp_ser_file->get_timestamp());
+            mp_playback_controls_widget->update_timestamp_label(m_frame_timestamp);
+
+            // Read ahead the frames that playback will want next, unless they can be taken from the mapped file
+            if (mp_playback_controls_widget->is_playing() &&
+                !(mp_ser_file->frame_view_is_native() && mp_ser_file->get_frame_view(1) != nullptr)) {
+                QVector<int> next_frames = mp_playback_controls_widget->get_next_frames(c_frame_prefetcher::C_RING_SIZE);
+                for (int x = next_frames.size() - 1; x >= 0; x--) {
+                    if (mp_frame_cache->contains(next_frames[x])) {
+                        // No need to read frames that are already cached
+                        next_frames.remove(x);
+                    }
+                }
+
+                mp_frame_prefetcher->request_frames(next_frames);
+            }
 
             // Ensure displayed histogram matches displayed frame
             if (!mp_playback_controls_widget->is_playing()) {
@@ -2382,7 +2797,7 @@ void c_ser_player::check_for_updates_slot(bool enabled)
 
 void c_ser_player::debayer_enable_slot()
 {
-    frame_slider_changed_slot();
+    update_frame_for_processing_change();
 }
 
 
@@ -2392,6 +2807,90 @@ void c_ser_player::new_version_available_slot(QString version)
 }
 
 
+void c_ser_player::update_frame_for_processing_change()
+{
+    // Dragging a processing option slider gives a stream of changes, so while paused the
+    // processing stages that have to be redone, the LUT based processing and the conversion
+    // for display are handed to the render worker, which only ever renders the newest settings
+    if (!m_ser_file_loaded || mp_playback_controls_widget->is_playing()) {
+        frame_slider_changed_slot();
+        return;
+    }
+
+    const int frame_number = mp_playback_controls_widget->slider_value();
+    s_processing_settings settings = get_processing_settings();
+    int first_stage;
+    if (!get_stage_start_frame(frame_number, settings, first_stage)) {
+        frame_slider_changed_slot();
+        return;
+    }
+
+    m_render_first_stage = first_stage;
+    m_render_frame_number = frame_number;
+    m_render_timestamp = m_frame_timestamp;
+    m_render_settings = settings;
+    mp_render_worker->request_render(
+                *mp_frame_image,
+                first_stage,
+                [settings](int stage, c_image *p_image) { return run_processing_stage(stage, p_image, settings); },
+                settings.m_colour_saturation,
+                mp_histogram_dialog->isVisible());  // keep_processed_image
+}
+
+
+void c_ser_player::render_done_slot(QImage frame_image, int request_id)
+{
+    // Ignore frames that have been superseded since they were requested
+    if (!mp_render_worker->is_current_request(request_id)) {
+        return;
+    }
+
+    mp_frame_image_Widget->set_frame_image(frame_image);
+
+    // Keep the frame after each stage the worker ran, so the next change can carry on from them
+    bool stage_changed[STAGE_COUNT];
+    bool generate_histogram = mp_histogram_dialog->isVisible();
+    if (!mp_render_worker->take_results(request_id, mp_stage_images, stage_changed, (generate_histogram) ? mp_histogram_image : nullptr)) {
+        return;
+    }
+
+    for (int stage = m_render_first_stage; stage < STAGE_COUNT; stage++) {
+        if (stage_changed[stage]) {
+            m_stage_image_index[stage] = stage;
+        } else {
+            m_stage_image_index[stage] = (stage == 0) ? -1 : m_stage_image_index[stage - 1];
+        }
+    }
+
+    m_valid_stages = STAGE_COUNT;
+    m_stage_frame_number = m_render_frame_number;
+    m_stage_timestamp = m_render_timestamp;
+    m_stage_settings = m_render_settings;
+
+    if (generate_histogram) {
+        m_histogram_pending = true;
+        generate_pending_histogram_slot();
+    }
+}
+
+
+void c_ser_player::generate_pending_histogram_slot()
+{
+    if (!m_histogram_pending) {
+        return;
+    }
+
+    if (mp_histogram_thread->is_running()) {
+        // Try again once the histogram being generated is done
+        QTimer::singleShot(5, this, SLOT(generate_pending_histogram_slot()));
+        return;
+    }
+
+    m_histogram_pending = false;
+    mp_histogram_thread->generate_histogram(mp_histogram_image, m_stage_frame_number);
+}
+
+
 void c_ser_player::histogram_done_slot()
 {
     QPixmap histogram_Pixmap;
@@ -2409,6 +2908,7 @@ void c_ser_player::start_playing_slot()
 void c_ser_player::stop_playing_slot()
 {
     mp_frame_Timer->stop();
+    mp_frame_prefetcher->clear();
 }
 
 
@@ -2628,8 +3128,51 @@ void c_ser_player::calculate_display_framerate()
 }
 
 
-bool c_ser_player::get_and_process_frame(int frame_number, bool conv_to_8_bit, bool do_processing)
+bool c_ser_player::get_and_process_frame(int frame_number, bool conv_to_8_bit, bool do_processing, bool conv_for_display)
 {
+    s_processing_settings settings = get_processing_settings();
+
+    // While paused the frame is kept after each processing stage, so changing a
+    // processing option does not redo the stages before it
+    if (do_processing && conv_to_8_bit && !mp_playback_controls_widget->is_playing()) {
+        if (!get_stage_processed_frame(frame_number, settings)) {
+            return false;
+        }
+
+        // Only the LUT based processing and colour saturation are left
+        if (!conv_for_display) {
+            mp_frame_image->do_lut_based_processing();
+            mp_frame_image->change_colour_saturation(settings.m_colour_saturation);
+        } else if (!mp_frame_image->process_and_conv_data_ready_for_qimage(false, 0, 0, 0, 0, -1, settings.m_colour_saturation)) {
+            mp_frame_image->do_lut_based_processing();
+            mp_frame_image->change_colour_saturation(settings.m_colour_saturation);
+            mp_frame_image->conv_data_ready_for_qimage();
+        }
+
+        return true;
+    }
+
+    // Frames read from the file for processing only read the part the crop keeps
+    int32_t ret = read_frame(frame_number, conv_to_8_bit, (do_processing) ? &settings : nullptr);
+    if (ret < 0) {
+        return false;
+    }
+
+    if (do_processing && conv_for_display) {
+        process_frame_for_display(mp_frame_image, settings);
+    } else if (do_processing) {
+        process_frame(mp_frame_image, settings);
+    } else if (conv_for_display) {
+        mp_frame_image->conv_data_ready_for_qimage();
+    }
+
+    return true;
+}
+
+
+int32_t c_ser_player::read_frame(int frame_number, bool conv_to_8_bit, s_processing_settings *p_crop_settings)
+{
+    int32_t ret = 0;
     bool is_colour = false;
     if (mp_ser_file->get_colour_id() == COLOURID_RGB || mp_ser_file->get_colour_id() == COLOURID_BGR) {
         is_colour = true;
@@ -2642,46 +3185,297 @@ bool c_ser_player::get_and_process_frame(int frame_number, bool conv_to_8_bit, b
                 mp_ser_file->get_colour_id(),  // colour_id
                 is_colour);  // colour
 
-    int32_t ret = mp_ser_file->get_frame(frame_number, mp_frame_image->get_p_buffer());
-
-    if (ret >= 0) {
-        if (conv_to_8_bit) {
-            mp_frame_image->convert_image_to_8bit();
-        }
+    // Whole frames are taken straight from the mapped file when they only need their lines reordering,
+    // the mapping already acts as a cache so these frames are not copied into the frame cache
+    const uint8_t *p_frame_view = nullptr;
+    if ((p_crop_settings == nullptr || !p_crop_settings->m_crop_enable) && mp_ser_file->frame_view_is_native()) {
+        p_frame_view = mp_ser_file->get_frame_view(frame_number);
+    }
 
-        if (do_processing) {
-            // Debayer frame if required
-            if (mp_processing_options_Dialog->get_debayer_enable()) {
-                int colour_id = mp_processing_options_Dialog->get_debayer_pattern();
-                if (colour_id < 0) {
-                    // No colour_id specified, use value from SER file
-                    colour_id = mp_ser_file->get_colour_id();
-                }
+    if (p_frame_view != nullptr) {
+        add_frame_stats(frame_number, p_frame_view);
+        mp_frame_image->copy_top_down_data(p_frame_view, conv_to_8_bit);
+        m_frame_timestamp = mp_ser_file->get_frame_timestamp(frame_number);
+        return 0;
+    }
 
-                mp_frame_image->debayer_image_bilinear(colour_id);
+    bool whole_frame = true;
+    if (!mp_frame_cache->get_frame(frame_number, mp_frame_image->get_p_buffer(), m_frame_timestamp)) {
+        if (!mp_frame_prefetcher->take_frame(frame_number, mp_frame_image->get_p_buffer(), m_frame_timestamp)) {
+            c_pipp_ser::s_roi roi = mp_ser_file->get_full_roi();
+            if (p_crop_settings != nullptr) {
+                roi = get_read_roi(*p_crop_settings);
+                whole_frame = roi.width == mp_ser_file->get_width() && roi.height == mp_ser_file->get_height();
             }
 
-            //
-            if (m_crop_enable) {
-                mp_frame_image->crop_image(
-                        m_crop_x_pos,
-                        m_crop_y_pos,
-                        m_crop_width,
-                        m_crop_height);
+            if (whole_frame) {
+                // Frame has not been prefetched, read it now
+                ret = mp_ser_file->get_frame(frame_number, mp_frame_image->get_p_buffer());
+                m_frame_timestamp = mp_ser_file->get_timestamp();
+            } else {
+                // Only read the region the crop needs
+                mp_frame_image->set_image_details(
+                            roi.width,  // width
+                            roi.height,  // height
+                            mp_ser_file->get_byte_depth(),  // byte_depth
+                            mp_ser_file->get_colour_id(),  // colour_id
+                            is_colour);  // colour
+
+                ret = mp_ser_file->read_frame(frame_number, roi, mp_frame_image->get_p_buffer());
+                m_frame_timestamp = mp_ser_file->get_frame_timestamp(frame_number);
             }
+        }
+
+        // Keep the frame before it is processed, the cache only holds whole frames
+        if (ret >= 0 && whole_frame) {
+            mp_frame_cache->add_frame(frame_number, mp_frame_image->get_p_buffer(), m_frame_timestamp);
+        }
+    }
+
+    if (ret >= 0 && whole_frame) {
+        add_frame_stats(frame_number, mp_frame_image->get_p_buffer());
+    }
+
+    if (ret >= 0 && conv_to_8_bit) {
+        mp_frame_image->convert_image_to_8bit();
+    }
+
+    return ret;
+}
 
-            mp_frame_image->align_colour_channels();
 
-            if (m_monochrome_conversion_enable) {
-                mp_frame_image->monochrome_conversion(m_monochrome_conversion_type);
+// Keep the statistics of a whole frame as it was read from the SER file, the first time it is read
+void c_ser_player::add_frame_stats(int frame_number, const uint8_t *p_frame_data)
+{
+    if (mp_metadata_cache->frame_stats_needed(frame_number)) {
+        const int32_t byte_depth = mp_ser_file->get_byte_depth();
+        mp_metadata_cache->set_frame_stats(
+                    frame_number,
+                    c_ser_metadata_cache::calculate_frame_stats(p_frame_data, mp_ser_file->get_buffer_size() / byte_depth, byte_depth));
+    }
+}
+
+
+bool c_ser_player::get_stage_start_frame(int frame_number, const s_processing_settings &settings, int &first_stage)
+{
+    // Leaves mp_frame_image holding the 8-bit frame that processing starts from, which is
+    // the frame after the last stage that is still valid if there is one
+    const int valid_stages = get_valid_stage_count(frame_number, settings);
+    first_stage = 0;
+    if (valid_stages > 0 && m_stage_image_index[valid_stages - 1] >= 0) {
+        // Carry on from the last stage that is still valid
+        mp_frame_image->copy_image_data(*mp_stage_images[m_stage_image_index[valid_stages - 1]]);
+        m_frame_timestamp = m_stage_timestamp;
+        first_stage = valid_stages;
+    } else if (read_frame(frame_number, true) < 0) {
+        return false;
+    }
+
+    return true;
+}
+
+
+bool c_ser_player::get_stage_processed_frame(int frame_number, const s_processing_settings &settings)
+{
+    // Leaves mp_frame_image holding the 8-bit frame with every processing stage done,
+    // ready for the LUT based processing and colour saturation
+    int first_stage;
+    if (!get_stage_start_frame(frame_number, settings, first_stage)) {
+        return false;
+    }
+
+    // Run the stages that are not valid, keeping a copy of the frame after each one that changes it
+    for (int stage = first_stage; stage < STAGE_COUNT; stage++) {
+        if (run_processing_stage(stage, mp_frame_image, settings)) {
+            mp_stage_images[stage]->copy_image_data(*mp_frame_image);
+            m_stage_image_index[stage] = stage;
+        } else {
+            m_stage_image_index[stage] = (stage == 0) ? -1 : m_stage_image_index[stage - 1];
+        }
+    }
+
+    m_valid_stages = STAGE_COUNT;
+    m_stage_frame_number = frame_number;
+    m_stage_timestamp = m_frame_timestamp;
+    m_stage_settings = settings;
+    return true;
+}
+
+
+int c_ser_player::get_valid_stage_count(int frame_number, const s_processing_settings &settings)
+{
+    if (m_valid_stages == 0 || frame_number != m_stage_frame_number) {
+        return 0;
+    }
+
+    // Each stage is only valid if it and all the stages before it have the same settings
+    const s_processing_settings &old = m_stage_settings;
+    int valid_stages = 0;
+    if (settings.m_debayer_colour_id == old.m_debayer_colour_id) {
+        valid_stages = STAGE_DEBAYER + 1;
+        bool same_crop = settings.m_crop_enable == old.m_crop_enable &&
+                         (!settings.m_crop_enable ||
+                          (settings.m_crop_x_pos == old.m_crop_x_pos &&
+                           settings.m_crop_y_pos == old.m_crop_y_pos &&
+                           settings.m_crop_width == old.m_crop_width &&
+                           settings.m_crop_height == old.m_crop_height));
+        bool same_align = settings.m_red_align_x == old.m_red_align_x &&
+                          settings.m_red_align_y == old.m_red_align_y &&
+                          settings.m_blue_align_x == old.m_blue_align_x &&
+                          settings.m_blue_align_y == old.m_blue_align_y;
+        if (same_crop && same_align) {
+            valid_stages = STAGE_CROP_AND_ALIGN + 1;
+            if (settings.m_monochrome_conversion_enable == old.m_monochrome_conversion_enable &&
+                (!settings.m_monochrome_conversion_enable ||
+                 settings.m_monochrome_conversion_type == old.m_monochrome_conversion_type)) {
+                valid_stages = STAGE_MONOCHROME + 1;
             }
+        }
+    }
 
-            mp_frame_image->do_lut_based_processing();
+    return std::min(valid_stages, m_valid_stages);
+}
+
+
+bool c_ser_player::run_processing_stage(int stage, c_image *p_image, const s_processing_settings &settings)
+{
+    // Returns true if the stage changed the image
+    switch (stage) {
+    case STAGE_DEBAYER:
+        if (settings.m_debayer_colour_id >= 0) {
+            p_image->debayer_image_bilinear(settings.m_debayer_colour_id);
+            return true;
+        }
 
-            // Adjust colour saturation if required
-            mp_frame_image->change_colour_saturation(mp_processing_options_Dialog->get_colour_saturation());
+        break;
+    case STAGE_CROP_AND_ALIGN:
+        if (settings.m_crop_enable) {
+            p_image->crop_image(
+                    settings.m_crop_x_pos,
+                    settings.m_crop_y_pos,
+                    settings.m_crop_width,
+                    settings.m_crop_height);
         }
+
+        p_image->align_colour_channels();
+        return settings.m_crop_enable || settings.m_red_align_x != 0 || settings.m_red_align_y != 0 ||
+               settings.m_blue_align_x != 0 || settings.m_blue_align_y != 0;
+    case STAGE_MONOCHROME:
+        if (settings.m_monochrome_conversion_enable) {
+            p_image->monochrome_conversion(settings.m_monochrome_conversion_type);
+            return true;
+        }
+
+        break;
+    }
+
+    return false;
+}
+
+
+c_ser_player::s_processing_settings c_ser_player::get_processing_settings()
+{
+    s_processing_settings settings;
+
+    // Debayer frame if required
+    settings.m_debayer_colour_id = -1;
+    if (mp_processing_options_Dialog->get_debayer_enable()) {
+        settings.m_debayer_colour_id = mp_processing_options_Dialog->get_debayer_pattern();
+        if (settings.m_debayer_colour_id < 0) {
+            // No colour_id specified, use value from SER file
+            settings.m_debayer_colour_id = mp_ser_file->get_colour_id();
+        }
+    }
+
+    settings.m_crop_enable = m_crop_enable;
+    settings.m_crop_x_pos = m_crop_x_pos;
+    settings.m_crop_y_pos = m_crop_y_pos;
+    settings.m_crop_width = m_crop_width;
+    settings.m_crop_height = m_crop_height;
+    settings.m_monochrome_conversion_enable = m_monochrome_conversion_enable;
+    settings.m_monochrome_conversion_type = m_monochrome_conversion_type;
+    settings.m_colour_saturation = mp_processing_options_Dialog->get_colour_saturation();
+    settings.m_red_align_x = m_red_align_x;
+    settings.m_red_align_y = m_red_align_y;
+    settings.m_blue_align_x = m_blue_align_x;
+    settings.m_blue_align_y = m_blue_align_y;
+    return settings;
+}
+
+
+c_pipp_ser::s_roi c_ser_player::get_read_roi(s_processing_settings &settings)
+{
+    // Only the part of the frame that the crop keeps needs to be read,
+    // with a margin around it if the frame is going to be debayered
+    if (!settings.m_crop_enable) {
+        return mp_ser_file->get_full_roi();
+    }
+
+    c_pipp_ser::s_roi roi = mp_ser_file->get_crop_roi(
+                settings.m_crop_x_pos,
+                settings.m_crop_y_pos,
+                settings.m_crop_width,
+                settings.m_crop_height,
+                settings.m_debayer_colour_id >= 0);  // cfa_margin
+
+    // The crop position is now relative to the region
+    settings.m_crop_x_pos -= roi.x;
+    settings.m_crop_y_pos -= roi.y;
+    return roi;
+}
+
+
+void c_ser_player::process_frame(c_image *p_image, const s_processing_settings &settings)
+{
+    // Debayer frame if required
+    if (settings.m_debayer_colour_id >= 0) {
+        p_image->debayer_image_bilinear(settings.m_debayer_colour_id);
+    }
+
+    // Crop frame if required
+    if (settings.m_crop_enable) {
+        p_image->crop_image(
+                settings.m_crop_x_pos,
+                settings.m_crop_y_pos,
+                settings.m_crop_width,
+                settings.m_crop_height);
     }
 
-    return (ret >= 0);
+    p_image->align_colour_channels();
+
+    if (settings.m_monochrome_conversion_enable) {
+        p_image->monochrome_conversion(settings.m_monochrome_conversion_type);
+    }
+
+    p_image->do_lut_based_processing();
+
+    // Adjust colour saturation if required
+    p_image->change_colour_saturation(settings.m_colour_saturation);
+}
+
+
+void c_ser_player::process_frame_for_display(c_image *p_image, const s_processing_settings &settings)
+{
+    // Debayer frame if required
+    if (settings.m_debayer_colour_id >= 0) {
+        p_image->debayer_image_bilinear(settings.m_debayer_colour_id);
+    }
+
+    // Do the rest of the processing and the conversion to RGB888 in a single pass if possible
+    bool single_pass_done = p_image->process_and_conv_data_ready_for_qimage(
+                settings.m_crop_enable,
+                settings.m_crop_x_pos,
+                settings.m_crop_y_pos,
+                settings.m_crop_width,
+                settings.m_crop_height,
+                (settings.m_monochrome_conversion_enable) ? settings.m_monochrome_conversion_type : -1,
+                settings.m_colour_saturation);
+
+    if (!single_pass_done) {
+        // Fall back to processing the frame one stage at a time
+        s_processing_settings remaining_settings = settings;
+        remaining_settings.m_debayer_colour_id = -1;  // Already debayered
+        process_frame(p_image, remaining_settings);
+        p_image->conv_data_ready_for_qimage();
+    }
 }
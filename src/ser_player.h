@@ -21,7 +21,9 @@
 
 #include <QMainWindow>
 #include <QFile>
+#include <QImage>
 #include <cstdint>
+#include "pipp_ser.h"
 
 class QAction;
 class QActionGroup;
@@ -31,7 +33,6 @@ class QImage;
 class QTimer;
 class QVBoxLayout;
 
-class c_pipp_ser;
 class c_playback_controls_dialog;
 class c_playback_controls_widget;
 class c_header_details_dialog;
@@ -42,6 +43,10 @@ class c_save_frames_dialog;
 class c_image_Widget;
 class c_image;
 class c_histogram_thread;
+class c_frame_prefetcher;
+class c_frame_cache;
+class c_render_worker;
+class c_ser_metadata_cache;
 
 
 class c_ser_player : public QMainWindow
@@ -53,6 +58,8 @@ private:
     static const QString C_DEBIAN_XML_TEXT1;
     static const QString C_DEBIAN_XML_TEXT2;
     static const QString C_DEBIAN_XML_TEXT3;
+    static const uint64_t C_RAW_COPY_RUN_SIZE;  // Most data copied between progress updates when frames are copied without decoding
+    static const int C_FOLLOW_STALLED_TIME;  // Milliseconds without growth before a followed file is treated as broken
 
     // Menus
     QAction *mp_save_frames_as_images_Act;
@@ -69,6 +76,7 @@ private:
     QAction *mp_processing_options_Act;
     QAction *mp_markers_dialog_Act;
     QAction *mp_detach_playback_controls_Act;
+    QAction *mp_follow_ser_file_Act;
 
     // Dialogs
     c_playback_controls_dialog *mp_playback_controls_dialog;
@@ -82,12 +90,21 @@ private:
 
     // Threads
     c_histogram_thread *mp_histogram_thread;
+    c_frame_prefetcher *mp_frame_prefetcher;
+    c_ser_metadata_cache *mp_metadata_cache;
+    c_render_worker *mp_render_worker;
+
+    // Recently displayed frames
+    c_frame_cache *mp_frame_cache;
 
     // Widgets
     c_playback_controls_widget *mp_playback_controls_widget;
     QPixmap m_no_file_open_Pixmap;
     c_image_Widget *mp_frame_image_Widget;
     QTimer *mp_frame_Timer;
+    QTimer *mp_follow_Timer;
+    int64_t m_follow_file_size;
+    int m_follow_stalled_time;
 //    QTimer *mp_resize_Timer;
 
     QVBoxLayout *mp_main_vlayout;
@@ -96,6 +113,7 @@ private:
     bool m_ser_file_loaded;
     c_pipp_ser *mp_ser_file;
     c_image *mp_frame_image;
+    uint64_t m_frame_timestamp;
     QString m_ser_directory;
     int m_total_frames;
     int m_display_framerate;
@@ -110,6 +128,10 @@ private:
     int m_crop_y_pos;
     int m_crop_width;
     int m_crop_height;
+    int m_red_align_x;
+    int m_red_align_y;
+    int m_blue_align_x;
+    int m_blue_align_y;
     int m_requested_zoom;
 
 
@@ -146,6 +168,10 @@ public slots:
     void save_frames_as_images_slot();
     void open_save_folder_slot(QAction *);
     void frame_timer_timeout_slot();
+    void follow_ser_file_slot(bool follow);
+    void follow_timer_timeout_slot();
+    void ser_read_mode_changed_slot(QAction *action);
+    void ser_export_read_mode_changed_slot(QAction *action);
 //void resize_timer_timeout_slot();
     void frame_slider_changed_slot();
     void markers_dialog_closed_slot();
@@ -159,6 +185,8 @@ public slots:
     void handle_arguments();
     void about_ser_player();
     void histogram_done_slot();
+    void render_done_slot(QImage frame_image, int request_id);
+    void generate_pending_histogram_slot();
     void start_playing_slot();
     void stop_playing_slot();
     void playback_controls_double_clicked_slot();
@@ -169,13 +197,69 @@ protected:
     virtual void changeEvent (QEvent *event);
 
 private:
+    // Snapshot of the processing options so frames can be processed away from the GUI thread
+    struct s_processing_settings {
+        int m_debayer_colour_id;  // -1 when debayering is disabled
+        bool m_crop_enable;
+        int m_crop_x_pos;
+        int m_crop_y_pos;
+        int m_crop_width;
+        int m_crop_height;
+        bool m_monochrome_conversion_enable;
+        int m_monochrome_conversion_type;
+        double m_colour_saturation;
+        int m_red_align_x;  // Colour alignment is applied from the image's own settings,
+        int m_red_align_y;  // these copies are only used to tell when it has changed
+        int m_blue_align_x;
+        int m_blue_align_y;
+    };
+
+    // Processing stages that are kept while paused, in processing order
+    enum e_processing_stage {
+        STAGE_DEBAYER = 0,
+        STAGE_CROP_AND_ALIGN,
+        STAGE_MONOCHROME,
+        STAGE_COUNT
+    };
+
+    // The displayed frame after each processing stage, so changing a processing option
+    // only redoes the stages from that option onwards
+    c_image *mp_stage_images[STAGE_COUNT];
+    int m_stage_image_index[STAGE_COUNT];  // Entry of mp_stage_images holding the frame after each stage, -1 for the unprocessed frame
+    int m_valid_stages;  // Number of stages that can be reused, 0 if none
+    int m_stage_frame_number;
+    uint64_t m_stage_timestamp;
+    s_processing_settings m_stage_settings;
+
+    // The newest request made to the render worker, its stages replace the ones above once it is done
+    int m_render_first_stage;
+    int m_render_frame_number;
+    uint64_t m_render_timestamp;
+    s_processing_settings m_render_settings;
+    c_image *mp_histogram_image;  // Processed frame from the render worker for the histogram
+    bool m_histogram_pending;  // mp_histogram_image is waiting for the histogram thread
+
     void add_string_to_stringlist(QStringList &string_list, QString string);
     void update_recent_ser_files_menu();
     void populate_recent_ser_files_menu();
     void update_recent_save_folders_menu();
     void populate_recent_save_folders_menu();
     void create_no_file_open_image();
-    bool get_and_process_frame(int frame_number, bool conv_to_8_bit, bool do_processing);
+    bool get_and_process_frame(int frame_number, bool conv_to_8_bit, bool do_processing, bool conv_for_display);
+    int32_t read_frame(int frame_number, bool conv_to_8_bit, s_processing_settings *p_crop_settings = nullptr);
+    void add_frame_stats(int frame_number, const uint8_t *p_frame_data);
+    bool get_stage_start_frame(int frame_number, const s_processing_settings &settings, int &first_stage);
+    bool get_stage_processed_frame(int frame_number, const s_processing_settings &settings);
+    void update_frame_for_processing_change();
+    s_processing_settings get_processing_settings();
+    c_pipp_ser::s_roi get_read_roi(s_processing_settings &settings);
+    static void process_frame(c_image *p_image, const s_processing_settings &settings);
+    static void process_frame_for_display(c_image *p_image, const s_processing_settings &settings);
+    int get_valid_stage_count(int frame_number, const s_processing_settings &settings);
+    static bool run_processing_stage(int stage, c_image *p_image, const s_processing_settings &settings);
+    void update_header_details(const QString &filename);
+    void offer_to_fix_stalled_ser_file();
+    void reopen_finished_ser_file();
     void calculate_display_framerate();
     void resize_window_with_zoom(int zoom);
     void set_defaut_histogram_position();
@@ -0,0 +1,563 @@
+// ---------------------------------------------------------------------
+// Copyright (C) 2015 Chris Garry
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>
+// ---------------------------------------------------------------------
+
+#include "ser_unpack.h"
+
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define SER_UNPACK_SSE2
+#endif
+
+#if defined(SER_UNPACK_SSE2) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    // The AVX2 code is always built and is only used if the processor supports it
+    #include <immintrin.h>
+    #define SER_UNPACK_AVX2
+#endif
+
+
+namespace {
+    // ------------------------------------------
+    // Plain C++ versions, also used for the pixels left over by the vector versions
+    // ------------------------------------------
+    inline uint16_t read_sample(
+        const uint8_t *p_src,
+        bool swap_bytes)
+    {
+        if (swap_bytes) {
+            return (uint16_t)((p_src[0] << 8) + p_src[1]);
+        }
+
+        uint16_t value;
+        memcpy(&value, p_src, sizeof(value));
+        return value;
+    }
+
+
+    template <bool SWAP_BYTES, bool SCALE>
+    void line_16_c(
+        const uint8_t *p_src,
+        uint16_t *p_dst,
+        int64_t start_pixel,
+        int64_t pixels,
+        int32_t channels,
+        bool swap_rb,
+        uint32_t shift1,
+        uint32_t shift2)
+    {
+        if (!swap_rb) {
+            // Sample order does not change
+            const uint8_t *p_read = p_src + start_pixel * channels * 2;
+            const uint8_t *p_end = p_src + pixels * channels * 2;
+            uint16_t *p_write = p_dst + start_pixel * channels;
+            for (; p_read < p_end; p_read += 2) {
+                uint16_t value = read_sample(p_read, SWAP_BYTES);
+                if (SCALE) {
+                    value = (uint16_t)((value << shift1) + (value >> shift2));
+                }
+
+                *p_write++ = value;
+            }
+
+            return;
+        }
+
+        for (int64_t pixel = start_pixel; pixel < pixels; pixel++) {
+            const uint8_t *p_read = p_src + pixel * channels * 2;
+            uint16_t *p_write = p_dst + pixel * channels;
+            for (int32_t channel = 0; channel < channels; channel++) {
+                int32_t read_channel = (swap_rb) ? channels - 1 - channel : channel;
+                uint16_t value = read_sample(p_read + read_channel * 2, SWAP_BYTES);
+                if (SCALE) {
+                    value = (uint16_t)((value << shift1) + (value >> shift2));
+                }
+
+                *p_write++ = value;
+            }
+        }
+    }
+
+
+    void line_16_to_8_c(
+        const uint8_t *p_src,
+        uint8_t *p_dst,
+        int64_t start_pixel,
+        int64_t pixels,
+        int32_t channels,
+        bool swap_rb,
+        int32_t byte_offset)
+    {
+        for (int64_t pixel = start_pixel; pixel < pixels; pixel++) {
+            const uint8_t *p_read = p_src + pixel * channels * 2 + byte_offset;
+            uint8_t *p_write = p_dst + pixel * channels;
+            for (int32_t channel = 0; channel < channels; channel++) {
+                int32_t read_channel = (swap_rb) ? channels - 1 - channel : channel;
+                *p_write++ = p_read[read_channel * 2];
+            }
+        }
+    }
+
+
+    void line_8_swap_rb_c(
+        const uint8_t *p_src,
+        uint8_t *p_dst,
+        int64_t start_pixel,
+        int64_t pixels)
+    {
+        for (int64_t pixel = start_pixel; pixel < pixels; pixel++) {
+            const uint8_t *p_read = p_src + pixel * 3;
+            uint8_t *p_write = p_dst + pixel * 3;
+            p_write[0] = p_read[2];
+            p_write[1] = p_read[1];
+            p_write[2] = p_read[0];
+        }
+    }
+
+
+#ifdef SER_UNPACK_SSE2
+    // ------------------------------------------
+    // SSE2 versions
+    // These return the number of pixels converted, which is always a whole number of pixels
+    // ------------------------------------------
+    template <bool SWAP_BYTES, bool SCALE>
+    inline __m128i convert_sse2(
+        __m128i value,
+        __m128i shift1,
+        __m128i shift2)
+    {
+        if (SWAP_BYTES) {
+            value = _mm_or_si128(_mm_slli_epi16(value, 8), _mm_srli_epi16(value, 8));
+        }
+
+        if (SCALE) {
+            value = _mm_add_epi16(_mm_sll_epi16(value, shift1), _mm_srl_epi16(value, shift2));
+        }
+
+        return value;
+    }
+
+
+    // Byte masks for swapping red and blue in 48 bytes (3 registers) of 3-sample pixels.
+    // Each sample either stays where it is, comes from 2 samples further on (first
+    // sample of a pixel) or comes from 2 samples further back (last sample of a pixel).
+    struct s_swap_rb_masks {
+        __m128i m_keep[3];
+        __m128i m_from_next[3];
+        __m128i m_from_prev[3];
+
+        explicit s_swap_rb_masks(int32_t sample_size)
+        {
+            for (int32_t reg = 0; reg < 3; reg++) {
+                uint8_t keep[16], from_next[16], from_prev[16];
+                for (int32_t byte = 0; byte < 16; byte++) {
+                    int32_t channel = ((reg * 16 + byte) / sample_size) % 3;
+                    keep[byte] = (channel == 1) ? 0xff : 0;
+                    from_next[byte] = (channel == 0) ? 0xff : 0;
+                    from_prev[byte] = (channel == 2) ? 0xff : 0;
+                }
+
+                m_keep[reg] = _mm_loadu_si128((const __m128i *)keep);
+                m_from_next[reg] = _mm_loadu_si128((const __m128i *)from_next);
+                m_from_prev[reg] = _mm_loadu_si128((const __m128i *)from_prev);
+            }
+        }
+    };
+
+
+    template <int SAMPLE_SIZE>
+    inline void swap_rb_sse2(
+        __m128i *p_regs,
+        const s_swap_rb_masks &masks)
+    {
+        const int SHIFT = 2 * SAMPLE_SIZE;  // Bytes between the first and last sample of a pixel
+        __m128i next[3];
+        __m128i prev[3];
+        next[0] = _mm_or_si128(_mm_srli_si128(p_regs[0], SHIFT), _mm_slli_si128(p_regs[1], 16 - SHIFT));
+        next[1] = _mm_or_si128(_mm_srli_si128(p_regs[1], SHIFT), _mm_slli_si128(p_regs[2], 16 - SHIFT));
+        next[2] = _mm_srli_si128(p_regs[2], SHIFT);
+        prev[0] = _mm_slli_si128(p_regs[0], SHIFT);
+        prev[1] = _mm_or_si128(_mm_slli_si128(p_regs[1], SHIFT), _mm_srli_si128(p_regs[0], 16 - SHIFT));
+        prev[2] = _mm_or_si128(_mm_slli_si128(p_regs[2], SHIFT), _mm_srli_si128(p_regs[1], 16 - SHIFT));
+
+        for (int reg = 0; reg < 3; reg++) {
+            p_regs[reg] = _mm_or_si128(_mm_and_si128(p_regs[reg], masks.m_keep[reg]),
+                          _mm_or_si128(_mm_and_si128(next[reg], masks.m_from_next[reg]),
+                                       _mm_and_si128(prev[reg], masks.m_from_prev[reg])));
+        }
+    }
+
+
+    // Samples are independent of each other - 8 samples at a time
+    template <bool SWAP_BYTES, bool SCALE>
+    int64_t line_16_sse2(
+        const uint8_t *p_src,
+        uint16_t *p_dst,
+        int64_t start_pixel,
+        int64_t pixels,
+        int32_t channels,
+        uint32_t shift1,
+        uint32_t shift2)
+    {
+        const __m128i shift1_reg = _mm_cvtsi32_si128(shift1);
+        const __m128i shift2_reg = _mm_cvtsi32_si128(shift2);
+        const int64_t samples = pixels * channels;
+        int64_t sample = start_pixel * channels;
+        for (; sample + 8 <= samples; sample += 8) {
+            __m128i value = _mm_loadu_si128((const __m128i *)(p_src + sample * 2));
+            value = convert_sse2<SWAP_BYTES, SCALE>(value, shift1_reg, shift2_reg);
+            _mm_storeu_si128((__m128i *)(p_dst + sample), value);
+        }
+
+        return sample / channels;
+    }
+
+
+    // Colour with red and blue swapped - 8 pixels at a time
+    template <bool SWAP_BYTES, bool SCALE>
+    int64_t line_16_swap_rb_sse2(
+        const uint8_t *p_src,
+        uint16_t *p_dst,
+        int64_t pixels,
+        uint32_t shift1,
+        uint32_t shift2)
+    {
+        const __m128i shift1_reg = _mm_cvtsi32_si128(shift1);
+        const __m128i shift2_reg = _mm_cvtsi32_si128(shift2);
+        const s_swap_rb_masks masks(2);
+        int64_t pixel = 0;
+        for (; pixel + 8 <= pixels; pixel += 8) {
+            const __m128i *p_read = (const __m128i *)(p_src + pixel * 6);
+            __m128i *p_write = (__m128i *)(p_dst + pixel * 3);
+            __m128i regs[3];
+            for (int reg = 0; reg < 3; reg++) {
+                regs[reg] = convert_sse2<SWAP_BYTES, SCALE>(_mm_loadu_si128(p_read + reg), shift1_reg, shift2_reg);
+            }
+
+            swap_rb_sse2<2>(regs, masks);
+            for (int reg = 0; reg < 3; reg++) {
+                _mm_storeu_si128(p_write + reg, regs[reg]);
+            }
+        }
+
+        return pixel;
+    }
+
+
+    // 16 pixels at a time
+    int64_t line_16_to_8_sse2(
+        const uint8_t *p_src,
+        uint8_t *p_dst,
+        int64_t pixels,
+        int32_t channels,
+        bool swap_rb,
+        int32_t byte_offset)
+    {
+        const s_swap_rb_masks masks(2);
+        const __m128i low_byte_mask = _mm_set1_epi16(0xff);
+        const int32_t in_regs = 2 * channels;
+        int64_t pixel = 0;
+        for (; pixel + 16 <= pixels; pixel += 16) {
+            const __m128i *p_read = (const __m128i *)(p_src + pixel * channels * 2);
+            __m128i *p_write = (__m128i *)(p_dst + pixel * channels);
+            __m128i regs[6];
+            for (int32_t reg = 0; reg < in_regs; reg++) {
+                __m128i value = _mm_loadu_si128(p_read + reg);
+                regs[reg] = (byte_offset == 0) ? _mm_and_si128(value, low_byte_mask) : _mm_srli_epi16(value, 8);
+            }
+
+            if (swap_rb) {
+                swap_rb_sse2<2>(regs, masks);
+                swap_rb_sse2<2>(regs + 3, masks);
+            }
+
+            for (int32_t reg = 0; reg < channels; reg++) {
+                _mm_storeu_si128(p_write + reg, _mm_packus_epi16(regs[2 * reg], regs[2 * reg + 1]));
+            }
+        }
+
+        return pixel;
+    }
+
+
+    // 16 pixels at a time
+    int64_t line_8_swap_rb_sse2(
+        const uint8_t *p_src,
+        uint8_t *p_dst,
+        int64_t pixels)
+    {
+        const s_swap_rb_masks masks(1);
+        int64_t pixel = 0;
+        for (; pixel + 16 <= pixels; pixel += 16) {
+            const __m128i *p_read = (const __m128i *)(p_src + pixel * 3);
+            __m128i *p_write = (__m128i *)(p_dst + pixel * 3);
+            __m128i regs[3];
+            for (int reg = 0; reg < 3; reg++) {
+                regs[reg] = _mm_loadu_si128(p_read + reg);
+            }
+
+            swap_rb_sse2<1>(regs, masks);
+            for (int reg = 0; reg < 3; reg++) {
+                _mm_storeu_si128(p_write + reg, regs[reg]);
+            }
+        }
+
+        return pixel;
+    }
+
+
+    // 32 samples at a time
+    int64_t or_16_sse2(
+        const uint8_t *p_src,
+        int64_t samples,
+        uint16_t &result)
+    {
+        __m128i acc[4];
+        for (int reg = 0; reg < 4; reg++) {
+            acc[reg] = _mm_setzero_si128();
+        }
+
+        int64_t sample = 0;
+        for (; sample + 32 <= samples; sample += 32) {
+            const __m128i *p_read = (const __m128i *)(p_src + sample * 2);
+            for (int reg = 0; reg < 4; reg++) {
+                acc[reg] = _mm_or_si128(acc[reg], _mm_loadu_si128(p_read + reg));
+            }
+        }
+
+        __m128i value = _mm_or_si128(_mm_or_si128(acc[0], acc[1]), _mm_or_si128(acc[2], acc[3]));
+        value = _mm_or_si128(value, _mm_srli_si128(value, 8));
+        value = _mm_or_si128(value, _mm_srli_si128(value, 4));
+        value = _mm_or_si128(value, _mm_srli_si128(value, 2));
+        result = (uint16_t)_mm_cvtsi128_si32(value);
+        return sample;
+    }
+#endif
+
+
+#ifdef SER_UNPACK_AVX2
+    // ------------------------------------------
+    // AVX2 versions for independent samples - 16 samples at a time
+    // ------------------------------------------
+    bool avx2_supported()
+    {
+        static const bool supported = __builtin_cpu_supports("avx2");
+        return supported;
+    }
+
+
+    template <bool SWAP_BYTES, bool SCALE>
+    __attribute__((target("avx2")))
+    int64_t line_16_avx2(
+        const uint8_t *p_src,
+        uint16_t *p_dst,
+        int64_t pixels,
+        int32_t channels,
+        uint32_t shift1,
+        uint32_t shift2)
+    {
+        const __m128i shift1_reg = _mm_cvtsi32_si128(shift1);
+        const __m128i shift2_reg = _mm_cvtsi32_si128(shift2);
+        const int64_t samples = pixels * channels;
+        int64_t sample = 0;
+        for (; sample + 16 <= samples; sample += 16) {
+            __m256i value = _mm256_loadu_si256((const __m256i *)(p_src + sample * 2));
+            if (SWAP_BYTES) {
+                value = _mm256_or_si256(_mm256_slli_epi16(value, 8), _mm256_srli_epi16(value, 8));
+            }
+
+            if (SCALE) {
+                value = _mm256_add_epi16(_mm256_sll_epi16(value, shift1_reg), _mm256_srl_epi16(value, shift2_reg));
+            }
+
+            _mm256_storeu_si256((__m256i *)(p_dst + sample), value);
+        }
+
+        return sample / channels;
+    }
+
+
+    // 64 samples at a time
+    __attribute__((target("avx2")))
+    int64_t or_16_avx2(
+        const uint8_t *p_src,
+        int64_t samples,
+        uint16_t &result)
+    {
+        __m256i acc[4];
+        for (int reg = 0; reg < 4; reg++) {
+            acc[reg] = _mm256_setzero_si256();
+        }
+
+        int64_t sample = 0;
+        for (; sample + 64 <= samples; sample += 64) {
+            const __m256i *p_read = (const __m256i *)(p_src + sample * 2);
+            for (int reg = 0; reg < 4; reg++) {
+                acc[reg] = _mm256_or_si256(acc[reg], _mm256_loadu_si256(p_read + reg));
+            }
+        }
+
+        __m256i value256 = _mm256_or_si256(_mm256_or_si256(acc[0], acc[1]), _mm256_or_si256(acc[2], acc[3]));
+        __m128i value = _mm_or_si128(_mm256_castsi256_si128(value256), _mm256_extracti128_si256(value256, 1));
+        value = _mm_or_si128(value, _mm_srli_si128(value, 8));
+        value = _mm_or_si128(value, _mm_srli_si128(value, 4));
+        value = _mm_or_si128(value, _mm_srli_si128(value, 2));
+        result = (uint16_t)_mm_cvtsi128_si32(value);
+        return sample;
+    }
+#endif
+
+
+    // ------------------------------------------
+    // Convert a line of 16-bit samples with the best version available
+    // ------------------------------------------
+    template <bool SWAP_BYTES, bool SCALE>
+    void line_16_any(
+        const uint8_t *p_src,
+        uint16_t *p_dst,
+        int64_t pixels,
+        int32_t channels,
+        bool swap_rb,
+        uint32_t shift1,
+        uint32_t shift2)
+    {
+        int64_t done = 0;
+#ifdef SER_UNPACK_SSE2
+        if (swap_rb) {
+            done = line_16_swap_rb_sse2<SWAP_BYTES, SCALE>(p_src, p_dst, pixels, shift1, shift2);
+        } else {
+#ifdef SER_UNPACK_AVX2
+            if (avx2_supported()) {
+                done = line_16_avx2<SWAP_BYTES, SCALE>(p_src, p_dst, pixels, channels, shift1, shift2);
+            }
+#endif
+            done = line_16_sse2<SWAP_BYTES, SCALE>(p_src, p_dst, done, pixels, channels, shift1, shift2);
+        }
+#endif
+
+        line_16_c<SWAP_BYTES, SCALE>(p_src, p_dst, done, pixels, channels, swap_rb, shift1, shift2);
+    }
+}
+
+
+// ------------------------------------------
+// Convert a line of 16-bit samples
+// ------------------------------------------
+void c_ser_unpack::line_16(
+    const uint8_t *p_src,
+    uint16_t *p_dst,
+    int32_t pixels,
+    bool colour,
+    bool swap_rb,
+    bool swap_bytes,
+    int32_t pixel_depth)
+{
+    const int32_t channels = (colour) ? 3 : 1;
+    swap_rb = swap_rb && colour;
+    const bool scale = pixel_depth > 8 && pixel_depth < 16;
+    const uint32_t shift1 = (scale) ? 16 - pixel_depth : 0;
+    const uint32_t shift2 = (scale) ? pixel_depth - shift1 : 0;
+
+    if (!swap_rb && !swap_bytes && !scale) {
+        // Nothing to change
+        memcpy(p_dst, p_src, (size_t)pixels * channels * 2);
+        return;
+    }
+
+    if (swap_bytes) {
+        if (scale) {
+            line_16_any<true, true>(p_src, p_dst, pixels, channels, swap_rb, shift1, shift2);
+        } else {
+            line_16_any<true, false>(p_src, p_dst, pixels, channels, swap_rb, shift1, shift2);
+        }
+    } else {
+        if (scale) {
+            line_16_any<false, true>(p_src, p_dst, pixels, channels, swap_rb, shift1, shift2);
+        } else {
+            line_16_any<false, false>(p_src, p_dst, pixels, channels, swap_rb, shift1, shift2);
+        }
+    }
+}
+
+
+// ------------------------------------------
+// Convert a line of 16-bit samples holding 8-bit data
+// ------------------------------------------
+void c_ser_unpack::line_16_to_8(
+    const uint8_t *p_src,
+    uint8_t *p_dst,
+    int32_t pixels,
+    bool colour,
+    bool swap_rb,
+    int32_t byte_offset)
+{
+    const int32_t channels = (colour) ? 3 : 1;
+    swap_rb = swap_rb && colour;
+
+    int64_t done = 0;
+#ifdef SER_UNPACK_SSE2
+    done = line_16_to_8_sse2(p_src, p_dst, pixels, channels, swap_rb, byte_offset);
+#endif
+
+    line_16_to_8_c(p_src, p_dst, done, pixels, channels, swap_rb, byte_offset);
+}
+
+
+// ------------------------------------------
+// Convert a line of 8-bit RGB pixels to BGR
+// ------------------------------------------
+void c_ser_unpack::line_8_swap_rb(
+    const uint8_t *p_src,
+    uint8_t *p_dst,
+    int32_t pixels)
+{
+    int64_t done = 0;
+#ifdef SER_UNPACK_SSE2
+    done = line_8_swap_rb_sse2(p_src, p_dst, pixels);
+#endif
+
+    line_8_swap_rb_c(p_src, p_dst, done, pixels);
+}
+
+
+// ------------------------------------------
+// OR together 16-bit samples
+// ------------------------------------------
+uint16_t c_ser_unpack::or_16(
+    const uint8_t *p_src,
+    int64_t samples)
+{
+    uint16_t result = 0;
+    int64_t done = 0;
+#ifdef SER_UNPACK_AVX2
+    if (avx2_supported()) {
+        done = or_16_avx2(p_src, samples, result);
+    } else {
+        done = or_16_sse2(p_src, samples, result);
+    }
+#elif defined(SER_UNPACK_SSE2)
+    done = or_16_sse2(p_src, samples, result);
+#endif
+
+    for (int64_t sample = done; sample < samples; sample++) {
+        uint16_t value;
+        memcpy(&value, p_src + sample * 2, sizeof(value));
+        result |= value;
+    }
+
+    return result;
+}
@@ -0,0 +1,77 @@
+// ---------------------------------------------------------------------
+// Copyright (C) 2015 Chris Garry
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>
+// ---------------------------------------------------------------------
+
+#ifndef SER_UNPACK_H
+#define SER_UNPACK_H
+
+#include <cstdint>
+
+
+// ------------------------------------------
+// Line conversion kernels used by c_pipp_ser to turn raw SER frame data into
+// get_frame() output format.  Each call converts a single line of pixels, the
+// caller takes care of reversing the line order.
+// SSE2 versions are used on x86 processors (with AVX2 for the simple cases when
+// the processor supports it), other processors use the plain C++ versions.
+// ------------------------------------------
+class c_ser_unpack
+{
+public:
+    // ------------------------------------------
+    // Convert a line of 16-bit samples to native endian 16-bit samples
+    // swap_bytes - read the samples as big-endian rather than native endian
+    // swap_rb - swap the first and last sample of each pixel (RGB to BGR)
+    // pixel_depth - samples with 9 to 15 significant bits are scaled up to fill 16 bits
+    // ------------------------------------------
+    static void line_16(
+        const uint8_t *p_src,
+        uint16_t *p_dst,
+        int32_t pixels,
+        bool colour,
+        bool swap_rb,
+        bool swap_bytes,
+        int32_t pixel_depth);
+
+    // ------------------------------------------
+    // Convert a line of 16-bit samples that only hold 8-bit data to 8-bit samples
+    // byte_offset - which byte of each sample holds the data (0 or 1)
+    // ------------------------------------------
+    static void line_16_to_8(
+        const uint8_t *p_src,
+        uint8_t *p_dst,
+        int32_t pixels,
+        bool colour,
+        bool swap_rb,
+        int32_t byte_offset);
+
+    // ------------------------------------------
+    // Convert a line of 8-bit RGB pixels to BGR
+    // ------------------------------------------
+    static void line_8_swap_rb(
+        const uint8_t *p_src,
+        uint8_t *p_dst,
+        int32_t pixels);
+
+    // ------------------------------------------
+    // OR together 16-bit samples as they are stored in memory
+    // ------------------------------------------
+    static uint16_t or_16(
+        const uint8_t *p_src,
+        int64_t samples);
+};
+
+#endif // SER_UNPACK_H
@@ -0,0 +1,64 @@
+# ---------------------------------------------------------------------
+# Copyright (C) 2015 Chris Garry
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>
+# ---------------------------------------------------------------------
+
+# ---------------------------------------------------------------------
+# Tests for SER files with frames larger than 4GB and with the largest
+# frame count a SER header can hold.  The test files are sparse so they
+# take almost no disk space, but the filesystem must support sparse files.
+# The files are created with POSIX calls so the tests only build on unix.
+#
+# Build and run from this directory with:
+# qmake && make check
+# ---------------------------------------------------------------------
+
+!unix: error("The SER large file tests need a unix system")
+
+QT += core
+QT -= gui
+
+CONFIG += c++11
+CONFIG += console
+CONFIG += testcase
+CONFIG -= app_bundle
+
+TARGET = tst_ser_large_files
+
+linux {
+    # Match the main project, the io_uring read mode is only built if liburing is installed
+    CONFIG += link_pkgconfig
+    packagesExist(liburing) {
+        PKGCONFIG += liburing
+        DEFINES += PIPP_SER_IO_URING
+    }
+}
+
+INCLUDEPATH += ../../src
+
+SOURCES += tst_ser_large_files.cpp \
+    ../../src/pipp_buffer.cpp \
+    ../../src/pipp_ser.cpp \
+    ../../src/pipp_timestamp.cpp \
+    ../../src/ser_io_backend.cpp \
+    ../../src/ser_unpack.cpp
+
+macx {
+    SOURCES += ../../src/pipp_utf8_osx.cpp
+} else:bsd {
+    SOURCES += ../../src/pipp_utf8_bsd.cpp
+} else {
+    SOURCES += ../../src/pipp_utf8_linux.cpp
+}
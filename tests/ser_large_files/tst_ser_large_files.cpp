@@ -0,0 +1,263 @@
+// ---------------------------------------------------------------------
+// Copyright (C) 2015 Chris Garry
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>
+// ---------------------------------------------------------------------
+
+
+// ---------------------------------------------------------------------
+// Tests c_pipp_ser against sparse SER files that are too big for 32-bit sizes:
+//  * A 16-bit file with frames larger than 4GB, so the frame size, frame offsets and
+//    offsets of lines within a frame all need more than 32 bits
+//  * A file with the largest frame count the SER header can hold (INT32_MAX), whose last
+//    frames are past 2GB into the file
+//  * fix_broken_ser_file() on a file with more whole frames than the header can hold
+// The SER header stores the frame count as a signed 32-bit number, so a file cannot
+// hold 2^31 frames, INT32_MAX is as close as it gets.
+// ---------------------------------------------------------------------
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include "pipp_ser.h"
+
+
+static int g_failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+            g_failures++; \
+        } \
+    } while (0)
+
+
+// ------------------------------------------
+// Create a sparse SER file with just a header, the frame data reads back as zeros
+// ------------------------------------------
+static int create_sparse_ser_file(
+    const std::string &filename,
+    int32_t colour_id,
+    int32_t width,
+    int32_t height,
+    int32_t pixel_depth,
+    int32_t frame_count,
+    int64_t file_size)
+{
+    uint8_t header[178] = {};
+    memcpy(header, "LUCAM-RECORDER", 14);
+    const int32_t fields[7] = {0, colour_id, 0, width, height, pixel_depth, frame_count};
+    for (int i = 0; i < 7; i++) {
+        // SER header fields are little-endian
+        for (int byte = 0; byte < 4; byte++) {
+            header[14 + i * 4 + byte] = (uint8_t)((uint32_t)fields[i] >> (byte * 8));
+        }
+    }
+
+    int fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+
+    if (pwrite(fd, header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+        ftruncate(fd, (off_t)file_size) != 0) {
+        ::close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+
+// ------------------------------------------
+// Write one byte-symmetric 16-bit sample, so it reads back the same whatever the endianess
+// ------------------------------------------
+static bool write_sample_16(int fd, int64_t offset, uint8_t value)
+{
+    const uint8_t sample[2] = {value, value};
+    return pwrite(fd, sample, 2, (off_t)offset) == 2;
+}
+
+
+// Marker value for a pixel, never 0 and never 0xff
+static uint8_t marker_value(int32_t frame, int32_t x, int32_t y)
+{
+    return (uint8_t)(1 + (frame * 7 + x * 3 + y * 5) % 250);
+}
+
+
+// ------------------------------------------
+// 16-bit mono frames of 60000 x 40000 pixels, 4.8GB each
+// ------------------------------------------
+static void test_frames_larger_than_4gb(const std::string &filename)
+{
+    const int32_t width = 60000;
+    const int32_t height = 40000;
+    const int32_t frame_count = 2;
+    const int64_t frame_size = (int64_t)width * height * 2;
+    const int64_t file_size = 178 + frame_size * frame_count;
+
+    int fd = create_sparse_ser_file(filename, 0, width, height, 16, frame_count, file_size);
+    CHECK(fd >= 0);
+    if (fd < 0) {
+        return;
+    }
+
+    // A full scale sample at the start of each frame stops the pixel depth check scanning the whole frame
+    bool written = true;
+    for (int32_t frame = 1; frame <= frame_count; frame++) {
+        const int64_t frame_offset = 178 + (frame - 1) * frame_size;
+        written &= write_sample_16(fd, frame_offset, 0xff);
+
+        // Markers in a block at the bottom right of the frame, over 4GB into the frame
+        for (int32_t y = height - 3; y < height; y++) {
+            for (int32_t x = width - 8; x < width; x++) {
+                written &= write_sample_16(fd, frame_offset + ((int64_t)y * width + x) * 2, marker_value(frame, x, y));
+            }
+        }
+    }
+
+    ::close(fd);
+    CHECK(written);
+
+    for (int mapped = 0; mapped < 2; mapped++) {
+        for (int io_mode = 0; io_mode < c_ser_io_backend::IO_MODE_COUNT; io_mode++) {
+            c_pipp_ser ser_file;
+            ser_file.set_memory_mapped_mode(mapped != 0);
+            ser_file.set_io_mode((c_ser_io_backend::e_io_mode)io_mode);
+            CHECK(ser_file.open(filename, 0, 1) == frame_count);
+            CHECK(ser_file.get_width() == width);
+            CHECK(ser_file.get_height() == height);
+            CHECK(ser_file.get_byte_depth() == 2);
+            CHECK(ser_file.get_buffer_size() == frame_size);
+
+            // Read the marker block, the buffer holds the lines bottom line first
+            c_pipp_ser::s_roi roi = {width - 8, height - 3, 8, 3};
+            CHECK(ser_file.get_buffer_size(roi) == 8 * 3 * 2);
+            for (int32_t frame = 1; frame <= frame_count; frame++) {
+                uint16_t buffer[8 * 3] = {};
+                CHECK(ser_file.read_frame(frame, roi, (uint8_t *)buffer) == 0);
+                bool match = true;
+                for (int32_t line = 0; line < 3; line++) {
+                    const int32_t y = height - 1 - line;
+                    for (int32_t x = width - 8; x < width; x++) {
+                        const uint8_t value = marker_value(frame, x, y);
+                        match &= buffer[line * 8 + x - (width - 8)] == (uint16_t)((value << 8) | value);
+                    }
+                }
+
+                CHECK(match);
+            }
+
+            ser_file.close();
+        }
+    }
+
+    remove(filename.c_str());
+}
+
+
+// ------------------------------------------
+// 8-bit mono frames of 1 x 1 pixel, with the largest possible frame count
+// ------------------------------------------
+static void test_largest_frame_count(const std::string &filename)
+{
+    const int32_t frame_count = INT32_MAX;
+    const int64_t file_size = 178 + (int64_t)frame_count;
+
+    int fd = create_sparse_ser_file(filename, 0, 1, 1, 8, frame_count, file_size);
+    CHECK(fd >= 0);
+    if (fd < 0) {
+        return;
+    }
+
+    const uint8_t first_value = 0x5a;
+    const uint8_t last_value = 0xa5;
+    CHECK(pwrite(fd, &first_value, 1, 178) == 1);
+    CHECK(pwrite(fd, &last_value, 1, (off_t)(file_size - 1)) == 1);
+    ::close(fd);
+
+    for (int mapped = 0; mapped < 2; mapped++) {
+        c_pipp_ser ser_file;
+        ser_file.set_memory_mapped_mode(mapped != 0);
+        CHECK(ser_file.open(filename, 0, 1) == frame_count);
+        CHECK(ser_file.get_frame_count() == frame_count);
+        CHECK(ser_file.get_buffer_size() == 1);
+
+        uint8_t value = 0;
+        CHECK(ser_file.read_frame(1, &value) == 0);
+        CHECK(value == first_value);
+        CHECK(ser_file.read_frame((uint32_t)frame_count, &value) == 0);
+        CHECK(value == last_value);
+        CHECK(ser_file.read_frame((uint32_t)frame_count - 1, &value) == 0);
+        CHECK(value == 0);
+
+        ser_file.close();
+    }
+
+    remove(filename.c_str());
+}
+
+
+// ------------------------------------------
+// Recover the frame count of a file with more whole frames than the header can hold
+// ------------------------------------------
+static void test_fix_broken_ser_file_frame_count(const std::string &filename)
+{
+    const int64_t file_size = 178 + (int64_t)INT32_MAX + 1000;
+    int fd = create_sparse_ser_file(filename, 0, 1, 1, 8, 0, file_size);
+    CHECK(fd >= 0);
+    if (fd < 0) {
+        return;
+    }
+
+    ::close(fd);
+    CHECK(c_pipp_ser::fix_broken_ser_file(filename) == INT32_MAX);
+
+    // The frame count field is clamped rather than wrapping to a negative number
+    fd = ::open(filename.c_str(), O_RDONLY);
+    uint8_t frame_count_bytes[4] = {};
+    CHECK(pread(fd, frame_count_bytes, 4, 38) == 4);
+    ::close(fd);
+    const uint32_t header_frame_count = frame_count_bytes[0] | (frame_count_bytes[1] << 8) |
+                                        (frame_count_bytes[2] << 16) | ((uint32_t)frame_count_bytes[3] << 24);
+    CHECK(header_frame_count == (uint32_t)INT32_MAX);
+
+    remove(filename.c_str());
+}
+
+
+int main(int argc, char *argv[])
+{
+    // Test files go in the directory given on the command line, or the current directory
+    const std::string directory = (argc > 1) ? std::string(argv[1]) + "/" : std::string();
+
+    test_frames_larger_than_4gb(directory + "tst_large_frames.ser");
+    test_largest_frame_count(directory + "tst_large_frame_count.ser");
+    test_fix_broken_ser_file_frame_count(directory + "tst_broken_frame_count.ser");
+
+    if (g_failures > 0) {
+        fprintf(stderr, "%d checks failed\n", g_failures);
+        return 1;
+    }
+
+    printf("All checks passed\n");
+    return 0;
+}